@@ -1,6 +1,7 @@
 #include "Chunk.h"
 #include "Debug.h"
 #include "VM.h"
+#include "Benchmark.h"
 
 #include <iostream>
 #include <string>
@@ -9,6 +10,7 @@
 #endif
 
 //#define TEST_VM_OPERATIONS
+//#define BENCHMARK_VM
 
 using namespace ash;
 
@@ -32,6 +34,9 @@ using namespace ash;
         debug.disassembleChunk(&chunk, "test chunk");
         InterpretResult result = vm.interpret(&chunk);
         system("pause");
+#elif defined(BENCHMARK_VM)
+        Benchmark benchmark;
+        benchmark.run();
 #else
         std::cout << "type 'exit' to exit REPL\n";
         std::string line;
@@ -0,0 +1,791 @@
+#include "Benchmark.h"
+#include "Compiler.h"
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace ash
+{
+	void Benchmark::run()
+	{
+		checks();
+#ifdef THREADED_DISPATCH
+		std::cout << "==dispatch benchmark (threaded)==\n";
+#else
+		std::cout << "==dispatch benchmark (switch)==\n";
+#endif
+		integerLoop(20000000);
+		fusedBranchLoop(20000000);
+		doubleLoop(20000000);
+		arrayLoop(20000000, false);
+		arrayLoop(20000000, true);
+		allocationLoop(5000000);
+		appendLoop(20000000);
+		bulkArrayLoop(200000);
+		std::cout << "==vector kernels (" << vectorKernels().name << ")==\n";
+		vectorLoop(20000, false);
+		vectorLoop(1000000, true);
+		std::cout << "==compiler==\n";
+		compiledLoop(20000000, 2000);
+		std::cout << "==loop optimizations==\n";
+		loopKernels(20000000);
+		std::cout << "==function calls==\n";
+		callKernels(10000000);
+		collectionScaling(1000000);
+	}
+
+	void Benchmark::report(const char* name, const char* engine, uint64_t instructions, double seconds)
+	{
+		std::cout << std::setfill(' ') << std::left << std::setw(20) << name << std::setw(8) << engine << std::right
+			<< std::setw(12) << instructions << " instructions in "
+			<< std::fixed << std::setprecision(3) << seconds << "s ("
+			<< std::setprecision(1) << (instructions / seconds) / 1000000.0 << " M instructions/s)" << std::endl;
+	}
+
+	double Benchmark::timeChunk(VM& vm, Chunk* chunk)
+	{
+		auto start = std::chrono::steady_clock::now();
+		vm.interpret(chunk);
+		auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration<double>(end - start).count();
+	}
+
+	//runs the chunk under every engine and checks they all leave the same registers behind
+	void Benchmark::measure(const char* name, Chunk* chunk, uint64_t instructions)
+	{
+		VM interpreter;
+		interpreter.setEngine(ExecutionEngine::ENGINE_INTERPRETER);
+		report(name, "interp", instructions, timeChunk(interpreter, chunk));
+		const PoolStatistics& heap = interpreter.heapStatistics();
+		if (heap.allocations)
+		{
+			std::cout << "  heap: " << heap.allocations << " allocations, " << heap.releases << " releases, peak "
+				<< heap.peakBytesInUse << " bytes in " << heap.pageBytes << " bytes of pages" << std::endl;
+		}
+		const GCStatistics& gc = interpreter.gcStatistics();
+		if (gc.collections || gc.minorCollections)
+		{
+			std::cout << "  gc: " << gc.minorCollections << " minor, " << gc.collections << " full collections, "
+				<< gc.bytesPromoted << " bytes promoted, " << gc.bytesFreed << " bytes freed, max pause "
+				<< gc.maxPause / 1000 << "us, total " << gc.totalPause / 1000 << "us" << std::endl;
+		}
+#ifdef JIT_SUPPORTED
+		VM jit;
+		jit.setEngine(ExecutionEngine::ENGINE_JIT);
+		report(name, "jit", instructions, timeChunk(jit, chunk));
+		VM tiered;
+		tiered.setEngine(ExecutionEngine::ENGINE_TIERED);
+		report(name, "tiered", instructions, timeChunk(tiered, chunk));
+		for (int i = 0; i < 256; i++)
+		{
+			if (interpreter.getRegister(i) != jit.getRegister(i) || interpreter.getRegister(i) != tiered.getRegister(i))
+			{
+				std::cout << "  engines disagree on R[" << i << "]: " << interpreter.getRegister(i) << " vs "
+					<< jit.getRegister(i) << " vs " << tiered.getRegister(i) << std::endl;
+			}
+		}
+#endif
+	}
+
+	//every loop below has the same shape: R[1] counts up to R[2] in steps of R[3],
+	//the header compares and branches into the body, and the body jumps back to the header
+	void Benchmark::integerLoop(uint32_t iterations)
+	{
+		Chunk chunk;
+		chunk.WriteU8(1, 0);
+		chunk.WriteU32(2, iterations);
+		chunk.WriteU8(3, 1);
+		chunk.WriteU8(4, 0);
+		chunk.WriteU8(5, 3);
+		int32_t loop = (int32_t)chunk.size();
+		chunk.WriteABC(OP_SIGN_LESS, 1, 2, 6, 0);
+		chunk.WriteRelativeJump(OP_RELATIVE_JUMP_IF_TRUE, 2, 0);
+		chunk.WriteRelativeJump(OP_RELATIVE_JUMP, 6, 0);
+		chunk.WriteABC(OP_INT_ADD, 4, 1, 4, 0);
+		chunk.WriteABC(OP_SIGN_MUL, 1, 5, 7, 0);
+		chunk.WriteABC(OP_INT_SUB, 4, 7, 4, 0);
+		chunk.WriteABC(OP_INT_ADD, 1, 3, 1, 0);
+		chunk.WriteRelativeJump(OP_RELATIVE_JUMP, loop - (int32_t)chunk.size(), 0);
+		chunk.WriteOp(OP_RETURN);
+
+		measure("integer arithmetic", &chunk, (uint64_t)iterations * 7);
+	}
+
+	//integerLoop with the header's compare and conditional jump fused into one instruction
+	void Benchmark::fusedBranchLoop(uint32_t iterations)
+	{
+		Chunk chunk;
+		chunk.WriteU8(1, 0);
+		chunk.WriteU32(2, iterations);
+		chunk.WriteU8(3, 1);
+		chunk.WriteU8(4, 0);
+		chunk.WriteU8(5, 3);
+		int32_t loop = (int32_t)chunk.size();
+		chunk.WriteCompareJump(OP_JUMP_IF_SIGN_LESS, 1, 2, 3, 0);
+		chunk.WriteRelativeJump(OP_RELATIVE_JUMP, 6, 0);
+		chunk.WriteABC(OP_INT_ADD, 4, 1, 4, 0);
+		chunk.WriteABC(OP_SIGN_MUL, 1, 5, 7, 0);
+		chunk.WriteABC(OP_INT_SUB, 4, 7, 4, 0);
+		chunk.WriteABC(OP_INT_ADD, 1, 3, 1, 0);
+		chunk.WriteRelativeJump(OP_RELATIVE_JUMP, loop - (int32_t)chunk.size(), 0);
+		chunk.WriteOp(OP_RETURN);
+
+		measure("fused branch", &chunk, (uint64_t)iterations * 6);
+	}
+
+	void Benchmark::doubleLoop(uint32_t iterations)
+	{
+		Chunk chunk;
+		chunk.WriteU8(1, 0);
+		chunk.WriteU32(2, iterations);
+		chunk.WriteU8(3, 1);
+		chunk.WriteDouble(10, 1.5);
+		chunk.WriteDouble(11, 0.5);
+		chunk.WriteDouble(12, 0.0);
+		int32_t loop = (int32_t)chunk.size();
+		chunk.WriteABC(OP_SIGN_LESS, 1, 2, 6, 0);
+		chunk.WriteRelativeJump(OP_RELATIVE_JUMP_IF_TRUE, 2, 0);
+		chunk.WriteRelativeJump(OP_RELATIVE_JUMP, 6, 0);
+		chunk.WriteABC(OP_DOUBLE_ADD, 12, 10, 12, 0);
+		chunk.WriteABC(OP_DOUBLE_MUL, 12, 11, 13, 0);
+		chunk.WriteABC(OP_DOUBLE_SUB, 12, 13, 12, 0);
+		chunk.WriteABC(OP_INT_ADD, 1, 3, 1, 0);
+		chunk.WriteRelativeJump(OP_RELATIVE_JUMP, loop - (int32_t)chunk.size(), 0);
+		chunk.WriteOp(OP_RETURN);
+
+		measure("double arithmetic", &chunk, (uint64_t)iterations * 7);
+	}
+
+	//unchecked: the accesses the compiler emits once it has proved the index in bounds
+	void Benchmark::arrayLoop(uint32_t iterations, bool unchecked)
+	{
+		Chunk chunk;
+		chunk.WriteU8(1, 0);
+		chunk.WriteU32(2, iterations);
+		chunk.WriteU8(3, 1);
+		chunk.WriteU8(4, 0);
+		chunk.WriteU16(8, 1024);
+		chunk.WriteU8(9, 8);
+		chunk.WriteRegisterMap(std::bitset<256>()); //no pointers are live yet
+		chunk.WriteABC(OP_ALLOC_ARRAY, 8, 9, 10, 0);
+		chunk.WriteU16(11, 1023);
+		int32_t loop = (int32_t)chunk.size();
+		chunk.WriteABC(OP_SIGN_LESS, 1, 2, 6, 0);
+		chunk.WriteRelativeJump(OP_RELATIVE_JUMP_IF_TRUE, 2, 0);
+		chunk.WriteRelativeJump(OP_RELATIVE_JUMP, 7, 0);
+		chunk.WriteABC(OP_BITWISE_AND, 1, 11, 12, 0);
+		chunk.WriteABC(unchecked ? OP_ARRAY_STORE_UNCHECKED : OP_ARRAY_STORE, 1, 10, 12, 0);
+		chunk.WriteABC(unchecked ? OP_ARRAY_LOAD_UNCHECKED : OP_ARRAY_LOAD, 13, 10, 12, 0);
+		chunk.WriteABC(OP_INT_ADD, 4, 13, 4, 0);
+		chunk.WriteABC(OP_INT_ADD, 1, 3, 1, 0);
+		chunk.WriteRelativeJump(OP_RELATIVE_JUMP, loop - (int32_t)chunk.size(), 0);
+		chunk.WriteU8(10, 0); //the array's address differs between runs
+		chunk.WriteRegisterMap(std::bitset<256>()); //nothing is live once it returns
+		chunk.WriteOp(OP_RETURN);
+
+		measure(unchecked ? "array unchecked" : "array load/store", &chunk, (uint64_t)iterations * 8);
+	}
+
+	//every iteration allocates a fresh 4 element array, so the heap churns through one size class
+	void Benchmark::allocationLoop(uint32_t iterations)
+	{
+		Chunk chunk;
+		chunk.WriteU8(1, 0);
+		chunk.WriteU32(2, iterations);
+		chunk.WriteU8(3, 1);
+		chunk.WriteU8(4, 0);
+		chunk.WriteU8(8, 4);
+		chunk.WriteU8(9, 8);
+		chunk.WriteU8(11, 2);
+		int32_t loop = (int32_t)chunk.size();
+		chunk.WriteCompareJump(OP_JUMP_IF_SIGN_LESS, 1, 2, 3, 0);
+		chunk.WriteRelativeJump(OP_RELATIVE_JUMP, 7, 0);
+		chunk.WriteRegisterMap(std::bitset<256>()); //the previous iteration's array is garbage
+		chunk.WriteABC(OP_ALLOC_ARRAY, 8, 9, 10, 0);
+		chunk.WriteABC(OP_ARRAY_STORE, 1, 10, 11, 0);
+		chunk.WriteABC(OP_ARRAY_LOAD, 12, 10, 11, 0);
+		chunk.WriteABC(OP_INT_ADD, 4, 12, 4, 0);
+		chunk.WriteABC(OP_INT_ADD, 1, 3, 1, 0);
+		chunk.WriteRelativeJump(OP_RELATIVE_JUMP, loop - (int32_t)chunk.size(), 0);
+		chunk.WriteU8(10, 0); //the array's address differs between runs
+		chunk.WriteRegisterMap(std::bitset<256>());
+		chunk.WriteOp(OP_RETURN);
+
+		measure("allocation", &chunk, (uint64_t)iterations * 7);
+	}
+
+	//pushes onto one array that starts empty, so it is moved every time it doubles
+	void Benchmark::appendLoop(uint32_t iterations)
+	{
+		std::bitset<256> arrayOnly;
+		arrayOnly.set(10);
+		Chunk chunk;
+		chunk.WriteU8(1, 0);
+		chunk.WriteU32(2, iterations);
+		chunk.WriteU8(3, 1);
+		chunk.WriteU8(8, 0);
+		chunk.WriteU8(9, 8);
+		chunk.WriteRegisterMap(std::bitset<256>());
+		chunk.WriteABC(OP_ALLOC_ARRAY, 8, 9, 10, 0);
+		int32_t loop = (int32_t)chunk.size();
+		chunk.WriteCompareJump(OP_JUMP_IF_SIGN_LESS, 1, 2, 3, 0);
+		chunk.WriteRelativeJump(OP_RELATIVE_JUMP, 4, 0);
+		chunk.WriteRegisterMap(arrayOnly);
+		chunk.WriteABC(OP_ARRAY_PUSH, 1, 10, 0, 0);
+		chunk.WriteABC(OP_INT_ADD, 1, 3, 1, 0);
+		chunk.WriteRelativeJump(OP_RELATIVE_JUMP, loop - (int32_t)chunk.size(), 0);
+		chunk.WriteABC(OP_ARRAY_LENGTH, 10, 4, 0, 0);
+		chunk.WriteU8(10, 0); //the array's address differs between runs
+		chunk.WriteRegisterMap(std::bitset<256>());
+		chunk.WriteOp(OP_RETURN);
+
+		measure("array append", &chunk, (uint64_t)iterations * 4);
+	}
+
+	//fills, copies and compares 1024 element arrays in bulk; counts elements rather than instructions
+	void Benchmark::bulkArrayLoop(uint32_t iterations)
+	{
+		std::bitset<256> firstArray;
+		firstArray.set(10);
+		Chunk chunk;
+		chunk.WriteU8(1, 0);
+		chunk.WriteU32(2, iterations);
+		chunk.WriteU8(3, 1);
+		chunk.WriteU8(4, 0);
+		chunk.WriteU16(8, 1024);
+		chunk.WriteU8(9, 8);
+		chunk.WriteRegisterMap(std::bitset<256>());
+		chunk.WriteABC(OP_ALLOC_ARRAY, 8, 9, 10, 0);
+		chunk.WriteRegisterMap(firstArray);
+		chunk.WriteABC(OP_ALLOC_ARRAY, 8, 9, 12, 0);
+		chunk.WriteU8(11, 0);
+		chunk.WriteU8(13, 0);
+		int32_t loop = (int32_t)chunk.size();
+		chunk.WriteCompareJump(OP_JUMP_IF_SIGN_LESS, 1, 2, 3, 0);
+		chunk.WriteRelativeJump(OP_RELATIVE_JUMP, 8, 0);
+		chunk.WriteABC(OP_ARRAY_FILL, 1, 10, 8, 0);
+		chunk.WriteABC(OP_ARRAY_COPY, 10, 12, 8, 0);
+		chunk.WriteAB(OP_MOVE, 8, 14, 0);
+		chunk.WriteABC(OP_ARRAY_COMPARE, 10, 12, 14, 0);
+		chunk.WriteABC(OP_INT_ADD, 4, 14, 4, 0);
+		chunk.WriteABC(OP_INT_ADD, 1, 3, 1, 0);
+		chunk.WriteRelativeJump(OP_RELATIVE_JUMP, loop - (int32_t)chunk.size(), 0);
+		chunk.WriteU8(10, 0); //the arrays' addresses differ between runs
+		chunk.WriteU8(12, 0);
+		chunk.WriteRegisterMap(std::bitset<256>());
+		chunk.WriteOp(OP_RETURN);
+
+		measure("array bulk ops", &chunk, (uint64_t)iterations * 1024 * 3);
+	}
+
+	//y += x * z over 1024 float arrays, reps times: with one instruction per element operation, or with a
+	//vector instruction per pass. both count elements, and leave the sum of y in R[9]
+	void Benchmark::vectorLoop(uint32_t reps, bool vector)
+	{
+		std::bitset<256> arrays;
+		Chunk chunk;
+		chunk.WriteU16(8, 1024);
+		chunk.WriteU8(9, 4);
+		for (uint8_t array : { 10, 12, 14 })
+		{
+			chunk.WriteRegisterMap(arrays);
+			chunk.WriteABC(OP_ALLOC_ARRAY, 8, 9, array, 0);
+			chunk.WriteU8(array + 1, 0);
+			arrays.set(array);
+		}
+		chunk.WriteFloat(5, 1.5f);
+		chunk.WriteABC(OP_ARRAY_FILL, 5, 10, 8, 0);
+		chunk.WriteFloat(5, 0.5f);
+		chunk.WriteABC(OP_ARRAY_FILL, 5, 12, 8, 0);
+		chunk.WriteU8(1, 0);
+		chunk.WriteU8(3, 1);
+		if (vector)
+		{
+			chunk.WriteU32(2, reps);
+			chunk.WriteU16(16, 1024);
+			int32_t loop = (int32_t)chunk.size();
+			chunk.WriteCompareJump(OP_JUMP_IF_SIGN_LESS, 1, 2, 3, 0);
+			chunk.WriteRelativeJump(OP_RELATIVE_JUMP, 4, 0);
+			chunk.WriteABC(OP_VECTOR_FLOAT_FMA, 10, 12, 14, 0);
+			chunk.WriteABC(OP_INT_ADD, 1, 3, 1, 0);
+			chunk.WriteRelativeJump(OP_RELATIVE_JUMP, loop - (int32_t)chunk.size(), 0);
+		}
+		else
+		{
+			chunk.WriteU32(2, reps * 1024);
+			chunk.WriteU16(16, 1023);
+			int32_t loop = (int32_t)chunk.size();
+			chunk.WriteCompareJump(OP_JUMP_IF_SIGN_LESS, 1, 2, 3, 0);
+			chunk.WriteRelativeJump(OP_RELATIVE_JUMP, 10, 0);
+			chunk.WriteABC(OP_BITWISE_AND, 1, 16, 17, 0);
+			chunk.WriteABC(OP_ARRAY_LOAD, 18, 10, 17, 0);
+			chunk.WriteABC(OP_ARRAY_LOAD, 19, 12, 17, 0);
+			chunk.WriteABC(OP_ARRAY_LOAD, 20, 14, 17, 0);
+			chunk.WriteABC(OP_FLOAT_MUL, 18, 19, 21, 0);
+			chunk.WriteABC(OP_FLOAT_ADD, 21, 20, 20, 0);
+			chunk.WriteABC(OP_ARRAY_STORE, 20, 14, 17, 0);
+			chunk.WriteABC(OP_INT_ADD, 1, 3, 1, 0);
+			chunk.WriteRelativeJump(OP_RELATIVE_JUMP, loop - (int32_t)chunk.size(), 0);
+		}
+		chunk.WriteU16(9, 1024);
+		chunk.WriteAB(OP_VECTOR_FLOAT_SUM, 14, 9, 0);
+		for (uint8_t array : { 10, 12, 14 }) chunk.WriteU8(array, 0); //the arrays' addresses differ between runs
+		chunk.WriteRegisterMap(std::bitset<256>());
+		chunk.WriteOp(OP_RETURN);
+
+		measure(vector ? "float fma vector" : "float fma bytecode", &chunk, (uint64_t)reps * 1024);
+	}
+
+	//source to running code: the time to compile a small loop, then the loop itself as the compiler emits it
+	void Benchmark::compiledLoop(uint32_t iterations, uint32_t compiles)
+	{
+		std::string source = "int i = 0\nint s = 0\nwhile(i < " + std::to_string(iterations) + ")\n{\n s = s + i * 3\n i = i + 1\n}\n";
+
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < compiles; i++)
+		{
+			Compiler compiler;
+			Chunk chunk;
+			compiler.compile(source.c_str(), &chunk);
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << std::setfill(' ') << std::left << std::setw(28) << "compile" << std::right << std::setw(12) << compiles
+			<< " compiles in " << std::fixed << std::setprecision(3) << seconds << "s (" << std::setprecision(1)
+			<< compiles / seconds << " compiles/s, " << (source.size() * compiles / seconds) / 1024.0 << " KB/s)" << std::endl;
+
+		Compiler compiler;
+		Chunk chunk;
+		if (!compiler.compile(source.c_str(), &chunk))
+		{
+			std::cout << "  compiled loop failed to compile!" << std::endl;
+			return;
+		}
+		//five instructions a pass: the fused header, the two additions, the strength-reduced product and the back jump
+		measure("compiled loop", &chunk, (uint64_t)iterations * 5);
+
+		VM vm;
+		vm.interpret(&chunk);
+		uint64_t expected = 3 * ((uint64_t)iterations * (iterations - 1) / 2);
+		int s = compiler.registerOf("s#0");
+		if (s < 0 || vm.getRegister(s) != expected)
+			std::cout << "  compiled loop computed the wrong sum!" << std::endl;
+	}
+
+	//times a compiled kernel without and with the loop passes, which have to agree on the result variable
+	void Benchmark::loopKernel(const char* name, const std::string& source, const char* result)
+	{
+		double seconds[2];
+		uint64_t values[2];
+		for (int optimized = 0; optimized < 2; optimized++)
+		{
+			Compiler compiler;
+			compiler.setLoopOptimization(optimized != 0);
+			Chunk chunk;
+			if (!compiler.compile(source.c_str(), &chunk))
+			{
+				std::cout << "  " << name << " failed to compile!" << std::endl;
+				return;
+			}
+			VM vm;
+			vm.setEngine(ExecutionEngine::ENGINE_INTERPRETER);
+			seconds[optimized] = timeChunk(vm, &chunk);
+			int r = compiler.registerOf(result);
+			values[optimized] = r < 0 ? 0 : vm.getRegister(r);
+		}
+		std::cout << std::setfill(' ') << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(3)
+			<< seconds[0] << "s plain, " << seconds[1] << "s optimized (" << std::setprecision(2) << seconds[0] / seconds[1] << "x)" << std::endl;
+		if (values[0] != values[1]) std::cout << "  loop passes changed the result: " << values[0] << " vs " << values[1] << std::endl;
+	}
+
+	//numeric kernels as a script would write them, each doing the bulk of its work in one loop
+	void Benchmark::loopKernels(uint32_t iterations)
+	{
+		std::string count = std::to_string(iterations);
+		//n comes out of a loop too long to unroll, so nothing but code motion can take n * 7 + n / 3 out of the loop
+		loopKernel("invariant arithmetic",
+			"int n = 0\nwhile(n < 1000)\n{\n n = n + 1\n}\nint s = 0\nint i = 0\nwhile(i < " + count + ")\n{\n s = s + n * 7 + n / 3 + i\n i = i + 1\n}\n", "s#0");
+		//the products become induction variables stepped by addition
+		loopKernel("strided indices",
+			"int s = 0\nint i = 0\nwhile(i < " + count + ")\n{\n s = s + i * 8 + i * 24\n i = i + 1\n}\n", "s#0");
+		//the inner loop is unrolled and its copies folded
+		loopKernel("small inner loop",
+			"int s = 0\nint i = 0\nwhile(i < " + std::to_string(iterations / 4) + ")\n{\n for(int j = 0; j < 4; j = j + 1)\n {\n  s = s + j * i\n }\n i = i + 1\n}\n", "s#0");
+		loopKernel("double recurrence",
+			"double x = 0.0\nint i = 0\nwhile(i < " + count + ")\n{\n x = x * 0.5 + 1.5\n i = i + 1\n}\n", "x#0");
+	}
+
+	//times a compiled kernel with every call made through OP_CALL, then with small functions inlined
+	void Benchmark::callKernel(const char* name, const std::string& source, const char* result)
+	{
+		double seconds[2];
+		uint64_t values[2];
+		for (int inlined = 0; inlined < 2; inlined++)
+		{
+			Compiler compiler;
+			compiler.setInlining(inlined != 0);
+			Chunk chunk;
+			if (!compiler.compile(source.c_str(), &chunk))
+			{
+				std::cout << "  " << name << " failed to compile!" << std::endl;
+				return;
+			}
+			VM vm;
+			vm.setEngine(ExecutionEngine::ENGINE_TIERED);
+			seconds[inlined] = timeChunk(vm, &chunk);
+			int r = compiler.registerOf(result);
+			values[inlined] = r < 0 ? 0 : vm.getRegister(r);
+		}
+		std::cout << std::setfill(' ') << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(3)
+			<< seconds[0] << "s called, " << seconds[1] << "s inlined (" << std::setprecision(2) << seconds[0] / seconds[1] << "x)" << std::endl;
+		if (values[0] != values[1]) std::cout << "  inlining changed the result: " << values[0] << " vs " << values[1] << std::endl;
+	}
+
+	void Benchmark::callKernels(uint32_t iterations)
+	{
+		std::string count = std::to_string(iterations);
+		//a leaf small enough to inline, called once a pass
+		callKernel("leaf call",
+			"int step(int s, int i)\n{\n return s + i * 3\n}\nint s = 0\nint i = 0\nwhile(i < " + count + ")\n{\n s = step(s, i)\n i = i + 1\n}\n", "s#0");
+		//recursion is only ever inlined one level, so this mostly measures the frame push and pop
+		callKernel("recursive calls",
+			"int fib(int n)\n{\n if (n < 2)\n {\n  return n\n }\n return fib(n - 1) + fib(n - 2)\n}\nint r = fib(27)\n", "r#0");
+	}
+
+	//a few hundred MB of 32 element arrays, all reachable from one pointer array, each filled twice so
+	//half of what was allocated is garbage; the final stop-the-world collection is timed for 1, 2, 4...
+	//collector threads up to the core count
+	void Benchmark::collectionScaling(uint32_t objects)
+	{
+		std::bitset<256> outerOnly;
+		outerOnly.set(10);
+		Chunk chunk;
+		chunk.WriteU32(1, objects);
+		chunk.WriteU8(2, 0x88);
+		chunk.WriteRegisterMap(std::bitset<256>());
+		chunk.WriteABC(OP_ALLOC_ARRAY, 1, 2, 10, 0);
+		chunk.WriteU8(3, 0);
+		chunk.WriteU8(4, 1);
+		chunk.WriteU8(5, 32);
+		chunk.WriteU8(6, 8);
+		chunk.WriteU8(7, 2);
+		chunk.WriteU8(8, 0);
+		chunk.WriteU8(20, 0);
+		chunk.WriteCompareJump(OP_JUMP_IF_SIGN_LESS, 8, 7, 3, 0);
+		chunk.WriteRelativeJump(OP_RELATIVE_JUMP, 13, 0);
+		chunk.WriteU8(9, 0);
+		chunk.WriteCompareJump(OP_JUMP_IF_SIGN_LESS, 9, 1, 3, 0);
+		chunk.WriteRelativeJump(OP_RELATIVE_JUMP, 7, 0);
+		chunk.WriteRegisterMap(outerOnly);
+		chunk.WriteABC(OP_ALLOC_ARRAY, 5, 6, 11, 0);
+		chunk.WriteABC(OP_ARRAY_STORE, 3, 11, 20, 0);
+		chunk.WriteABC(OP_ARRAY_STORE, 11, 10, 9, 0);
+		chunk.WriteABC(OP_INT_ADD, 3, 4, 3, 0);
+		chunk.WriteABC(OP_INT_ADD, 9, 4, 9, 0);
+		chunk.WriteRelativeJump(OP_RELATIVE_JUMP, -8, 0);
+		chunk.WriteABC(OP_INT_ADD, 8, 4, 8, 0);
+		chunk.WriteRelativeJump(OP_RELATIVE_JUMP, -14, 0);
+		chunk.WriteRegisterMap(outerOnly);
+		chunk.WriteOp(OP_RETURN);
+
+		std::cout << "==collection scaling==\n";
+		unsigned cores = std::thread::hardware_concurrency();
+		if (cores == 0) cores = 1;
+		for (unsigned threads = 1; threads <= cores; threads *= 2)
+		{
+			VM vm;
+			GCPolicy policy;
+			policy.threads = threads;
+			vm.setGCPolicy(policy);
+			vm.interpret(&chunk);
+			uint64_t garbage = vm.heapStatistics().bytesInUse;
+			vm.collectGarbage();
+			const GCStatistics& gc = vm.gcStatistics();
+			garbage -= gc.liveBytes;
+			std::cout << std::setw(3) << threads << " threads: " << std::fixed << std::setprecision(1)
+				<< gc.liveBytes / 1048576.0 << " MB live, " << garbage / 1048576.0 << " MB swept, pause "
+				<< std::setprecision(2) << gc.lastPause / 1000000.0 << "ms (" << gc.collections << " full collections, "
+				<< gc.totalPause / 1000000.0 << "ms paused in total)" << std::endl;
+		}
+	}
+
+	static const ExecutionEngine engines[] = { ExecutionEngine::ENGINE_INTERPRETER,
+#ifdef JIT_SUPPORTED
+		ExecutionEngine::ENGINE_JIT, ExecutionEngine::ENGINE_TIERED
+#endif
+	};
+	static const char* engineNames[] = { "interp", "jit", "tiered" };
+
+	//compiles source with the loop passes and inlining both off, then both on, and runs it under every engine
+	void Benchmark::checkSource(const char* name, const std::string& source, const char* result, uint64_t expected, const GCPolicy& policy)
+	{
+		bool passed = true;
+		for (int optimized = 0; optimized < 2; optimized++)
+		{
+			Compiler compiler;
+			compiler.setLoopOptimization(optimized != 0);
+			compiler.setInlining(optimized != 0);
+			Chunk chunk;
+			if (!compiler.compile(source.c_str(), &chunk))
+			{
+				std::cout << "  " << name << " failed to compile!" << std::endl;
+				return;
+			}
+			int r = compiler.registerOf(result);
+			for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++)
+			{
+				VM vm;
+				vm.setEngine(engines[e]);
+				vm.setGCPolicy(policy);
+				InterpretResult ran = vm.interpret(&chunk);
+				uint64_t value = r < 0 ? 0 : vm.getRegister(r);
+				if (ran == InterpretResult::INTERPRET_OK && r >= 0 && value == expected) continue;
+				std::cout << "  " << name << " under " << engineNames[e] << (optimized ? " with" : " without") << " the passes: expected "
+					<< expected << ", got " << value << std::endl;
+				passed = false;
+			}
+		}
+		if (passed) std::cout << std::setfill(' ') << std::left << std::setw(28) << name << "ok" << std::right << std::endl;
+	}
+
+	//compiles source both ways and runs it under every engine, expecting it to stop with the error it prints
+	void Benchmark::checkSourceError(const char* name, const std::string& source, const std::string& expected)
+	{
+		bool passed = true;
+		for (int optimized = 0; optimized < 2; optimized++)
+		{
+			Compiler compiler;
+			compiler.setLoopOptimization(optimized != 0);
+			compiler.setInlining(optimized != 0);
+			Chunk chunk;
+			if (!compiler.compile(source.c_str(), &chunk))
+			{
+				std::cout << "  " << name << " failed to compile!" << std::endl;
+				return;
+			}
+			for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++)
+			{
+				VM vm;
+				vm.setEngine(engines[e]);
+				std::ostringstream printed;
+				auto console = std::cout.rdbuf(printed.rdbuf());
+				InterpretResult ran = vm.interpret(&chunk);
+				std::cout.rdbuf(console);
+				if (ran == InterpretResult::INTERPRET_RUNTIME_ERROR && printed.str() == expected) continue;
+				std::cout << "  " << name << " under " << engineNames[e] << (optimized ? " with" : " without") << " the passes printed:\n"
+					<< printed.str() << "  instead of:\n" << expected;
+				passed = false;
+			}
+		}
+		if (passed) std::cout << std::setfill(' ') << std::left << std::setw(28) << name << "ok" << std::right << std::endl;
+	}
+
+	//compiles source with the passes on and counts the array accesses left checked, made unchecked, and checked once
+	//ahead of their loop, to see the bounds check pass do what it should and not only give the right answer
+	void Benchmark::checkAccesses(const char* name, const std::string& source, size_t checked, size_t unchecked, size_t hoisted)
+	{
+		Compiler compiler;
+		Chunk chunk;
+		DecodedChunk decoded;
+		if (!compiler.compile(source.c_str(), &chunk) || decoded.decode(&chunk) != nullptr)
+		{
+			std::cout << "  " << name << " failed to compile!" << std::endl;
+			return;
+		}
+		size_t counts[3] = {};
+		for (size_t i = 0; i < decoded.size(); i++)
+		{
+			switch (decoded.code()[i].op)
+			{
+				case OP_ARRAY_LOAD: case OP_ARRAY_STORE: counts[0]++; break;
+				case OP_ARRAY_LOAD_UNCHECKED: case OP_ARRAY_STORE_UNCHECKED: counts[1]++; break;
+				case OP_ARRAY_CHECK: counts[2]++; break;
+				default: break;
+			}
+		}
+		if (counts[0] == checked && counts[1] == unchecked && counts[2] == hoisted)
+		{
+			std::cout << std::setfill(' ') << std::left << std::setw(28) << name << "ok" << std::right << std::endl;
+			return;
+		}
+		std::cout << "  " << name << ": " << counts[0] << " checked, " << counts[1] << " unchecked and " << counts[2]
+			<< " hoisted checks instead of " << checked << ", " << unchecked << " and " << hoisted << std::endl;
+	}
+
+	void Benchmark::checks()
+	{
+		std::cout << "==checks==\n";
+		//more locals than registers, live across a call, so some are spilled and reloaded
+		std::string spill = "int twice(int n)\n{\n return n * 2\n}\nint spill(int n)\n{\n";
+		std::string sum;
+		for (int k = 0; k < 300; k++)
+		{
+			spill += " int v" + std::to_string(k) + " = n * " + std::to_string(k) + " + 1\n";
+			sum += " + v" + std::to_string(k);
+		}
+		spill += " int w = twice(n)\n return w" + sum + "\n}\nint n = 0\nwhile(n < 1000)\n{\n n = n + 1\n}\nint s = spill(n)\n";
+		checkSource("spilled locals", spill, "s#0", 1000 * 44850 + 300 + 2000, GCPolicy());
+
+		//called functions, inlined or not, read and write the program's globals
+		std::string globals =
+			"int g = 10\n"
+			"int read(int b)\n{\n return b + g\n}\n"
+			"void add(int b)\n{\n g = g + b\n}\n"
+			"int deep(int n)\n{\n if (n == 0)\n {\n  return g\n }\n return deep(n - 1)\n}\n"
+			"int r = read(1)\nadd(5)\nint s = r + deep(4) + g\n";
+		checkSource("globals in calls", globals, "s#0", 11 + 15 + 15, GCPolicy());
+
+		//callees that allocate enough to collect, while their callers hold pointers in registers
+		std::string pointers =
+			"def Box\n{\n int v\n}\n"
+			"Box make(int v)\n{\n Box b = {v}\n return b\n}\n"
+			"int churn(int n)\n{\n int acc = 0\n int k = 0\n while (k < n)\n {\n  Box t = make(k)\n  acc = acc + t.v\n  k = k + 1\n }\n return acc\n}\n"
+			"Box keep = make(7)\nint total = 0\nint i = 0\nwhile (i < 200)\n{\n Box mine = make(i)\n total = total + churn(1000) + mine.v + keep.v\n i = i + 1\n}\n";
+		uint64_t churned = 200 * 499500 + 199 * 200 / 2 + 200 * 7;
+		GCPolicy incremental, concurrent, counted;
+		incremental.incremental = true;
+		concurrent.concurrent = true;
+		concurrent.compact = true;
+		counted.deferredCounting = true;
+		checkSource("pointers across calls", pointers, "total#0", churned, GCPolicy());
+		checkSource("  incremental", pointers, "total#0", churned, incremental);
+		checkSource("  concurrent, compacting", pointers, "total#0", churned, concurrent);
+		checkSource("  deferred counting", pointers, "total#0", churned, counted);
+
+		//a chunk without register maps, holding an array's address and, as a plain integer, that address plus
+		//eight: neither the churn nor a compacting collection afterwards may move the array out from under it
+		{
+			Chunk chunk;
+			chunk.WriteU8(1, 4);
+			chunk.WriteU8(2, 8);
+			chunk.WriteABC(OP_ALLOC_ARRAY, 1, 2, 10, 0);
+			chunk.WriteABC(OP_INT_ADD, 10, 2, 11, 0);
+			chunk.WriteU8(3, 0);
+			chunk.WriteU8(4, 1);
+			chunk.WriteU32(5, 100000);
+			int32_t loop = (int32_t)chunk.size();
+			chunk.WriteCompareJump(OP_JUMP_IF_SIGN_LESS, 3, 5, 3, 0);
+			chunk.WriteRelativeJump(OP_RELATIVE_JUMP, 4, 0);
+			chunk.WriteABC(OP_ALLOC_ARRAY, 1, 2, 12, 0);
+			chunk.WriteABC(OP_INT_ADD, 3, 4, 3, 0);
+			chunk.WriteRelativeJump(OP_RELATIVE_JUMP, loop - (int32_t)chunk.size(), 0);
+			chunk.WriteOp(OP_RETURN);
+			GCPolicy compacting;
+			compacting.compact = true;
+			compacting.compactOccupancy = 1.0;
+			bool passed = true;
+			for (const GCPolicy& policy : { compacting, incremental, concurrent })
+			{
+				for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++)
+				{
+					VM vm;
+					vm.setEngine(engines[e]);
+					vm.setGCPolicy(policy);
+					InterpretResult ran = vm.interpret(&chunk);
+					vm.collectGarbage();
+					if (ran == InterpretResult::INTERPRET_OK && vm.getRegister(10) != 0 && vm.getRegister(10) + 8 == vm.getRegister(11)) continue;
+					std::cout << "  conservative roots under " << engineNames[e] << ": the array moved" << std::endl;
+					passed = false;
+				}
+			}
+			if (passed) std::cout << std::setfill(' ') << std::left << std::setw(28) << "conservative roots" << "ok" << std::right << std::endl;
+		}
+
+		//an array of 0 to 15 added to itself one element further on, or one element back: whichever kernels run and
+		//whatever order they write in, the sources are read as they were before the instruction
+		{
+			bool passed = true;
+			for (uint8_t forward : { 1, 0 })
+			{
+				Chunk chunk;
+				chunk.WriteU8(1, 16);
+				chunk.WriteU8(2, 8);
+				chunk.WriteRegisterMap(std::bitset<256>());
+				chunk.WriteABC(OP_ALLOC_ARRAY, 1, 2, 10, 0);
+				chunk.WriteU8(3, 0);
+				chunk.WriteU8(4, 1);
+				int32_t loop = (int32_t)chunk.size();
+				chunk.WriteCompareJump(OP_JUMP_IF_SIGN_LESS, 3, 1, 3, 0);
+				chunk.WriteRelativeJump(OP_RELATIVE_JUMP, 4, 0);
+				chunk.WriteABC(OP_ARRAY_STORE, 3, 10, 3, 0);
+				chunk.WriteABC(OP_INT_ADD, 3, 4, 3, 0);
+				chunk.WriteRelativeJump(OP_RELATIVE_JUMP, loop - (int32_t)chunk.size(), 0);
+				chunk.WriteU8(11, 1 - forward);
+				chunk.WriteAB(OP_MOVE, 10, 12, 0);
+				chunk.WriteU8(13, forward);
+				chunk.WriteU8(14, 15);
+				chunk.WriteABC(OP_VECTOR_INT_ADD, 10, 10, 12, 0);
+				chunk.WriteU8(11, 0);
+				chunk.WriteU8(15, 16);
+				chunk.WriteAB(OP_VECTOR_INT_SUM, 10, 15, 0);
+				chunk.WriteRegisterMap(std::bitset<256>());
+				chunk.WriteOp(OP_RETURN);
+				uint64_t expected = forward ? 2 * 105 : 2 * 120 + 15;
+				for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++)
+				{
+					VM vm;
+					vm.setEngine(engines[e]);
+					InterpretResult ran = vm.interpret(&chunk);
+					if (ran == InterpretResult::INTERPRET_OK && vm.getRegister(15) == expected) continue;
+					std::cout << "  overlapping vector operands under " << engineNames[e] << ": expected " << expected
+						<< ", got " << vm.getRegister(15) << std::endl;
+					passed = false;
+				}
+			}
+			if (passed) std::cout << std::setfill(' ') << std::left << std::setw(28) << "overlapping vector operands" << "ok" << std::right << std::endl;
+		}
+
+		//array accesses the bounds check pass rewrites: proven in bounds, checked once ahead of their loop, or left alone
+		std::string proven =
+			"int n = 50\nint a[n]\nint i = 0\nwhile (i < n)\n{\n a[i] = i\n i = i + 1\n}\n"
+			"int s = 0\nint j = 0\nwhile (j < n)\n{\n s = s + a[j]\n j = j + 1\n}\n";
+		checkSource("bounds proven", proven, "s#0", 1225, GCPolicy());
+		std::string another =
+			"int b[30]\nint m = b.length\nint a[40]\nint i = 0\nwhile (i < m)\n{\n a[i] = i\n i = i + 1\n}\n"
+			"int s = 0\nint j = 0\nwhile (j < m)\n{\n s = s + a[j]\n j = j + 1\n}\nint r = i * 1000 + s\n";
+		checkSource("bounds from another array", another, "r#0", 30 * 1000 + 435, GCPolicy());
+		//both loops of the first are proven; the second's store loop is versioned, with a checked copy for when a is
+		//too short, and its loads are checked once
+		checkAccesses("  proven, unchecked", proven, 0, 2, 0);
+		checkAccesses("  versioned and hoisted", another, 1, 2, 1);
+		std::string outOfBounds = "array index out of bounds!\n";
+		std::string partway =
+			"int b[20]\nint m = b.length\nint a[15]\nint i = 0\nwhile (i < m)\n{\n a[i] = i\n i = i + 1\n}\n";
+		checkSourceError("bounds failing partway", partway, outOfBounds);
+		//the tenth trip divides by zero before the fifteenth can store past a's end, so only a loop that runs its
+		//trips in order until one fails stops with the division
+		std::string dividing =
+			"int b[20]\nint m = b.length\nint a[15]\nint q = 0\nint i = 0\nwhile (i < m)\n{\n a[i] = i\n"
+			" q = q + 100 / (10 - i)\n i = i + 1\n}\n";
+		checkSourceError("  an earlier trip failing", dividing, "division by zero!\n");
+		std::string loads =
+			"int b[20]\nint m = b.length\nint a[15]\nint s = 0\nint i = 0\nwhile (i < m)\n{\n s = s + a[i]\n i = i + 1\n}\n";
+		checkSourceError("bounds failing, loads only", loads, outOfBounds);
+		//the loop leaves, by returning, before the index passes the array's end
+		std::string early =
+			"int a[150]\n"
+			"int fill(int m)\n{\n int s = 0\n int i = 0\n while (i < m)\n {\n  if (i == 100)\n  {\n   return s\n  }\n"
+			"  a[i] = i\n  s = s + 1\n  i = i + 1\n }\n return s\n}\n"
+			"int b[200]\nint s = fill(b.length)\n";
+		checkSource("bounds with an early exit", early, "s#0", 100, GCPolicy());
+		std::string none =
+			"int b[20]\nint m = b.length\nint a[15]\nint s = 0\nint i = a.length + 10\n"
+			"while (i < m)\n{\n a[i] = i\n s = s + 1\n i = i + 1\n}\n";
+		checkSource("bounds with no trips", none, "s#0", 0, GCPolicy());
+		//the inner loop's bound is the outer induction variable
+		std::string nested =
+			"int a[64]\nint n = a.length\nint s = 0\nint i = 0\nwhile (i < n)\n{\n int j = 0\n while (j < i)\n {\n"
+			"  int t = a[j] + 1\n  a[j] = t\n  s = s + t\n  j = j + 1\n }\n i = i + 1\n}\n";
+		checkSource("bounds in nested loops", nested, "s#0", 43680, GCPolicy());
+		checkSource("literal indices", "int a[10]\na[9] = 7\nint t = a[9]\n", "t#0", 7, GCPolicy());
+		checkSourceError("literal index past the end", "int a[10]\na[9] = 7\nint t = a[10]\n", outOfBounds);
+		//pushes grow the array past its first capacity, and length follows them
+		std::string pushed =
+			"int a[0]\nint i = 0\nwhile (i < 1000)\n{\n a.push(i)\n i = i + 1\n}\n"
+			"int s = 0\nint j = 0\nwhile (j < a.length)\n{\n s = s + a[j]\n j = j + 1\n}\nint r = a.length * 1000000 + s\n";
+		checkSource("pushes", pushed, "r#0", 1000 * 1000000 + 499500, GCPolicy());
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Chunk.h"
+#include "VM.h"
+
+#include <string>
+
+namespace ash
+{
+	class Benchmark
+	{
+	private:
+		void report(const char* name, const char* engine, uint64_t instructions, double seconds);
+		double timeChunk(VM& vm, Chunk* chunk);
+		void measure(const char* name, Chunk* chunk, uint64_t instructions);
+
+		void integerLoop(uint32_t iterations);
+		void fusedBranchLoop(uint32_t iterations);
+		void doubleLoop(uint32_t iterations);
+		void arrayLoop(uint32_t iterations, bool unchecked);
+		void allocationLoop(uint32_t iterations);
+		void appendLoop(uint32_t iterations);
+		void bulkArrayLoop(uint32_t iterations);
+		void vectorLoop(uint32_t reps, bool vector);
+		void compiledLoop(uint32_t iterations, uint32_t compiles);
+		void loopKernel(const char* name, const std::string& source, const char* result);
+		void loopKernels(uint32_t iterations);
+		void callKernel(const char* name, const std::string& source, const char* result);
+		void callKernels(uint32_t iterations);
+		void collectionScaling(uint32_t objects);
+
+		//known answers, under every engine with the optimizer's passes on and off
+		void checkSource(const char* name, const std::string& source, const char* result, uint64_t expected, const GCPolicy& policy);
+		void checkSourceError(const char* name, const std::string& source, const std::string& expected);
+		void checkAccesses(const char* name, const std::string& source, size_t checked, size_t unchecked, size_t hoisted);
+		void checks();
+	public:
+		Benchmark() = default;
+		~Benchmark() = default;
+		void run();
+	};
+}
@@ -36,6 +36,47 @@ namespace ash
 		opcode.push_back(result);
 	}
 
+	void Chunk::WriteCompareJump(uint8_t op, uint8_t A, uint8_t B, int32_t jump, int line)
+	{
+		if (lines.size() != 0 && line == lines.back().first)
+			lines.back().second += 2;
+		else
+			lines.emplace_back(std::pair<int, int>(line, 2));
+		uint32_t result = 0;
+		result = op;
+		result = (result << 8) + A;
+		result = (result << 8) + B;
+		result = (result << 8);
+		opcode.push_back(result);
+		opcode.push_back(static_cast<uint32_t>(jump));
+	}
+
+	void Chunk::WriteStackSlot(uint8_t op, uint8_t A, uint16_t slot, int line)
+	{
+		if (lines.size() != 0 && line == lines.back().first)
+			lines.back().second++;
+		else
+			lines.emplace_back(std::pair<int, int>(line, 1));
+		uint32_t result = 0;
+		result = op;
+		result = (result << 8) + A;
+		result = (result << 16) + slot;
+		opcode.push_back(result);
+	}
+
+	void Chunk::PatchJump(size_t offset, int32_t jump)
+	{
+		uint8_t op = opcode[offset] >> 24;
+		if ((op >= OP_JUMP_IF_SIGN_LESS && op <= OP_JUMP_IF_DOUBLE_EQUAL) || op == OP_CALL)
+		{
+			opcode[offset + 1] = static_cast<uint32_t>(jump);
+			return;
+		}
+		if (jump > INT24_MAX) jump = INT24_MAX;
+		if (jump < INT24_MIN) jump = INT24_MIN;
+		opcode[offset] = (opcode[offset] & 0xFF000000) + (jump & 0xFFFFFF);
+	}
+
 	void Chunk::WriteAB(uint8_t op, uint8_t A, uint8_t B, int line)
 	{
 
@@ -76,25 +117,13 @@ namespace ash
 		uint32_t result = 0;
 		result = constant >> 15 ? OP_CONST_LOW_NEGATIVE : OP_CONST_LOW;
 		result = (result << 8) + A;
-		result = (result << 16) + constant;
+		result = (result << 16) + static_cast<uint16_t>(constant);
 
 		opcode.push_back(result);
 	}
 	void Chunk::WriteI32(uint8_t A, int32_t constant)
 	{
-		uint16_t constant_high = static_cast<uint16_t>(constant >> 16);
-		uint16_t constant_low = static_cast<uint16_t>(constant);
-
-		uint32_t result_high = OP_CONST_MID_LOW;
-		result_high = (result_high << 8) + A;
-		result_high = (result_high << 16) + constant_high;
-
-		uint32_t result_low = constant >> 31 ? OP_CONST_LOW_NEGATIVE : OP_CONST_LOW;
-		result_low = (result_low << 8) + A;
-		result_low = (result_low << 16) + constant_low;
-
-		opcode.push_back(result_low);
-		opcode.push_back(result_high);
+		WriteI64(A, constant);
 	}
 	void Chunk::WriteFloat(uint8_t A, float constant)
 	{
@@ -102,31 +131,10 @@ namespace ash
 	}
 	void Chunk::WriteI64(uint8_t A, int64_t constant)
 	{
-		uint16_t constant_high = static_cast<uint16_t>(constant >> 48);
-		uint16_t constant_mid_high = static_cast<uint16_t>(constant >> 32);
-		uint16_t constant_mid_low = static_cast<uint16_t>(constant >> 16);
-		uint16_t constant_low = static_cast<uint16_t>(constant);
-
-		uint32_t result_high = OP_CONST_HIGH;
-		result_high = (result_high << 8) + A;
-		result_high = (result_high << 16) + constant_high;
-
-		uint32_t result_mid_high = OP_CONST_MID_HIGH;
-		result_mid_high = (result_mid_high << 8) + A;
-		result_mid_high = (result_mid_high << 16) + constant_mid_high;
-
-		uint32_t result_mid_low = OP_CONST_MID_LOW;
-		result_mid_low = (result_mid_low << 8) + A;
-		result_mid_low = (result_mid_low << 16) + constant_mid_low;
-
-		uint32_t result_low = constant >> 63 ? OP_CONST_LOW_NEGATIVE : OP_CONST_LOW;
-		result_low = (result_low << 8) + A;
-		result_low = (result_low << 16) + constant_low;
-
-		opcode.push_back(result_low);
-		opcode.push_back(result_mid_low);
-		opcode.push_back(result_mid_high);
-		opcode.push_back(result_high);
+		if (constant >= INT16_MIN && constant <= INT16_MAX)
+			WriteI16(A, static_cast<int16_t>(constant));
+		else
+			WriteConstant(A, static_cast<uint64_t>(constant));
 	}
 	void Chunk::WriteDouble(uint8_t A, double constant)
 	{
@@ -147,51 +155,67 @@ namespace ash
 	}
 	void Chunk::WriteU32(uint8_t A, uint32_t constant)
 	{
-		uint16_t constant_high = static_cast<uint16_t>(constant >> 16);
-		uint16_t constant_low = static_cast<uint16_t>(constant);
-
-		uint32_t result_high = OP_CONST_MID_LOW;
-		result_high = (result_high << 8) + A;
-		result_high = (result_high << 16) + constant_high;
-
-		uint32_t result_low = OP_CONST_LOW;
-		result_low = (result_low << 8) + A;
-		result_low = (result_low << 16) + constant_low;
-
-		opcode.push_back(result_low);
-		opcode.push_back(result_high);
+		WriteU64(A, constant);
 	}
 	void Chunk::WriteU64(uint8_t A, uint64_t constant)
 	{
-		uint16_t constant_high = static_cast<uint16_t>(constant >> 48);
-		uint16_t constant_mid_high = static_cast<uint16_t>(constant >> 32);
-		uint16_t constant_mid_low = static_cast<uint16_t>(constant >> 16);
-		uint16_t constant_low = static_cast<uint16_t>(constant);
-
-		uint32_t result_high = OP_CONST_HIGH;
-		result_high = (result_high << 8) + A;
-		result_high = (result_high << 16) + constant_high;
-
-		uint32_t result_mid_high = OP_CONST_MID_HIGH;
-		result_mid_high = (result_mid_high << 8) + A;
-		result_mid_high = (result_mid_high << 16) + constant_mid_high;
-
-		uint32_t result_mid_low = OP_CONST_MID_LOW;
-		result_mid_low = (result_mid_low << 8) + A;
-		result_mid_low = (result_mid_low << 16) + constant_mid_low;
-
-		uint32_t result_low = OP_CONST_LOW;
-		result_low = (result_low << 8) + A;
-		result_low = (result_low << 16) + constant_low;
+		if (constant <= UINT16_MAX)
+			WriteU16(A, static_cast<uint16_t>(constant));
+		else
+			WriteConstant(A, constant);
+	}
 
-		opcode.push_back(result_low);
-		opcode.push_back(result_mid_low);
-		opcode.push_back(result_mid_high);
-		opcode.push_back(result_high);
+	void Chunk::WriteConstant(uint8_t A, uint64_t constant)
+	{
+		uint32_t index = AddConstant(constant);
+		if (index <= UINT16_MAX)
+		{
+			uint32_t result = OP_LOAD_CONST;
+			result = (result << 8) + A;
+			result = (result << 16) + index;
+			opcode.push_back(result);
+		}
+		else
+		{
+			uint32_t result = OP_LOAD_CONST_WIDE;
+			result = (result << 8) + A;
+			result = (result << 16);
+			opcode.push_back(result);
+			opcode.push_back(index);
+		}
+	}
 
+	uint32_t Chunk::AddConstant(uint64_t constant)
+	{
+		auto existing = constantIndices.find(constant);
+		if (existing != constantIndices.end()) return existing->second;
+		uint32_t index = static_cast<uint32_t>(constants.size());
+		constants.push_back(constant);
+		constantIndices.emplace(constant, index);
+		return index;
 	}
 
+	void Chunk::WriteRegisterMap(const std::bitset<256>& pointers)
+	{
+		if (registerMaps.size() != 0 && registerMaps.back().first == opcode.size())
+			registerMaps.back().second = pointers;
+		else
+			registerMaps.emplace_back(opcode.size(), pointers);
+	}
 
+	const std::bitset<256>* Chunk::GetRegisterMap(size_t offset)
+	{
+		size_t low = 0;
+		size_t high = registerMaps.size();
+		while (low < high)
+		{
+			size_t middle = (low + high) / 2;
+			if (registerMaps[middle].first < offset) low = middle + 1;
+			else high = middle;
+		}
+		if (low < registerMaps.size() && registerMaps[low].first == offset) return &registerMaps[low].second;
+		return nullptr;
+	}
 
 	int Chunk::GetLine(size_t offset)
 	{
@@ -2,15 +2,24 @@
 
 #include <vector>
 #include <string>
+#include <bitset>
+#include <unordered_map>
+#include <memory>
 #include <stdint.h>
 namespace ash
 {
+	struct TypeMetadata;
 
 	class Chunk
 	{
 	private:
 		std::vector<uint32_t> opcode;
 		std::vector<std::pair<int, int>> lines;
+		std::vector<std::pair<size_t, std::bitset<256>>> registerMaps; //sorted by instruction offset
+		std::vector<uint64_t> constants;
+		std::unordered_map<uint64_t, uint32_t> constantIndices; //deduplicates the pool by bit pattern
+
+		void WriteConstant(uint8_t A, uint64_t constant);
 	public:
 		Chunk() = default;
 		~Chunk() = default;
@@ -30,6 +39,21 @@ namespace ash
 		void WriteDouble(uint8_t A, double constant);
 
 		void WriteRelativeJump(uint8_t op, int32_t jump, int line);
+		//also writes OP_CALL, with B unused
+		void WriteCompareJump(uint8_t op, uint8_t A, uint8_t B, int32_t jump, int line);
+		void WriteStackSlot(uint8_t op, uint8_t A, uint16_t slot, int line);
+
+		//sets the offset of the jump written at offset, once the compiler knows where its label landed
+		void PatchJump(size_t offset, int32_t jump);
+
+		//returns the pool index of constant, adding it if no equal bit pattern is pooled yet
+		uint32_t AddConstant(uint64_t constant);
+		const std::vector<uint64_t>& GetConstants() { return constants; }
+
+		//marks which registers hold live heap pointers when the next instruction written executes;
+		//the compiler records one before every instruction that can collect garbage
+		void WriteRegisterMap(const std::bitset<256>& pointers);
+		const std::bitset<256>* GetRegisterMap(size_t offset);
 
 		uint32_t* code() { return opcode.data(); }
 		size_t size() { return opcode.size(); }
@@ -37,7 +61,9 @@ namespace ash
 
 		int GetLine(size_t offset);
 
-		
+		//struct layouts, indexed by the type IDs OP_ALLOC takes
+		std::vector<std::shared_ptr<TypeMetadata>> types;
+
 	};
 
 	enum OpCodes : uint8_t
@@ -118,6 +144,79 @@ namespace ash
 				//absolute jump instruction: 8-bit opcode | 8-bit register A | 16 bits space
 		OP_REGISTER_JUMP, // instruction pointer = chunk beginning + R[A] 
 		OP_REGISTER_JUMP_IF_TRUE, // if(comparison register) instruciton pointer = chunk beginning + R[A]
+			//typed variants: registers carry no type information at runtime, so the compiler picks these from static types
+		OP_PUSH_POINTER, // A; push heap pointer from R[A] onto stack, recording the slot for the garbage collector
+		OP_OUT_SIGNED, // A; outputs R[A] as a signed integer
+		OP_OUT_FLOAT, // A; outputs R[A] as a float
+		OP_OUT_DOUBLE, // A; outputs R[A] as a double
+			//constant pool loads: one dispatch for any 64-bit constant that does not fit the 16-bit OP_CONST_LOW forms
+		OP_LOAD_CONST, // A, index; R[A] = constants[16-bit index]
+		OP_LOAD_CONST_WIDE, // A; R[A] = constants[index], the 32-bit index is the whole next instruction word
+			//compare-and-branch: 8-bit opcode | 8-bit register A | 8-bit register B | 8 bits space,
+			//followed by a word holding the 32-bit jump offset relative to the first word. neither R nor the comparison register is written
+		OP_JUMP_IF_SIGN_LESS, // A, B, offset; if(R[A] < R[B]) instruction pointer += offset
+		OP_JUMP_IF_SIGN_GREATER, // A, B, offset; if(R[A] > R[B]) instruction pointer += offset
+		OP_JUMP_IF_UNSIGN_LESS,
+		OP_JUMP_IF_UNSIGN_GREATER,
+		OP_JUMP_IF_INT_EQUAL, // A, B, offset; if(R[A] == R[B]) instruction pointer += offset
+		OP_JUMP_IF_FLOAT_LESS,
+		OP_JUMP_IF_FLOAT_GREATER,
+		OP_JUMP_IF_FLOAT_EQUAL,
+		OP_JUMP_IF_DOUBLE_LESS,
+		OP_JUMP_IF_DOUBLE_GREATER,
+		OP_JUMP_IF_DOUBLE_EQUAL,
+			//growable arrays: an array has room for more elements than it holds, and grows geometrically when full.
+			//growing moves only the elements, so every reference to the array sees the new ones
+		OP_ARRAY_PUSH, // A, B; append R[A] to array R[B]
+		OP_ARRAY_RESERVE, // A, B; make room in array R[B] for R[A] elements without changing its length
+		OP_ARRAY_LENGTH, // A, B; R[B] = element count of array R[A]
+			//bulk array operations: an array operand R[X] starts at index R[X + 1], and both arrays must have the same element type
+		OP_ARRAY_COPY, // A, B, C; copy R[C] elements from array R[A] to array R[B]; the ranges may overlap
+		OP_ARRAY_FILL, // A, B, C; write R[A] to R[C] elements of array R[B]
+		OP_ARRAY_COMPARE, // A, B, C; R[C] = 1 if R[C] elements of arrays R[A] and R[B] are equal, else 0
+		OP_ARRAY_SLICE, // A, B, C; R[C] = new array of R[B] elements copied from array R[A]
+			//accesses the compiler proved in bounds, and the one check it hoists ahead of a loop it could not prove
+		OP_ARRAY_STORE_UNCHECKED, // A, B, C; as OP_ARRAY_STORE, for an array R[B] known to hold index R[C]
+		OP_ARRAY_LOAD_UNCHECKED, // A, B, C; as OP_ARRAY_LOAD, for an array R[B] known to hold index R[C]
+		OP_ARRAY_CHECK, // A, B, C; stop unless array R[A] holds indices R[B] up to R[C]; nothing is checked when signed R[B] >= R[C]
+			//vector instructions over arrays of 8 byte ints, floats or doubles, with array operands as in the bulk operations.
+			//kernels use the widest SIMD instructions the CPU has, and sums may round differently than a loop would
+		OP_VECTOR_INT_ADD, // A, B, C; R[C] = R[A] + R[B] for R[C + 2] elements
+		OP_VECTOR_FLOAT_ADD,
+		OP_VECTOR_DOUBLE_ADD,
+		OP_VECTOR_INT_SUB, // A, B, C; R[C] = R[A] - R[B] for R[C + 2] elements
+		OP_VECTOR_FLOAT_SUB,
+		OP_VECTOR_DOUBLE_SUB,
+		OP_VECTOR_INT_MUL, // A, B, C; R[C] = R[A] * R[B] for R[C + 2] elements
+		OP_VECTOR_FLOAT_MUL,
+		OP_VECTOR_DOUBLE_MUL,
+		OP_VECTOR_INT_FMA, // A, B, C; R[C] += R[A] * R[B] for R[C + 2] elements, fused where the CPU has FMA
+		OP_VECTOR_FLOAT_FMA,
+		OP_VECTOR_DOUBLE_FMA,
+		OP_VECTOR_INT_MIN, // A, B, C; R[C] = min(R[A], R[B]) for R[C + 2] elements
+		OP_VECTOR_FLOAT_MIN,
+		OP_VECTOR_DOUBLE_MIN,
+		OP_VECTOR_INT_MAX, // A, B, C; R[C] = max(R[A], R[B]) for R[C + 2] elements
+		OP_VECTOR_FLOAT_MAX,
+		OP_VECTOR_DOUBLE_MAX,
+		OP_VECTOR_INT_SCALE, // A, B, C; R[C] = R[A] * scalar R[B] for R[C + 2] elements
+		OP_VECTOR_FLOAT_SCALE,
+		OP_VECTOR_DOUBLE_SCALE,
+		OP_VECTOR_INT_DOT, // A, B, C; R[C] = sum of R[A] * R[B] over R[C] elements
+		OP_VECTOR_FLOAT_DOT,
+		OP_VECTOR_DOUBLE_DOT,
+		OP_VECTOR_INT_SUM, // A, B; R[B] = sum of R[B] elements of R[A]
+		OP_VECTOR_FLOAT_SUM,
+		OP_VECTOR_DOUBLE_SUM,
+			//spill slots: registers the compiler ran out of live in stack slots, counted from the bottom of the stack.
+			//8-bit opcode | 8-bit register A | 16-bit slot
+		OP_STACK_LOAD, // A, slot; R[A] = stack[slot]
+		OP_STACK_STORE, // A, slot; stack[slot] = R[A]
+			//calls: the registers of every active call are one contiguous frame stack, and R is a window onto the top frame.
+			//a call slides the window up, so what the caller left in R[A], R[A + 1]... is the callee's R[0], R[1]... without a copy.
+			//spill slots are counted from where the stack stood when the call was made
+		OP_CALL, // A, offset; call the function at instruction pointer + offset with its window starting at R[A]; the offset word follows, as in compare-and-branch
+		OP_RET, // A; return to the caller, which finds R[A] in the register its OP_CALL named
 	};
 
 	static const std::vector<std::string> OpcodeNames = {
@@ -183,6 +282,64 @@ namespace ash
 			"OP_RELATIVE_JUMP", 
 			"OP_RELATIVE_JUMP_IF_TRUE",
 			"OP_REGISTER_JUMP",
-			"OP_REGISTER_JUMP_IF_TRUE"
+			"OP_REGISTER_JUMP_IF_TRUE",
+			"OP_PUSH_POINTER",
+			"OP_OUT_SIGNED",
+			"OP_OUT_FLOAT",
+			"OP_OUT_DOUBLE",
+			"OP_LOAD_CONST",
+			"OP_LOAD_CONST_WIDE",
+			"OP_JUMP_IF_SIGN_LESS",
+			"OP_JUMP_IF_SIGN_GREATER",
+			"OP_JUMP_IF_UNSIGN_LESS",
+			"OP_JUMP_IF_UNSIGN_GREATER",
+			"OP_JUMP_IF_INT_EQUAL",
+			"OP_JUMP_IF_FLOAT_LESS",
+			"OP_JUMP_IF_FLOAT_GREATER",
+			"OP_JUMP_IF_FLOAT_EQUAL",
+			"OP_JUMP_IF_DOUBLE_LESS",
+			"OP_JUMP_IF_DOUBLE_GREATER",
+			"OP_JUMP_IF_DOUBLE_EQUAL",
+			"OP_ARRAY_PUSH",
+			"OP_ARRAY_RESERVE",
+			"OP_ARRAY_LENGTH",
+			"OP_ARRAY_COPY",
+			"OP_ARRAY_FILL",
+			"OP_ARRAY_COMPARE",
+			"OP_ARRAY_SLICE",
+			"OP_ARRAY_STORE_UNCHECKED",
+			"OP_ARRAY_LOAD_UNCHECKED",
+			"OP_ARRAY_CHECK",
+			"OP_VECTOR_INT_ADD",
+			"OP_VECTOR_FLOAT_ADD",
+			"OP_VECTOR_DOUBLE_ADD",
+			"OP_VECTOR_INT_SUB",
+			"OP_VECTOR_FLOAT_SUB",
+			"OP_VECTOR_DOUBLE_SUB",
+			"OP_VECTOR_INT_MUL",
+			"OP_VECTOR_FLOAT_MUL",
+			"OP_VECTOR_DOUBLE_MUL",
+			"OP_VECTOR_INT_FMA",
+			"OP_VECTOR_FLOAT_FMA",
+			"OP_VECTOR_DOUBLE_FMA",
+			"OP_VECTOR_INT_MIN",
+			"OP_VECTOR_FLOAT_MIN",
+			"OP_VECTOR_DOUBLE_MIN",
+			"OP_VECTOR_INT_MAX",
+			"OP_VECTOR_FLOAT_MAX",
+			"OP_VECTOR_DOUBLE_MAX",
+			"OP_VECTOR_INT_SCALE",
+			"OP_VECTOR_FLOAT_SCALE",
+			"OP_VECTOR_DOUBLE_SCALE",
+			"OP_VECTOR_INT_DOT",
+			"OP_VECTOR_FLOAT_DOT",
+			"OP_VECTOR_DOUBLE_DOT",
+			"OP_VECTOR_INT_SUM",
+			"OP_VECTOR_FLOAT_SUM",
+			"OP_VECTOR_DOUBLE_SUM",
+			"OP_STACK_LOAD",
+			"OP_STACK_STORE",
+			"OP_CALL",
+			"OP_RET"
 	};
 }
\ No newline at end of file
@@ -1,7 +1,10 @@
 #include "Compiler.h"
 #include "Semantics.h"
 #include "ControlFlowAnalysis.h"
+#include "Optimizer.h"
+#include <algorithm>
 #include <string>
+#include <unordered_set>
 
 namespace ash
 {
@@ -52,6 +55,110 @@ namespace ash
 			return { TokenType::ERROR, "identifier not found!", identifier.line };
 		}
 
+		//compare-and-branch opcode that replaces a comparison feeding a jump, OP_HALT if there is none
+		static OpCodes fusedBranch(OpCodes compare)
+		{
+			switch (compare)
+			{
+				case OP_SIGN_LESS: return OP_JUMP_IF_SIGN_LESS;
+				case OP_SIGN_GREATER: return OP_JUMP_IF_SIGN_GREATER;
+				case OP_UNSIGN_LESS: return OP_JUMP_IF_UNSIGN_LESS;
+				case OP_UNSIGN_GREATER: return OP_JUMP_IF_UNSIGN_GREATER;
+				case OP_INT_EQUAL: return OP_JUMP_IF_INT_EQUAL;
+				case OP_FLOAT_LESS: return OP_JUMP_IF_FLOAT_LESS;
+				case OP_FLOAT_GREATER: return OP_JUMP_IF_FLOAT_GREATER;
+				case OP_FLOAT_EQUAL: return OP_JUMP_IF_FLOAT_EQUAL;
+				case OP_DOUBLE_LESS: return OP_JUMP_IF_DOUBLE_LESS;
+				case OP_DOUBLE_GREATER: return OP_JUMP_IF_DOUBLE_GREATER;
+				case OP_DOUBLE_EQUAL: return OP_JUMP_IF_DOUBLE_EQUAL;
+				default: return OP_HALT;
+			}
+		}
+
+		//whether op leaves its result in the comparison register OP_RELATIVE_JUMP_IF_TRUE tests
+		static bool setsComparison(OpCodes op)
+		{
+			switch (op)
+			{
+				case OP_LOGICAL_AND:
+				case OP_LOGICAL_OR:
+				case OP_LOGICAL_NOT:
+					return true;
+				default: return fusedBranch(op) != OP_HALT;
+			}
+		}
+
+		static bool isTemporary(const Token& token)
+		{
+			return token.string.size() && token.string[0] == '#';
+		}
+
+		//a comparison whose only use is the jump that follows it, or nullptr
+		static threeAddress* fusableComparison(const std::shared_ptr<assembly>& instruction, const Token* result)
+		{
+			if (instruction->type() != Asm::ThreeAddr) return nullptr;
+			auto compare = (threeAddress*)instruction.get();
+			if (fusedBranch(compare->op) == OP_HALT || !isTemporary(compare->result)) return nullptr;
+			if (result && compare->result.string.compare(result->string) != 0) return nullptr;
+			return compare;
+		}
+
+		static std::shared_ptr<compareJump> makeCompareJump(threeAddress* compare, size_t jumpLabel)
+		{
+			auto jump = std::make_shared<compareJump>();
+			jump->op = fusedBranch(compare->op);
+			jump->A = compare->A;
+			jump->B = compare->B;
+			jump->jumpLabel = jumpLabel;
+			return jump;
+		}
+
+		//appends condition followed by a jump to jumpLabel taken when it is true. a trailing comparison
+		//into a temporary becomes a compare-and-branch, as do both halves of the <= and >= lowering
+		static void appendConditionalJump(std::vector<std::shared_ptr<assembly>>& chunk, std::vector<std::shared_ptr<assembly>>& condition, size_t jumpLabel)
+		{
+			size_t size = condition.size();
+			if (size >= 1)
+			{
+				if (auto compare = fusableComparison(condition[size - 1], nullptr))
+				{
+					chunk.insert(chunk.end(), condition.begin(), condition.end() - 1);
+					chunk.push_back(makeCompareJump(compare, jumpLabel));
+					return;
+				}
+			}
+			if (size >= 3 && condition[size - 1]->type() == Asm::ThreeAddr)
+			{
+				auto or_ = (threeAddress*)condition[size - 1].get();
+				threeAddress* first = nullptr;
+				threeAddress* second = nullptr;
+				if (or_->op == OP_LOGICAL_OR && isTemporary(or_->result))
+				{
+					first = fusableComparison(condition[size - 3], &or_->A);
+					second = fusableComparison(condition[size - 2], &or_->B);
+				}
+				if (first && second)
+				{
+					chunk.insert(chunk.end(), condition.begin(), condition.end() - 3);
+					chunk.push_back(makeCompareJump(first, jumpLabel));
+					chunk.push_back(makeCompareJump(second, jumpLabel));
+					return;
+				}
+			}
+			auto jump = std::make_shared<relativeJump>();
+			jump->op = OP_RELATIVE_JUMP_IF_TRUE;
+			jump->jumpLabel = jumpLabel;
+			chunk.insert(chunk.end(), condition.begin(), condition.end());
+			if (size >= 1)
+			{
+				std::vector<Token*> reads;
+				Token* written = nullptr;
+				condition[size - 1]->operands(reads, written);
+				if (written) jump->condition = *written;
+			}
+			chunk.push_back(jump);
+		}
+
 		static OpCodes typeConversion(Token toConvert, Token resultType)
 		{
 			if (resultType.string.compare("double") == 0)
@@ -73,7 +180,7 @@ namespace ash
 				}
 				else if(signed_int(toConvert) || unsigned_int(toConvert))
 				{
-					return OP_INT_TO_DOUBLE;
+					return OP_INT_TO_FLOAT;
 				}
 			}
 			else if(signed_int(resultType) || unsigned_int(resultType))
@@ -87,13 +194,80 @@ namespace ash
 					return OP_DOUBLE_TO_INT;
 				}
 			}
+			//integers of different widths share one 64-bit representation
+			return OP_MOVE;
+		}
+
+		//operand of a binary expression: variables are renamed by scope, literals are left as they are
+		static Token operand(ExpressionNode* node, std::shared_ptr<ScopeNode> current)
+		{
+			Token primary = ((CallNode*)node)->primary;
+			if (primary.type == TokenType::IDENTIFIER) return renameByScope(primary, current);
+			return primary;
+		}
+
+		//an integer literal assigned to a floating point variable is written as one
+		static Token literalOf(Token literal, Token type)
+		{
+			if (literal.type != TokenType::INT) return literal;
+			if (type.string.compare("double") == 0) literal.type = TokenType::DOUBLE;
+			else if (type.string.compare("float") == 0) literal.type = TokenType::FLOAT;
+			return literal;
+		}
+
+		//registers 253 to 255 hold spilled variables and literals for the one instruction that reads them
+		static const uint8_t scratchRegister = 253;
+		static_assert(ALLOCATABLE_REGISTERS <= 253, "the three highest registers are scratch");
+
+		//the struct holding the globals functions share with the program, and the pointer calls pass it by
+		static const char* const sharedGlobals = "#globals";
+
+		//scopes of a function's blocks, whose variables belong to it
+		static void collectScopes(ParseNode* node, std::unordered_set<size_t>& scopes)
+		{
+			switch (node->nodeType())
+			{
+				case NodeType::Block:
+				{
+					auto block = (BlockNode*)node;
+					if (block->scope) scopes.insert(block->scope->scopeIndex);
+					for (const auto& declaration : block->declarations) collectScopes(declaration.get(), scopes);
+					break;
+				}
+				case NodeType::IfStatement:
+				{
+					auto ifNode = (IfStatementNode*)node;
+					collectScopes(ifNode->thenStatement.get(), scopes);
+					if (ifNode->elseStatement) collectScopes(ifNode->elseStatement.get(), scopes);
+					break;
+				}
+				case NodeType::WhileStatement: collectScopes(((WhileStatementNode*)node)->doStatement.get(), scopes); break;
+				case NodeType::ForStatement: collectScopes(((ForStatementNode*)node)->statement.get(), scopes); break;
+				default: break;
+			}
+		}
+
+		static uint32_t charLiteral(const Token& literal)
+		{
+			//the token keeps its quotes
+			if (literal.string.size() < 3) return 0;
+			if (literal.string[1] != '\\') return (uint8_t)literal.string[1];
+			switch (literal.string[2])
+			{
+				case 'n': return '\n';
+				case 't': return '\t';
+				case 'r': return '\r';
+				case '0': return '\0';
+				default: return (uint8_t)literal.string[2];
+			}
 		}
 	}
-	bool Compiler::compile(const char* source)
+	bool Compiler::compile(const char* source, Chunk* chunk)
 	{
 		Parser parser(source);
 
 		auto ast = parser.parse();
+		if (ast->hadError) return false;
 
 		Semantics analyzer;
 
@@ -115,26 +289,61 @@ namespace ash
 		//}
 
  		pseudochunk result = precompile(ast);
-		
-		std::cout << std::endl;
+		//the program, then every function a call was not inlined into
+		std::vector<pseudochunk*> chunks = { &result };
+		for (auto& function : functionChunks) chunks.push_back(&function);
+		for (auto code : chunks)
+		{
+			replaceScalars(*code);
 
-		for(const auto& instruction : result.code)
+			//identifiers that did not resolve surface here, once every operand is known
+			for (const auto& instruction : code->code)
+			{
+				std::vector<Token*> reads;
+				Token* written = nullptr;
+				instruction->operands(reads, written);
+				for (Token* token : reads)
+				{
+					if (token->type == TokenType::ERROR) error(*token, token->string);
+				}
+			}
+		}
+		if (hadError) return false;
+
+#ifndef DISABLE_OPTIMIZER
+		Optimizer optimizer(optimizeLoops);
+		for (auto code : chunks) *code = optimizer.optimize(*code);
+#endif
+
+		/*for(const auto& instruction : result.code)
 		{
 			instruction->print();
-		}
+		}*/
 
 		/*for (const auto& typeID : typeIDs)
 		{
 			std::cout << typeID.first << ": " << typeID.second << std::endl;
 		}*/
 
-		return false;
+		return assemble(result, chunk);
+	}
+
+	void Compiler::error(const Token& token, std::string message)
+	{
+		std::cerr << token.line << " Error ";
+		if (token.type != TokenType::ERROR) std::cerr << "at " << token.string << ": ";
+		std::cerr << message << std::endl;
+		hadError = true;
 	}
 
 	pseudochunk Compiler::precompile(std::shared_ptr<ProgramNode> ast)
 	{
 		pseudochunk chunk;
 		currentScope = ast->globalScope;
+		functions.clear();
+		functionSizes.clear();
+		called.clear();
+		functionChunks.clear();
 		for (const auto& declaration : ast->declarations)
 		{
 			auto nextCode = compileNode((ParseNode*)declaration.get(), nullptr);
@@ -145,9 +354,926 @@ namespace ash
 		if(chunk.code.size())
 			chunk.code.push_back(halt);
 
+		//compiling a function can call one more, so the list grows as it is walked
+		for (size_t f = 0; f < called.size(); f++) functionChunks.push_back(compileFunction(called[f]));
+		shareGlobals(chunk, ast->globalScope);
+
+		return chunk;
+	}
+
+	void Compiler::shareGlobals(pseudochunk& program, std::shared_ptr<ScopeNode> global)
+	{
+		std::string suffix = "#" + std::to_string(global->scopeIndex);
+		auto isGlobal = [&](const Token& token)
+		{
+			if (token.type != TokenType::IDENTIFIER || util::isTemporary(token)) return false;
+			size_t at = token.string.rfind('#');
+			if (at == std::string::npos || token.string.compare(at, std::string::npos, suffix) != 0) return false;
+			auto symbol = global->symbols.find(token.string.substr(0, at));
+			return symbol != global->symbols.end() && symbol->second.cat == category::Variable;
+		};
+		std::unordered_map<std::string, size_t> fields; //global to its field in the struct
+		std::vector<std::string> shared;
+		for (auto& function : functionChunks)
+		{
+			for (const auto& instruction : function.code)
+			{
+				std::vector<Token*> reads;
+				Token* written = nullptr;
+				instruction->operands(reads, written);
+				if (written) reads.push_back(written);
+				for (Token* token : reads)
+				{
+					if (!isGlobal(*token) || fields.count(token->string)) continue;
+					fields.emplace(token->string, shared.size());
+					shared.push_back(token->string);
+				}
+			}
+		}
+		if (shared.empty()) return;
+
+		//every field is a full register wide, so a global reads back exactly what was written to it
+		auto metadata = std::make_shared<TypeMetadata>();
+		size_t offset = 16;
+		for (const auto& name : shared)
+		{
+			FieldMetadata field{};
+			Token type = util::renameByScope(global->symbols.at(name.substr(0, name.rfind('#'))).type, global);
+			if (typeIDs.count(type.string))
+			{
+				field.type = FieldType::Struct;
+				field.typeID = typeIDs.at(type.string);
+			}
+			else if (util::isArray(type)) field.type = FieldType::Array;
+			else
+			{
+				field.type = FieldType::Long;
+				field.typeID = -3;
+			}
+			field.offset = offset;
+			offset += 8;
+			metadata->fields.push_back(field);
+		}
+		typeIDs.emplace(util::sharedGlobals, types.size());
+		types.push_back(metadata);
+
+		Token pointer = { TokenType::IDENTIFIER, util::sharedGlobals, 0 };
+		auto rewrite = [&](pseudochunk& chunk)
+		{
+			std::vector<std::shared_ptr<assembly>> code;
+			for (const auto& instruction : chunk.code)
+			{
+				if (instruction->type() == Asm::Call) ((call*)instruction.get())->arguments.push_back(pointer);
+				std::vector<Token*> reads;
+				Token* written = nullptr;
+				instruction->operands(reads, written);
+				std::unordered_map<std::string, Token> loaded;
+				for (Token* token : reads)
+				{
+					if (!fields.count(token->string)) continue;
+					auto found = loaded.find(token->string);
+					if (found == loaded.end())
+					{
+						auto load = std::make_shared<threeAddress>();
+						load->op = OP_LOAD_OFFSET;
+						load->A = { TokenType::IDENTIFIER, "#" + std::to_string(temporaries++), token->line };
+						load->B = pointer;
+						load->result = { TokenType::INT, std::to_string(fields.at(token->string)), token->line };
+						code.push_back(load);
+						found = loaded.emplace(token->string, load->A).first;
+					}
+					*token = found->second;
+				}
+				code.push_back(instruction);
+				if (written && fields.count(written->string))
+				{
+					auto store = std::make_shared<threeAddress>();
+					store->op = OP_STORE_OFFSET;
+					store->B = pointer;
+					store->result = { TokenType::INT, std::to_string(fields.at(written->string)), written->line };
+					*written = { TokenType::IDENTIFIER, "#" + std::to_string(temporaries++), written->line };
+					store->A = *written;
+					code.push_back(store);
+				}
+			}
+			chunk.code.swap(code);
+		};
+		rewrite(program);
+		for (auto& function : functionChunks)
+		{
+			rewrite(function);
+			function.parameters.push_back({ { TokenType::IDENTIFIER, util::sharedGlobals, 0 }, pointer });
+		}
+
+		//the program allocates the struct first, and copies the globals back out where it halts so they stay its result
+		auto alloc = std::make_shared<twoAddress>();
+		alloc->op = OP_ALLOC;
+		alloc->A = { TokenType::IDENTIFIER, util::sharedGlobals, 0 };
+		alloc->result = pointer;
+		program.code.insert(program.code.begin(), alloc);
+		std::vector<std::shared_ptr<assembly>> results;
+		for (const auto& name : shared)
+		{
+			auto load = std::make_shared<threeAddress>();
+			load->op = OP_LOAD_OFFSET;
+			load->A = { TokenType::IDENTIFIER, name, 0 };
+			load->B = pointer;
+			load->result = { TokenType::INT, std::to_string(fields.at(name)), 0 };
+			results.push_back(load);
+		}
+		program.code.insert(program.code.end() - 1, results.begin(), results.end());
+	}
+
+	pseudochunk Compiler::compileFunction(const std::string& name)
+	{
+		auto function = functions.at(name);
+		pseudochunk chunk;
+		chunk.function = name;
+		for (const auto& parameter : function->parameters)
+		{
+			chunk.parameters.push_back({ util::renameByScope(parameter.type, function->body->scope), util::renameByScope(parameter.identifier, function->body->scope) });
+		}
+		auto hold = currentScope;
+		inlining.push_back({ name, {}, SIZE_MAX });
+		chunk.code = compileNode(function->body.get(), nullptr);
+		inlining.pop_back();
+		currentScope = hold;
+		//a void function can run off the end of its body
+		auto ret = std::make_shared<pseudocode>();
+		ret->op = OP_RET;
+		chunk.code.push_back(ret);
+		return chunk;
+	}
+
+	std::vector<std::shared_ptr<assembly>> Compiler::compileCall(FunctionCallNode* callNode, Token* result)
+	{
+		std::vector<std::shared_ptr<assembly>> chunk;
+		int line = callNode->line();
+		Token name = util::renameByScope({ TokenType::IDENTIFIER, callNode->resolveName(), line }, currentScope);
+		if (name.type == TokenType::ERROR || !functions.count(name.string))
+		{
+			error({ TokenType::IDENTIFIER, callNode->resolveName(), line }, "function not found!");
+			return chunk;
+		}
+		auto function = functions.at(name.string);
+		if (callNode->arguments.size() != function->parameters.size())
+		{
+			error(name, "wrong number of arguments!");
+			return chunk;
+		}
+		auto temporary = [&]()
+		{
+			return Token{ TokenType::IDENTIFIER, "#" + std::to_string(temporaries++), line };
+		};
+
+		//arguments that are not a variable or a literal are computed into temporaries first
+		std::vector<Token> arguments;
+		for (size_t i = 0; i < callNode->arguments.size(); i++)
+		{
+			auto argument = callNode->arguments[i].get();
+			if (argument->expressionType() == ExpressionNode::ExpressionType::Primary)
+			{
+				arguments.push_back(util::literalOf(util::operand(argument, currentScope), function->parameters[i].type));
+				continue;
+			}
+			Token value = temporary();
+			auto code = compileNode(argument, &value);
+			chunk.insert(chunk.end(), code.begin(), code.end());
+			arguments.push_back(value);
+		}
+		bool returns = function->type.string.compare("void") != 0;
+		Token value = returns ? temporary() : Token{};
+
+		bool recursive = false;
+		for (const auto& body : inlining) recursive = recursive || body.function.compare(name.string) == 0;
+		bool inlined = inlineCalls && !recursive && inlining.size() < INLINE_MAX_DEPTH;
+		if (inlined && !functionSizes.count(name.string))
+		{
+			//measured by compiling the body once; calls it would make out of line are not kept
+			size_t calledBefore = called.size();
+			auto hold = currentScope;
+			inlining.push_back({ name.string, value, jumpLabels++ });
+			auto body = compileNode(function->body.get(), nullptr);
+			inlining.pop_back();
+			currentScope = hold;
+			called.resize(calledBefore);
+			size_t size = 0;
+			for (const auto& instruction : body) size += instruction->type() != Asm::Label;
+			functionSizes[name.string] = size;
+		}
+		inlined = inlined && functionSizes.at(name.string) <= INLINE_MAX_INSTRUCTIONS;
+
+		if (inlined)
+		{
+			std::vector<std::shared_ptr<assembly>> body;
+			auto scope = function->body->scope;
+			for (size_t i = 0; i < arguments.size(); i++)
+			{
+				auto move = std::make_shared<twoAddress>();
+				move->op = arguments[i].type == TokenType::IDENTIFIER || arguments[i].type == TokenType::ERROR ? OP_MOVE : OP_CONST_LOW;
+				move->A = arguments[i];
+				move->result = util::renameByScope(function->parameters[i].identifier, scope);
+				body.push_back(move);
+			}
+			auto exit = std::make_shared<label>();
+			exit->label = jumpLabels++;
+			auto hold = currentScope;
+			inlining.push_back({ name.string, value, exit->label });
+			auto code = compileNode(function->body.get(), nullptr);
+			inlining.pop_back();
+			currentScope = hold;
+			body.insert(body.end(), code.begin(), code.end());
+			body.push_back(exit);
+
+			//the function's own variables die with the call, so they become temporaries of the caller
+			std::unordered_set<size_t> scopes;
+			util::collectScopes(function->body.get(), scopes);
+			for (const auto& instruction : body)
+			{
+				std::vector<Token*> uses;
+				Token* def = nullptr;
+				instruction->operands(uses, def);
+				if (def) uses.push_back(def);
+				for (Token* token : uses)
+				{
+					size_t at = token->string.rfind('#');
+					if (util::isTemporary(*token) || at == std::string::npos) continue;
+					if (scopes.count(std::strtoull(token->string.c_str() + at + 1, nullptr, 10))) token->string.insert(0, "#");
+				}
+			}
+			chunk.insert(chunk.end(), body.begin(), body.end());
+		}
+		else
+		{
+			if (std::find(called.begin(), called.end(), name.string) == called.end()) called.push_back(name.string);
+			auto site = std::make_shared<call>();
+			site->op = OP_CALL;
+			site->function = name;
+			site->arguments = arguments;
+			site->result = value;
+			chunk.push_back(site);
+		}
+
+		//the value ends up where the caller asked, by a copy consumers of the last instruction can read
+		if (returns)
+		{
+			auto move = std::make_shared<twoAddress>();
+			move->op = OP_MOVE;
+			move->A = value;
+			move->result = result ? *result : temporary();
+			chunk.push_back(move);
+		}
 		return chunk;
 	}
 
+	Token Compiler::compileOperand(ExpressionNode* node, std::vector<std::shared_ptr<assembly>>& chunk)
+	{
+		if (node->expressionType() == ExpressionNode::ExpressionType::Primary) return util::operand(node, currentScope);
+		Token value = { TokenType::IDENTIFIER, "#" + std::to_string(temporaries++), node->line() };
+		auto code = compileNode(node, &value);
+		chunk.insert(chunk.end(), code.begin(), code.end());
+		return value;
+	}
+
+	void Compiler::replaceScalars(pseudochunk& chunk)
+	{
+		//a struct escapes once its pointer is used for anything but loading and storing its own
+		//fields: stored elsewhere, moved, compared, printed, passed to a function, or overwritten by something other than OP_ALLOC
+		std::unordered_map<std::string, size_t> candidates; //variable to the type it allocates
+		std::unordered_set<std::string> escaped;
+		std::unordered_set<std::string> loaded; //fields read somewhere, which an allocation has to zero
+		auto escape = [&](const Token& token) { escaped.insert(token.string); };
+		for (const auto& instruction : chunk.code)
+		{
+			switch (instruction->type())
+			{
+				case Asm::OneAddr:
+				{
+					escape(((oneAddress*)instruction.get())->A);
+					break;
+				}
+				case Asm::TwoAddr:
+				{
+					auto twoAddr = (twoAddress*)instruction.get();
+					if (twoAddr->op == OP_ALLOC && typeIDs.count(twoAddr->A.string))
+					{
+						candidates[twoAddr->result.string] = typeIDs.at(twoAddr->A.string);
+						break;
+					}
+					escape(twoAddr->A);
+					escape(twoAddr->result);
+					break;
+				}
+				case Asm::ThreeAddr:
+				{
+					auto threeAddr = (threeAddress*)instruction.get();
+					if (threeAddr->op == OP_STORE_OFFSET)
+					{
+						escape(threeAddr->A);
+						break;
+					}
+					if (threeAddr->op == OP_LOAD_OFFSET)
+					{
+						escape(threeAddr->A);
+						loaded.insert(threeAddr->B.string + "." + threeAddr->result.string);
+						break;
+					}
+					escape(threeAddr->A);
+					escape(threeAddr->B);
+					escape(threeAddr->result);
+					break;
+				}
+				case Asm::CompareJump:
+				{
+					escape(((compareJump*)instruction.get())->A);
+					escape(((compareJump*)instruction.get())->B);
+					break;
+				}
+				case Asm::Call:
+				{
+					for (const auto& argument : ((call*)instruction.get())->arguments) escape(argument);
+					escape(((call*)instruction.get())->result);
+					break;
+				}
+				default: break;
+			}
+		}
+		for (const auto& name : escaped) candidates.erase(name);
+		if (candidates.empty()) return;
+
+		//each field of a struct that stays local becomes a variable of its own, named after the field's index
+		auto field = [](const Token& object, const Token& index)
+		{
+			return Token{ TokenType::IDENTIFIER, object.string + "." + index.string, object.line };
+		};
+		std::vector<std::shared_ptr<assembly>> code;
+		code.reserve(chunk.code.size());
+		for (const auto& instruction : chunk.code)
+		{
+			if (instruction->type() == Asm::TwoAddr)
+			{
+				auto alloc = (twoAddress*)instruction.get();
+				if (alloc->op == OP_ALLOC && candidates.count(alloc->result.string))
+				{
+					size_t fields = types[candidates.at(alloc->result.string)]->fields.size();
+					for (size_t i = 0; i < fields; i++)
+					{
+						Token fieldToken = field(alloc->result, { TokenType::INT, std::to_string(i), alloc->result.line });
+						if (!loaded.count(fieldToken.string)) continue;
+						auto zero = std::make_shared<twoAddress>();
+						zero->op = OP_CONST_LOW;
+						zero->A = { TokenType::INT, "0", alloc->result.line };
+						zero->result = fieldToken;
+						code.push_back(zero);
+					}
+					continue;
+				}
+			}
+			else if (instruction->type() == Asm::ThreeAddr)
+			{
+				auto access = (threeAddress*)instruction.get();
+				if ((access->op == OP_STORE_OFFSET || access->op == OP_LOAD_OFFSET) && candidates.count(access->B.string))
+				{
+					auto move = std::make_shared<twoAddress>();
+					move->op = OP_MOVE;
+					if (access->op == OP_STORE_OFFSET)
+					{
+						move->A = access->A;
+						move->result = field(access->B, access->result);
+					}
+					else
+					{
+						move->A = field(access->B, access->result);
+						move->result = access->A;
+					}
+					code.push_back(move);
+					continue;
+				}
+			}
+			code.push_back(instruction);
+		}
+		chunk.code.swap(code);
+	}
+
+	bool Compiler::assemble(pseudochunk& chunk, Chunk* out)
+	{
+		currentChunk = out;
+		entries.clear();
+		calls.clear();
+		bool assembled = assembleChunk(chunk);
+		for (auto& function : functionChunks)
+		{
+			entries[function.function] = currentChunk->size();
+			assembled = assembleChunk(function) && assembled;
+		}
+		for (const auto& site : calls)
+		{
+			currentChunk->PatchJump(site.first, (int32_t)(entries.at(site.second) - site.first));
+		}
+		return assembled;
+	}
+
+	bool Compiler::assembleChunk(pseudochunk& chunk)
+	{
+		using util::scratchRegister;
+
+		//number every variable, and record the ones each instruction reads and writes
+		size_t count = chunk.code.size();
+		std::unordered_map<std::string, size_t> ids;
+		std::vector<std::string> names;
+		std::vector<std::vector<size_t>> uses(count);
+		std::vector<int64_t> defs(count, -1);
+		std::unordered_map<size_t, size_t> labels; //label to the instruction it marks
+		auto variable = [&](const Token& token) -> size_t
+		{
+			auto found = ids.find(token.string);
+			if (found != ids.end()) return found->second;
+			ids.emplace(token.string, names.size());
+			names.push_back(token.string);
+			return names.size() - 1;
+		};
+		for (size_t i = 0; i < count; i++)
+		{
+			auto instruction = chunk.code[i].get();
+			if (instruction->type() == Asm::Label) labels[((label*)instruction)->label] = i;
+			std::vector<Token*> reads;
+			Token* written = nullptr;
+			instruction->operands(reads, written);
+			for (Token* token : reads) uses[i].push_back(variable(*token));
+			if (written) defs[i] = variable(*written);
+		}
+		//the program's variables are its result, so they stay live up to where it halts
+		for (size_t i = 0; i < count; i++)
+		{
+			auto instruction = chunk.code[i].get();
+			if (instruction->type() != Asm::pseudocode || ((pseudocode*)instruction)->op != OP_HALT) continue;
+			for (size_t v = 0; v < names.size(); v++)
+			{
+				//SSA versions (name%n) were copied back to their variable ahead of the halt
+				if (!util::isTemporary({ TokenType::IDENTIFIER, names[v], 0 }) && names[v].find('%') == std::string::npos) uses[i].push_back(v);
+			}
+		}
+
+		auto successors = [&](size_t i, size_t* next)
+		{
+			size_t found = 0;
+			auto instruction = chunk.code[i].get();
+			if (instruction->type() == Asm::pseudocode && ((pseudocode*)instruction)->op == OP_HALT) return found;
+			if ((instruction->type() == Asm::pseudocode || instruction->type() == Asm::OneAddr) && ((pseudocode*)instruction)->op == OP_RET) return found;
+			if (instruction->type() == Asm::Jump || instruction->type() == Asm::CompareJump)
+			{
+				auto jump = (relativeJump*)instruction;
+				next[found++] = labels.at(jump->jumpLabel);
+				if (jump->op == OP_RELATIVE_JUMP) return found;
+			}
+			if (i + 1 < count) next[found++] = i + 1;
+			return found;
+		};
+
+		//backward liveness, one bit per variable
+		size_t words = (names.size() + 63) / 64;
+		std::vector<uint64_t> liveIn(count * words, 0);
+		std::vector<uint64_t> live(words);
+		bool changed = true;
+		while (changed)
+		{
+			changed = false;
+			for (size_t i = count; i-- > 0;)
+			{
+				std::fill(live.begin(), live.end(), 0);
+				size_t next[2];
+				size_t successorCount = successors(i, next);
+				for (size_t s = 0; s < successorCount; s++)
+				{
+					for (size_t w = 0; w < words; w++) live[w] |= liveIn[next[s] * words + w];
+				}
+				if (defs[i] >= 0) live[defs[i] / 64] &= ~(1ull << (defs[i] % 64));
+				for (size_t v : uses[i]) live[v / 64] |= 1ull << (v % 64);
+				for (size_t w = 0; w < words; w++)
+				{
+					if (liveIn[i * words + w] == live[w]) continue;
+					liveIn[i * words + w] = live[w];
+					changed = true;
+				}
+			}
+		}
+
+		//a variable's interval runs from the first to the last instruction it is live at, defined or used by
+		std::vector<size_t> start(names.size(), SIZE_MAX);
+		std::vector<size_t> end(names.size(), 0);
+		auto extend = [&](size_t v, size_t i)
+		{
+			start[v] = std::min(start[v], i);
+			end[v] = std::max(end[v], i);
+		};
+		for (size_t i = 0; i < count; i++)
+		{
+			for (size_t w = 0; w < words; w++)
+			{
+				uint64_t bits = liveIn[i * words + w];
+				for (size_t b = 0; bits != 0; b++, bits >>= 1)
+				{
+					if (bits & 1) extend(w * 64 + b, i);
+				}
+			}
+			for (size_t v : uses[i]) extend(v, i);
+			if (defs[i] >= 0) extend(defs[i], i);
+		}
+
+		//a function's parameters arrive in the first registers of its window and stay there; whatever is live on
+		//entry is one of them, under its own name or, after the optimizer, an SSA version of it
+		std::vector<int> location(names.size(), -1);
+		std::vector<int64_t> parameterType(names.size(), -1);
+		if (chunk.parameters.size() > ALLOCATABLE_REGISTERS)
+		{
+			error({ TokenType::ERROR, "", 0 }, "too many parameters!");
+			return false;
+		}
+		for (size_t v = 0; v < names.size() && count; v++)
+		{
+			if (!(liveIn[v / 64] >> (v % 64) & 1)) continue;
+			std::string name = names[v].substr(0, names[v].find('%'));
+			for (size_t p = 0; p < chunk.parameters.size(); p++)
+			{
+				if (chunk.parameters[p].identifier.string.compare(name) != 0) continue;
+				location[v] = (int)p;
+				if (typeIDs.count(chunk.parameters[p].type.string)) parameterType[v] = typeIDs.at(chunk.parameters[p].type.string);
+			}
+		}
+
+		//linear scan: when no register is free, whichever of the active intervals and the new one ends last is spilled
+		std::vector<size_t> order;
+		for (size_t v = 0; v < names.size(); v++)
+		{
+			if (start[v] != SIZE_MAX && location[v] < 0) order.push_back(v);
+		}
+		std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return start[a] < start[b]; });
+		std::vector<int> slot(names.size(), -1);
+		std::vector<size_t> active; //by increasing end
+		std::vector<uint8_t> freeRegisters;
+		for (int r = ALLOCATABLE_REGISTERS - 1; r >= (int)chunk.parameters.size(); r--) freeRegisters.push_back(r);
+		size_t slots = 0;
+		auto byEnd = [&](size_t a, size_t b) { return end[a] < end[b]; };
+		for (size_t v : order)
+		{
+			size_t kept = 0;
+			for (size_t a : active)
+			{
+				if (end[a] < start[v]) freeRegisters.push_back(location[a]);
+				else active[kept++] = a;
+			}
+			active.resize(kept);
+			if (freeRegisters.empty())
+			{
+				size_t furthest = active.back();
+				if (end[furthest] <= end[v])
+				{
+					slot[v] = slots++;
+					continue;
+				}
+				location[v] = location[furthest];
+				location[furthest] = -1;
+				slot[furthest] = slots++;
+				active.pop_back();
+			}
+			else
+			{
+				location[v] = freeRegisters.back();
+				freeRegisters.pop_back();
+			}
+			active.insert(std::upper_bound(active.begin(), active.end(), v, byEnd), v);
+		}
+		if (slots > UINT16_MAX)
+		{
+			error({ TokenType::ERROR, "", 0 }, "too many variables to spill!");
+			return false;
+		}
+
+		//the struct type of every variable that holds a pointer, which the collector needs to know;
+		//arrays get a type past the last struct
+		auto idOf = [&](const Token& token) -> int64_t
+		{
+			if (token.type != TokenType::IDENTIFIER) return -1;
+			return ids.at(token.string);
+		};
+		const int64_t arrayType = (int64_t)types.size();
+		std::vector<int64_t> typeOf = parameterType;
+		bool grew = true;
+		while (grew)
+		{
+			grew = false;
+			for (size_t i = 0; i < count; i++)
+			{
+				if (defs[i] < 0 || typeOf[defs[i]] >= 0) continue;
+				int64_t type = -1;
+				if (chunk.code[i]->type() == Asm::TwoAddr)
+				{
+					auto twoAddr = (twoAddress*)chunk.code[i].get();
+					if (twoAddr->op == OP_ALLOC && typeIDs.count(twoAddr->A.string)) type = typeIDs.at(twoAddr->A.string);
+					else if ((twoAddr->op == OP_MOVE || twoAddr->op == OP_CONST_LOW) && idOf(twoAddr->A) >= 0) type = typeOf[idOf(twoAddr->A)];
+				}
+				else if (chunk.code[i]->type() == Asm::ThreeAddr)
+				{
+					auto load = (threeAddress*)chunk.code[i].get();
+					if (load->op == OP_ALLOC_ARRAY) type = arrayType;
+					else if (load->op == OP_LOAD_OFFSET && idOf(load->B) >= 0 && typeOf[idOf(load->B)] >= 0 && typeOf[idOf(load->B)] < arrayType)
+					{
+						auto& fields = types[typeOf[idOf(load->B)]]->fields;
+						size_t index = std::stoul(load->result.string);
+						if (index < fields.size() && fields[index].type == FieldType::Struct) type = fields[index].typeID;
+						else if (index < fields.size() && fields[index].type == FieldType::Array) type = arrayType;
+					}
+				}
+				else if (chunk.code[i]->type() == Asm::Call)
+				{
+					//whatever the callee returns keeps the type it was declared with
+					auto function = functions.find(((call*)chunk.code[i].get())->function.string);
+					if (function == functions.end()) continue;
+					std::string returned = util::renameByScope(function->second->type, function->second->body->scope).string;
+					if (typeIDs.count(returned)) type = typeIDs.at(returned);
+				}
+				if (type < 0) continue;
+				typeOf[defs[i]] = type;
+				grew = true;
+			}
+		}
+
+		Chunk* out = currentChunk;
+		//spill slots are pushed up front, so slot n is stack[n]
+		if (slots)
+		{
+			std::vector<bool> pointerSlot(slots, false);
+			for (size_t v = 0; v < names.size(); v++)
+			{
+				if (slot[v] >= 0 && typeOf[v] >= 0) pointerSlot[slot[v]] = true;
+			}
+			out->WriteU16(scratchRegister, 0);
+			for (size_t s = 0; s < slots; s++) out->WriteA(pointerSlot[s] ? OP_PUSH_POINTER : OP_PUSH, scratchRegister, 0);
+		}
+
+		auto literal = [&](const Token& token, uint8_t r)
+		{
+			switch (token.type)
+			{
+				case TokenType::INT: out->WriteU64(r, std::strtoull(token.string.c_str(), nullptr, 10)); break;
+				case TokenType::FLOAT: out->WriteFloat(r, std::strtof(token.string.c_str(), nullptr)); break;
+				case TokenType::DOUBLE: out->WriteDouble(r, std::strtod(token.string.c_str(), nullptr)); break;
+				case TokenType::TRUE: out->WriteU16(r, 1); break;
+				case TokenType::FALSE: out->WriteU16(r, 0); break;
+				case TokenType::CHAR: out->WriteU32(r, util::charLiteral(token)); break;
+				default: error(token, "literal not supported by the compiler yet!"); break;
+			}
+		};
+		//the register an operand can be read from, loading spilled variables and literals into scratch
+		auto read = [&](const Token& token, uint8_t scratch) -> uint8_t
+		{
+			int64_t v = idOf(token);
+			if (v < 0)
+			{
+				literal(token, scratch);
+				return scratch;
+			}
+			if (location[v] >= 0) return location[v];
+			out->WriteStackSlot(OP_STACK_LOAD, scratch, slot[v], token.line);
+			return scratch;
+		};
+		auto target = [&](const Token& token) -> uint8_t
+		{
+			int64_t v = idOf(token);
+			return location[v] >= 0 ? location[v] : scratchRegister + 2;
+		};
+		auto writeBack = [&](const Token& token, uint8_t r)
+		{
+			int64_t v = idOf(token);
+			if (location[v] < 0) out->WriteStackSlot(OP_STACK_STORE, r, slot[v], token.line);
+		};
+		auto fieldIndex = [&](const Token& index, uint8_t scratch) -> uint8_t
+		{
+			out->WriteU64(scratch, std::strtoull(index.string.c_str(), nullptr, 10));
+			return scratch;
+		};
+		//an allocation may collect: every pointer still needed afterwards is a root
+		auto writeRoots = [&](size_t i)
+		{
+			std::bitset<256> pointers;
+			for (size_t v = 0; v < names.size(); v++)
+			{
+				if (typeOf[v] >= 0 && location[v] >= 0 && (liveIn[i * words + v / 64] >> (v % 64) & 1)) pointers.set(location[v]);
+			}
+			out->WriteRegisterMap(pointers);
+		};
+
+		std::unordered_map<size_t, size_t> positions; //label to where it landed in the chunk
+		std::vector<std::pair<size_t, size_t>> jumps; //jump offset in the chunk, label it targets
+		int64_t flag = -1; //variable the comparison register was last set from, while it still holds it
+		for (size_t i = 0; i < count; i++)
+		{
+			auto instruction = chunk.code[i].get();
+			if (defs[i] >= 0)
+			{
+				bool sets = false;
+				if (instruction->type() == Asm::TwoAddr || instruction->type() == Asm::ThreeAddr) sets = util::setsComparison(((pseudocode*)instruction)->op);
+				if (sets) flag = defs[i];
+				else if (flag == defs[i]) flag = -1;
+			}
+			switch (instruction->type())
+			{
+				case Asm::Label:
+				{
+					positions[((label*)instruction)->label] = out->size();
+					flag = -1;
+					break;
+				}
+				case Asm::pseudocode:
+				{
+					//a collection can follow the run, and finds the program's pointers by the map at its halt
+					if (((pseudocode*)instruction)->op == OP_HALT) writeRoots(i);
+					out->WriteOp(((pseudocode*)instruction)->op);
+					break;
+				}
+				case Asm::Jump:
+				{
+					auto jump = (relativeJump*)instruction;
+					//a plain value, or one whose comparison was moved or folded away, sets the flag by or'ing it with itself
+					if (!jump->condition.string.empty() && (idOf(jump->condition) < 0 || idOf(jump->condition) != flag))
+					{
+						uint8_t A = read(jump->condition, scratchRegister);
+						out->WriteABC(OP_LOGICAL_OR, A, A, scratchRegister + 2, jump->condition.line);
+					}
+					flag = -1;
+					jumps.emplace_back(out->size(), jump->jumpLabel);
+					out->WriteRelativeJump(jump->op, 0, 0);
+					break;
+				}
+				case Asm::CompareJump:
+				{
+					auto jump = (compareJump*)instruction;
+					uint8_t A = read(jump->A, scratchRegister);
+					uint8_t B = read(jump->B, scratchRegister + 1);
+					jumps.emplace_back(out->size(), jump->jumpLabel);
+					out->WriteCompareJump(jump->op, A, B, 0, jump->A.line);
+					break;
+				}
+				case Asm::OneAddr:
+				{
+					auto oneAddr = (oneAddress*)instruction;
+					out->WriteA(oneAddr->op, read(oneAddr->A, scratchRegister), oneAddr->A.line);
+					break;
+				}
+				case Asm::Call:
+				{
+					auto site = (call*)instruction;
+					int line = site->function.line;
+					//the callee's window starts above every register the caller still needs after it returns
+					int top = -1;
+					for (size_t v = 0; v < names.size(); v++)
+					{
+						if (location[v] < 0 || (int64_t)v == defs[i]) continue;
+						if (i + 1 < count && (liveIn[(i + 1) * words + v / 64] >> (v % 64) & 1)) top = std::max(top, location[v]);
+					}
+					for (const auto& argument : site->arguments)
+					{
+						if (idOf(argument) >= 0) top = std::max(top, location[idOf(argument)]);
+					}
+					size_t base = top + 1;
+					if (base + site->arguments.size() > scratchRegister)
+					{
+						error(site->function, "too many registers live across the call!");
+						break;
+					}
+					for (size_t a = 0; a < site->arguments.size(); a++)
+					{
+						const Token& argument = site->arguments[a];
+						uint8_t to = (uint8_t)(base + a);
+						int64_t v = idOf(argument);
+						if (v < 0) literal(argument, to);
+						else if (location[v] < 0) out->WriteStackSlot(OP_STACK_LOAD, to, slot[v], line);
+						else if (location[v] != to) out->WriteAB(OP_MOVE, location[v], to, line);
+					}
+					//the callee can collect, and the collector finds this window's pointers by the map ahead of the call
+					writeRoots(i);
+					calls.emplace_back(out->size(), site->function.string);
+					out->WriteCompareJump(OP_CALL, (uint8_t)base, 0, 0, line);
+					if (!site->result.string.empty())
+					{
+						int64_t v = idOf(site->result);
+						if (location[v] < 0) out->WriteStackSlot(OP_STACK_STORE, (uint8_t)base, slot[v], line);
+						else if (location[v] != (int)base) out->WriteAB(OP_MOVE, (uint8_t)base, location[v], line);
+					}
+					flag = -1;
+					break;
+				}
+				case Asm::TwoAddr:
+				{
+					auto twoAddr = (twoAddress*)instruction;
+					int line = twoAddr->result.line;
+					if (twoAddr->op == OP_ALLOC)
+					{
+						if (!typeIDs.count(twoAddr->A.string))
+						{
+							error(twoAddr->A, "type not found!");
+							break;
+						}
+						out->WriteU64(scratchRegister, typeIDs.at(twoAddr->A.string));
+						writeRoots(i);
+						uint8_t result = target(twoAddr->result);
+						out->WriteAB(OP_ALLOC, scratchRegister, result, line);
+						writeBack(twoAddr->result, result);
+						break;
+					}
+					bool move = twoAddr->op == OP_MOVE || twoAddr->op == OP_CONST_LOW;
+					if (move && idOf(twoAddr->A) < 0)
+					{
+						uint8_t result = target(twoAddr->result);
+						literal(twoAddr->A, result);
+						writeBack(twoAddr->result, result);
+						break;
+					}
+					if (move)
+					{
+						int64_t from = idOf(twoAddr->A);
+						int64_t to = idOf(twoAddr->result);
+						//moves into or out of a stack slot need no register to register copy
+						if (location[to] < 0) out->WriteStackSlot(OP_STACK_STORE, read(twoAddr->A, scratchRegister), slot[to], line);
+						else if (location[from] < 0) out->WriteStackSlot(OP_STACK_LOAD, location[to], slot[from], line);
+						else if (location[from] != location[to]) out->WriteAB(OP_MOVE, location[from], location[to], line);
+						break;
+					}
+					uint8_t A = read(twoAddr->A, scratchRegister);
+					uint8_t result = target(twoAddr->result);
+					out->WriteAB(twoAddr->op, A, result, line);
+					writeBack(twoAddr->result, result);
+					break;
+				}
+				case Asm::ThreeAddr:
+				{
+					auto threeAddr = (threeAddress*)instruction;
+					if (threeAddr->op == OP_STORE_OFFSET)
+					{
+						uint8_t A = read(threeAddr->A, scratchRegister);
+						uint8_t B = read(threeAddr->B, scratchRegister + 1);
+						uint8_t C = fieldIndex(threeAddr->result, scratchRegister + 2);
+						out->WriteABC(OP_STORE_OFFSET, A, B, C, threeAddr->B.line);
+					}
+					else if (threeAddr->op == OP_LOAD_OFFSET)
+					{
+						uint8_t B = read(threeAddr->B, scratchRegister);
+						uint8_t C = fieldIndex(threeAddr->result, scratchRegister + 1);
+						uint8_t A = target(threeAddr->A);
+						out->WriteABC(OP_LOAD_OFFSET, A, B, C, threeAddr->B.line);
+						writeBack(threeAddr->A, A);
+					}
+					else if (threeAddr->op == OP_ARRAY_LOAD || threeAddr->op == OP_ARRAY_LOAD_UNCHECKED)
+					{
+						uint8_t B = read(threeAddr->B, scratchRegister);
+						uint8_t C = read(threeAddr->result, scratchRegister + 1);
+						uint8_t A = target(threeAddr->A);
+						out->WriteABC(threeAddr->op, A, B, C, threeAddr->B.line);
+						writeBack(threeAddr->A, A);
+					}
+					else if (threeAddr->op == OP_ARRAY_PUSH)
+					{
+						//growing the array can collect
+						uint8_t A = read(threeAddr->A, scratchRegister);
+						uint8_t B = read(threeAddr->B, scratchRegister + 1);
+						writeRoots(i);
+						out->WriteAB(OP_ARRAY_PUSH, A, B, threeAddr->B.line);
+					}
+					else if (threeAddr->op == OP_ARRAY_STORE || threeAddr->op == OP_ARRAY_STORE_UNCHECKED || threeAddr->op == OP_ARRAY_CHECK)
+					{
+						uint8_t A = read(threeAddr->A, scratchRegister);
+						uint8_t B = read(threeAddr->B, scratchRegister + 1);
+						uint8_t C = read(threeAddr->result, scratchRegister + 2);
+						out->WriteABC(threeAddr->op, A, B, C, threeAddr->B.line);
+					}
+					else
+					{
+						uint8_t A = read(threeAddr->A, scratchRegister);
+						uint8_t B = read(threeAddr->B, scratchRegister + 1);
+						uint8_t C = target(threeAddr->result);
+						if (threeAddr->op == OP_ALLOC_ARRAY) writeRoots(i);
+						out->WriteABC(threeAddr->op, A, B, C, threeAddr->result.line);
+						writeBack(threeAddr->result, C);
+					}
+					break;
+				}
+				default: break;
+			}
+		}
+		for (const auto& jump : jumps)
+		{
+			out->PatchJump(jump.first, (int32_t)(positions.at(jump.second) - jump.first));
+		}
+
+		if (chunk.function.empty())
+		{
+			registers.clear();
+			for (size_t v = 0; v < names.size(); v++) registers[names[v]] = location[v];
+		}
+		out->types = types;
+		return !hadError;
+	}
+
 	std::vector<std::shared_ptr<assembly>> Compiler::compileNode(ParseNode* node, Token* result)
 	{
 		switch (node->nodeType())
@@ -158,9 +1284,6 @@ namespace ash
 				elseLabel->label = jumpLabels++;
 				std::shared_ptr<label> exitLabel = std::make_shared<label>();
 				exitLabel->label = jumpLabels++;
-				std::shared_ptr<relativeJump> thenJump = std::make_shared<relativeJump>();
-				thenJump->op = OP_RELATIVE_JUMP_IF_TRUE;
-				thenJump->jumpLabel = elseLabel->label;
 				std::shared_ptr<relativeJump> exitJump = std::make_shared<relativeJump>();
 				exitJump->op = OP_RELATIVE_JUMP;
 				exitJump->jumpLabel = exitLabel->label;
@@ -168,10 +1291,12 @@ namespace ash
 				std::vector<std::shared_ptr<assembly>> ifChunk;
 
 				auto conditionChunk = compileNode((ParseNode*)ifNode->condition.get(), nullptr);
-				ifChunk.insert(ifChunk.end(), conditionChunk.begin(), conditionChunk.end());
-				ifChunk.push_back(thenJump);
-				auto elseChunk = compileNode((ParseNode*)ifNode->elseStatement.get(), nullptr);
-				ifChunk.insert(ifChunk.end(), elseChunk.begin(), elseChunk.end());
+				util::appendConditionalJump(ifChunk, conditionChunk, elseLabel->label);
+				if (ifNode->elseStatement)
+				{
+					auto elseChunk = compileNode((ParseNode*)ifNode->elseStatement.get(), nullptr);
+					ifChunk.insert(ifChunk.end(), elseChunk.begin(), elseChunk.end());
+				}
 				ifChunk.push_back(exitJump);
 				ifChunk.push_back(elseLabel);
 				auto thenChunk = compileNode((ParseNode*)ifNode->thenStatement.get(), nullptr);
@@ -307,16 +1432,12 @@ namespace ash
 				std::shared_ptr<relativeJump> loopJump = std::make_shared<relativeJump>();
 				loopJump->op = OP_RELATIVE_JUMP;
 				loopJump->jumpLabel = loopLabel->label;
-				std::shared_ptr<relativeJump> conditionJump = std::make_shared<relativeJump>();
-				conditionJump->op = OP_RELATIVE_JUMP_IF_TRUE;
-				conditionJump->jumpLabel = conditionLabel->label;
 
 				WhileStatementNode* whileNode = (WhileStatementNode*)node;
 				std::vector<std::shared_ptr<assembly>> whileChunk;
 				whileChunk.push_back(loopLabel);
 				auto conditionChunk = compileNode((ParseNode*)whileNode->condition.get(), nullptr);
-				whileChunk.insert(whileChunk.end(), conditionChunk.begin(), conditionChunk.end());
-				whileChunk.push_back(conditionJump);
+				util::appendConditionalJump(whileChunk, conditionChunk, conditionLabel->label);
 				whileChunk.push_back(exitJump);
 				whileChunk.push_back(conditionLabel);
 				auto stmtChunk = compileNode((ParseNode*)whileNode->doStatement.get(), nullptr);
@@ -339,27 +1460,36 @@ namespace ash
 				std::shared_ptr<relativeJump> loopJump = std::make_shared<relativeJump>();
 				loopJump->op = OP_RELATIVE_JUMP;
 				loopJump->jumpLabel = loopLabel->label;
-				std::shared_ptr<relativeJump> conditionJump = std::make_shared<relativeJump>();
-				conditionJump->op = OP_RELATIVE_JUMP_IF_TRUE;
-				conditionJump->jumpLabel = conditionLabel->label;
 				std::shared_ptr<relativeJump> exitJump = std::make_shared<relativeJump>();
 				exitJump->op = OP_RELATIVE_JUMP;
 				exitJump->jumpLabel = exitLabel->label;
 
 				ForStatementNode* forNode = (ForStatementNode*)node;
 				std::vector<std::shared_ptr<assembly>> forChunk;
-				auto declarationChunk = compileNode((ParseNode*)forNode->declaration.get(), nullptr);
-				forChunk.insert(forChunk.end(), declarationChunk.begin(), declarationChunk.end());
+				if (forNode->declaration)
+				{
+					auto declarationChunk = compileNode((ParseNode*)forNode->declaration.get(), nullptr);
+					forChunk.insert(forChunk.end(), declarationChunk.begin(), declarationChunk.end());
+				}
 				forChunk.push_back(loopLabel);
-				auto conditionChunk = compileNode((ParseNode*)forNode->conditional.get(), nullptr);
-				forChunk.insert(forChunk.end(), conditionChunk.begin(), conditionChunk.end());
-				forChunk.push_back(conditionJump);
-				forChunk.push_back(exitJump);
+				if (forNode->conditional)
+				{
+					//the condition reads the loop variable, which lives in the body's scope
+					auto hold = currentScope;
+					if (forNode->statement->nodeType() == NodeType::Block) currentScope = ((BlockNode*)forNode->statement.get())->scope;
+					auto conditionChunk = compileNode((ParseNode*)forNode->conditional.get(), nullptr);
+					currentScope = hold;
+					util::appendConditionalJump(forChunk, conditionChunk, conditionLabel->label);
+					forChunk.push_back(exitJump);
+				}
 				forChunk.push_back(conditionLabel);
 				auto stmtChunk = compileNode((ParseNode*)forNode->statement.get(), nullptr);
 				forChunk.insert(forChunk.end(), stmtChunk.begin(), stmtChunk.end());
-				auto incrementChunk = compileNode((ParseNode*)forNode->increment.get(), nullptr);
-				forChunk.insert(forChunk.end(), incrementChunk.begin(), incrementChunk.end());
+				if (forNode->increment)
+				{
+					auto incrementChunk = compileNode((ParseNode*)forNode->increment.get(), nullptr);
+					forChunk.insert(forChunk.end(), incrementChunk.begin(), incrementChunk.end());
+				}
 				forChunk.push_back(loopJump);
 				forChunk.push_back(exitLabel);
 
@@ -390,26 +1520,44 @@ namespace ash
 
 				auto identifier = util::renameByScope(varNode->identifier, currentScope);
 
+				if (identifier.type == TokenType::ERROR)
+				{
+					error(varNode->identifier, identifier.string);
+					return result;
+				}
+
+				//elements are a full register wide, so whatever is stored reads back unchanged
+				if (varNode->arraySize)
+				{
+					auto alloc = std::make_shared<threeAddress>();
+					alloc->op = OP_ALLOC_ARRAY;
+					alloc->A = compileOperand(varNode->arraySize.get(), result);
+					alloc->B = { TokenType::INT, "8", identifier.line };
+					alloc->result = identifier;
+					result.push_back(alloc);
+					return result;
+				}
+
 				if(util::isBasic(varNode->type))
 				{
 					if (varNode->value)
 					{ 
 						result = compileNode(varNode->value.get(), &identifier);
-						if (result.back()->type() == Asm::TwoAddr)
+						if (result.size() && result.back()->type() == Asm::TwoAddr)
 						{
-							Token id = ((twoAddress*)result.back().get())->result;
-							OpCodes operator_ = ((twoAddress*)result.back().get())->op;
-							if (id.type == TokenType::IDENTIFIER && operator_ == OP_CONST_LOW)
-							{
-								result.clear();
-								auto move = std::make_shared<twoAddress>();
-								move->op = OP_MOVE;
-								move->A = id;
-								move->result = identifier;
-								result.push_back(move);
-							}
+							auto last = (twoAddress*)result.back().get();
+							if (last->op == OP_CONST_LOW && last->A.type == TokenType::IDENTIFIER) last->op = OP_MOVE;
+							else if (last->op == OP_CONST_LOW) last->A = util::literalOf(last->A, varNode->type);
 						}
 					}
+					else
+					{
+						auto zero = std::make_shared<twoAddress>();
+						zero->op = OP_CONST_LOW;
+						zero->A = util::literalOf({ TokenType::INT, "0", identifier.line }, varNode->type);
+						zero->result = identifier;
+						result.push_back(zero);
+					}
 				}
 				else
 				{
@@ -430,6 +1578,62 @@ namespace ash
 				return result;
 			}
 
+			case NodeType::FunctionDeclaration:
+			{
+				//bodies are compiled where they are called, or on their own once a call is not inlined
+				auto funcNode = (FunctionDeclarationNode*)node;
+				auto name = util::renameByScope(funcNode->identifier, currentScope);
+				if (name.type == TokenType::ERROR) error(funcNode->identifier, name.string);
+				else functions[name.string] = funcNode;
+				return {};
+			}
+
+			case NodeType::ReturnStatement:
+			{
+				auto returnNode = (ReturnStatementNode*)node;
+				std::vector<std::shared_ptr<assembly>> result;
+				if (inlining.empty())
+				{
+					error({ TokenType::ERROR, "return", 0 }, "return outside of a function!");
+					return result;
+				}
+				//a copy, as compiling the value can inline further calls
+				Inlined body = inlining.back();
+				Token value = body.result;
+				if (returnNode->returnValue)
+				{
+					if (body.exit == SIZE_MAX) value = { TokenType::IDENTIFIER, "#" + std::to_string(temporaries++), returnNode->returnValue->line() };
+					result = compileNode(returnNode->returnValue.get(), &value);
+					if (result.size() && result.back()->type() == Asm::TwoAddr)
+					{
+						auto last = (twoAddress*)result.back().get();
+						if (last->op == OP_CONST_LOW && last->A.type == TokenType::IDENTIFIER) last->op = OP_MOVE;
+						else if (last->op == OP_CONST_LOW) last->A = util::literalOf(last->A, functions.at(body.function)->type);
+					}
+				}
+				if (body.exit != SIZE_MAX)
+				{
+					auto jump = std::make_shared<relativeJump>();
+					jump->op = OP_RELATIVE_JUMP;
+					jump->jumpLabel = body.exit;
+					result.push_back(jump);
+				}
+				else if (returnNode->returnValue)
+				{
+					auto ret = std::make_shared<oneAddress>();
+					ret->op = OP_RET;
+					ret->A = value;
+					result.push_back(ret);
+				}
+				else
+				{
+					auto ret = std::make_shared<pseudocode>();
+					ret->op = OP_RET;
+					result.push_back(ret);
+				}
+				return result;
+			}
+
 			case NodeType::ExpressionStatement:
 			{
 				auto exprStmt = (ExpressionStatement*)node;
@@ -466,12 +1670,12 @@ namespace ash
 
 									if (binaryNode->leftType.string.compare(expressionType.string) == 0)
 									{
-										binaryInstruction->A = ((CallNode*)binaryNode->left.get())->primary;
+										binaryInstruction->A = util::operand(binaryNode->left.get(), currentScope);
 									}
 									else
 									{
 										auto conversion = std::make_shared<twoAddress>();
-										conversion->A = ((CallNode*)binaryNode->left.get())->primary;
+										conversion->A = util::operand(binaryNode->left.get(), currentScope);
 										std::string temp("#");
 										temp.append(std::to_string(temporaries++));
 										Token tempToken = { TokenType::IDENTIFIER, temp, binaryNode->left->line() };
@@ -480,14 +1684,14 @@ namespace ash
 										chunk.push_back(conversion);
 										binaryInstruction->A = tempToken;
 									}
-									if (binaryNode->leftType.string.compare(expressionType.string) == 0)
+									if (binaryNode->rightType.string.compare(expressionType.string) == 0)
 									{
-										binaryInstruction->B = ((CallNode*)binaryNode->right.get())->primary;
+										binaryInstruction->B = util::operand(binaryNode->right.get(), currentScope);
 									}
 									else
 									{
 										auto conversion = std::make_shared<twoAddress>();
-										conversion->A = ((CallNode*)binaryNode->right.get())->primary;
+										conversion->A = util::operand(binaryNode->right.get(), currentScope);
 										std::string temp("#");
 										temp.append(std::to_string(temporaries++));
 										Token tempToken = { TokenType::IDENTIFIER, temp, binaryNode->right->line() };
@@ -550,6 +1754,7 @@ namespace ash
 											binaryInstruction->result = { TokenType::IDENTIFIER, temp2, binaryNode->left->line() };
 											or_->A = equal->result;
 											or_->B = binaryInstruction->result;
+											or_->op = OP_LOGICAL_OR;
 											binaryInstruction->op = OP_DOUBLE_LESS;
 											chunk.push_back(equal);
 											chunk.push_back(binaryInstruction);
@@ -576,19 +1781,20 @@ namespace ash
 											binaryInstruction->result = { TokenType::IDENTIFIER, temp2, binaryNode->left->line() };
 											or_->A = equal->result;
 											or_->B = binaryInstruction->result;
+											or_->op = OP_LOGICAL_OR;
 											binaryInstruction->op = OP_DOUBLE_GREATER;
 											chunk.push_back(equal);
 											chunk.push_back(binaryInstruction);
 											chunk.push_back(or_);
 										}
-										else if (op.type == TokenType::EQUAL)
+										else if (op.type == TokenType::EQUAL_EQUAL)
 										{
 											binaryInstruction->op = OP_DOUBLE_EQUAL;
 											chunk.push_back(binaryInstruction);
 										}
 										else if (op.type == TokenType::BANG_EQUAL)
 										{
-											std::shared_ptr<twoAddress> not;
+											auto not = std::make_shared<twoAddress>();
 											not->result = binaryInstruction->result;
 											not->op = OP_LOGICAL_NOT;
 											std::string temp("#");
@@ -676,7 +1882,7 @@ namespace ash
 											chunk.push_back(binaryInstruction);
 											chunk.push_back(or_);
 										}
-										else if (op.type == TokenType::EQUAL)
+										else if (op.type == TokenType::EQUAL_EQUAL)
 										{
 											binaryInstruction->op = OP_FLOAT_EQUAL;
 											chunk.push_back(binaryInstruction);
@@ -771,7 +1977,7 @@ namespace ash
 											chunk.push_back(binaryInstruction);
 											chunk.push_back(or_);
 										}
-										else if (op.type == TokenType::EQUAL)
+										else if (op.type == TokenType::EQUAL_EQUAL)
 										{
 											binaryInstruction->op = OP_INT_EQUAL;
 											chunk.push_back(binaryInstruction);
@@ -866,14 +2072,14 @@ namespace ash
 											chunk.push_back(binaryInstruction);
 											chunk.push_back(or_);
 										}
-										else if (op.type == TokenType::EQUAL)
+										else if (op.type == TokenType::EQUAL_EQUAL)
 										{
 											binaryInstruction->op = OP_INT_EQUAL;
 											chunk.push_back(binaryInstruction);
 										}
 										else if (op.type == TokenType::BANG_EQUAL)
 										{
-											auto not = std::shared_ptr<twoAddress>();
+											auto not = std::make_shared<twoAddress>();
 											not->result = binaryInstruction->result;
 											not->op = OP_LOGICAL_NOT;
 											std::string temp("#");
@@ -891,8 +2097,8 @@ namespace ash
 								case TokenType::OR:
 								{
 									auto binaryInstruction = std::make_shared<threeAddress>();
-									binaryInstruction->A = ((CallNode*)binaryNode->left.get())->primary;
-									binaryInstruction->B = ((CallNode*)binaryNode->right.get())->primary;
+									binaryInstruction->A = util::operand(binaryNode->left.get(), currentScope);
+									binaryInstruction->B = util::operand(binaryNode->right.get(), currentScope);
 									if(result != nullptr)
 									{
 										binaryInstruction->result = *result;
@@ -913,9 +2119,19 @@ namespace ash
 										binaryInstruction->op = OP_BITWISE_OR;
 
 									chunk.push_back(binaryInstruction);
+									break;
+								}
+								default:
+								{
+									error(op, "operator not supported by the compiler yet!");
+									break;
 								}
 							}
 						}
+						else
+						{
+							error(binaryNode->op, "operands of this type are not supported by the compiler yet!");
+						}
 						return chunk;
 					}
 					case ExpressionNode::ExpressionType::Assignment:
@@ -923,6 +2139,17 @@ namespace ash
 						auto assignmentNode = (AssignmentNode*)exprNode;
 
 						std::vector<std::shared_ptr<assembly>> chunk;
+						if (assignmentNode->identifier->expressionType() == ExpressionNode::ExpressionType::ArrayIndex)
+						{
+							auto indexNode = (ArrayIndexNode*)assignmentNode->identifier.get();
+							auto store = std::make_shared<threeAddress>();
+							store->op = OP_ARRAY_STORE;
+							store->B = compileOperand(indexNode->left.get(), chunk);
+							store->result = compileOperand(indexNode->index.get(), chunk);
+							store->A = util::literalOf(compileOperand(assignmentNode->value.get(), chunk), assignmentNode->assignmentType);
+							chunk.push_back(store);
+							return chunk;
+						}
 						std::string assigned = assignmentNode->resolveIdentifier();
 
 						size_t pos = assigned.find(".");
@@ -936,20 +2163,11 @@ namespace ash
 						if (!isFieldAssignment)
 						{
 							chunk = compileNode(assignmentNode->value.get(), &id);
-							if (chunk.back()->type() == Asm::TwoAddr)
+							if (chunk.size() && chunk.back()->type() == Asm::TwoAddr)
 							{
-								Token id = ((twoAddress*)chunk.back().get())->result;
-								OpCodes operator_ = ((twoAddress*)chunk.back().get())->op;
-								if (id.type == TokenType::IDENTIFIER && operator_ == OP_CONST_LOW)
-								{
-									chunk.clear();
-									auto move = std::make_shared<twoAddress>();
-									move->op = OP_MOVE;
-									move->result = id;
-									Token assigned = { TokenType::IDENTIFIER, assignedVar, assignmentNode->line() };
-									move->A = assigned;
-									chunk.push_back(move);
-								}
+								auto last = (twoAddress*)chunk.back().get();
+								if (last->op == OP_CONST_LOW && last->A.type == TokenType::IDENTIFIER) last->op = OP_MOVE;
+								else if (last->op == OP_CONST_LOW) last->A = util::literalOf(last->A, assignmentNode->assignmentType);
 							}
 						}
 						else
@@ -1037,6 +2255,7 @@ namespace ash
 											auto store = std::make_shared<threeAddress>();
 											store->op = OP_STORE_OFFSET;
 											store->A = tempToken;
+											store->B = { TokenType::IDENTIFIER, last, assignmentNode->line() };
 											if(chunk.back()->type() == Asm::ThreeAddr)
 											{
 												std::shared_ptr<threeAddress> lastResult = std::dynamic_pointer_cast<threeAddress>(chunk.back());
@@ -1044,7 +2263,6 @@ namespace ash
 												{
 													store->B = lastResult->A;
 												}
-												else store->B = { TokenType::IDENTIFIER, last, assignmentNode->line() };
 											}
 											store->result = { TokenType::INT, std::to_string(i), assignmentNode->line() };
 											chunk.push_back(store);
@@ -1063,17 +2281,117 @@ namespace ash
 					}
 					case ExpressionNode::ExpressionType::FieldCall:
 					{
-						
+						auto fieldNode = (FieldCallNode*)node;
+
+						std::vector<std::shared_ptr<assembly>> chunk;
+						Token object;
+						std::string objectType;
+						if (fieldNode->left->expressionType() == ExpressionNode::ExpressionType::Primary)
+						{
+							auto primaryNode = (CallNode*)fieldNode->left.get();
+							object = util::renameByScope(primaryNode->primary, currentScope);
+							objectType = primaryNode->primaryType.string;
+						}
+						else
+						{
+							std::string temp("#");
+							temp.append(std::to_string(temporaries++));
+							object = { TokenType::IDENTIFIER, temp, fieldNode->line() };
+							chunk = compileNode(fieldNode->left.get(), &object);
+							objectType = fieldNode->left->typeToken().string;
+						}
+
+						//the one field of an array is its length
+						if (util::isArray(fieldNode->left->typeToken()))
+						{
+							auto length = std::make_shared<twoAddress>();
+							length->op = OP_ARRAY_LENGTH;
+							length->A = object;
+							length->result = result ? *result : Token{ TokenType::IDENTIFIER, "#" + std::to_string(temporaries++), fieldNode->line() };
+							chunk.push_back(length);
+							return chunk;
+						}
+
+						auto scope = currentScope;
+						while (scope != nullptr && scope->typeParameters.find(objectType) == scope->typeParameters.end())
+							scope = scope->parentScope;
+						if (scope == nullptr)
+						{
+							error(fieldNode->field, "type of field access could not be resolved!");
+							return chunk;
+						}
+						auto& params = scope->typeParameters.at(objectType);
+						size_t index = 0;
+						while (index < params.size() && params[index].identifier.string.compare(fieldNode->field.string) != 0) index++;
+						if (index == params.size())
+						{
+							error(fieldNode->field, "field not found!");
+							return chunk;
+						}
+
+						auto load = std::make_shared<threeAddress>();
+						load->op = OP_LOAD_OFFSET;
+						if (result != nullptr)
+						{
+							load->A = *result;
+						}
+						else
+						{
+							std::string temp("#");
+							temp.append(std::to_string(temporaries++));
+							load->A = { TokenType::IDENTIFIER, temp, fieldNode->line() };
+						}
+						load->B = object;
+						load->result = { TokenType::INT, std::to_string(index), fieldNode->line() };
+						chunk.push_back(load);
+						return chunk;
 					}
 					case ExpressionNode::ExpressionType::FunctionCall:
 					{
-						
+						//the one method of an array appends to it
+						auto callNode = (FunctionCallNode*)node;
+						if (callNode->left->expressionType() == ExpressionNode::ExpressionType::FieldCall)
+						{
+							auto method = (FieldCallNode*)callNode->left.get();
+							Token arrayType = method->left->typeToken();
+							if (util::isArray(arrayType))
+							{
+								std::vector<std::shared_ptr<assembly>> chunk;
+								auto push = std::make_shared<threeAddress>();
+								push->op = OP_ARRAY_PUSH;
+								push->B = compileOperand(method->left.get(), chunk);
+								push->A = util::literalOf(compileOperand(callNode->arguments[0].get(), chunk), util::elementType(arrayType));
+								chunk.push_back(push);
+								return chunk;
+							}
+						}
+						return compileCall(callNode, result);
+					}
+					case ExpressionNode::ExpressionType::ArrayIndex:
+					{
+						auto indexNode = (ArrayIndexNode*)exprNode;
+						std::vector<std::shared_ptr<assembly>> chunk;
+						auto load = std::make_shared<threeAddress>();
+						load->op = OP_ARRAY_LOAD;
+						load->B = compileOperand(indexNode->left.get(), chunk);
+						load->result = compileOperand(indexNode->index.get(), chunk);
+						load->A = result ? *result : Token{ TokenType::IDENTIFIER, "#" + std::to_string(temporaries++), indexNode->line() };
+						chunk.push_back(load);
+						return chunk;
 					}
 					case ExpressionNode::ExpressionType::Constructor:
 					{
 						auto constructorNode = (ConstructorNode*)node;
 
 						std::vector<std::shared_ptr<assembly>> chunk;
+						Token temporary;
+						if (result == nullptr)
+						{
+							std::string temp("#");
+							temp.append(std::to_string(temporaries++));
+							temporary = { TokenType::IDENTIFIER, temp, constructorNode->line() };
+							result = &temporary;
+						}
 						if (result->string.front() == '#')
 						{
 							auto tempType = util::renameByScope(constructorNode->ConstructorType, currentScope);
@@ -1112,6 +2430,10 @@ namespace ash
 								{
 									store->A = threeAddr->B;
 								}
+								else if (threeAddr->op == OP_ARRAY_LOAD)
+								{
+									store->A = threeAddr->A;
+								}
 								else
 								{
 									store->A = threeAddr->result;
@@ -1128,14 +2450,6 @@ namespace ash
 
 						std::vector<std::shared_ptr<assembly>> chunk;
 
-						auto operand = compileNode(unaryNode->unary.get(), result);
-						
-						chunk.insert(chunk.end(), operand.begin(), operand.end());
-						auto& last = chunk.back();
-						auto& type = unaryNode->unaryType;
-
-						auto& op = unaryNode->op;
-
 						auto not = std::make_shared<twoAddress>();
 						if (result != nullptr)
 						{
@@ -1149,6 +2463,17 @@ namespace ash
 						}
 						not->A = not->result;
 
+						not->op = OP_HALT;
+
+						auto operand = compileNode(unaryNode->unary.get(), &not->result);
+						if (operand.empty()) return chunk;
+						
+						chunk.insert(chunk.end(), operand.begin(), operand.end());
+						auto& last = chunk.back();
+						auto& type = unaryNode->unaryType;
+
+						auto& op = unaryNode->op;
+
 						switch(op.type)
 						{
 							case TokenType::BANG:
@@ -1172,6 +2497,12 @@ namespace ash
 								}
 								break;
 							}
+							default: break;
+						}
+						if (not->op == OP_HALT)
+						{
+							error(op, "unary operator not supported for this type!");
+							return chunk;
 						}
 						if (last->type() == Asm::TwoAddr)
 						{
@@ -1214,8 +2545,18 @@ namespace ash
 						chunk.push_back(constant);
 						return chunk;
 					}
+					default:
+					{
+						error({ TokenType::ERROR, "expression", exprNode->line() }, "expression not supported by the compiler yet!");
+						return {};
+					}
 				}
 			}
+			default:
+			{
+				error({ TokenType::ERROR, "statement", 0 }, "statement not supported by the compiler yet!");
+				return {};
+			}
 		}
 	}
 }
\ No newline at end of file
@@ -1,8 +1,22 @@
+#pragma once
+
 #include "Parser.h"
 #include "Chunk.h"
 #include "Memory.h"
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+//registers the allocator hands out; the three above them are scratch for spilled variables and literals
+#ifndef ALLOCATABLE_REGISTERS
+#define ALLOCATABLE_REGISTERS 253
+#endif
+
+//calls to a function whose body compiles to at most this many instructions are replaced by its body...
+#define INLINE_MAX_INSTRUCTIONS 32
+//...up to this many calls deep
+#define INLINE_MAX_DEPTH 4
+
 namespace ash
 {
 
@@ -10,16 +24,27 @@ namespace ash
 	{
 		Label,
 		Jump,
+		CompareJump,
 		pseudocode,
 		OneAddr,
 		TwoAddr,
-		ThreeAddr
+		ThreeAddr,
+		Phi,
+		Call
 	};
 
+	//unresolved identifiers are kept as error tokens, so the compiler can report them
+	inline void readVariable(Token& token, std::vector<Token*>& uses)
+	{
+		if (token.type == TokenType::IDENTIFIER || token.type == TokenType::ERROR) uses.push_back(&token);
+	}
+
 	struct assembly
 	{
 		virtual Asm type() = 0;
 		virtual void print() = 0;
+		//the variables the instruction reads, and the one it writes (left alone if none); literals and type names are not variables
+		virtual void operands(std::vector<Token*>&, Token*&) {}
 	};
 
 	struct label : public assembly
@@ -45,10 +70,31 @@ namespace ash
 	struct relativeJump : public pseudocode
 	{
 		size_t jumpLabel;
+		Token condition; //value OP_RELATIVE_JUMP_IF_TRUE tests; the comparison register is only set from it when needed
 		virtual Asm type() override { return Asm::Jump; }
 		virtual void print() override
 		{
-			std::cout << "    " << OpcodeNames[op] << " " << jumpLabel << std::endl;
+			std::cout << "    " << OpcodeNames[op] << " " << condition.string << (condition.string.empty() ? "" : " ") << jumpLabel << std::endl;
+		}
+		virtual void operands(std::vector<Token*>& uses, Token*&) override
+		{
+			if (!condition.string.empty()) readVariable(condition, uses);
+		}
+	};
+
+	struct compareJump : public relativeJump
+	{
+		Token A;
+		Token B;
+		virtual Asm type() override { return Asm::CompareJump; }
+		virtual void print() override
+		{
+			std::cout << "    " << OpcodeNames[op] << " " << A.string << " " << B.string << " " << jumpLabel << std::endl;
+		}
+		virtual void operands(std::vector<Token*>& uses, Token*&) override
+		{
+			readVariable(A, uses);
+			readVariable(B, uses);
 		}
 	};
 
@@ -60,6 +106,10 @@ namespace ash
 		{
 			std::cout << "    " << OpcodeNames[op] << " " << A.string << std::endl;
 		}
+		virtual void operands(std::vector<Token*>& uses, Token*&) override
+		{
+			readVariable(A, uses);
+		}
 	};
 	struct twoAddress : public pseudocode
 	{
@@ -70,6 +120,12 @@ namespace ash
 		{
 			std::cout << "    " << OpcodeNames[op] << " " << A.string << " " << result.string << std::endl;
 		}
+		virtual void operands(std::vector<Token*>& uses, Token*& def) override
+		{
+			//OP_ALLOC names a type, not a variable
+			if (op != OP_ALLOC) readVariable(A, uses);
+			def = &result;
+		}
 	};
 
 	struct threeAddress : public pseudocode
@@ -82,11 +138,76 @@ namespace ash
 		{
 			std::cout << "    " << OpcodeNames[op] << " " << A.string << " " << B.string << " " << result.string << std::endl;
 		}
+		virtual void operands(std::vector<Token*>& uses, Token*& def) override
+		{
+			//field accesses carry the field index as their third operand
+			if (op == OP_LOAD_OFFSET)
+			{
+				readVariable(B, uses);
+				def = &A;
+				return;
+			}
+			//array accesses keep the VM's operand order, so the third operand is the index
+			if (op == OP_ARRAY_LOAD || op == OP_ARRAY_LOAD_UNCHECKED)
+			{
+				readVariable(B, uses);
+				readVariable(result, uses);
+				def = &A;
+				return;
+			}
+			//a push appends A to the array in B, which keeps its address, so it defines nothing
+			readVariable(A, uses);
+			readVariable(B, uses);
+			if (op == OP_ARRAY_STORE || op == OP_ARRAY_STORE_UNCHECKED || op == OP_ARRAY_CHECK) readVariable(result, uses);
+			else if (op != OP_STORE_OFFSET && op != OP_ARRAY_PUSH) def = &result;
+		}
+	};
+
+	//phi function at the top of a basic block in SSA form: result takes the argument of whichever predecessor ran last
+	struct phi : public assembly
+	{
+		Token result;
+		std::vector<std::pair<size_t, Token>> arguments; //predecessor block, value
+		virtual Asm type() override { return Asm::Phi; }
+		virtual void print() override
+		{
+			std::cout << "    PHI";
+			for (const auto& argument : arguments) std::cout << " [" << argument.first << "] " << argument.second.string;
+			std::cout << " " << result.string << std::endl;
+		}
+		virtual void operands(std::vector<Token*>& uses, Token*& def) override
+		{
+			for (auto& argument : arguments) readVariable(argument.second, uses);
+			def = &result;
+		}
+	};
+
+	//OP_CALL of a function that was not inlined: its parameters take the arguments, and result takes what it returns
+	struct call : public pseudocode
+	{
+		Token function; //renamed by scope, like a variable
+		std::vector<Token> arguments;
+		Token result; //empty for a void function
+		virtual Asm type() override { return Asm::Call; }
+		virtual void print() override
+		{
+			std::cout << "    " << OpcodeNames[op] << " " << function.string;
+			for (const auto& argument : arguments) std::cout << " " << argument.string;
+			std::cout << (result.string.empty() ? "" : " ") << result.string << std::endl;
+		}
+		virtual void operands(std::vector<Token*>& uses, Token*& def) override
+		{
+			for (auto& argument : arguments) readVariable(argument, uses);
+			if (!result.string.empty()) def = &result;
+		}
 	};
 
 	struct pseudochunk
 	{
 		std::vector<std::shared_ptr<assembly>> code;
+		//set for a function: its name, and its parameters in the order they arrive in the first registers of its window
+		std::string function;
+		std::vector<parameter> parameters;
 	};
 
 	struct Local
@@ -109,15 +230,70 @@ namespace ash
 		Chunk* currentChunk = nullptr;
 		size_t temporaries = 0;
 		size_t jumpLabels = 0;
+		bool hadError = false;
+		bool optimizeLoops = true;
+		bool inlineCalls = true;
+		std::unordered_map<std::string, int> registers; //variable to the register it was given, -1 if spilled
+
+		//function declarations by name renamed by scope, and the size their bodies compile to once measured
+		std::unordered_map<std::string, FunctionDeclarationNode*> functions;
+		std::unordered_map<std::string, size_t> functionSizes;
+		//a body being inlined: the temporary its returns write and the label after it, or SIZE_MAX for one compiled on its own
+		struct Inlined
+		{
+			std::string function;
+			Token result;
+			size_t exit;
+		};
+		std::vector<Inlined> inlining;
+		std::vector<std::string> called; //functions compiled on their own, in the order a call first needed them
+		std::vector<pseudochunk> functionChunks;
+		std::unordered_map<std::string, size_t> entries; //function to where its code starts in the chunk
+		std::vector<std::pair<size_t, std::string>> calls; //OP_CALLs to patch once every function is written
+
+		void error(const Token& token, std::string message);
+		//a function's body with returns that leave the chunk, for calls that were not inlined
+		pseudochunk compileFunction(const std::string& name);
+		//globals read or written by a function compiled on its own move into a struct the program allocates and
+		//every call passes on as a last argument; the program copies them back out where it halts
+		void shareGlobals(pseudochunk& program, std::shared_ptr<ScopeNode> global);
+		//a call: the function's body in place when it is small and not already being inlined, OP_CALL otherwise
+		std::vector<std::shared_ptr<assembly>> compileCall(FunctionCallNode* callNode, Token* result);
+		//a variable or literal as it is, anything else computed into a temporary appended to chunk
+		Token compileOperand(ExpressionNode* node, std::vector<std::shared_ptr<assembly>>& chunk);
+		//register allocation and code for one chunk, the program or a function, written at the end of the output
+		bool assembleChunk(pseudochunk& chunk);
 	public:
 		Compiler()
 			:scopeDepth(0) {}
 
-		bool compile(const char* source);
+		//writes the program into chunk, ready for VM::interpret; false on a syntax or compile error
+		bool compile(const char* source, Chunk* chunk);
+
+		//unrolling, invariant code motion and strength reduction, on by default
+		void setLoopOptimization(bool enabled) { optimizeLoops = enabled; }
+		//replacing calls to small functions by their bodies, on by default
+		void setInlining(bool enabled) { inlineCalls = enabled; }
 
 		pseudochunk precompile(std::shared_ptr<ProgramNode> ast);
 
+		//escape analysis: structs whose pointer never leaves their own field accesses are not
+		//allocated, and their fields live in variables instead
+		void replaceScalars(pseudochunk& chunk);
+
 		std::vector<std::shared_ptr<assembly>> compileNode(ParseNode* node, Token* result);
+
+		//writes chunk into out: resolves labels to jump offsets and gives every variable a register by linear
+		//scan over its live interval, spilling to stack slots once the registers run out; the functions calls
+		//were not inlined into follow the program, each allocated on its own
+		bool assemble(pseudochunk& chunk, Chunk* out);
+
+		//register holding a variable (renamed by scope, as in name#scope) when the program halts; -1 if it was spilled
+		int registerOf(const std::string& variable)
+		{
+			auto found = registers.find(variable);
+			return found == registers.end() ? -1 : found->second;
+		}
 	};
 
 }
\ No newline at end of file
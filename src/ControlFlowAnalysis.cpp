@@ -1,7 +1,100 @@
 #include "ControlFlowAnalysis.h"
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace ash
 {
+	namespace util
+	{
+		static bool isHalt(assembly* instruction)
+		{
+			return instruction->type() == Asm::pseudocode && ((pseudocode*)instruction)->op == OP_HALT;
+		}
+
+		//a halt, or a function's return: nothing follows either
+		static bool exits(assembly* instruction)
+		{
+			if (isHalt(instruction)) return true;
+			return (instruction->type() == Asm::pseudocode || instruction->type() == Asm::OneAddr) && ((pseudocode*)instruction)->op == OP_RET;
+		}
+
+		//a jump that falls through to the next block when not taken
+		static bool isConditional(assembly* instruction)
+		{
+			if (instruction->type() == Asm::CompareJump) return true;
+			return instruction->type() == Asm::Jump && ((relativeJump*)instruction)->op != OP_RELATIVE_JUMP;
+		}
+
+		static bool isTemporary(const std::string& name)
+		{
+			return name.size() && name[0] == '#';
+		}
+
+		static std::shared_ptr<twoAddress> makeCopy(const Token& from, const Token& to)
+		{
+			auto copy = std::make_shared<twoAddress>();
+			copy->op = from.type == TokenType::IDENTIFIER ? OP_MOVE : OP_CONST_LOW;
+			copy->A = from;
+			copy->result = to;
+			return copy;
+		}
+
+		//orders copies that happen at once (from, to) so none overwrites a source before it is read,
+		//saving one value of each cycle in a new temporary
+		static void sequentialize(std::vector<std::pair<Token, Token>> copies, std::vector<std::shared_ptr<assembly>>& out, size_t& temporaries)
+		{
+			auto reads = [&](size_t i, const std::string& name)
+			{
+				return copies[i].first.type == TokenType::IDENTIFIER && copies[i].first.string.compare(name) == 0;
+			};
+			while (copies.size())
+			{
+				size_t ready = copies.size();
+				for (size_t i = 0; i < copies.size() && ready == copies.size(); i++)
+				{
+					bool needed = false;
+					for (size_t j = 0; j < copies.size(); j++)
+					{
+						if (j != i && reads(j, copies[i].second.string)) needed = true;
+					}
+					if (!needed) ready = i;
+				}
+				if (ready < copies.size())
+				{
+					out.push_back(makeCopy(copies[ready].first, copies[ready].second));
+					copies.erase(copies.begin() + ready);
+					continue;
+				}
+				Token saved = { TokenType::IDENTIFIER, "#%" + std::to_string(temporaries++), copies[0].second.line };
+				out.push_back(makeCopy(copies[0].second, saved));
+				std::string overwritten = copies[0].second.string;
+				for (size_t i = 0; i < copies.size(); i++)
+				{
+					if (reads(i, overwritten)) copies[i].first = saved;
+				}
+			}
+		}
+	}
+
+	void FlowGraph::print()
+	{
+		for (size_t b = 0; b < blocks.size(); b++)
+		{
+			if (!blocks[b].reachable) continue;
+			std::cout << "block " << b << " (idom " << blocks[b].idom << ", from";
+			for (size_t p : blocks[b].predecessors) std::cout << " " << p;
+			std::cout << ")" << std::endl;
+			for (const auto& instruction : blocks[b].code) instruction->print();
+		}
+	}
+
+	bool FlowGraph::dominates(size_t a, size_t b)
+	{
+		while (b != a && b != 0) b = blocks[b].idom;
+		return b == a;
+	}
 	std::shared_ptr<ControlFlowGraph> ControlFlowAnalysis::createCFG(std::shared_ptr<ProgramNode> ast)
 	{
 		result = std::make_shared<ControlFlowGraph>();
@@ -130,4 +223,634 @@ namespace ash
 
 		}
 	}
+
+	FlowGraph ControlFlowAnalysis::createBlocks(pseudochunk& chunk)
+	{
+		FlowGraph graph;
+		//the entry block has no predecessors, so a program that starts with a label gets an empty one ahead of it
+		if (chunk.code.size() && chunk.code[0]->type() == Asm::Label) graph.blocks.emplace_back();
+		bool open = false; //whether the last block continues with the next instruction
+		for (const auto& instruction : chunk.code)
+		{
+			if (instruction->type() == Asm::Label)
+			{
+				graph.labels = std::max(graph.labels, ((label*)instruction.get())->label + 1);
+				open = false;
+			}
+			if (!open) graph.blocks.emplace_back();
+			graph.blocks.back().code.push_back(instruction);
+			open = instruction->type() != Asm::Jump && instruction->type() != Asm::CompareJump && !util::exits(instruction.get());
+		}
+		linkBlocks(graph);
+		return graph;
+	}
+
+	void ControlFlowAnalysis::linkBlocks(FlowGraph& graph)
+	{
+		auto& blocks = graph.blocks;
+		std::unordered_map<size_t, size_t> targets; //label to the block it starts
+		for (size_t b = 0; b < blocks.size(); b++)
+		{
+			blocks[b].successors.clear();
+			blocks[b].predecessors.clear();
+			blocks[b].children.clear();
+			blocks[b].frontier.clear();
+			if (blocks[b].code.size() && blocks[b].code[0]->type() == Asm::Label) targets[((label*)blocks[b].code[0].get())->label] = b;
+		}
+		for (size_t b = 0; b < blocks.size(); b++)
+		{
+			auto& successors = blocks[b].successors;
+			bool falls = true;
+			if (blocks[b].code.size())
+			{
+				auto last = blocks[b].code.back().get();
+				if (last->type() == Asm::Jump || last->type() == Asm::CompareJump)
+				{
+					successors.push_back(targets.at(((relativeJump*)last)->jumpLabel));
+					falls = util::isConditional(last);
+				}
+				else if (util::exits(last)) falls = false;
+			}
+			if (falls && b + 1 < blocks.size() && (successors.empty() || successors[0] != b + 1)) successors.push_back(b + 1);
+		}
+
+		//depth first from the entry: whatever it does not reach is dead
+		std::vector<bool> seen(blocks.size(), false);
+		std::vector<size_t> postorder;
+		std::vector<std::pair<size_t, size_t>> stack; //block, successors visited
+		if (blocks.size())
+		{
+			stack.emplace_back(0, 0);
+			seen[0] = true;
+		}
+		while (stack.size())
+		{
+			size_t b = stack.back().first;
+			if (stack.back().second < blocks[b].successors.size())
+			{
+				size_t s = blocks[b].successors[stack.back().second++];
+				if (seen[s]) continue;
+				seen[s] = true;
+				stack.emplace_back(s, 0);
+				continue;
+			}
+			postorder.push_back(b);
+			stack.pop_back();
+		}
+		graph.order.assign(postorder.rbegin(), postorder.rend());
+		for (size_t b = 0; b < blocks.size(); b++) blocks[b].reachable = seen[b];
+		for (size_t b : graph.order)
+		{
+			for (size_t s : blocks[b].successors) blocks[s].predecessors.push_back(b);
+		}
+		for (size_t b : graph.order)
+		{
+			auto& predecessors = blocks[b].predecessors;
+			for (auto& instruction : blocks[b].code)
+			{
+				if (instruction->type() != Asm::Phi) continue;
+				auto& arguments = ((phi*)instruction.get())->arguments;
+				arguments.erase(std::remove_if(arguments.begin(), arguments.end(), [&](const std::pair<size_t, Token>& argument)
+				{
+					return std::find(predecessors.begin(), predecessors.end(), argument.first) == predecessors.end();
+				}), arguments.end());
+			}
+		}
+
+		//dominators by Cooper, Harvey and Kennedy's iteration over reverse postorder
+		const size_t none = SIZE_MAX;
+		std::vector<size_t> number(blocks.size(), none);
+		for (size_t i = 0; i < graph.order.size(); i++) number[graph.order[i]] = i;
+		for (size_t b : graph.order) blocks[b].idom = none;
+		if (graph.order.size()) blocks[0].idom = 0;
+		bool changed = true;
+		while (changed)
+		{
+			changed = false;
+			for (size_t i = 1; i < graph.order.size(); i++)
+			{
+				size_t b = graph.order[i];
+				size_t idom = none;
+				for (size_t p : blocks[b].predecessors)
+				{
+					if (blocks[p].idom == none) continue;
+					if (idom == none)
+					{
+						idom = p;
+						continue;
+					}
+					size_t x = p;
+					while (x != idom)
+					{
+						while (number[x] > number[idom]) x = blocks[x].idom;
+						while (number[idom] > number[x]) idom = blocks[idom].idom;
+					}
+				}
+				if (blocks[b].idom == idom) continue;
+				blocks[b].idom = idom;
+				changed = true;
+			}
+		}
+		for (size_t i = 1; i < graph.order.size(); i++) blocks[blocks[graph.order[i]].idom].children.push_back(graph.order[i]);
+		for (size_t b : graph.order)
+		{
+			if (blocks[b].predecessors.size() < 2) continue;
+			for (size_t p : blocks[b].predecessors)
+			{
+				for (size_t runner = p; runner != blocks[b].idom; runner = blocks[runner].idom)
+				{
+					auto& frontier = blocks[runner].frontier;
+					if (std::find(frontier.begin(), frontier.end(), b) == frontier.end()) frontier.push_back(b);
+				}
+			}
+		}
+	}
+
+	void ControlFlowAnalysis::buildSSA(FlowGraph& graph)
+	{
+		auto& blocks = graph.blocks;
+		std::unordered_map<std::string, size_t> ids;
+		std::vector<std::string> names;
+		std::vector<std::vector<size_t>> definedIn;
+		std::vector<bool> crosses; //read in some block before that block defines it
+		auto variable = [&](const std::string& name) -> size_t
+		{
+			auto found = ids.find(name);
+			if (found != ids.end()) return found->second;
+			ids.emplace(name, names.size());
+			names.push_back(name);
+			definedIn.emplace_back();
+			//the program's variables are read when it halts
+			crosses.push_back(!util::isTemporary(name));
+			return names.size() - 1;
+		};
+		for (size_t b : graph.order)
+		{
+			std::unordered_set<size_t> defined;
+			for (const auto& instruction : blocks[b].code)
+			{
+				std::vector<Token*> uses;
+				Token* def = nullptr;
+				instruction->operands(uses, def);
+				for (Token* use : uses)
+				{
+					size_t v = variable(use->string);
+					if (!defined.count(v)) crosses[v] = true;
+				}
+				if (!def) continue;
+				size_t v = variable(def->string);
+				if (defined.insert(v).second) definedIn[v].push_back(b);
+			}
+		}
+
+		//semi-pruned: only variables live across blocks get phis, on the iterated dominance frontier of their definitions
+		std::unordered_map<assembly*, size_t> phis; //phi to the variable it merges
+		std::vector<size_t> placed(blocks.size(), SIZE_MAX); //variable each block last got a phi for
+		std::vector<size_t> queued(blocks.size(), SIZE_MAX);
+		for (size_t v = 0; v < names.size(); v++)
+		{
+			if (!crosses[v]) continue;
+			std::vector<size_t> work = definedIn[v];
+			for (size_t b : work) queued[b] = v;
+			while (work.size())
+			{
+				size_t b = work.back();
+				work.pop_back();
+				for (size_t f : blocks[b].frontier)
+				{
+					if (placed[f] == v) continue;
+					placed[f] = v;
+					auto merge = std::make_shared<phi>();
+					merge->result = { TokenType::IDENTIFIER, names[v], 0 };
+					auto& code = blocks[f].code;
+					code.insert(code.begin() + (code.size() && code[0]->type() == Asm::Label ? 1 : 0), merge);
+					phis[merge.get()] = v;
+					if (queued[f] == v) continue;
+					queued[f] = v;
+					work.push_back(f);
+				}
+			}
+		}
+
+		//rename down the dominator tree, so each block sees the versions of the blocks dominating it
+		std::vector<std::vector<std::string>> stacks(names.size());
+		std::vector<size_t> versions(names.size(), 0);
+		auto current = [&](size_t v) { return stacks[v].empty() ? names[v] + "%0" : stacks[v].back(); };
+		auto fresh = [&](size_t v)
+		{
+			stacks[v].push_back(names[v] + "%" + std::to_string(++versions[v]));
+			return stacks[v].back();
+		};
+		std::vector<std::vector<size_t>> pushed(blocks.size());
+		std::vector<std::pair<size_t, bool>> walk; //block, whether it is being left
+		if (graph.order.size()) walk.emplace_back(0, false);
+		while (walk.size())
+		{
+			size_t b = walk.back().first;
+			bool leaving = walk.back().second;
+			walk.pop_back();
+			if (leaving)
+			{
+				for (size_t v : pushed[b]) stacks[v].pop_back();
+				continue;
+			}
+			walk.emplace_back(b, true);
+			for (size_t child : blocks[b].children) walk.emplace_back(child, false);
+
+			auto& code = blocks[b].code;
+			for (size_t i = 0; i < code.size(); i++)
+			{
+				auto instruction = code[i].get();
+				if (instruction->type() == Asm::Phi)
+				{
+					size_t v = phis.at(instruction);
+					((phi*)instruction)->result.string = fresh(v);
+					pushed[b].push_back(v);
+					continue;
+				}
+				if (util::isHalt(instruction))
+				{
+					std::vector<std::shared_ptr<assembly>> copies;
+					for (size_t v = 0; v < names.size(); v++)
+					{
+						if (util::isTemporary(names[v]) || stacks[v].empty()) continue;
+						copies.push_back(util::makeCopy({ TokenType::IDENTIFIER, stacks[v].back(), 0 }, { TokenType::IDENTIFIER, names[v], 0 }));
+					}
+					code.insert(code.begin() + i, copies.begin(), copies.end());
+					i += copies.size();
+					continue;
+				}
+				std::vector<Token*> uses;
+				Token* def = nullptr;
+				instruction->operands(uses, def);
+				for (Token* use : uses) use->string = current(ids.at(use->string));
+				if (!def) continue;
+				size_t v = ids.at(def->string);
+				def->string = fresh(v);
+				pushed[b].push_back(v);
+			}
+			for (size_t s : blocks[b].successors)
+			{
+				for (const auto& instruction : blocks[s].code)
+				{
+					if (instruction->type() != Asm::Phi) continue;
+					((phi*)instruction.get())->arguments.emplace_back(b, Token{ TokenType::IDENTIFIER, current(phis.at(instruction.get())), 0 });
+				}
+			}
+		}
+	}
+
+	pseudochunk ControlFlowAnalysis::leaveSSA(FlowGraph& graph)
+	{
+		auto& blocks = graph.blocks;
+		std::unordered_map<std::string, size_t> ids;
+		std::vector<std::string> names;
+		auto variable = [&](const std::string& name) -> size_t
+		{
+			auto found = ids.find(name);
+			if (found != ids.end()) return found->second;
+			ids.emplace(name, names.size());
+			names.push_back(name);
+			return names.size() - 1;
+		};
+
+		//per block, one bit per variable: read before written, written, and read by the phis of its successors
+		size_t words = 0;
+		for (size_t b : graph.order)
+		{
+			for (const auto& instruction : blocks[b].code)
+			{
+				std::vector<Token*> uses;
+				Token* def = nullptr;
+				instruction->operands(uses, def);
+				for (Token* use : uses) variable(use->string);
+				if (def) variable(def->string);
+			}
+		}
+		words = (names.size() + 63) / 64;
+		auto set = [&](std::vector<uint64_t>& bits, size_t b, size_t v) { bits[b * words + v / 64] |= 1ull << (v % 64); };
+		auto test = [&](const std::vector<uint64_t>& bits, size_t b, size_t v) { return (bits[b * words + v / 64] >> (v % 64) & 1) != 0; };
+		std::vector<uint64_t> exposed(blocks.size() * words, 0);
+		std::vector<uint64_t> written(blocks.size() * words, 0);
+		std::vector<uint64_t> phiReads(blocks.size() * words, 0);
+		std::vector<bool> candidate(names.size(), false); //phi results and arguments
+		for (size_t b : graph.order)
+		{
+			for (const auto& instruction : blocks[b].code)
+			{
+				if (instruction->type() == Asm::Phi)
+				{
+					auto merge = (phi*)instruction.get();
+					size_t r = ids.at(merge->result.string);
+					set(written, b, r);
+					candidate[r] = true;
+					for (const auto& argument : merge->arguments)
+					{
+						if (argument.second.type != TokenType::IDENTIFIER) continue;
+						size_t a = ids.at(argument.second.string);
+						set(phiReads, argument.first, a);
+						candidate[a] = true;
+					}
+					continue;
+				}
+				std::vector<Token*> uses;
+				Token* def = nullptr;
+				instruction->operands(uses, def);
+				for (Token* use : uses)
+				{
+					size_t v = ids.at(use->string);
+					if (!test(written, b, v)) set(exposed, b, v);
+				}
+				if (def) set(written, b, ids.at(def->string));
+			}
+		}
+		std::vector<uint64_t> liveIn(blocks.size() * words, 0);
+		std::vector<uint64_t> liveOut(blocks.size() * words, 0);
+		bool changed = true;
+		while (changed)
+		{
+			changed = false;
+			for (size_t i = graph.order.size(); i-- > 0;)
+			{
+				size_t b = graph.order[i];
+				for (size_t w = 0; w < words; w++)
+				{
+					uint64_t out = phiReads[b * words + w];
+					for (size_t s : blocks[b].successors) out |= liveIn[s * words + w];
+					uint64_t in = exposed[b * words + w] | (out & ~written[b * words + w]);
+					if (out == liveOut[b * words + w] && in == liveIn[b * words + w]) continue;
+					liveOut[b * words + w] = out;
+					liveIn[b * words + w] = in;
+					changed = true;
+				}
+			}
+		}
+
+		//two variables interfere when one is live just after the other is defined
+		std::unordered_map<size_t, std::vector<uint64_t>> liveAfter; //candidate to what is live right after its definition
+		for (size_t b : graph.order)
+		{
+			std::vector<uint64_t> live(liveOut.begin() + b * words, liveOut.begin() + (b + 1) * words);
+			auto& code = blocks[b].code;
+			std::vector<size_t> results;
+			for (size_t i = code.size(); i-- > 0;)
+			{
+				if (code[i]->type() == Asm::Phi)
+				{
+					results.push_back(ids.at(((phi*)code[i].get())->result.string));
+					continue;
+				}
+				std::vector<Token*> uses;
+				Token* def = nullptr;
+				code[i]->operands(uses, def);
+				if (def)
+				{
+					size_t v = ids.at(def->string);
+					if (candidate[v]) liveAfter[v] = live;
+					live[v / 64] &= ~(1ull << (v % 64));
+				}
+				for (Token* use : uses)
+				{
+					size_t v = ids.at(use->string);
+					live[v / 64] |= 1ull << (v % 64);
+				}
+			}
+			//phis all happen at once on entry, so their results are live together
+			for (size_t r : results) live[r / 64] |= 1ull << (r % 64);
+			for (size_t r : results)
+			{
+				liveAfter[r] = live;
+				liveAfter[r][r / 64] &= ~(1ull << (r % 64));
+			}
+		}
+		//a value read before it is written (name%0) is defined on entry, where a function's parameters arrive
+		auto entryValue = [&](size_t v) { return names[v].size() > 2 && names[v].compare(names[v].size() - 2, 2, "%0") == 0; };
+		for (size_t v = 0; v < names.size(); v++)
+		{
+			if (candidate[v] && entryValue(v) && graph.order.size()) liveAfter[v] = std::vector<uint64_t>(liveIn.begin(), liveIn.begin() + words);
+		}
+
+		//union phi webs, variable by variable, while they stay free of interference
+		std::vector<size_t> parent(names.size());
+		std::vector<std::vector<size_t>> members(names.size());
+		for (size_t v = 0; v < names.size(); v++)
+		{
+			parent[v] = v;
+			members[v].push_back(v);
+		}
+		auto find = [&](size_t v)
+		{
+			while (parent[v] != v) v = parent[v] = parent[parent[v]];
+			return v;
+		};
+		auto liveAt = [&](size_t defined, size_t other)
+		{
+			auto found = liveAfter.find(defined);
+			return found != liveAfter.end() && (found->second[other / 64] >> (other % 64) & 1);
+		};
+		auto interfere = [&](size_t x, size_t y)
+		{
+			for (size_t a : members[x])
+			{
+				for (size_t b : members[y])
+				{
+					if (liveAt(a, b) || liveAt(b, a)) return true;
+				}
+			}
+			return false;
+		};
+		for (size_t b : graph.order)
+		{
+			for (const auto& instruction : blocks[b].code)
+			{
+				if (instruction->type() != Asm::Phi) continue;
+				auto merge = (phi*)instruction.get();
+				for (const auto& argument : merge->arguments)
+				{
+					if (argument.second.type != TokenType::IDENTIFIER) continue;
+					size_t x = find(ids.at(merge->result.string));
+					size_t y = find(ids.at(argument.second.string));
+					if (x == y || interfere(x, y)) continue;
+					parent[y] = x;
+					members[x].insert(members[x].end(), members[y].begin(), members[y].end());
+					members[y].clear();
+				}
+			}
+		}
+		//a web holding an entry value keeps its name, so the assembler can still find the parameter it came in as
+		std::vector<size_t> named(names.size());
+		for (size_t v = 0; v < names.size(); v++) named[v] = v;
+		for (size_t v = 0; v < names.size(); v++)
+		{
+			if (entryValue(v)) named[find(v)] = v;
+		}
+		for (size_t b : graph.order)
+		{
+			for (const auto& instruction : blocks[b].code)
+			{
+				std::vector<Token*> uses;
+				Token* def = nullptr;
+				instruction->operands(uses, def);
+				for (Token* use : uses) use->string = names[named[find(ids.at(use->string))]];
+				if (def) def->string = names[named[find(ids.at(def->string))]];
+			}
+		}
+
+		//the phi arguments left in another web become copies on their edge
+		std::map<std::pair<size_t, size_t>, std::vector<std::pair<Token, Token>>> edges; //predecessor and block, copies (from, to)
+		for (size_t b : graph.order)
+		{
+			for (const auto& instruction : blocks[b].code)
+			{
+				if (instruction->type() != Asm::Phi) continue;
+				auto merge = (phi*)instruction.get();
+				for (const auto& argument : merge->arguments)
+				{
+					if (argument.second.type == TokenType::IDENTIFIER && argument.second.string.compare(merge->result.string) == 0) continue;
+					edges[{ argument.first, b }].emplace_back(argument.second, merge->result);
+				}
+			}
+		}
+		//copies go at the end of a predecessor with one way out, at the top of a block with one way in,
+		//or else on a new block splitting the edge: right after the predecessor for its fallthrough, at the end for its jump
+		size_t temporaries = 0;
+		std::vector<std::vector<std::shared_ptr<assembly>>> top(blocks.size()), bottom(blocks.size()), after(blocks.size());
+		std::vector<std::shared_ptr<assembly>> appended;
+		for (const auto& edge : edges)
+		{
+			size_t from = edge.first.first;
+			size_t to = edge.first.second;
+			std::vector<std::shared_ptr<assembly>> copies;
+			util::sequentialize(edge.second, copies, temporaries);
+			auto last = blocks[from].code.size() ? blocks[from].code.back().get() : nullptr;
+			if (!last || !util::isConditional(last))
+			{
+				bottom[from] = copies;
+				continue;
+			}
+			if (blocks[to].predecessors.size() == 1)
+			{
+				top[to] = copies;
+				continue;
+			}
+			auto jump = (relativeJump*)last;
+			auto split = std::make_shared<label>();
+			split->label = graph.labels++;
+			if (to == from + 1)
+			{
+				//a jump to the next block takes the same edge as falling into it
+				auto target = blocks[to].code[0].get();
+				if (target->type() == Asm::Label && ((label*)target)->label == jump->jumpLabel)
+				{
+					jump->jumpLabel = split->label;
+					after[from].push_back(split);
+				}
+				after[from].insert(after[from].end(), copies.begin(), copies.end());
+				continue;
+			}
+			auto back = std::make_shared<relativeJump>();
+			back->op = OP_RELATIVE_JUMP;
+			back->jumpLabel = jump->jumpLabel;
+			jump->jumpLabel = split->label;
+			appended.push_back(split);
+			appended.insert(appended.end(), copies.begin(), copies.end());
+			appended.push_back(back);
+		}
+
+		pseudochunk result;
+		for (size_t b = 0; b < blocks.size(); b++)
+		{
+			if (!blocks[b].reachable) continue;
+			auto& code = blocks[b].code;
+			size_t i = 0;
+			for (; i < code.size() && code[i]->type() == Asm::Label; i++) result.code.push_back(code[i]);
+			result.code.insert(result.code.end(), top[b].begin(), top[b].end());
+			bool jumps = code.size() && code.back()->type() == Asm::Jump && !util::isConditional(code.back().get());
+			size_t end = jumps ? code.size() - 1 : code.size();
+			for (; i < end; i++)
+			{
+				if (code[i]->type() != Asm::Phi) result.code.push_back(code[i]);
+			}
+			result.code.insert(result.code.end(), bottom[b].begin(), bottom[b].end());
+			if (jumps) result.code.push_back(code.back());
+			result.code.insert(result.code.end(), after[b].begin(), after[b].end());
+		}
+		result.code.insert(result.code.end(), appended.begin(), appended.end());
+
+		//resolved branches can leave jumps to the label right after them
+		size_t kept = 0;
+		for (size_t i = 0; i < result.code.size(); i++)
+		{
+			auto instruction = result.code[i].get();
+			if (instruction->type() == Asm::Jump && !util::isConditional(instruction))
+			{
+				size_t next = i + 1;
+				bool lands = false;
+				for (; next < result.code.size() && result.code[next]->type() == Asm::Label; next++)
+				{
+					if (((label*)result.code[next].get())->label == ((relativeJump*)instruction)->jumpLabel) lands = true;
+				}
+				if (lands) continue;
+			}
+			result.code[kept++] = result.code[i];
+		}
+		result.code.resize(kept);
+		return result;
+	}
+
+	std::vector<Loop> ControlFlowAnalysis::findLoops(FlowGraph& graph)
+	{
+		auto& blocks = graph.blocks;
+		std::vector<Loop> loops;
+		std::vector<size_t> number(blocks.size(), SIZE_MAX);
+		for (size_t i = 0; i < graph.order.size(); i++) number[graph.order[i]] = i;
+		for (size_t h : graph.order)
+		{
+			Loop loop;
+			loop.header = h;
+			for (size_t p : blocks[h].predecessors)
+			{
+				if (graph.dominates(h, p)) loop.latches.push_back(p);
+			}
+			if (loop.latches.empty()) continue;
+
+			//walk back from the latches; the header dominates all of them, so the walk stops there
+			std::vector<bool> inside(blocks.size(), false);
+			inside[h] = true;
+			std::vector<size_t> work;
+			for (size_t latch : loop.latches)
+			{
+				if (inside[latch]) continue;
+				inside[latch] = true;
+				work.push_back(latch);
+			}
+			while (work.size())
+			{
+				size_t b = work.back();
+				work.pop_back();
+				for (size_t p : blocks[b].predecessors)
+				{
+					if (inside[p]) continue;
+					inside[p] = true;
+					work.push_back(p);
+				}
+			}
+			for (size_t b : graph.order)
+			{
+				if (inside[b]) loop.blocks.push_back(b);
+			}
+			size_t outside = 0;
+			for (size_t p : blocks[h].predecessors)
+			{
+				if (inside[p]) continue;
+				outside++;
+				loop.preheader = p;
+			}
+			if (outside != 1) loop.preheader = SIZE_MAX;
+			loops.push_back(loop);
+		}
+		//a loop nested in another has fewer blocks, so it comes first
+		std::stable_sort(loops.begin(), loops.end(), [](const Loop& a, const Loop& b) { return a.blocks.size() < b.blocks.size(); });
+		return loops;
+	}
 }
\ No newline at end of file
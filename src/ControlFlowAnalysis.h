@@ -1,12 +1,58 @@
 #pragma once
 #include "ParseTree.h"
+#include "Compiler.h"
 
 namespace ash
 {
+	//straight-line run of pseudocode, entered at the top and left at the bottom
+	struct BasicBlock
+	{
+		std::vector<std::shared_ptr<assembly>> code; //its label if anything jumps here, then its phis
+		std::vector<size_t> successors;
+		std::vector<size_t> predecessors;
+		bool reachable = true;
+		size_t idom = 0; //immediate dominator; the entry is its own
+		std::vector<size_t> children; //blocks it immediately dominates
+		std::vector<size_t> frontier; //dominance frontier
+	};
+
+	//a pseudochunk's blocks in code order, so a block that does not end in a jump falls into the next; blocks[0] is the entry
+	struct FlowGraph
+	{
+		std::vector<BasicBlock> blocks;
+		std::vector<size_t> order; //reachable blocks in reverse postorder
+		size_t labels = 0; //first jump label not in use
+		void print();
+		//whether every path from the entry to b passes through a
+		bool dominates(size_t a, size_t b);
+	};
+
+	//natural loop: the blocks that reach a back edge to the header without passing through it
+	struct Loop
+	{
+		size_t header;
+		std::vector<size_t> blocks; //in reverse postorder, header first
+		std::vector<size_t> latches; //blocks that jump back to the header
+		size_t preheader = SIZE_MAX; //the header's only predecessor outside the loop, if it has just one
+	};
+
 	class ControlFlowAnalysis
 	{
 	public:
 		std::shared_ptr<ControlFlowGraph> createCFG(std::shared_ptr<ProgramNode> ast);
+
+		//splits a pseudochunk before every label and after every jump
+		FlowGraph createBlocks(pseudochunk& chunk);
+		//recomputes the edges from the jumps that end each block, marks blocks control no longer reaches
+		//and drops their phi arguments, then recomputes dominators and dominance frontiers
+		void linkBlocks(FlowGraph& graph);
+		//gives every definition its own version of the variable, name%n, with phis where versions meet;
+		//each named variable gets its last version copied back ahead of the halt
+		void buildSSA(FlowGraph& graph);
+		//joins phi operands that never interfere into one variable and turns the others into copies on the incoming edges
+		pseudochunk leaveSSA(FlowGraph& graph);
+		//the loops of the graph, innermost first; back edges to one header make one loop
+		std::vector<Loop> findLoops(FlowGraph& graph);
 	private:
 		std::shared_ptr<ControlFlowGraph> result = nullptr;
 
@@ -87,6 +87,64 @@ namespace ash
 			case OP_RELATIVE_JUMP_IF_TRUE: return JumpInstruction("OP_RELATIVE_JUMP_IF_TRUE", offset);
 			case OP_REGISTER_JUMP: return ABInstruction("OP_REGISTER_JUMP", offset);
 			case OP_REGISTER_JUMP_IF_TRUE: return ABInstruction("OP_REGISTER_JUMP_IF_TRUE", offset);
+			case OP_PUSH_POINTER: return AInstruction("OP_PUSH_POINTER", offset);
+			case OP_OUT_SIGNED: return AInstruction("OP_OUT_SIGNED", offset);
+			case OP_OUT_FLOAT: return AInstruction("OP_OUT_FLOAT", offset);
+			case OP_OUT_DOUBLE: return AInstruction("OP_OUT_DOUBLE", offset);
+			case OP_LOAD_CONST: return PoolInstruction("OP_LOAD_CONST", offset);
+			case OP_LOAD_CONST_WIDE: return PoolInstruction("OP_LOAD_CONST_WIDE", offset);
+			case OP_JUMP_IF_SIGN_LESS:
+			case OP_JUMP_IF_SIGN_GREATER:
+			case OP_JUMP_IF_UNSIGN_LESS:
+			case OP_JUMP_IF_UNSIGN_GREATER:
+			case OP_JUMP_IF_INT_EQUAL:
+			case OP_JUMP_IF_FLOAT_LESS:
+			case OP_JUMP_IF_FLOAT_GREATER:
+			case OP_JUMP_IF_FLOAT_EQUAL:
+			case OP_JUMP_IF_DOUBLE_LESS:
+			case OP_JUMP_IF_DOUBLE_GREATER:
+			case OP_JUMP_IF_DOUBLE_EQUAL: return CompareJumpInstruction(OpcodeNames[instruction].c_str(), offset);
+			case OP_ARRAY_PUSH: return ABInstruction("OP_ARRAY_PUSH", offset);
+			case OP_ARRAY_RESERVE: return ABInstruction("OP_ARRAY_RESERVE", offset);
+			case OP_ARRAY_LENGTH: return ABInstruction("OP_ARRAY_LENGTH", offset);
+			case OP_ARRAY_COPY: return ABCInstruction("OP_ARRAY_COPY", offset);
+			case OP_ARRAY_FILL: return ABCInstruction("OP_ARRAY_FILL", offset);
+			case OP_ARRAY_COMPARE: return ABCInstruction("OP_ARRAY_COMPARE", offset);
+			case OP_ARRAY_SLICE: return ABCInstruction("OP_ARRAY_SLICE", offset);
+			case OP_ARRAY_STORE_UNCHECKED: return ABCInstruction("OP_ARRAY_STORE_UNCHECKED", offset);
+			case OP_ARRAY_LOAD_UNCHECKED: return ABCInstruction("OP_ARRAY_LOAD_UNCHECKED", offset);
+			case OP_ARRAY_CHECK: return ABCInstruction("OP_ARRAY_CHECK", offset);
+			case OP_VECTOR_INT_ADD:
+			case OP_VECTOR_FLOAT_ADD:
+			case OP_VECTOR_DOUBLE_ADD:
+			case OP_VECTOR_INT_SUB:
+			case OP_VECTOR_FLOAT_SUB:
+			case OP_VECTOR_DOUBLE_SUB:
+			case OP_VECTOR_INT_MUL:
+			case OP_VECTOR_FLOAT_MUL:
+			case OP_VECTOR_DOUBLE_MUL:
+			case OP_VECTOR_INT_FMA:
+			case OP_VECTOR_FLOAT_FMA:
+			case OP_VECTOR_DOUBLE_FMA:
+			case OP_VECTOR_INT_MIN:
+			case OP_VECTOR_FLOAT_MIN:
+			case OP_VECTOR_DOUBLE_MIN:
+			case OP_VECTOR_INT_MAX:
+			case OP_VECTOR_FLOAT_MAX:
+			case OP_VECTOR_DOUBLE_MAX:
+			case OP_VECTOR_INT_SCALE:
+			case OP_VECTOR_FLOAT_SCALE:
+			case OP_VECTOR_DOUBLE_SCALE:
+			case OP_VECTOR_INT_DOT:
+			case OP_VECTOR_FLOAT_DOT:
+			case OP_VECTOR_DOUBLE_DOT: return ABCInstruction(OpcodeNames[instruction].c_str(), offset);
+			case OP_VECTOR_INT_SUM:
+			case OP_VECTOR_FLOAT_SUM:
+			case OP_VECTOR_DOUBLE_SUM: return ABInstruction(OpcodeNames[instruction].c_str(), offset);
+			case OP_STACK_LOAD: return SlotInstruction("OP_STACK_LOAD", offset);
+			case OP_STACK_STORE: return SlotInstruction("OP_STACK_STORE", offset);
+			case OP_CALL: return CompareJumpInstruction("OP_CALL", offset);
+			case OP_RET: return AInstruction("OP_RET", offset);
 		}
 	}
 
@@ -136,6 +194,40 @@ namespace ash
 		return offset + 1;
 	}
 
+	size_t Disassembler::PoolInstruction(const char* name, size_t offset)
+	{
+		uint8_t A = static_cast<uint8_t>(chunk->at(offset) >> 16);
+		bool wide = static_cast<uint8_t>(chunk->at(offset) >> 24) == OP_LOAD_CONST_WIDE;
+		uint32_t index = wide ? chunk->at(offset + 1) : static_cast<uint16_t>(chunk->at(offset));
+
+		std::cout << std::setfill('0') << name << " " << std::setw(3) << +A << " #" << index;
+		if (index < chunk->GetConstants().size()) std::cout << " (0x" << std::hex << chunk->GetConstants()[index] << std::dec << ")";
+		std::cout << std::endl;
+
+		return offset + 1 + wide;
+	}
+
+	size_t Disassembler::SlotInstruction(const char* name, size_t offset)
+	{
+		uint8_t A = static_cast<uint8_t>(chunk->at(offset) >> 16);
+		uint16_t slot = static_cast<uint16_t>(chunk->at(offset));
+
+		std::cout << std::setfill('0') << name << " " << std::setw(3) << +A << " [" << slot << "]" << std::endl;
+
+		return offset + 1;
+	}
+
+	size_t Disassembler::CompareJumpInstruction(const char* name, size_t offset)
+	{
+		uint8_t A = static_cast<uint8_t>(chunk->at(offset) >> 16);
+		uint8_t B = static_cast<uint8_t>(chunk->at(offset) >> 8);
+		int32_t jumpSize = static_cast<int32_t>(chunk->at(offset + 1));
+
+		std::cout << std::setfill('0') << name << " " << std::setw(3) << +A << " " << std::setw(3) << +B << " " << jumpSize << std::endl;
+
+		return offset + 2;
+	}
+
 	size_t Disassembler::JumpInstruction(const char* name, size_t offset)
 	{
 		uint32_t jumpSize = chunk->at(offset) & 0x00FFFFFF;
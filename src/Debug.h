@@ -12,9 +12,12 @@ namespace ash
 		size_t ABInstruction(const char* name, size_t offset);
 		size_t ABCInstruction(const char* name, size_t offset);
 		size_t ConstantInstruction(const char* name, size_t offset);
+		size_t PoolInstruction(const char* name, size_t offset);
 		size_t SimpleInstruction(const char* name, size_t offset);
 		size_t AInstruction(const char* name, size_t offset);
 		size_t JumpInstruction(const char* name, size_t offset);
+		size_t CompareJumpInstruction(const char* name, size_t offset);
+		size_t SlotInstruction(const char* name, size_t offset);
 	public:
 		Disassembler() = default;
 		~Disassembler() = default;
@@ -0,0 +1,191 @@
+#include "DecodedChunk.h"
+
+#include <stdlib.h>
+
+namespace ash
+{
+	namespace util
+	{
+		inline static uint8_t Opcode(uint32_t instruction)
+		{
+			uint8_t op = instruction >> 24;
+			return op;
+		}
+
+		inline static uint8_t RegisterA(uint32_t instruction)
+		{
+			uint8_t A = instruction >> 16;
+			return A;
+		}
+
+		inline static uint8_t RegisterB(uint32_t instruction)
+		{
+			uint8_t B = instruction >> 8;
+			return B;
+		}
+
+		inline static uint8_t RegisterC(uint32_t instruction)
+		{
+			uint8_t C = instruction;
+			return C;
+		}
+
+		inline static uint16_t Value(uint32_t instruction)
+		{
+			uint16_t value = instruction;
+			return value;
+		}
+
+		inline static int32_t JumpOffset(uint32_t instruction)
+		{
+			uint32_t offset = instruction & 0x00FFFFFF;
+			offset += (!!(offset & (1 << (24 - 1))) * 0xFF000000);
+			return (int32_t)offset;
+		}
+	}
+
+	DecodedChunk::~DecodedChunk()
+	{
+		free(allocation);
+	}
+
+	const char* DecodedChunk::decode(Chunk* chunk)
+	{
+		using namespace util;
+
+		free(allocation);
+		boundTable = nullptr;
+		unmapped = false;
+		constants = chunk->GetConstants();
+		//one extra slot for the OP_HALT sentinel, so running off the end (or jumping to it) stops cleanly
+		count = chunk->size() + 1;
+		allocation = malloc(count * sizeof(DecodedInstruction) + 63);
+		if (allocation == nullptr) exit(1);
+		instructions = reinterpret_cast<DecodedInstruction*>((reinterpret_cast<uintptr_t>(allocation) + 63) & ~(uintptr_t)63);
+
+		for (size_t offset = 0; offset < chunk->size(); offset++)
+		{
+			uint32_t word = chunk->at(offset);
+			DecodedInstruction decoded;
+			decoded.op = Opcode(word);
+			decoded.A = RegisterA(word);
+			decoded.B = RegisterB(word);
+			decoded.C = RegisterC(word);
+
+			if (decoded.op >= OpcodeNames.size()) return "unknown opcode!";
+
+			switch (decoded.op)
+			{
+				//allocation collects, a caller waits at its call, and a program that stopped can be collected after
+				case OP_ALLOC:
+				case OP_ALLOC_ARRAY:
+				case OP_ARRAY_PUSH:
+				case OP_ARRAY_RESERVE:
+				case OP_ARRAY_SLICE:
+				case OP_CALL:
+				case OP_HALT:
+				case OP_RETURN:
+					if (chunk->GetRegisterMap(offset) == nullptr) unmapped = true;
+					break;
+				default: break;
+			}
+
+			switch (decoded.op)
+			{
+				case OP_CONST_LOW:
+				case OP_CONST_MID_LOW:
+				case OP_CONST_MID_HIGH:
+				case OP_CONST_HIGH:
+				{
+					decoded.immediate = Value(word);
+					break;
+				}
+				case OP_CONST_LOW_NEGATIVE:
+				{
+					//stored already sign-extended so the handler is a single register write
+					decoded.immediate = (int32_t)(0xFFFF0000 | Value(word));
+					break;
+				}
+				case OP_RELATIVE_JUMP:
+				case OP_RELATIVE_JUMP_IF_TRUE:
+				{
+					int64_t target = (int64_t)offset + JumpOffset(word);
+					if (target < 0 || target > (int64_t)chunk->size()) return "attempted jump beyond code bounds!";
+					decoded.immediate = (int32_t)target;
+					break;
+				}
+				case OP_STORE_IP_OFFSET:
+				{
+					decoded.immediate = (int32_t)(offset + 1);
+					break;
+				}
+				case OP_STACK_LOAD:
+				case OP_STACK_STORE:
+				{
+					decoded.immediate = Value(word);
+					break;
+				}
+				case OP_LOAD_CONST:
+				{
+					if (Value(word) >= constants.size()) return "constant index out of bounds!";
+					decoded.immediate = Value(word);
+					break;
+				}
+				case OP_JUMP_IF_SIGN_LESS:
+				case OP_JUMP_IF_SIGN_GREATER:
+				case OP_JUMP_IF_UNSIGN_LESS:
+				case OP_JUMP_IF_UNSIGN_GREATER:
+				case OP_JUMP_IF_INT_EQUAL:
+				case OP_JUMP_IF_FLOAT_LESS:
+				case OP_JUMP_IF_FLOAT_GREATER:
+				case OP_JUMP_IF_FLOAT_EQUAL:
+				case OP_JUMP_IF_DOUBLE_LESS:
+				case OP_JUMP_IF_DOUBLE_GREATER:
+				case OP_JUMP_IF_DOUBLE_EQUAL:
+				{
+					if (offset + 1 >= chunk->size()) return "jump offset missing!";
+					int64_t target = (int64_t)offset + (int32_t)chunk->at(offset + 1);
+					if (target < 0 || target > (int64_t)chunk->size()) return "attempted jump beyond code bounds!";
+					decoded.immediate = (int32_t)target;
+					instructions[offset] = decoded;
+					instructions[++offset] = DecodedInstruction();
+					continue;
+				}
+				case OP_CALL:
+				{
+					if (offset + 1 >= chunk->size()) return "call offset missing!";
+					int64_t target = (int64_t)offset + (int32_t)chunk->at(offset + 1);
+					if (target < 0 || target >= (int64_t)chunk->size()) return "attempted call beyond code bounds!";
+					decoded.immediate = (int32_t)target;
+					instructions[offset] = decoded;
+					instructions[++offset] = DecodedInstruction();
+					continue;
+				}
+				case OP_LOAD_CONST_WIDE:
+				{
+					if (offset + 1 >= chunk->size()) return "constant index missing!";
+					uint32_t index = chunk->at(offset + 1);
+					if (index >= constants.size()) return "constant index out of bounds!";
+					decoded.immediate = (int32_t)index;
+					//the index word is skipped by the handler; decoding it as a halt keeps a stray jump onto it harmless
+					instructions[offset] = decoded;
+					instructions[++offset] = DecodedInstruction();
+					continue;
+				}
+			}
+			instructions[offset] = decoded;
+		}
+		instructions[count - 1] = DecodedInstruction();
+		return nullptr;
+	}
+
+	void DecodedChunk::bindHandlers(const void* const* table)
+	{
+		if (boundTable == table) return;
+		for (size_t i = 0; i < count; i++)
+		{
+			instructions[i].handler = table[instructions[i].op];
+		}
+		boundTable = table;
+	}
+}
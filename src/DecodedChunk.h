@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Chunk.h"
+
+namespace ash
+{
+	//one fully decoded instruction; four of these share a 64 byte cache line
+	struct alignas(16) DecodedInstruction
+	{
+		const void* handler = nullptr; //label address for threaded dispatch, unused by the switch loop
+		uint8_t op = OP_HALT;
+		uint8_t A = 0;
+		uint8_t B = 0;
+		uint8_t C = 0;
+		int32_t immediate = 0; //sign-correct constant bits, constant pool index, absolute jump target or ip offset
+	};
+
+	//execution form of a Chunk: the packed uint32_t words stay the on-disk format,
+	//this is what VM::run walks so that no handler has to shift operands out of a word
+	class DecodedChunk
+	{
+	private:
+		void* allocation = nullptr;
+		DecodedInstruction* instructions = nullptr;
+		size_t count = 0;
+		const void* const* boundTable = nullptr;
+		std::vector<uint64_t> constants;
+		bool unmapped = false;
+	public:
+		DecodedChunk() = default;
+		~DecodedChunk();
+		DecodedChunk(const DecodedChunk&) = delete;
+		DecodedChunk& operator=(const DecodedChunk&) = delete;
+
+		//returns nullptr on success, otherwise a description of the first malformed instruction
+		const char* decode(Chunk* chunk);
+
+		//fills in the handler of every instruction from a table indexed by opcode; no-op if already bound to it
+		void bindHandlers(const void* const* table);
+
+		DecodedInstruction* code() { return instructions; }
+		size_t size() { return count; }
+		uint64_t constant(int32_t index) { return constants[index]; }
+		//some instruction a collection can wait on has no register map, so registers can only be scanned conservatively
+		bool conservativeRoots() { return unmapped; }
+	};
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Memory.h"
+
+#include <deque>
+#include <mutex>
+
+namespace ash
+{
+	//grey objects of one parallel marking thread: the owner works from the back, and idle threads
+	//steal from the front so they take the oldest (and likely largest) parts of the graph
+	class MarkDeque
+	{
+	private:
+		std::mutex mutex;
+		std::deque<ObjectHeader*> objects;
+	public:
+		void push(ObjectHeader* object)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			objects.push_back(object);
+		}
+
+		bool pop(ObjectHeader*& object)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (objects.empty()) return false;
+			object = objects.back();
+			objects.pop_back();
+			return true;
+		}
+
+		bool steal(ObjectHeader*& object)
+		{
+			std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+			if (!lock.owns_lock() || objects.empty()) return false;
+			object = objects.front();
+			objects.pop_front();
+			return true;
+		}
+	};
+}
@@ -1,7 +1,32 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <atomic>
 #include <vector>
+
+//object layout: shared by the interpreter and native code. registers and fields point at the
+//header, and the payload follows it in the same block
+#define ARRAY_TYPE_OFFSET 8
+#define STRUCT_SPACING_OFFSET 8
+#define OBJECT_KIND_OFFSET 10
+#define OBJECT_BEGIN_OFFSET 12
+//arrays reach their elements through a pointer, so growing one never moves its header: the elements
+//start out in the block at ARRAY_BEGIN_OFFSET and move to storage of their own once they outgrow it
+#define ARRAY_BLOCK_OFFSET 12
+#define ARRAY_ELEMENTS_OFFSET 16
+#define ARRAY_BEGIN_OFFSET 24
+//the heap count and the links of the old space list sit in front of each header (ObjectLinks);
+//in the nursery the next link is the forwarding address
+#define OBJECT_LINK_SIZE 24
+
+//ObjectHeader::flags
+#define OBJECT_REMEMBERED 0x01 //old object in the remembered set
+#define OBJECT_MARKED 0x02 //reached by the collection in progress
+#define OBJECT_FORWARDED 0x04 //moved by compaction; the link word holds the new address
+#define OBJECT_ZERO_COUNT 0x08 //in the zero count table of deferred reference counting
+
 namespace ash
 {
 	enum class FieldType : uint8_t
@@ -60,28 +85,51 @@ namespace ash
 		std::vector<FieldMetadata> fields;
 	};
 
-	enum class AllocationType
+	enum class ObjectKind : uint8_t
 	{
 		Type, Array
 	};
 
-	struct Allocation
-	{
-		char* memory;
-		Allocation* next;
-		Allocation* previous;
-		uint64_t size;
+	struct ObjectHeader;
 
-		virtual AllocationType type() = 0;
-	};
-
-	struct TypeAllocation : public Allocation
+	struct ObjectLinks
 	{
-		virtual AllocationType type() override { return AllocationType::Type; }
+		uint32_t refCount; //references from other heap objects; registers and the stack are not counted
+		uint32_t capacity; //arrays: elements their storage has room for; those past count are kept zeroed
+		ObjectHeader** previous; //the link pointing at this object, so it can be unlinked without a search
+		ObjectHeader* next;
 	};
 
-	struct ArrayAllocation : public Allocation
+	struct ObjectHeader
 	{
-		virtual AllocationType type() override { return AllocationType::Array; }
+		union
+		{
+			TypeMetadata* type; //structs
+			uint64_t count; //arrays
+		};
+		uint8_t tag; //struct spacing, or array element span (| 0x80 when the elements are pointers)
+		uint8_t reserved;
+		ObjectKind kind;
+		uint8_t flags;
+
+		char* payload() { return reinterpret_cast<char*>(this) + OBJECT_BEGIN_OFFSET; }
+		//arrays: the storage of the elements, and elements the block itself has room for
+		char*& elements() { return *reinterpret_cast<char**>(reinterpret_cast<char*>(this) + ARRAY_ELEMENTS_OFFSET); }
+		uint32_t& blockCapacity() { return *reinterpret_cast<uint32_t*>(reinterpret_cast<char*>(this) + ARRAY_BLOCK_OFFSET); }
+		bool inlineElements() { return elements() == reinterpret_cast<char*>(this) + ARRAY_BEGIN_OFFSET; }
+		//arrays: address of element index
+		char* element(uint64_t index) { return elements() + (tag & 0x7F) * index; }
+		//flags are shared with the concurrent marker
+		std::atomic<uint8_t>& atomicFlags() { return *reinterpret_cast<std::atomic<uint8_t>*>(&flags); }
+		ObjectLinks* links() { return reinterpret_cast<ObjectLinks*>(reinterpret_cast<char*>(this) - OBJECT_LINK_SIZE); }
+		ObjectHeader*& next() { return links()->next; }
+		ObjectHeader**& previous() { return links()->previous; }
+		uint32_t& refCount() { return links()->refCount; }
+		uint32_t& capacity() { return links()->capacity; }
 	};
+
+	static_assert(offsetof(ObjectHeader, tag) == ARRAY_TYPE_OFFSET, "object layout out of sync");
+	static_assert(offsetof(ObjectHeader, kind) == OBJECT_KIND_OFFSET, "object layout out of sync");
+	static_assert(OBJECT_LINK_SIZE == sizeof(ObjectLinks), "object layout out of sync");
+	static_assert(sizeof(std::atomic<uint8_t>) == 1, "object flags must be updatable in place");
 }
\ No newline at end of file
@@ -0,0 +1,705 @@
+#include "NativeChunk.h"
+#include "Memory.h"
+#include "Vector.h"
+
+#ifdef JIT_SUPPORTED
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <cstddef>
+#include <string.h>
+#include <algorithm>
+
+namespace ash
+{
+#ifdef JIT_SUPPORTED
+	namespace util
+	{
+		//operand registers used by the templates
+		enum : uint8_t { RAX = 0, RCX = 1, RDX = 2, RBX = 3, XMM0 = 0 };
+
+		inline static void Emit(std::vector<uint8_t>& code, std::initializer_list<uint8_t> bytes)
+		{
+			code.insert(code.end(), bytes);
+		}
+
+		inline static void Emit32(std::vector<uint8_t>& code, uint32_t value)
+		{
+			for (int i = 0; i < 4; i++) code.push_back((uint8_t)(value >> (8 * i)));
+		}
+
+		inline static void Emit64(std::vector<uint8_t>& code, uint64_t value)
+		{
+			for (int i = 0; i < 8; i++) code.push_back((uint8_t)(value >> (8 * i)));
+		}
+
+		//[rbx + 8 * vmRegister + byteOffset]; rbx holds the address of R[0] for the whole native chunk
+		inline static void EmitRegisterOperand(std::vector<uint8_t>& code, uint8_t reg, uint8_t vmRegister, uint8_t byteOffset = 0)
+		{
+			code.push_back(0x80 | (reg << 3) | RBX);
+			Emit32(code, 8 * (uint32_t)vmRegister + byteOffset);
+		}
+
+		//prefix (0 for none), REX (0 for none), one or two opcode bytes, then a register file operand
+		inline static void EmitMemory(std::vector<uint8_t>& code, uint8_t prefix, uint8_t rex, std::initializer_list<uint8_t> op, uint8_t reg, uint8_t vmRegister)
+		{
+			if (prefix) code.push_back(prefix);
+			if (rex) code.push_back(rex);
+			code.insert(code.end(), op);
+			EmitRegisterOperand(code, reg, vmRegister);
+		}
+
+		inline static void LoadRegister(std::vector<uint8_t>& code, uint8_t reg, uint8_t vmRegister)
+		{
+			EmitMemory(code, 0, 0x48, { 0x8B }, reg, vmRegister); //mov reg, [R]
+		}
+
+		inline static void StoreRegister(std::vector<uint8_t>& code, uint8_t reg, uint8_t vmRegister)
+		{
+			EmitMemory(code, 0, 0x48, { 0x89 }, reg, vmRegister); //mov [R], reg
+		}
+
+		//the comparison register lives at [r12]
+		inline static void StoreComparisonFromAL(std::vector<uint8_t>& code, uint8_t vmRegister)
+		{
+			Emit(code, { 0x0F, 0xB6, 0xC0 }); //movzx eax, al
+			StoreRegister(code, RAX, vmRegister);
+			Emit(code, { 0x41, 0x88, 0x04, 0x24 }); //mov [r12], al
+		}
+
+		//low 32 bits of xmm0 into R with the high half cleared, matching how the interpreter stores floats
+		inline static void StoreFloat(std::vector<uint8_t>& code, uint8_t vmRegister)
+		{
+			Emit(code, { 0x66, 0x0F, 0x7E, 0xC0 }); //movd eax, xmm0
+			StoreRegister(code, RAX, vmRegister);
+		}
+
+		inline static void StoreDouble(std::vector<uint8_t>& code, uint8_t vmRegister)
+		{
+			EmitMemory(code, 0xF2, 0, { 0x0F, 0x11 }, XMM0, vmRegister); //movsd [R], xmm0
+		}
+
+		inline static uint32_t Operands(DecodedInstruction& instruction)
+		{
+			return ((uint32_t)instruction.A << 16) | ((uint32_t)instruction.B << 8) | instruction.C;
+		}
+
+		//slow paths shared by all native code; returning false leaves the instruction to the interpreter,
+		//which repeats the checks and reports the error (or, for pointer arrays, keeps the heap counts)
+		static bool NativeArrayAccess(uint64_t* R, uint32_t operands, bool store, bool checked = true)
+		{
+			uint8_t A = operands >> 16;
+			uint8_t B = operands >> 8;
+			uint8_t C = operands;
+			if (checked && R[B] == 0) return false;
+			auto object = reinterpret_cast<ObjectHeader*>(R[B]);
+			if (checked && object->kind != ObjectKind::Array) return false;
+			uint8_t typeByte = object->tag;
+			if (store && (typeByte & 0x80)) return false;
+			uint8_t span = typeByte & 0x7F;
+			if (checked && R[C] >= object->count) return false;
+			char* address = object->element(R[C]);
+			switch (span)
+			{
+				case 1: if (store) *(uint8_t*)address = (uint8_t)R[A]; else R[A] = *(uint8_t*)address; break;
+				case 2: if (store) *(uint16_t*)address = (uint16_t)R[A]; else R[A] = *(uint16_t*)address; break;
+				case 4: if (store) *(uint32_t*)address = (uint32_t)R[A]; else R[A] = *(uint32_t*)address; break;
+				case 8: if (store) *(uint64_t*)address = R[A]; else R[A] = *(uint64_t*)address; break;
+			}
+			return true;
+		}
+
+		static bool NativeArrayLoad(uint64_t* R, uint32_t operands)
+		{
+			return NativeArrayAccess(R, operands, false);
+		}
+
+		static bool NativeArrayStore(uint64_t* R, uint32_t operands)
+		{
+			return NativeArrayAccess(R, operands, true);
+		}
+
+		//the compiler proved these in bounds
+		static bool NativeArrayLoadUnchecked(uint64_t* R, uint32_t operands)
+		{
+			return NativeArrayAccess(R, operands, false, false);
+		}
+
+		static bool NativeArrayStoreUnchecked(uint64_t* R, uint32_t operands)
+		{
+			return NativeArrayAccess(R, operands, true, false);
+		}
+
+		static bool NativeArrayCheck(uint64_t* R, uint32_t operands)
+		{
+			uint8_t A = operands >> 16;
+			uint8_t B = operands >> 8;
+			uint8_t C = operands;
+			if ((int64_t)R[B] >= (int64_t)R[C]) return true;
+			if (R[A] == 0) return false;
+			auto object = reinterpret_cast<ObjectHeader*>(R[A]);
+			if (object->kind != ObjectKind::Array) return false;
+			return R[B] <= object->count && R[C] - R[B] <= object->count - R[B];
+		}
+
+		static bool NativeArrayLength(uint64_t* R, uint32_t operands)
+		{
+			uint8_t A = operands >> 16;
+			uint8_t B = operands >> 8;
+			if (R[A] == 0) return false;
+			auto object = reinterpret_cast<ObjectHeader*>(R[A]);
+			if (object->kind != ObjectKind::Array) return false;
+			R[B] = object->count;
+			return true;
+		}
+
+		//the array in R[reference] when it holds elements [R[reference + 1], R[reference + 1] + count)
+		static ObjectHeader* NativeArrayRange(uint64_t* R, uint8_t reference, uint64_t count)
+		{
+			if (R[reference] == 0) return nullptr;
+			auto object = reinterpret_cast<ObjectHeader*>(R[reference]);
+			if (object->kind != ObjectKind::Array) return nullptr;
+			uint64_t index = R[(uint8_t)(reference + 1)];
+			if (index > object->count || count > object->count - index) return nullptr;
+			return object;
+		}
+
+		//bulk operations on pointer arrays need the heap counts and barriers, so they are left to the interpreter
+		static bool NativeArrayCopy(uint64_t* R, uint32_t operands)
+		{
+			uint8_t A = operands >> 16;
+			uint8_t B = operands >> 8;
+			uint8_t C = operands;
+			ObjectHeader* source = NativeArrayRange(R, A, R[C]);
+			ObjectHeader* destination = NativeArrayRange(R, B, R[C]);
+			if (source == nullptr || destination == nullptr) return false;
+			if (source->tag != destination->tag || (source->tag & 0x80)) return false;
+			memmove(destination->element(R[(uint8_t)(B + 1)]), source->element(R[(uint8_t)(A + 1)]), R[C] * source->tag);
+			return true;
+		}
+
+		static bool NativeArrayFill(uint64_t* R, uint32_t operands)
+		{
+			uint8_t A = operands >> 16;
+			uint8_t B = operands >> 8;
+			uint8_t C = operands;
+			ObjectHeader* array = NativeArrayRange(R, B, R[C]);
+			if (array == nullptr || (array->tag & 0x80)) return false;
+			char* address = array->element(R[(uint8_t)(B + 1)]);
+			uint64_t count = R[C];
+			switch (array->tag)
+			{
+				case 1: memset(address, (uint8_t)R[A], count); break;
+				case 2: std::fill_n((uint16_t*)address, count, (uint16_t)R[A]); break;
+				case 4: std::fill_n((uint32_t*)address, count, (uint32_t)R[A]); break;
+				case 8: std::fill_n((uint64_t*)address, count, R[A]); break;
+			}
+			return true;
+		}
+
+		static bool NativeArrayCompare(uint64_t* R, uint32_t operands)
+		{
+			uint8_t A = operands >> 16;
+			uint8_t B = operands >> 8;
+			uint8_t C = operands;
+			ObjectHeader* left = NativeArrayRange(R, A, R[C]);
+			ObjectHeader* right = NativeArrayRange(R, B, R[C]);
+			if (left == nullptr || right == nullptr || left->tag != right->tag) return false;
+			R[C] = memcmp(left->element(R[(uint8_t)(A + 1)]), right->element(R[(uint8_t)(B + 1)]), R[C] * (left->tag & 0x7F)) == 0;
+			return true;
+		}
+
+		//operands carry the opcode in their top byte
+		static bool NativeVector(uint64_t* R, uint32_t operands)
+		{
+			return vectorInstruction(R, operands >> 24, operands >> 16, operands >> 8, operands) == nullptr;
+		}
+	}
+#endif
+
+	NativeChunk::~NativeChunk()
+	{
+		clear();
+	}
+
+	void NativeChunk::clear()
+	{
+#ifdef JIT_SUPPORTED
+		if (buffer) munmap(buffer, capacity);
+#endif
+		buffer = nullptr;
+		entries.clear();
+	}
+
+#ifdef JIT_SUPPORTED
+	const char* NativeChunk::compile(DecodedChunk& program)
+	{
+		using namespace util;
+
+		if (buffer) munmap(buffer, capacity);
+		buffer = nullptr;
+		entries.assign(program.size(), 0);
+
+		std::vector<uint8_t> code;
+		std::vector<std::pair<size_t, size_t>> jumps; //rel32 position, target instruction
+
+		//entry(R, &comparisonRegister, target): rbx = R, r12 = &comparisonRegister, then jump into the body
+		Emit(code, { 0x53 });                   //push rbx
+		Emit(code, { 0x41, 0x54 });             //push r12
+		Emit(code, { 0x48, 0x83, 0xEC, 0x08 }); //sub rsp, 8 (keeps calls 16 byte aligned)
+		Emit(code, { 0x48, 0x89, 0xFB });       //mov rbx, rdi
+		Emit(code, { 0x49, 0x89, 0xF4 });       //mov r12, rsi
+		Emit(code, { 0xFF, 0xE2 });             //jmp rdx
+		//every exit loads the resume index into eax and jumps here
+		size_t epilogue = code.size();
+		Emit(code, { 0x48, 0x83, 0xC4, 0x08 }); //add rsp, 8
+		Emit(code, { 0x41, 0x5C });             //pop r12
+		Emit(code, { 0x5B });                   //pop rbx
+		Emit(code, { 0xC3 });                   //ret
+
+		auto exitTo = [&](size_t index)
+		{
+			Emit(code, { 0xB8 }); //mov eax, index
+			Emit32(code, (uint32_t)index);
+			Emit(code, { 0xE9 }); //jmp epilogue
+			Emit32(code, (uint32_t)(epilogue - (code.size() + 4)));
+		};
+		//skips the 10 byte exit that follows unless the flags say zero
+		auto exitIfZero = [&](size_t index)
+		{
+			Emit(code, { 0x75, 0x0A }); //jnz +10
+			exitTo(index);
+		};
+		auto jumpTo = [&](size_t target)
+		{
+			Emit(code, { 0xE9 });
+			jumps.emplace_back(code.size(), target);
+			Emit32(code, 0);
+		};
+		auto jumpIf = [&](uint8_t jcc, size_t target)
+		{
+			Emit(code, { 0x0F, jcc }); //jcc rel32
+			jumps.emplace_back(code.size(), target);
+			Emit32(code, 0);
+		};
+		//fused compare-and-branch; the offset word that follows gets no code of its own
+		auto compareJump = [&](DecodedInstruction& in, size_t& i, uint8_t prefix, uint8_t left, uint8_t right, uint8_t jcc)
+		{
+			if (prefix == 0x48)
+			{
+				LoadRegister(code, RAX, left);
+				EmitMemory(code, 0, 0x48, { 0x3B }, RAX, right); //cmp rax, [right]
+			}
+			else
+			{
+				EmitMemory(code, prefix == 0x66 ? 0xF2 : 0xF3, 0, { 0x0F, 0x10 }, XMM0, left);
+				EmitMemory(code, prefix, 0, { 0x0F, 0x2E }, XMM0, right); //ucomiss/ucomisd xmm0, [right]
+				if (jcc == 0x84) Emit(code, { 0x7A, 0x06 }); //jp over the je: unordered is never equal
+			}
+			jumpIf(jcc, in.immediate);
+			entries[++i] = (uint32_t)code.size();
+		};
+		auto callHelper = [&](bool (*helper)(uint64_t*, uint32_t), uint32_t operands, size_t index)
+		{
+			Emit(code, { 0x48, 0x89, 0xDF }); //mov rdi, rbx
+			Emit(code, { 0xBE });             //mov esi, operands
+			Emit32(code, operands);
+			Emit(code, { 0x48, 0xB8 });       //mov rax, helper
+			Emit64(code, reinterpret_cast<uint64_t>(helper));
+			Emit(code, { 0xFF, 0xD0 });       //call rax
+			Emit(code, { 0x84, 0xC0 });       //test al, al
+			exitIfZero(index);
+		};
+		//accesses the compiler proved in bounds run inline on arrays of 8 byte elements;
+		//other spans, and stores of pointers, go through the helper
+		auto uncheckedAccess = [&](DecodedInstruction& in, size_t index, bool store)
+		{
+			const uint8_t tag = (uint8_t)offsetof(ObjectHeader, tag);
+			const uint8_t elements = (uint8_t)ARRAY_ELEMENTS_OFFSET;
+			LoadRegister(code, RAX, in.B);
+			if (store) Emit(code, { 0x80, 0x78, tag, 0x08 }); //cmp byte [rax + tag], 8
+			else
+			{
+				Emit(code, { 0x8A, 0x48, tag });  //mov cl, [rax + tag]
+				Emit(code, { 0x80, 0xE1, 0x7F }); //and cl, 0x7F
+				Emit(code, { 0x80, 0xF9, 0x08 }); //cmp cl, 8
+			}
+			Emit(code, { 0x75, 0x00 }); //jne to the helper
+			size_t fast = code.size();
+			LoadRegister(code, RCX, in.C);
+			Emit(code, { 0x48, 0x8B, 0x40, elements }); //mov rax, [rax + elements]
+			if (store)
+			{
+				LoadRegister(code, RDX, in.A);
+				Emit(code, { 0x48, 0x89, 0x14, 0xC8 }); //mov [rax + rcx * 8], rdx
+			}
+			else
+			{
+				Emit(code, { 0x48, 0x8B, 0x04, 0xC8 }); //mov rax, [rax + rcx * 8]
+				StoreRegister(code, RAX, in.A);
+			}
+			Emit(code, { 0xEB, 0x00 }); //jmp over the helper
+			size_t slow = code.size();
+			code[fast - 1] = (uint8_t)(slow - fast);
+			callHelper(store ? NativeArrayStoreUnchecked : NativeArrayLoadUnchecked, Operands(in), index);
+			code[slow - 1] = (uint8_t)(code.size() - slow);
+		};
+		//integer ALU op of the form op rax, [R]
+		auto integerBinary = [&](DecodedInstruction& in, std::initializer_list<uint8_t> op)
+		{
+			LoadRegister(code, RAX, in.A);
+			EmitMemory(code, 0, 0x48, op, RAX, in.B);
+			StoreRegister(code, RAX, in.C);
+		};
+		auto integerCompare = [&](DecodedInstruction& in, uint8_t setcc)
+		{
+			LoadRegister(code, RAX, in.A);
+			EmitMemory(code, 0, 0x48, { 0x3B }, RAX, in.B); //cmp rax, [B]
+			Emit(code, { 0x0F, setcc, 0xC0 });             //setcc al
+			StoreComparisonFromAL(code, in.C);
+		};
+		//prefix F3 works on floats, F2 on doubles
+		auto floatingBinary = [&](DecodedInstruction& in, uint8_t prefix, uint8_t op)
+		{
+			EmitMemory(code, prefix, 0, { 0x0F, 0x10 }, XMM0, in.A); //movss/movsd xmm0, [A]
+			EmitMemory(code, prefix, 0, { 0x0F, op }, XMM0, in.B);   //op xmm0, [B]
+			if (prefix == 0xF3) StoreFloat(code, in.C);
+			else StoreDouble(code, in.C);
+		};
+		//prefix 0 compares floats, 0x66 doubles; ucomis sets CF/ZF like an unsigned compare and PF on NaN
+		auto floatingCompare = [&](DecodedInstruction& in, uint8_t prefix, uint8_t left, uint8_t right, uint8_t setcc)
+		{
+			EmitMemory(code, prefix == 0x66 ? 0xF2 : 0xF3, 0, { 0x0F, 0x10 }, XMM0, left);
+			EmitMemory(code, prefix, 0, { 0x0F, 0x2E }, XMM0, right);
+			Emit(code, { 0x0F, setcc, 0xC0 });
+			if (setcc == 0x94)
+			{
+				Emit(code, { 0x0F, 0x9B, 0xC1 }); //setnp cl
+				Emit(code, { 0x20, 0xC8 });       //and al, cl
+			}
+			StoreComparisonFromAL(code, in.C);
+		};
+
+		DecodedInstruction* instructions = program.code();
+		for (size_t i = 0; i < program.size(); i++)
+		{
+			entries[i] = (uint32_t)code.size();
+			DecodedInstruction& in = instructions[i];
+			switch (in.op)
+			{
+				case OP_MOVE:
+				{
+					LoadRegister(code, RAX, in.A);
+					StoreRegister(code, RAX, in.B);
+					break;
+				}
+				case OP_CONST_LOW:
+				case OP_CONST_LOW_NEGATIVE:
+				case OP_STORE_IP_OFFSET:
+				{
+					EmitMemory(code, 0, 0x48, { 0xC7 }, 0, in.A); //mov qword [A], imm32 (sign extended)
+					Emit32(code, (uint32_t)in.immediate);
+					break;
+				}
+				case OP_LOAD_CONST:
+				case OP_LOAD_CONST_WIDE:
+				{
+					//the pool is immutable once decoded, so its value goes straight into the code
+					Emit(code, { 0x48, 0xB8 }); //mov rax, imm64
+					Emit64(code, program.constant(in.immediate));
+					StoreRegister(code, RAX, in.A);
+					if (in.op == OP_LOAD_CONST_WIDE)
+					{
+						//nothing to emit for the index word
+						entries[++i] = (uint32_t)code.size();
+					}
+					break;
+				}
+				case OP_CONST_MID_LOW:
+				case OP_CONST_MID_HIGH:
+				case OP_CONST_HIGH:
+				{
+					//each of these replaces exactly one 16-bit lane of R[A]
+					uint8_t lane = in.op == OP_CONST_MID_LOW ? 1 : in.op == OP_CONST_MID_HIGH ? 2 : 3;
+					Emit(code, { 0x66, 0xC7 }); //mov word [A + 2 * lane], imm16
+					EmitRegisterOperand(code, 0, in.A, 2 * lane);
+					Emit(code, { (uint8_t)in.immediate, (uint8_t)(in.immediate >> 8) });
+					break;
+				}
+				case OP_INT_ADD: integerBinary(in, { 0x03 }); break;
+				case OP_INT_SUB: integerBinary(in, { 0x2B }); break;
+				case OP_UNSIGN_MUL:
+				case OP_SIGN_MUL: integerBinary(in, { 0x0F, 0xAF }); break; //the low 64 bits do not depend on signedness
+				case OP_BITWISE_AND: integerBinary(in, { 0x23 }); break;
+				case OP_BITWISE_OR: integerBinary(in, { 0x0B }); break;
+				case OP_INT_NEGATE:
+				{
+					LoadRegister(code, RAX, in.A);
+					Emit(code, { 0x48, 0xF7, 0xD8 }); //neg rax
+					StoreRegister(code, RAX, in.B);
+					break;
+				}
+				case OP_UNSIGN_DIV:
+				case OP_SIGN_DIV:
+				{
+					LoadRegister(code, RCX, in.B);
+					Emit(code, { 0x48, 0x85, 0xC9 }); //test rcx, rcx
+					exitIfZero(i);
+					LoadRegister(code, RAX, in.A);
+					if (in.op == OP_SIGN_DIV)
+					{
+						Emit(code, { 0x48, 0x99 });       //cqo
+						Emit(code, { 0x48, 0xF7, 0xF9 }); //idiv rcx
+					}
+					else
+					{
+						Emit(code, { 0x31, 0xD2 });       //xor edx, edx
+						Emit(code, { 0x48, 0xF7, 0xF1 }); //div rcx
+					}
+					StoreRegister(code, RAX, in.C);
+					break;
+				}
+				case OP_BIT_SHIFT_RIGHT:
+				case OP_BIT_SHIFT_LEFT:
+				{
+					LoadRegister(code, RCX, in.B);
+					LoadRegister(code, RAX, in.A);
+					Emit(code, { 0x48, 0xD3, (uint8_t)(in.op == OP_BIT_SHIFT_RIGHT ? 0xE8 : 0xE0) }); //shr/shl rax, cl
+					StoreRegister(code, RAX, in.C);
+					break;
+				}
+				case OP_UNSIGN_LESS: integerCompare(in, 0x92); break;    //setb
+				case OP_UNSIGN_GREATER: integerCompare(in, 0x97); break; //seta
+				case OP_SIGN_LESS: integerCompare(in, 0x9C); break;      //setl
+				case OP_SIGN_GREATER: integerCompare(in, 0x9F); break;   //setg
+				case OP_INT_EQUAL: integerCompare(in, 0x94); break;      //sete
+				case OP_FLOAT_ADD: floatingBinary(in, 0xF3, 0x58); break;
+				case OP_FLOAT_SUB: floatingBinary(in, 0xF3, 0x5C); break;
+				case OP_FLOAT_MUL: floatingBinary(in, 0xF3, 0x59); break;
+				case OP_FLOAT_DIV: floatingBinary(in, 0xF3, 0x5E); break;
+				case OP_DOUBLE_ADD: floatingBinary(in, 0xF2, 0x58); break;
+				case OP_DOUBLE_SUB: floatingBinary(in, 0xF2, 0x5C); break;
+				case OP_DOUBLE_MUL: floatingBinary(in, 0xF2, 0x59); break;
+				case OP_DOUBLE_DIV: floatingBinary(in, 0xF2, 0x5E); break;
+				//a < b is tested as b > a so that NaN operands compare false
+				case OP_FLOAT_LESS: floatingCompare(in, 0, in.B, in.A, 0x97); break;
+				case OP_FLOAT_GREATER: floatingCompare(in, 0, in.A, in.B, 0x97); break;
+				case OP_FLOAT_EQUAL: floatingCompare(in, 0, in.A, in.B, 0x94); break;
+				case OP_DOUBLE_LESS: floatingCompare(in, 0x66, in.B, in.A, 0x97); break;
+				case OP_DOUBLE_GREATER: floatingCompare(in, 0x66, in.A, in.B, 0x97); break;
+				case OP_DOUBLE_EQUAL: floatingCompare(in, 0x66, in.A, in.B, 0x94); break;
+				case OP_FLOAT_NEGATE:
+				{
+					EmitMemory(code, 0, 0, { 0x8B }, RAX, in.A); //mov eax, [A]
+					Emit(code, { 0x35 });                         //xor eax, sign bit
+					Emit32(code, 0x80000000);
+					StoreRegister(code, RAX, in.B);
+					break;
+				}
+				case OP_DOUBLE_NEGATE:
+				{
+					LoadRegister(code, RAX, in.A);
+					Emit(code, { 0x48, 0x0F, 0xBA, 0xF8, 0x3F }); //btc rax, 63
+					StoreRegister(code, RAX, in.B);
+					break;
+				}
+				case OP_INT_TO_FLOAT:
+				{
+					EmitMemory(code, 0xF3, 0x48, { 0x0F, 0x2A }, XMM0, in.A); //cvtsi2ss xmm0, qword [A]
+					StoreFloat(code, in.B);
+					break;
+				}
+				case OP_INT_TO_DOUBLE:
+				{
+					EmitMemory(code, 0xF2, 0x48, { 0x0F, 0x2A }, XMM0, in.A); //cvtsi2sd xmm0, qword [A]
+					StoreDouble(code, in.B);
+					break;
+				}
+				case OP_FLOAT_TO_INT:
+				case OP_DOUBLE_TO_INT:
+				{
+					EmitMemory(code, in.op == OP_FLOAT_TO_INT ? 0xF3 : 0xF2, 0x48, { 0x0F, 0x2C }, RAX, in.A); //cvttss2si/cvttsd2si rax, [A]
+					StoreRegister(code, RAX, in.B);
+					break;
+				}
+				case OP_FLOAT_TO_DOUBLE:
+				{
+					EmitMemory(code, 0xF3, 0, { 0x0F, 0x5A }, XMM0, in.A); //cvtss2sd xmm0, [A]
+					StoreDouble(code, in.B);
+					break;
+				}
+				case OP_DOUBLE_TO_FLOAT:
+				{
+					EmitMemory(code, 0xF2, 0, { 0x0F, 0x5A }, XMM0, in.A); //cvtsd2ss xmm0, [A]
+					StoreFloat(code, in.B);
+					break;
+				}
+				case OP_LOGICAL_AND:
+				case OP_LOGICAL_OR:
+				{
+					EmitMemory(code, 0, 0x48, { 0x83 }, 7, in.A); //cmp qword [A], 0
+					code.push_back(0);
+					Emit(code, { 0x0F, 0x95, 0xC0 });            //setne al
+					EmitMemory(code, 0, 0x48, { 0x83 }, 7, in.B); //cmp qword [B], 0
+					code.push_back(0);
+					Emit(code, { 0x0F, 0x95, 0xC1 });            //setne cl
+					Emit(code, { (uint8_t)(in.op == OP_LOGICAL_AND ? 0x20 : 0x08), 0xC8 }); //and/or al, cl
+					StoreComparisonFromAL(code, in.C);
+					break;
+				}
+				case OP_LOGICAL_NOT:
+				{
+					EmitMemory(code, 0, 0x48, { 0x83 }, 7, in.A); //cmp qword [A], 0
+					code.push_back(0);
+					Emit(code, { 0x0F, 0x94, 0xC0 });            //sete al
+					StoreComparisonFromAL(code, in.B);
+					break;
+				}
+				case OP_ARRAY_LOAD:
+				{
+					callHelper(NativeArrayLoad, Operands(in), i);
+					break;
+				}
+				case OP_ARRAY_STORE:
+				{
+					callHelper(NativeArrayStore, Operands(in), i);
+					break;
+				}
+				case OP_ARRAY_LOAD_UNCHECKED:
+				{
+					uncheckedAccess(in, i, false);
+					break;
+				}
+				case OP_ARRAY_STORE_UNCHECKED:
+				{
+					uncheckedAccess(in, i, true);
+					break;
+				}
+				case OP_ARRAY_CHECK:
+				{
+					callHelper(NativeArrayCheck, Operands(in), i);
+					break;
+				}
+				case OP_ARRAY_LENGTH:
+				{
+					callHelper(NativeArrayLength, Operands(in), i);
+					break;
+				}
+				case OP_ARRAY_COPY:
+				{
+					callHelper(NativeArrayCopy, Operands(in), i);
+					break;
+				}
+				case OP_ARRAY_FILL:
+				{
+					callHelper(NativeArrayFill, Operands(in), i);
+					break;
+				}
+				case OP_ARRAY_COMPARE:
+				{
+					callHelper(NativeArrayCompare, Operands(in), i);
+					break;
+				}
+				case OP_VECTOR_INT_ADD:
+				case OP_VECTOR_FLOAT_ADD:
+				case OP_VECTOR_DOUBLE_ADD:
+				case OP_VECTOR_INT_SUB:
+				case OP_VECTOR_FLOAT_SUB:
+				case OP_VECTOR_DOUBLE_SUB:
+				case OP_VECTOR_INT_MUL:
+				case OP_VECTOR_FLOAT_MUL:
+				case OP_VECTOR_DOUBLE_MUL:
+				case OP_VECTOR_INT_FMA:
+				case OP_VECTOR_FLOAT_FMA:
+				case OP_VECTOR_DOUBLE_FMA:
+				case OP_VECTOR_INT_MIN:
+				case OP_VECTOR_FLOAT_MIN:
+				case OP_VECTOR_DOUBLE_MIN:
+				case OP_VECTOR_INT_MAX:
+				case OP_VECTOR_FLOAT_MAX:
+				case OP_VECTOR_DOUBLE_MAX:
+				case OP_VECTOR_INT_SCALE:
+				case OP_VECTOR_FLOAT_SCALE:
+				case OP_VECTOR_DOUBLE_SCALE:
+				case OP_VECTOR_INT_DOT:
+				case OP_VECTOR_FLOAT_DOT:
+				case OP_VECTOR_DOUBLE_DOT:
+				case OP_VECTOR_INT_SUM:
+				case OP_VECTOR_FLOAT_SUM:
+				case OP_VECTOR_DOUBLE_SUM:
+				{
+					callHelper(NativeVector, Operands(in) | (uint32_t)in.op << 24, i);
+					break;
+				}
+				case OP_RELATIVE_JUMP:
+				{
+					jumpTo(in.immediate);
+					break;
+				}
+				case OP_JUMP_IF_SIGN_LESS: compareJump(in, i, 0x48, in.A, in.B, 0x8C); break;      //jl
+				case OP_JUMP_IF_SIGN_GREATER: compareJump(in, i, 0x48, in.A, in.B, 0x8F); break;   //jg
+				case OP_JUMP_IF_UNSIGN_LESS: compareJump(in, i, 0x48, in.A, in.B, 0x82); break;    //jb
+				case OP_JUMP_IF_UNSIGN_GREATER: compareJump(in, i, 0x48, in.A, in.B, 0x87); break; //ja
+				case OP_JUMP_IF_INT_EQUAL: compareJump(in, i, 0x48, in.A, in.B, 0x84); break;      //je
+				case OP_JUMP_IF_FLOAT_LESS: compareJump(in, i, 0, in.B, in.A, 0x87); break;
+				case OP_JUMP_IF_FLOAT_GREATER: compareJump(in, i, 0, in.A, in.B, 0x87); break;
+				case OP_JUMP_IF_FLOAT_EQUAL: compareJump(in, i, 0, in.A, in.B, 0x84); break;
+				case OP_JUMP_IF_DOUBLE_LESS: compareJump(in, i, 0x66, in.B, in.A, 0x87); break;
+				case OP_JUMP_IF_DOUBLE_GREATER: compareJump(in, i, 0x66, in.A, in.B, 0x87); break;
+				case OP_JUMP_IF_DOUBLE_EQUAL: compareJump(in, i, 0x66, in.A, in.B, 0x84); break;
+				case OP_RELATIVE_JUMP_IF_TRUE:
+				{
+					Emit(code, { 0x41, 0x80, 0x3C, 0x24, 0x00 }); //cmp byte [r12], 0
+					Emit(code, { 0x74, 0x0A });                   //je over the reset and jump
+					Emit(code, { 0x41, 0xC6, 0x04, 0x24, 0x00 }); //mov byte [r12], 0
+					jumpTo(in.immediate);
+					break;
+				}
+				default:
+				{
+					//halts, calls and returns, allocation, the stack, output and register jumps stay in the interpreter
+					exitTo(i);
+					break;
+				}
+			}
+		}
+
+		for (auto& jump : jumps)
+		{
+			int32_t relative = (int32_t)entries[jump.second] - (int32_t)(jump.first + 4);
+			memcpy(&code[jump.first], &relative, 4);
+		}
+
+		size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+		capacity = (code.size() + pageSize - 1) & ~(pageSize - 1);
+		void* memory = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (memory == MAP_FAILED) return "could not map memory for native code!";
+		memcpy(memory, code.data(), code.size());
+		//never writable and executable at the same time
+		if (mprotect(memory, capacity, PROT_READ | PROT_EXEC) != 0)
+		{
+			munmap(memory, capacity);
+			return "could not make native code executable!";
+		}
+		buffer = memory;
+		return nullptr;
+	}
+
+	size_t NativeChunk::enter(uint64_t* registers, bool* comparisonRegister, size_t index)
+	{
+		typedef uint32_t(*Entry)(uint64_t*, bool*, const void*);
+		Entry entry = reinterpret_cast<Entry>(buffer);
+		return entry(registers, comparisonRegister, (char*)buffer + entries[index]);
+	}
+#else
+	const char* NativeChunk::compile(DecodedChunk& program)
+	{
+		return "native code is not supported on this platform!";
+	}
+
+	size_t NativeChunk::enter(uint64_t* registers, bool* comparisonRegister, size_t index)
+	{
+		return index;
+	}
+#endif
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "DecodedChunk.h"
+
+#include <vector>
+
+//#define DISABLE_JIT
+
+//the baseline JIT emits System V x86-64 code into mmap'd memory; everywhere else the VM only interprets
+#if defined(__x86_64__) && !defined(_WIN32) && !defined(DISABLE_JIT)
+#define JIT_SUPPORTED
+#endif
+
+namespace ash
+{
+	//x86-64 translation of a DecodedChunk: every instruction becomes a fixed template that reads and
+	//writes the VM's register file in memory, so native code can be entered or left at any instruction
+	class NativeChunk
+	{
+	private:
+		void* buffer = nullptr;
+		size_t capacity = 0;
+		std::vector<uint32_t> entries; //native offset of each decoded instruction
+	public:
+		NativeChunk() = default;
+		~NativeChunk();
+		NativeChunk(const NativeChunk&) = delete;
+		NativeChunk& operator=(const NativeChunk&) = delete;
+
+		//returns nullptr on success, otherwise why no native code could be produced
+		const char* compile(DecodedChunk& program);
+
+		//runs native code from instruction index until it reaches an instruction it does not translate
+		//(or one that fails a runtime check); returns that instruction's index for the interpreter to resume at
+		size_t enter(uint64_t* registers, bool* comparisonRegister, size_t index);
+
+		bool compiled() { return buffer != nullptr; }
+
+		//drops the translation, so a VM running a new chunk never enters code compiled for an old one
+		void clear();
+	};
+}
@@ -0,0 +1,1555 @@
+#include "Optimizer.h"
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace ash
+{
+	namespace util
+	{
+		//SSA versions carry their number after a '%'; only the copies back to the program's variables do not
+		static bool isVersion(const Token& token)
+		{
+			return token.string.find('%') != std::string::npos;
+		}
+
+		static bool isLiteral(const Token& token)
+		{
+			switch (token.type)
+			{
+				case TokenType::INT:
+				case TokenType::FLOAT:
+				case TokenType::DOUBLE:
+				case TokenType::TRUE:
+				case TokenType::FALSE:
+				case TokenType::CHAR:
+					return true;
+				default: return false;
+			}
+		}
+
+		static bool sameOperand(const Token& a, const Token& b)
+		{
+			return a.type == b.type && a.string.compare(b.string) == 0;
+		}
+
+		static bool integer(const Token& token, uint64_t& value)
+		{
+			switch (token.type)
+			{
+				case TokenType::INT: value = std::strtoull(token.string.c_str(), nullptr, 10); return true;
+				case TokenType::TRUE: value = 1; return true;
+				case TokenType::FALSE: value = 0; return true;
+				default: return false;
+			}
+		}
+
+		static bool real(const Token& token, double& value)
+		{
+			if (token.type != TokenType::DOUBLE) return false;
+			value = std::strtod(token.string.c_str(), nullptr);
+			return true;
+		}
+
+		static Token integerToken(uint64_t value, int line)
+		{
+			return { TokenType::INT, std::to_string((int64_t)value), line };
+		}
+
+		static Token realToken(double value, int line)
+		{
+			char text[32];
+			std::snprintf(text, sizeof(text), "%.17g", value);
+			return { TokenType::DOUBLE, text, line };
+		}
+
+		//comparison a compare-and-branch makes
+		static OpCodes comparisonOf(OpCodes jump)
+		{
+			switch (jump)
+			{
+				case OP_JUMP_IF_SIGN_LESS: return OP_SIGN_LESS;
+				case OP_JUMP_IF_SIGN_GREATER: return OP_SIGN_GREATER;
+				case OP_JUMP_IF_UNSIGN_LESS: return OP_UNSIGN_LESS;
+				case OP_JUMP_IF_UNSIGN_GREATER: return OP_UNSIGN_GREATER;
+				case OP_JUMP_IF_INT_EQUAL: return OP_INT_EQUAL;
+				case OP_JUMP_IF_DOUBLE_LESS: return OP_DOUBLE_LESS;
+				case OP_JUMP_IF_DOUBLE_GREATER: return OP_DOUBLE_GREATER;
+				case OP_JUMP_IF_DOUBLE_EQUAL: return OP_DOUBLE_EQUAL;
+				default: return OP_HALT;
+			}
+		}
+
+		//what the VM computes from two literals; false for anything it does not fold, and for a division that would fail at run time
+		static bool evaluate(OpCodes op, const Token& A, const Token& B, Token& result)
+		{
+			uint64_t a, b;
+			double x, y;
+			int line = A.line;
+			if (integer(A, a) && integer(B, b))
+			{
+				switch (op)
+				{
+					case OP_INT_ADD: result = integerToken(a + b, line); return true;
+					case OP_INT_SUB: result = integerToken(a - b, line); return true;
+					case OP_UNSIGN_MUL:
+					case OP_SIGN_MUL: result = integerToken(a * b, line); return true;
+					case OP_UNSIGN_DIV:
+						if (b == 0) return false;
+						result = integerToken(a / b, line);
+						return true;
+					case OP_SIGN_DIV:
+						if (b == 0 || ((int64_t)a == INT64_MIN && (int64_t)b == -1)) return false;
+						result = integerToken((uint64_t)((int64_t)a / (int64_t)b), line);
+						return true;
+					case OP_UNSIGN_LESS: result = integerToken(a < b, line); return true;
+					case OP_UNSIGN_GREATER: result = integerToken(a > b, line); return true;
+					case OP_SIGN_LESS: result = integerToken((int64_t)a < (int64_t)b, line); return true;
+					case OP_SIGN_GREATER: result = integerToken((int64_t)a > (int64_t)b, line); return true;
+					case OP_INT_EQUAL: result = integerToken(a == b, line); return true;
+					case OP_BITWISE_AND: result = integerToken(a & b, line); return true;
+					case OP_BITWISE_OR: result = integerToken(a | b, line); return true;
+					case OP_LOGICAL_AND: result = integerToken(a != 0 && b != 0, line); return true;
+					case OP_LOGICAL_OR: result = integerToken(a != 0 || b != 0, line); return true;
+					default: return false;
+				}
+			}
+			if (real(A, x) && real(B, y))
+			{
+				switch (op)
+				{
+					case OP_DOUBLE_ADD: result = realToken(x + y, line); return true;
+					case OP_DOUBLE_SUB: result = realToken(x - y, line); return true;
+					case OP_DOUBLE_MUL: result = realToken(x * y, line); return true;
+					case OP_DOUBLE_DIV: result = realToken(x / y, line); return true;
+					case OP_DOUBLE_LESS: result = integerToken(x < y, line); return true;
+					case OP_DOUBLE_GREATER: result = integerToken(x > y, line); return true;
+					case OP_DOUBLE_EQUAL: result = integerToken(x == y, line); return true;
+					default: return false;
+				}
+			}
+			return false;
+		}
+
+		static bool evaluate(OpCodes op, const Token& A, Token& result)
+		{
+			uint64_t a;
+			double x;
+			int line = A.line;
+			if (integer(A, a))
+			{
+				switch (op)
+				{
+					case OP_INT_NEGATE: result = integerToken(0 - a, line); return true;
+					case OP_LOGICAL_NOT: result = integerToken(a == 0, line); return true;
+					case OP_INT_TO_DOUBLE: result = realToken((double)(int64_t)a, line); return true;
+					default: return false;
+				}
+			}
+			if (real(A, x))
+			{
+				switch (op)
+				{
+					case OP_DOUBLE_NEGATE: result = realToken(-x, line); return true;
+					case OP_DOUBLE_TO_INT:
+						//out of range the conversion is undefined, so it is left to the VM
+						if (!(x > -9.2e18 && x < 9.2e18)) return false;
+						result = integerToken((uint64_t)(int64_t)x, line);
+						return true;
+					default: return false;
+				}
+			}
+			return false;
+		}
+
+		//integer identities: x + 0, x - 0, x | 0 and x * 1 leave x, x * 0 and x & 0 leave 0. floating point
+		//is left alone, where -0 and NaN make them inexact
+		static bool simplify(OpCodes op, const Token& A, const Token& B, Token& result)
+		{
+			uint64_t a = 0, b = 0;
+			bool literalA = A.type == TokenType::INT && integer(A, a);
+			bool literalB = B.type == TokenType::INT && integer(B, b);
+			switch (op)
+			{
+				case OP_INT_ADD:
+				case OP_BITWISE_OR:
+					if (literalB && b == 0) result = A;
+					else if (literalA && a == 0) result = B;
+					else return false;
+					return true;
+				case OP_INT_SUB:
+					if (!literalB || b != 0) return false;
+					result = A;
+					return true;
+				case OP_SIGN_MUL:
+				case OP_UNSIGN_MUL:
+					if ((literalA && a == 0) || (literalB && b == 0)) result = integerToken(0, A.line);
+					else if (literalB && b == 1) result = A;
+					else if (literalA && a == 1) result = B;
+					else return false;
+					return true;
+				case OP_BITWISE_AND:
+					if ((literalA && a == 0) || (literalB && b == 0)) result = integerToken(0, A.line);
+					else return false;
+					return true;
+				default: return false;
+			}
+		}
+
+		//whether op reads only its operands and writes only its result, so repeating it gives the same value
+		static bool pure(OpCodes op)
+		{
+			switch (op)
+			{
+				case OP_INT_ADD: case OP_INT_SUB: case OP_INT_NEGATE:
+				case OP_UNSIGN_MUL: case OP_UNSIGN_DIV: case OP_SIGN_MUL: case OP_SIGN_DIV:
+				case OP_BIT_SHIFT_LEFT: case OP_BIT_SHIFT_RIGHT:
+				case OP_FLOAT_ADD: case OP_FLOAT_SUB: case OP_FLOAT_MUL: case OP_FLOAT_DIV: case OP_FLOAT_NEGATE:
+				case OP_DOUBLE_ADD: case OP_DOUBLE_SUB: case OP_DOUBLE_MUL: case OP_DOUBLE_DIV: case OP_DOUBLE_NEGATE:
+				case OP_UNSIGN_LESS: case OP_UNSIGN_GREATER: case OP_SIGN_LESS: case OP_SIGN_GREATER: case OP_INT_EQUAL:
+				case OP_FLOAT_LESS: case OP_FLOAT_GREATER: case OP_FLOAT_EQUAL:
+				case OP_DOUBLE_LESS: case OP_DOUBLE_GREATER: case OP_DOUBLE_EQUAL:
+				case OP_INT_TO_FLOAT: case OP_FLOAT_TO_INT: case OP_FLOAT_TO_DOUBLE:
+				case OP_DOUBLE_TO_FLOAT: case OP_INT_TO_DOUBLE: case OP_DOUBLE_TO_INT:
+				case OP_BITWISE_AND: case OP_BITWISE_OR:
+				case OP_LOGICAL_AND: case OP_LOGICAL_OR: case OP_LOGICAL_NOT:
+					return true;
+				default: return false;
+			}
+		}
+
+		static bool commutative(OpCodes op)
+		{
+			switch (op)
+			{
+				case OP_INT_ADD: case OP_UNSIGN_MUL: case OP_SIGN_MUL: case OP_INT_EQUAL:
+				case OP_FLOAT_ADD: case OP_FLOAT_MUL: case OP_FLOAT_EQUAL:
+				case OP_DOUBLE_ADD: case OP_DOUBLE_MUL: case OP_DOUBLE_EQUAL:
+				case OP_BITWISE_AND: case OP_BITWISE_OR: case OP_LOGICAL_AND: case OP_LOGICAL_OR:
+					return true;
+				default: return false;
+			}
+		}
+
+		//a division by anything but a nonzero literal, or a checked array read, can stop the program, so it is kept even when
+		//unused; so is a call, which can do anything
+		static bool mayFail(assembly* instruction)
+		{
+			if (instruction->type() == Asm::Call) return true;
+			if (instruction->type() == Asm::TwoAddr) return ((twoAddress*)instruction)->op == OP_ARRAY_LENGTH;
+			if (instruction->type() != Asm::ThreeAddr) return false;
+			auto threeAddr = (threeAddress*)instruction;
+			if (threeAddr->op == OP_ARRAY_LOAD) return true;
+			if (threeAddr->op != OP_SIGN_DIV && threeAddr->op != OP_UNSIGN_DIV) return false;
+			uint64_t divisor;
+			return !integer(threeAddr->B, divisor) || divisor == 0;
+		}
+
+		static bool arrayAccess(OpCodes op)
+		{
+			return op == OP_ARRAY_LOAD || op == OP_ARRAY_STORE || op == OP_ARRAY_LOAD_UNCHECKED || op == OP_ARRAY_STORE_UNCHECKED;
+		}
+
+		static std::shared_ptr<twoAddress> makeCopy(const Token& from, const Token& to)
+		{
+			auto copy = std::make_shared<twoAddress>();
+			copy->op = from.type == TokenType::IDENTIFIER ? OP_MOVE : OP_CONST_LOW;
+			copy->A = from;
+			copy->result = to;
+			return copy;
+		}
+
+		static std::shared_ptr<assembly> clone(assembly* instruction)
+		{
+			switch (instruction->type())
+			{
+				case Asm::pseudocode: return std::make_shared<pseudocode>(*(pseudocode*)instruction);
+				case Asm::OneAddr: return std::make_shared<oneAddress>(*(oneAddress*)instruction);
+				case Asm::TwoAddr: return std::make_shared<twoAddress>(*(twoAddress*)instruction);
+				case Asm::ThreeAddr: return std::make_shared<threeAddress>(*(threeAddress*)instruction);
+				case Asm::Call: return std::make_shared<call>(*(call*)instruction);
+				default: return nullptr;
+			}
+		}
+
+		static bool endsBlock(assembly* instruction)
+		{
+			if (instruction->type() == Asm::Jump || instruction->type() == Asm::CompareJump) return true;
+			if (instruction->type() == Asm::pseudocode && ((pseudocode*)instruction)->op == OP_HALT) return true;
+			return (instruction->type() == Asm::pseudocode || instruction->type() == Asm::OneAddr) && ((pseudocode*)instruction)->op == OP_RET;
+		}
+
+		//adds code to the end of a block, ahead of the jump that leaves it
+		static void append(BasicBlock& block, const std::vector<std::shared_ptr<assembly>>& code)
+		{
+			auto at = block.code.end();
+			if (block.code.size() && endsBlock(block.code.back().get())) at--;
+			block.code.insert(at, code.begin(), code.end());
+		}
+
+		//the block each version is defined in, and the instruction defining it
+		static void findDefinitions(FlowGraph& graph, std::unordered_map<std::string, std::pair<size_t, assembly*>>& definitions)
+		{
+			definitions.clear();
+			for (size_t b : graph.order)
+			{
+				for (const auto& instruction : graph.blocks[b].code)
+				{
+					std::vector<Token*> uses;
+					Token* def = nullptr;
+					instruction->operands(uses, def);
+					if (def) definitions[def->string] = { b, instruction.get() };
+				}
+			}
+		}
+
+		//a header phi that takes initial from the preheader and, round the back edge, what step makes of it and a literal
+		struct Induction
+		{
+			phi* merge;
+			Token initial;
+			threeAddress* step;
+			size_t stepBlock;
+			Token increment; //the literal operand of step
+		};
+
+		static std::vector<Induction> findInductions(FlowGraph& graph, const Loop& loop, std::unordered_map<std::string, std::pair<size_t, assembly*>>& definitions)
+		{
+			std::vector<Induction> inductions;
+			if (loop.preheader == SIZE_MAX || loop.latches.size() != 1) return inductions;
+			for (const auto& instruction : graph.blocks[loop.header].code)
+			{
+				if (instruction->type() != Asm::Phi) continue;
+				auto merge = (phi*)instruction.get();
+				if (merge->arguments.size() != 2) continue;
+				Induction induction;
+				induction.merge = merge;
+				Token next;
+				for (const auto& argument : merge->arguments)
+				{
+					if (argument.first == loop.preheader) induction.initial = argument.second;
+					else next = argument.second;
+				}
+				auto found = definitions.find(next.string);
+				if (next.type != TokenType::IDENTIFIER || found == definitions.end() || found->second.second->type() != Asm::ThreeAddr) continue;
+				auto step = (threeAddress*)found->second.second;
+				if (std::find(loop.blocks.begin(), loop.blocks.end(), found->second.first) == loop.blocks.end()) continue;
+				if (step->A.string.compare(merge->result.string) == 0 && isLiteral(step->B)) induction.increment = step->B;
+				else if (step->B.string.compare(merge->result.string) == 0 && isLiteral(step->A) && commutative(step->op)) induction.increment = step->A;
+				else continue;
+				induction.step = step;
+				induction.stepBlock = found->second.first;
+				inductions.push_back(induction);
+			}
+			return inductions;
+		}
+
+		//constant propagation leaves literals in copies, so an operand may be a version holding one
+		static Token literalOf(const Token& token, std::unordered_map<std::string, std::pair<size_t, assembly*>>& definitions)
+		{
+			auto found = definitions.find(token.string);
+			if (token.type != TokenType::IDENTIFIER || found == definitions.end() || found->second.second->type() != Asm::TwoAddr) return token;
+			auto copy = (twoAddress*)found->second.second;
+			return copy->op == OP_CONST_LOW ? copy->A : token;
+		}
+
+		//a jump that falls through to the next block when not taken
+		static bool isConditional(assembly* instruction)
+		{
+			if (instruction->type() == Asm::CompareJump) return true;
+			return instruction->type() == Asm::Jump && ((pseudocode*)instruction)->op != OP_RELATIVE_JUMP;
+		}
+
+		static std::shared_ptr<relativeJump> makeJump(size_t jumpLabel)
+		{
+			auto jump = std::make_shared<relativeJump>();
+			jump->op = OP_RELATIVE_JUMP;
+			jump->jumpLabel = jumpLabel;
+			return jump;
+		}
+
+		//the label starting a block, given one if it has none
+		static size_t labelOf(FlowGraph& graph, size_t b)
+		{
+			auto& code = graph.blocks[b].code;
+			if (code.empty() || code[0]->type() != Asm::Label)
+			{
+				auto start = std::make_shared<label>();
+				start->label = graph.labels++;
+				code.insert(code.begin(), start);
+			}
+			return ((label*)code[0].get())->label;
+		}
+
+		//loop versioning: the preheader runs guards, blocks that each end in a jump to slow, and goes into the loop when none
+		//jumps; slow starts a copy of the loop with its versions renamed, and exit, the loop's only way out, merges what the
+		//two leave. blocks are only added at the end, so the others keep their indices; the caller relinks the graph
+		static bool versionLoop(FlowGraph& graph, const Loop& loop, size_t exit, std::vector<std::vector<std::shared_ptr<assembly>>>& guards, size_t slow)
+		{
+			auto& blocks = graph.blocks;
+			size_t header = loop.header;
+			size_t preheader = loop.preheader;
+			auto inside = [&](size_t b) { return std::find(loop.blocks.begin(), loop.blocks.end(), b) != loop.blocks.end(); };
+			auto last = [&](size_t b) { return blocks[b].code.size() ? blocks[b].code.back().get() : nullptr; };
+			auto falls = [&](size_t b) { return !last(b) || !endsBlock(last(b)) || isConditional(last(b)); };
+			//the preheader reaches the guards by a jump, and the last block must not fall into them
+			if (guards.empty() || preheader == SIZE_MAX || blocks[preheader].successors.size() != 1 || (last(preheader) && isConditional(last(preheader)))) return false;
+			if (falls(blocks.size() - 1) || blocks[exit].predecessors.size() != 1) return false;
+			std::vector<size_t> order(loop.blocks.begin(), loop.blocks.end());
+			std::sort(order.begin(), order.end());
+			for (size_t b : order)
+			{
+				for (const auto& instruction : blocks[b].code)
+				{
+					Asm type = instruction->type();
+					if (type != Asm::Label && type != Asm::Phi && type != Asm::Jump && type != Asm::CompareJump && !clone(instruction.get())) return false;
+				}
+			}
+
+			//after the guards come the jump into the loop, the jump into the copy, then the copies in code order,
+			//each followed by a jump to where its original falls through to when that ends in a conditional jump
+			size_t first = blocks.size();
+			size_t fast = first + guards.size();
+			size_t enter = fast + 1;
+			std::unordered_map<size_t, size_t> copyOf, bridgeOf;
+			std::unordered_map<size_t, size_t> labels; //original label to its copy's
+			size_t next = enter + 1;
+			for (size_t b : order)
+			{
+				copyOf[b] = next++;
+				if (last(b) && isConditional(last(b))) bridgeOf[b] = next++;
+				size_t original = labelOf(graph, b);
+				labels[original] = graph.labels++;
+			}
+			size_t exitLabel = labelOf(graph, exit);
+			std::string suffix = ".checked" + std::to_string(first);
+			std::unordered_map<std::string, std::string> renamed;
+			for (size_t b : order)
+			{
+				for (const auto& instruction : blocks[b].code)
+				{
+					std::vector<Token*> uses;
+					Token* def = nullptr;
+					instruction->operands(uses, def);
+					if (def) renamed[def->string] = def->string + suffix;
+				}
+			}
+			auto rename = [&](Token& token)
+			{
+				auto found = renamed.find(token.string);
+				if (token.type == TokenType::IDENTIFIER && found != renamed.end()) token.string = found->second;
+			};
+			//an original block's way out, as its copy takes it: from the copy itself or from the jump after it
+			auto copiedEdges = [&](size_t b)
+			{
+				std::vector<size_t> from = { copyOf.at(b) };
+				if (bridgeOf.count(b)) from.push_back(bridgeOf.at(b));
+				return from;
+			};
+
+			//versions read past the loop now come from a phi in exit, which takes the copy's when that ran
+			std::map<std::string, std::string> merged;
+			for (size_t b = 0; b < first; b++)
+			{
+				if (inside(b)) continue;
+				for (const auto& instruction : blocks[b].code)
+				{
+					std::vector<Token*> uses;
+					Token* def = nullptr;
+					if (instruction->type() == Asm::Phi)
+					{
+						//an argument from inside the loop is read on the way out of it, ahead of the merge
+						for (auto& argument : ((phi*)instruction.get())->arguments)
+						{
+							if (!inside(argument.first)) uses.push_back(&argument.second);
+						}
+					}
+					else instruction->operands(uses, def);
+					for (Token* use : uses)
+					{
+						if (use->type != TokenType::IDENTIFIER || !renamed.count(use->string)) continue;
+						auto found = merged.emplace(use->string, use->string + ".exit" + std::to_string(first)).first;
+						use->string = found->second;
+					}
+				}
+			}
+			auto& exitCode = blocks[exit].code;
+			size_t at = 0;
+			for (; at < exitCode.size() && (exitCode[at]->type() == Asm::Label || exitCode[at]->type() == Asm::Phi); at++)
+			{
+				if (exitCode[at]->type() != Asm::Phi) continue;
+				auto& arguments = ((phi*)exitCode[at].get())->arguments;
+				for (size_t i = 0, n = arguments.size(); i < n; i++)
+				{
+					Token value = arguments[i].second;
+					rename(value);
+					for (size_t from : copiedEdges(header)) arguments.emplace_back(from, value);
+				}
+			}
+			for (const auto& merge : merged)
+			{
+				auto join = std::make_shared<phi>();
+				join->result = { TokenType::IDENTIFIER, merge.second, 0 };
+				Token value = { TokenType::IDENTIFIER, merge.first, 0 };
+				join->arguments.emplace_back(header, value);
+				rename(value);
+				for (size_t from : copiedEdges(header)) join->arguments.emplace_back(from, value);
+				exitCode.insert(exitCode.begin() + at, join);
+			}
+
+			//the preheader's way into the loop now goes through the guards
+			auto& preheaderCode = blocks[preheader].code;
+			if (last(preheader) && last(preheader)->type() == Asm::Jump) ((relativeJump*)last(preheader))->jumpLabel = graph.labels;
+			else preheaderCode.push_back(makeJump(graph.labels));
+			auto start = std::make_shared<label>();
+			start->label = graph.labels++;
+			guards[0].insert(guards[0].begin(), start);
+			for (auto& instruction : blocks[header].code)
+			{
+				if (instruction->type() != Asm::Phi) continue;
+				for (auto& argument : ((phi*)instruction.get())->arguments)
+				{
+					if (argument.first == preheader) argument.first = fast;
+				}
+			}
+			for (auto& guard : guards)
+			{
+				blocks.emplace_back();
+				blocks.back().code = guard;
+			}
+			blocks.emplace_back();
+			blocks.back().code.push_back(makeJump(labelOf(graph, header)));
+			auto entry = std::make_shared<label>();
+			entry->label = slow;
+			blocks.emplace_back();
+			blocks.back().code = { entry, makeJump(labels.at(labelOf(graph, header))) };
+
+			//the copies, their jumps within the loop sent to the copy, and the fallthroughs made jumps
+			for (size_t b : order)
+			{
+				auto& original = blocks[b].code;
+				std::vector<std::shared_ptr<assembly>> code;
+				for (const auto& instruction : original)
+				{
+					std::shared_ptr<assembly> copy;
+					switch (instruction->type())
+					{
+						case Asm::Label:
+						{
+							auto copied = std::make_shared<label>();
+							copied->label = labels.at(((label*)instruction.get())->label);
+							copy = copied;
+							break;
+						}
+						case Asm::Jump:
+						case Asm::CompareJump:
+						{
+							auto jump = instruction->type() == Asm::Jump ? std::make_shared<relativeJump>(*(relativeJump*)instruction.get()) : std::make_shared<compareJump>(*(compareJump*)instruction.get());
+							auto found = labels.find(jump->jumpLabel);
+							if (found != labels.end()) jump->jumpLabel = found->second;
+							copy = jump;
+							break;
+						}
+						case Asm::Phi:
+						{
+							auto merge = std::make_shared<phi>(*(phi*)instruction.get());
+							merge->arguments.clear();
+							for (auto argument : ((phi*)instruction.get())->arguments)
+							{
+								if (!inside(argument.first))
+								{
+									merge->arguments.emplace_back(enter, argument.second);
+									continue;
+								}
+								rename(argument.second);
+								for (size_t from : copiedEdges(argument.first)) merge->arguments.emplace_back(from, argument.second);
+							}
+							copy = merge;
+							break;
+						}
+						default: copy = clone(instruction.get());
+					}
+					std::vector<Token*> uses;
+					Token* def = nullptr;
+					copy->operands(uses, def);
+					for (Token* use : uses) rename(*use);
+					if (def) rename(*def);
+					code.push_back(copy);
+				}
+				size_t target = 0;
+				if (falls(b)) target = inside(b + 1) ? labels.at(labelOf(graph, b + 1)) : exitLabel;
+				if (falls(b) && !bridgeOf.count(b)) code.push_back(makeJump(target));
+				blocks.emplace_back();
+				blocks.back().code = code;
+				if (!bridgeOf.count(b)) continue;
+				blocks.emplace_back();
+				blocks.back().code.push_back(makeJump(target));
+			}
+			return true;
+		}
+	}
+
+	pseudochunk Optimizer::optimize(pseudochunk& chunk)
+	{
+		FlowGraph graph = cfa.createBlocks(chunk);
+		cfa.buildSSA(graph);
+#ifdef PRINT_IR
+		std::cout << "== SSA ==" << std::endl;
+		graph.print();
+#endif
+		run("constant propagation", &Optimizer::propagateConstants, graph);
+		run("copy propagation", &Optimizer::propagateCopies, graph);
+		if (loops)
+		{
+			//unrolled copies are folded with the rest of the program
+			run("loop unrolling", &Optimizer::unrollLoops, graph);
+			run("constant propagation", &Optimizer::propagateConstants, graph);
+			run("copy propagation", &Optimizer::propagateCopies, graph);
+		}
+		run("value numbering", &Optimizer::numberValues, graph);
+		run("copy propagation", &Optimizer::propagateCopies, graph);
+		run("bounds check elimination", &Optimizer::removeBoundsChecks, graph);
+		if (loops)
+		{
+			run("strength reduction", &Optimizer::reduceStrength, graph);
+			run("invariant code motion", &Optimizer::hoistInvariants, graph);
+			run("copy propagation", &Optimizer::propagateCopies, graph);
+		}
+		run("dead code elimination", &Optimizer::eliminateDeadCode, graph);
+		pseudochunk result = cfa.leaveSSA(graph);
+		result.function = chunk.function;
+		result.parameters = chunk.parameters;
+#ifdef PRINT_IR
+		std::cout << "== out of SSA ==" << std::endl;
+		for (const auto& instruction : result.code) instruction->print();
+#endif
+		return result;
+	}
+
+#ifdef PRINT_IR
+	void Optimizer::run(const char* name, bool (Optimizer::*pass)(FlowGraph&), FlowGraph& graph)
+	{
+		bool changed = (this->*pass)(graph);
+		std::cout << "== after " << name << (changed ? "" : ", unchanged") << " ==" << std::endl;
+		if (changed) graph.print();
+	}
+#else
+	void Optimizer::run(const char*, bool (Optimizer::*pass)(FlowGraph&), FlowGraph& graph)
+	{
+		(this->*pass)(graph);
+	}
+#endif
+
+	bool Optimizer::propagateConstants(FlowGraph& graph)
+	{
+		std::unordered_map<std::string, Token> constants; //version to the literal it holds
+		auto resolve = [&](const Token& token)
+		{
+			auto found = constants.find(token.string);
+			if (found == constants.end()) return token;
+			Token literal = found->second;
+			literal.line = token.line;
+			return literal;
+		};
+		bool any = false;
+		bool changed = true;
+		while (changed)
+		{
+			changed = false;
+			bool branched = false;
+			for (size_t b : graph.order)
+			{
+				auto& code = graph.blocks[b].code;
+				for (size_t i = 0; i < code.size(); i++)
+				{
+					std::vector<Token*> reads;
+					Token* def = nullptr;
+					code[i]->operands(reads, def);
+
+					//literals are only written into copies, phis and jump conditions: an arithmetic operand
+					//would be loaded into scratch every time it runs, where its variable keeps it in a register
+					auto instruction = code[i].get();
+					Token value;
+					bool known = false;
+					switch (instruction->type())
+					{
+						case Asm::TwoAddr:
+						{
+							auto twoAddr = (twoAddress*)instruction;
+							if (twoAddr->op == OP_MOVE || twoAddr->op == OP_CONST_LOW)
+							{
+								if (constants.count(twoAddr->A.string))
+								{
+									twoAddr->A = resolve(twoAddr->A);
+									twoAddr->op = OP_CONST_LOW;
+									changed = true;
+								}
+								known = util::isLiteral(twoAddr->A);
+								value = twoAddr->A;
+							}
+							else known = util::evaluate(twoAddr->op, resolve(twoAddr->A), value);
+							break;
+						}
+						case Asm::ThreeAddr:
+						{
+							auto threeAddr = (threeAddress*)instruction;
+							known = util::evaluate(threeAddr->op, resolve(threeAddr->A), resolve(threeAddr->B), value);
+							//an identity that leaves one operand becomes a copy of it, for copy propagation
+							Token kept;
+							if (!known && def && util::simplify(threeAddr->op, resolve(threeAddr->A), resolve(threeAddr->B), kept))
+							{
+								if (util::isLiteral(kept))
+								{
+									value = kept;
+									known = true;
+								}
+								else
+								{
+									code[i] = util::makeCopy(kept, *def);
+									changed = true;
+								}
+							}
+							break;
+						}
+						case Asm::Phi:
+						{
+							auto& arguments = ((phi*)instruction)->arguments;
+							for (auto& argument : arguments)
+							{
+								if (!constants.count(argument.second.string)) continue;
+								argument.second = resolve(argument.second);
+								changed = true;
+							}
+							known = arguments.size() && util::isLiteral(arguments[0].second);
+							for (const auto& argument : arguments)
+							{
+								if (!util::sameOperand(argument.second, arguments[0].second)) known = false;
+							}
+							if (known) value = arguments[0].second;
+							break;
+						}
+						case Asm::CompareJump:
+						case Asm::Jump:
+						{
+							auto jump = (relativeJump*)instruction;
+							Token taken;
+							if (instruction->type() == Asm::CompareJump)
+							{
+								auto compare = (compareJump*)instruction;
+								if (!util::evaluate(util::comparisonOf(compare->op), resolve(compare->A), resolve(compare->B), taken)) break;
+							}
+							else if (jump->op != OP_RELATIVE_JUMP_IF_TRUE) break;
+							else taken = resolve(jump->condition);
+							uint64_t truth = 0;
+							if (!util::integer(taken, truth)) break;
+							if (truth)
+							{
+								auto always = std::make_shared<relativeJump>();
+								always->op = OP_RELATIVE_JUMP;
+								always->jumpLabel = jump->jumpLabel;
+								code[i] = always;
+							}
+							else code.erase(code.begin() + i--);
+							branched = changed = true;
+							break;
+						}
+						default: break;
+					}
+					if (!known || !def) continue;
+					Token defined = *def;
+					//phis stay at the top of their block until dead code elimination removes them
+					bool folded = instruction->type() == Asm::Phi || (instruction->type() == Asm::TwoAddr && ((twoAddress*)instruction)->op == OP_CONST_LOW);
+					if (!folded)
+					{
+						code[i] = util::makeCopy(value, defined);
+						changed = true;
+					}
+					if (util::isVersion(defined) && !constants.count(defined.string))
+					{
+						constants.emplace(defined.string, value);
+						changed = true;
+					}
+				}
+			}
+			//a resolved branch can leave blocks unreachable and phis with fewer arguments
+			if (branched) cfa.linkBlocks(graph);
+			any = any || changed;
+		}
+		return any;
+	}
+
+	bool Optimizer::propagateCopies(FlowGraph& graph)
+	{
+		std::unordered_map<std::string, Token> copies; //version to the value it copies
+		bool any = false;
+		bool changed = true;
+		while (changed)
+		{
+			changed = false;
+			for (size_t b : graph.order)
+			{
+				auto& code = graph.blocks[b].code;
+				for (size_t i = 0; i < code.size(); i++)
+				{
+					std::vector<Token*> uses;
+					Token* def = nullptr;
+					code[i]->operands(uses, def);
+					for (Token* use : uses)
+					{
+						auto found = copies.find(use->string);
+						if (found == copies.end()) continue;
+						int line = use->line;
+						*use = found->second;
+						use->line = line;
+						changed = true;
+					}
+					if (!def || !util::isVersion(*def)) continue;
+
+					auto instruction = code[i].get();
+					Token source;
+					if (instruction->type() == Asm::TwoAddr)
+					{
+						auto twoAddr = (twoAddress*)instruction;
+						if (twoAddr->op != OP_MOVE && twoAddr->op != OP_CONST_LOW) continue;
+						if (twoAddr->A.type != TokenType::IDENTIFIER) continue;
+						source = twoAddr->A;
+					}
+					else if (instruction->type() == Asm::Phi)
+					{
+						//arguments that are the phi itself come round a loop that never changes it
+						bool found = false;
+						bool same = true;
+						for (const auto& argument : ((phi*)instruction)->arguments)
+						{
+							if (argument.second.type == TokenType::IDENTIFIER && argument.second.string.compare(def->string) == 0) continue;
+							if (found && !util::sameOperand(argument.second, source)) same = false;
+							source = argument.second;
+							found = true;
+						}
+						if (!found || !same) continue;
+					}
+					else continue;
+					copies.emplace(def->string, source);
+					code.erase(code.begin() + i--);
+					changed = true;
+				}
+			}
+			any = any || changed;
+		}
+		return any;
+	}
+
+	bool Optimizer::numberValues(FlowGraph& graph)
+	{
+		auto& blocks = graph.blocks;
+		auto operand = [](const Token& token) { return std::to_string((int)token.type) + token.string; };
+		std::unordered_map<std::string, Token> available; //operation and operands to the version that computed them
+		std::vector<std::vector<std::string>> added(blocks.size());
+		std::vector<std::pair<size_t, bool>> walk; //block, whether it is being left
+		bool changed = false;
+		if (graph.order.size()) walk.emplace_back(0, false);
+		while (walk.size())
+		{
+			size_t b = walk.back().first;
+			bool leaving = walk.back().second;
+			walk.pop_back();
+			if (leaving)
+			{
+				for (const auto& key : added[b]) available.erase(key);
+				continue;
+			}
+			walk.emplace_back(b, true);
+			for (size_t child : blocks[b].children) walk.emplace_back(child, false);
+
+			auto& code = blocks[b].code;
+			for (size_t i = 0; i < code.size(); i++)
+			{
+				auto instruction = code[i].get();
+				std::string key;
+				Token* result = nullptr;
+				if (instruction->type() == Asm::TwoAddr)
+				{
+					auto twoAddr = (twoAddress*)instruction;
+					if (!util::pure(twoAddr->op)) continue;
+					key = std::to_string(twoAddr->op) + " " + operand(twoAddr->A);
+					result = &twoAddr->result;
+				}
+				else if (instruction->type() == Asm::ThreeAddr)
+				{
+					auto threeAddr = (threeAddress*)instruction;
+					if (!util::pure(threeAddr->op)) continue;
+					std::string A = operand(threeAddr->A);
+					std::string B = operand(threeAddr->B);
+					if (util::commutative(threeAddr->op) && B < A) std::swap(A, B);
+					key = std::to_string(threeAddr->op) + " " + A + " " + B;
+					result = &threeAddr->result;
+				}
+				if (!result || !util::isVersion(*result)) continue;
+				auto found = available.find(key);
+				if (found != available.end())
+				{
+					code[i] = util::makeCopy(found->second, *result);
+					changed = true;
+					continue;
+				}
+				available.emplace(key, *result);
+				added[b].push_back(key);
+			}
+		}
+		return changed;
+	}
+
+	bool Optimizer::eliminateDeadCode(FlowGraph& graph)
+	{
+		std::unordered_map<std::string, assembly*> definitions;
+		std::unordered_set<assembly*> needed;
+		std::vector<assembly*> work;
+		for (size_t b : graph.order)
+		{
+			for (const auto& instruction : graph.blocks[b].code)
+			{
+				std::vector<Token*> uses;
+				Token* def = nullptr;
+				instruction->operands(uses, def);
+				if (def) definitions[def->string] = instruction.get();
+				if (def && util::isVersion(*def) && !util::mayFail(instruction.get())) continue;
+				needed.insert(instruction.get());
+				work.push_back(instruction.get());
+			}
+		}
+		while (work.size())
+		{
+			auto instruction = work.back();
+			work.pop_back();
+			std::vector<Token*> uses;
+			Token* def = nullptr;
+			instruction->operands(uses, def);
+			for (Token* use : uses)
+			{
+				auto found = definitions.find(use->string);
+				if (found == definitions.end() || !needed.insert(found->second).second) continue;
+				work.push_back(found->second);
+			}
+		}
+		bool changed = false;
+		for (size_t b : graph.order)
+		{
+			auto& code = graph.blocks[b].code;
+			size_t kept = 0;
+			for (size_t i = 0; i < code.size(); i++)
+			{
+				if (needed.count(code[i].get())) code[kept++] = code[i];
+			}
+			changed = changed || kept != code.size();
+			code.resize(kept);
+		}
+		return changed;
+	}
+
+	bool Optimizer::unrollLoops(FlowGraph& graph)
+	{
+		auto& blocks = graph.blocks;
+		std::unordered_map<std::string, std::pair<size_t, assembly*>> definitions;
+		bool changed = false;
+		bool unrolled = true;
+		//unrolling changes the graph, so the loops are found again after each one
+		while (unrolled)
+		{
+			unrolled = false;
+			util::findDefinitions(graph, definitions);
+			for (const Loop& loop : cfa.findLoops(graph))
+			{
+				//the header tests the induction variable and the body jumps straight back to it
+				if (loop.blocks.size() != 2 || loop.latches.size() != 1 || loop.preheader == SIZE_MAX) continue;
+				size_t header = loop.header;
+				size_t body = loop.latches[0];
+				auto& headerCode = blocks[header].code;
+				auto& bodyCode = blocks[body].code;
+				if (headerCode.back()->type() != Asm::CompareJump || bodyCode.back()->type() != Asm::Jump) continue;
+				auto test = (compareJump*)headerCode.back().get();
+				//the test either jumps into the body and falls out of the loop, or jumps out and falls into the body
+				bool entersOnJump = bodyCode[0]->type() == Asm::Label && ((label*)bodyCode[0].get())->label == test->jumpLabel;
+				if (entersOnJump == (header + 1 == body)) continue;
+
+				const util::Induction* counter = nullptr;
+				auto inductions = util::findInductions(graph, loop, definitions);
+				for (const auto& induction : inductions)
+				{
+					const std::string& name = induction.merge->result.string;
+					if ((test->A.string.compare(name) == 0 && util::isLiteral(test->B)) || (test->B.string.compare(name) == 0 && util::isLiteral(test->A))) counter = &induction;
+				}
+				if (!counter) continue;
+
+				//run the counter until the test leaves the loop
+				auto substitute = [&](const Token& operand, const Token& value) { return operand.string.compare(counter->merge->result.string) == 0 ? value : operand; };
+				Token value = counter->initial;
+				size_t trips = 0;
+				bool counted = util::isLiteral(value);
+				while (counted)
+				{
+					Token taken;
+					uint64_t truth = 0;
+					if (!util::evaluate(util::comparisonOf(test->op), substitute(test->A, value), substitute(test->B, value), taken) || !util::integer(taken, truth))
+					{
+						counted = false;
+						break;
+					}
+					if ((truth != 0) != entersOnJump) break;
+					Token next;
+					if (++trips > UNROLL_MAX_TRIPS || !util::evaluate(counter->step->op, substitute(counter->step->A, value), substitute(counter->step->B, value), next))
+					{
+						counted = false;
+						break;
+					}
+					value = next;
+				}
+				if (!counted) continue;
+
+				//the header runs once more than the body, to take the exit
+				std::vector<assembly*> headerBody, loopBody;
+				for (size_t i = 0; i + 1 < headerCode.size(); i++)
+				{
+					if (headerCode[i]->type() != Asm::Label && headerCode[i]->type() != Asm::Phi) headerBody.push_back(headerCode[i].get());
+				}
+				for (size_t i = 0; i + 1 < bodyCode.size(); i++)
+				{
+					if (bodyCode[i]->type() != Asm::Label) loopBody.push_back(bodyCode[i].get());
+				}
+				bool clonable = true;
+				for (auto instruction : headerBody) clonable = clonable && util::clone(instruction);
+				for (auto instruction : loopBody) clonable = clonable && util::clone(instruction);
+				size_t size = (trips + 1) * headerBody.size() + trips * loopBody.size();
+				if (!clonable || size > UNROLL_MAX_INSTRUCTIONS) continue;
+
+				//every copy defines new versions, name%n.k for iteration k
+				std::unordered_map<std::string, Token> current; //loop version to its copy in the iteration being written
+				std::vector<std::shared_ptr<assembly>> code;
+				if (headerCode[0]->type() == Asm::Label) code.push_back(headerCode[0]);
+				auto write = [&](assembly* instruction, size_t k)
+				{
+					auto copy = util::clone(instruction);
+					std::vector<Token*> uses;
+					Token* def = nullptr;
+					copy->operands(uses, def);
+					for (Token* use : uses)
+					{
+						auto found = current.find(use->string);
+						if (found != current.end()) use->string = found->second.string;
+					}
+					if (def)
+					{
+						std::string original = def->string;
+						def->string.append(".").append(std::to_string(k));
+						current[original] = *def;
+					}
+					code.push_back(copy);
+				};
+				for (size_t k = 0; k <= trips; k++)
+				{
+					//phis take their values all at once, from the preheader and then from the last copy of the body
+					std::vector<std::pair<std::string, Token>> entering;
+					for (const auto& instruction : headerCode)
+					{
+						if (instruction->type() != Asm::Phi) continue;
+						auto merge = (phi*)instruction.get();
+						Token from;
+						for (const auto& argument : merge->arguments)
+						{
+							if ((argument.first == loop.preheader) == (k == 0)) from = argument.second;
+						}
+						auto found = current.find(from.string);
+						if (from.type == TokenType::IDENTIFIER && found != current.end()) from = found->second;
+						Token to = merge->result;
+						to.string.append(".").append(std::to_string(k));
+						code.push_back(util::makeCopy(from, to));
+						entering.emplace_back(merge->result.string, to);
+					}
+					for (const auto& phiValue : entering) current[phiValue.first] = phiValue.second;
+					for (auto instruction : headerBody) write(instruction, k);
+					if (k == trips) break;
+					for (auto instruction : loopBody) write(instruction, k);
+				}
+				if (!entersOnJump)
+				{
+					auto leave = std::make_shared<relativeJump>();
+					leave->op = OP_RELATIVE_JUMP;
+					leave->jumpLabel = test->jumpLabel;
+					code.push_back(leave);
+				}
+
+				//only the header's versions reach past the loop, as the last copy left them
+				for (size_t b : graph.order)
+				{
+					if (b == header || b == body) continue;
+					for (const auto& instruction : blocks[b].code)
+					{
+						std::vector<Token*> uses;
+						Token* def = nullptr;
+						instruction->operands(uses, def);
+						for (Token* use : uses)
+						{
+							auto found = current.find(use->string);
+							if (found != current.end()) use->string = found->second.string;
+						}
+					}
+				}
+				headerCode = code;
+				cfa.linkBlocks(graph);
+				unrolled = changed = true;
+				break;
+			}
+		}
+		return changed;
+	}
+
+	bool Optimizer::hoistInvariants(FlowGraph& graph)
+	{
+		auto& blocks = graph.blocks;
+		std::unordered_map<std::string, std::pair<size_t, assembly*>> definitions;
+		util::findDefinitions(graph, definitions);
+		bool changed = false;
+		//inner loops first, so what leaves one can leave the loop around it too
+		for (const Loop& loop : cfa.findLoops(graph))
+		{
+			if (loop.preheader == SIZE_MAX) continue;
+			std::vector<bool> inside(blocks.size(), false);
+			for (size_t b : loop.blocks) inside[b] = true;
+			//a field load is invariant only while nothing in the loop stores to a field at its index, or calls a function that might
+			std::unordered_set<std::string> stored;
+			bool calls = false;
+			for (size_t b : loop.blocks)
+			{
+				for (const auto& instruction : blocks[b].code)
+				{
+					if (instruction->type() == Asm::ThreeAddr && ((threeAddress*)instruction.get())->op == OP_STORE_OFFSET) stored.insert(((threeAddress*)instruction.get())->result.string);
+					calls = calls || instruction->type() == Asm::Call;
+				}
+			}
+			auto outside = [&](const Token& token)
+			{
+				auto found = definitions.find(token.string);
+				return found == definitions.end() || !inside[found->second.first];
+			};
+			//loads are only moved off objects that were allocated, so hoisting one cannot touch a null pointer
+			auto allocated = [&](const Token& token)
+			{
+				auto found = definitions.find(token.string);
+				if (found == definitions.end() || found->second.second->type() != Asm::TwoAddr) return false;
+				return ((twoAddress*)found->second.second)->op == OP_ALLOC;
+			};
+
+			std::vector<std::shared_ptr<assembly>> hoisted;
+			for (size_t b : loop.blocks)
+			{
+				auto& code = blocks[b].code;
+				for (size_t i = 0; i < code.size(); i++)
+				{
+					auto instruction = code[i].get();
+					std::vector<Token*> uses;
+					Token* def = nullptr;
+					instruction->operands(uses, def);
+					if (!def || !util::isVersion(*def)) continue;
+					bool movable = false;
+					if (instruction->type() == Asm::TwoAddr)
+					{
+						OpCodes op = ((twoAddress*)instruction)->op;
+						movable = util::pure(op) || op == OP_MOVE || op == OP_CONST_LOW;
+					}
+					else if (instruction->type() == Asm::ThreeAddr)
+					{
+						auto threeAddr = (threeAddress*)instruction;
+						if (threeAddr->op == OP_LOAD_OFFSET) movable = !calls && !stored.count(threeAddr->result.string) && allocated(threeAddr->B);
+						else movable = util::pure(threeAddr->op) && !util::mayFail(instruction);
+					}
+					for (Token* use : uses) movable = movable && outside(*use);
+					if (!movable) continue;
+					definitions[def->string].first = loop.preheader;
+					hoisted.push_back(code[i]);
+					code.erase(code.begin() + i--);
+				}
+			}
+
+			//a literal operand is loaded into scratch every time it runs, so each one the loop reads is loaded once ahead of it
+			std::map<std::pair<TokenType, std::string>, Token> literals;
+			auto load = [&](Token& operand)
+			{
+				if (!util::isLiteral(operand)) return;
+				auto found = literals.find({ operand.type, operand.string });
+				if (found == literals.end())
+				{
+					Token constant = { TokenType::IDENTIFIER, "#" + std::to_string(loop.header) + "." + std::to_string(literals.size()) + "%", operand.line };
+					hoisted.push_back(util::makeCopy(operand, constant));
+					found = literals.emplace(std::make_pair(operand.type, operand.string), constant).first;
+				}
+				int line = operand.line;
+				operand = found->second;
+				operand.line = line;
+			};
+			for (size_t b : loop.blocks)
+			{
+				for (const auto& instruction : blocks[b].code)
+				{
+					if (instruction->type() == Asm::CompareJump)
+					{
+						load(((compareJump*)instruction.get())->A);
+						load(((compareJump*)instruction.get())->B);
+					}
+					else if (instruction->type() == Asm::ThreeAddr)
+					{
+						//field accesses carry their index as a literal, OP_LOAD_OFFSET writes A, and array accesses read an index as their third operand
+						auto threeAddr = (threeAddress*)instruction.get();
+						if (threeAddr->op != OP_LOAD_OFFSET) load(threeAddr->A);
+						if (threeAddr->op != OP_LOAD_OFFSET && threeAddr->op != OP_STORE_OFFSET) load(threeAddr->B);
+						if (util::arrayAccess(threeAddr->op)) load(threeAddr->result);
+					}
+				}
+			}
+			if (hoisted.empty()) continue;
+			util::append(blocks[loop.preheader], hoisted);
+			changed = true;
+		}
+		return changed;
+	}
+
+	bool Optimizer::removeBoundsChecks(FlowGraph& graph)
+	{
+		auto& blocks = graph.blocks;
+		std::unordered_map<std::string, std::pair<size_t, assembly*>> definitions;
+		size_t copies = blocks.size(); //blocks from here on are guards and checked copies of versioned loops, left checked
+		bool changed = false;
+		bool versioned = true;
+		//versioning changes the graph, so it is looked at again after each loop
+		while (versioned)
+		{
+			versioned = false;
+			util::findDefinitions(graph, definitions);
+			//an array's length is only known while it is used for nothing but accesses and length reads,
+			//since anything else could make it grow or hand it to something that does
+			std::unordered_set<std::string> escaped;
+			std::vector<std::pair<size_t, threeAddress*>> accesses;
+			for (size_t b : graph.order)
+			{
+				for (const auto& instruction : blocks[b].code)
+				{
+					std::vector<Token*> uses;
+					Token* def = nullptr;
+					instruction->operands(uses, def);
+					//the copies back to the program's variables ahead of the halt
+					if (def && !util::isVersion(*def)) continue;
+					const Token* array = nullptr;
+					if (instruction->type() == Asm::TwoAddr && ((twoAddress*)instruction.get())->op == OP_ARRAY_LENGTH) array = &((twoAddress*)instruction.get())->A;
+					else if (instruction->type() == Asm::ThreeAddr)
+					{
+						auto threeAddr = (threeAddress*)instruction.get();
+						if (util::arrayAccess(threeAddr->op)) array = &threeAddr->B;
+						else if (threeAddr->op == OP_ARRAY_CHECK) array = &threeAddr->A;
+						if (threeAddr->op == OP_ARRAY_LOAD || threeAddr->op == OP_ARRAY_STORE) accesses.emplace_back(b, threeAddr);
+					}
+					for (Token* use : uses)
+					{
+						if (use != array) escaped.insert(use->string);
+					}
+				}
+			}
+			if (accesses.empty()) break;
+
+			//whether array holds at least bound elements: it was allocated with that length, or bound was read off it
+			auto covers = [&](const Token& array, const Token& bound)
+			{
+				auto found = definitions.find(array.string);
+				if (array.type != TokenType::IDENTIFIER || found == definitions.end() || escaped.count(array.string)) return false;
+				auto measured = definitions.find(bound.string);
+				if (bound.type == TokenType::IDENTIFIER && measured != definitions.end() && measured->second.second->type() == Asm::TwoAddr)
+				{
+					auto length = (twoAddress*)measured->second.second;
+					if (length->op == OP_ARRAY_LENGTH && length->A.string.compare(array.string) == 0) return true;
+				}
+				if (found->second.second->type() != Asm::ThreeAddr || ((threeAddress*)found->second.second)->op != OP_ALLOC_ARRAY) return false;
+				Token count = util::literalOf(((threeAddress*)found->second.second)->A, definitions);
+				Token limit = util::literalOf(bound, definitions);
+				uint64_t counted, limited;
+				if (util::sameOperand(count, limit)) return true;
+				return util::integer(count, counted) && util::integer(limit, limited) && limited <= counted;
+			};
+
+			//an induction variable the loop header tests against a bound before jumping into the loop,
+			//so the blocks that jump dominates only see it below the bound
+			struct Range
+			{
+				const Loop* loop;
+				size_t entry;
+				Token bound;
+				Token initial;
+				bool nonNegative; //unsigned tests bound it from below as well; signed ones need it to start at 0 or above and count up
+				bool counted; //signed test, stepping by one
+			};
+			std::unordered_map<std::string, Range> ranges;
+			auto loops = cfa.findLoops(graph);
+			for (const Loop& loop : loops)
+			{
+				auto& headerCode = blocks[loop.header].code;
+				if (headerCode.empty() || headerCode.back()->type() != Asm::CompareJump) continue;
+				auto test = (compareJump*)headerCode.back().get();
+				size_t entry = SIZE_MAX;
+				for (size_t successor : blocks[loop.header].successors)
+				{
+					auto& code = blocks[successor].code;
+					if (code.size() && code[0]->type() == Asm::Label && ((label*)code[0].get())->label == test->jumpLabel) entry = successor;
+				}
+				if (entry == SIZE_MAX || blocks[entry].predecessors.size() != 1 || std::find(loop.blocks.begin(), loop.blocks.end(), entry) == loop.blocks.end()) continue;
+				bool below = test->op == OP_JUMP_IF_SIGN_LESS || test->op == OP_JUMP_IF_UNSIGN_LESS;
+				bool above = test->op == OP_JUMP_IF_SIGN_GREATER || test->op == OP_JUMP_IF_UNSIGN_GREATER;
+				if (!below && !above) continue;
+				bool isSigned = test->op == OP_JUMP_IF_SIGN_LESS || test->op == OP_JUMP_IF_SIGN_GREATER;
+				const Token& index = below ? test->A : test->B;
+				for (const auto& induction : util::findInductions(graph, loop, definitions))
+				{
+					if (induction.merge->result.string.compare(index.string) != 0) continue;
+					Range range = { &loop, entry, below ? test->B : test->A, induction.initial, !isSigned, false };
+					//a step this small cannot carry the variable past the largest array and round to a negative value
+					uint64_t increment, initial;
+					bool up = induction.step->op == OP_INT_ADD && util::integer(induction.increment, increment) && increment > 0 && increment <= UINT32_MAX;
+					if (isSigned && up && util::integer(util::literalOf(induction.initial, definitions), initial)) range.nonNegative = (int64_t)initial >= 0;
+					range.counted = isSigned && up && increment == 1;
+					ranges.emplace(index.string, range);
+				}
+			}
+
+			//the block the loop leaves to, when its header's test is the only way out; SIZE_MAX otherwise
+			auto exitOf = [&](const Loop& loop)
+			{
+				size_t exit = SIZE_MAX;
+				for (size_t b : loop.blocks)
+				{
+					//a return or halt leaves it too
+					if (blocks[b].successors.empty()) return (size_t)SIZE_MAX;
+					for (size_t successor : blocks[b].successors)
+					{
+						if (std::find(loop.blocks.begin(), loop.blocks.end(), successor) != loop.blocks.end()) continue;
+						if (b != loop.header || exit != SIZE_MAX) return (size_t)SIZE_MAX;
+						exit = successor;
+					}
+				}
+				return exit;
+			};
+			//whether stopping the program ahead of the loop instead of partway through it shows: nothing in it stores, calls,
+			//writes output or can stop the program other than by its array reads
+			auto quiet = [&](const Loop& loop)
+			{
+				for (size_t b : loop.blocks)
+				{
+					for (const auto& instruction : blocks[b].code)
+					{
+						switch (instruction->type())
+						{
+							case Asm::Label: case Asm::Phi: case Asm::CompareJump: break;
+							case Asm::Jump:
+								if (((relativeJump*)instruction.get())->op != OP_RELATIVE_JUMP && ((relativeJump*)instruction.get())->op != OP_RELATIVE_JUMP_IF_TRUE) return false;
+								break;
+							case Asm::TwoAddr:
+							case Asm::ThreeAddr:
+							{
+								OpCodes op = ((pseudocode*)instruction.get())->op;
+								if (op == OP_ARRAY_LOAD || op == OP_ARRAY_LOAD_UNCHECKED) break;
+								if ((!util::pure(op) && op != OP_MOVE && op != OP_CONST_LOW) || util::mayFail(instruction.get())) return false;
+								break;
+							}
+							default: return false;
+						}
+					}
+				}
+				return true;
+			};
+
+			//accesses by an induction variable that one check of its range ahead of the loop covers, by loop header
+			struct Hoisted
+			{
+				const Range* range;
+				std::vector<threeAddress*> accesses;
+				bool everyTrip; //every access runs on every trip through the loop
+			};
+			std::unordered_map<size_t, Hoisted> hoisted;
+			for (const auto& access : accesses)
+			{
+				size_t b = access.first;
+				threeAddress* instruction = access.second;
+				const Token& array = instruction->B;
+				bool safe = false;
+				uint64_t index;
+				if (util::integer(util::literalOf(instruction->result, definitions), index))
+				{
+					safe = index < UINT64_MAX && covers(array, util::integerToken(index + 1, array.line));
+				}
+				auto found = ranges.find(instruction->result.string);
+				if (!safe && found != ranges.end() && graph.dominates(found->second.entry, b))
+				{
+					const Range& range = found->second;
+					const Loop& loop = *range.loop;
+					safe = range.nonNegative && covers(array, range.bound);
+					//otherwise the loop runs through every index from the initial value up to the bound, unless it stops first
+					auto outside = [&](const Token& token)
+					{
+						auto defined = definitions.find(token.string);
+						return token.type != TokenType::IDENTIFIER || defined == definitions.end() || std::find(loop.blocks.begin(), loop.blocks.end(), defined->second.first) == loop.blocks.end();
+					};
+					if (!safe && b < copies && range.counted && array.type == TokenType::IDENTIFIER && outside(array) && outside(range.bound) && exitOf(loop) != SIZE_MAX)
+					{
+						auto& covered = hoisted.emplace(loop.header, Hoisted{ &range, {}, true }).first->second;
+						covered.accesses.push_back(instruction);
+						for (size_t latch : loop.latches) covered.everyTrip = covered.everyTrip && graph.dominates(b, latch);
+						continue;
+					}
+				}
+				if (!safe) continue;
+				instruction->op = instruction->op == OP_ARRAY_LOAD ? OP_ARRAY_LOAD_UNCHECKED : OP_ARRAY_STORE_UNCHECKED;
+				changed = true;
+			}
+
+			for (const Loop& loop : loops)
+			{
+				auto found = hoisted.find(loop.header);
+				if (found == hoisted.end()) continue;
+				const Range& range = *found->second.range;
+				std::vector<Token> arrays;
+				for (auto instruction : found->second.accesses)
+				{
+					bool seen = false;
+					for (const auto& array : arrays) seen = seen || util::sameOperand(array, instruction->B);
+					if (!seen) arrays.push_back(instruction->B);
+				}
+				if (found->second.everyTrip && quiet(loop))
+				{
+					//a failing access stops the program on some trip, and nothing the trips before it did shows,
+					//so a check of each array ahead of the loop stops it just the same
+					for (const auto& array : arrays)
+					{
+						auto check = std::make_shared<threeAddress>();
+						check->op = OP_ARRAY_CHECK;
+						check->A = array;
+						check->B = range.initial;
+						check->result = range.bound;
+						util::append(blocks[loop.preheader], { check });
+					}
+				}
+				else
+				{
+					//otherwise the loop runs unchecked only when the range is in every array, and a checked copy runs instead
+					size_t slow = graph.labels++;
+					std::vector<std::vector<std::shared_ptr<assembly>>> guards;
+					auto jumpIf = [&](OpCodes op, const Token& A, const Token& B)
+					{
+						auto jump = std::make_shared<compareJump>();
+						jump->op = op;
+						jump->A = A;
+						jump->B = B;
+						jump->jumpLabel = slow;
+						return jump;
+					};
+					if (!range.nonNegative) guards.push_back({ jumpIf(OP_JUMP_IF_SIGN_LESS, range.initial, util::integerToken(0, range.initial.line)) });
+					for (const auto& array : arrays)
+					{
+						guards.push_back({ jumpIf(OP_JUMP_IF_INT_EQUAL, array, util::integerToken(0, array.line)) });
+						auto length = std::make_shared<twoAddress>();
+						length->op = OP_ARRAY_LENGTH;
+						length->A = array;
+						length->result = { TokenType::IDENTIFIER, "#" + std::to_string(blocks.size() + guards.size()) + ".length%", array.line };
+						guards.push_back({ length, jumpIf(OP_JUMP_IF_SIGN_GREATER, range.bound, length->result) });
+					}
+					if (!util::versionLoop(graph, loop, exitOf(loop), guards, slow)) continue;
+					versioned = true;
+				}
+				for (auto instruction : found->second.accesses) instruction->op = instruction->op == OP_ARRAY_LOAD ? OP_ARRAY_LOAD_UNCHECKED : OP_ARRAY_STORE_UNCHECKED;
+				changed = true;
+				if (versioned) break;
+			}
+			if (versioned) cfa.linkBlocks(graph);
+		}
+		return changed;
+	}
+
+	bool Optimizer::reduceStrength(FlowGraph& graph)
+	{
+		auto& blocks = graph.blocks;
+		std::unordered_map<std::string, std::pair<size_t, assembly*>> definitions;
+		util::findDefinitions(graph, definitions);
+		bool changed = false;
+		for (const Loop& loop : cfa.findLoops(graph))
+		{
+			auto inductions = util::findInductions(graph, loop, definitions);
+			std::unordered_map<std::string, Token> derived; //induction variable and factor to the version stepping with their product
+			std::vector<std::shared_ptr<assembly>> phis;
+			std::vector<std::pair<threeAddress*, std::shared_ptr<assembly>>> steps; //step of the induction variable, step of the product after it
+			for (size_t b : loop.blocks)
+			{
+				for (auto& instruction : blocks[b].code)
+				{
+					if (instruction->type() != Asm::ThreeAddr) continue;
+					auto multiply = (threeAddress*)instruction.get();
+					if ((multiply->op != OP_SIGN_MUL && multiply->op != OP_UNSIGN_MUL) || !util::isVersion(multiply->result)) continue;
+					const util::Induction* induction = nullptr;
+					Token factor;
+					for (const auto& candidate : inductions)
+					{
+						if ((candidate.step->op != OP_INT_ADD && candidate.step->op != OP_INT_SUB) || candidate.increment.type != TokenType::INT) continue;
+						const std::string& name = candidate.merge->result.string;
+						if (multiply->A.string.compare(name) == 0) factor = util::literalOf(multiply->B, definitions);
+						else if (multiply->B.string.compare(name) == 0) factor = util::literalOf(multiply->A, definitions);
+						if (factor.type != TokenType::INT) continue;
+						induction = &candidate;
+						break;
+					}
+					if (!induction) continue;
+
+					std::string key = induction->merge->result.string + "*" + factor.string;
+					auto found = derived.find(key);
+					if (found == derived.end())
+					{
+						int line = multiply->result.line;
+						Token product = { TokenType::IDENTIFIER, key, line };
+						Token next = { TokenType::IDENTIFIER, key + ".next", line };
+						Token initial;
+						if (!util::evaluate(multiply->op, induction->initial, factor, initial))
+						{
+							auto start = std::make_shared<threeAddress>();
+							start->op = multiply->op;
+							start->A = induction->initial;
+							start->B = factor;
+							start->result = { TokenType::IDENTIFIER, key + ".entry", line };
+							util::append(blocks[loop.preheader], { start });
+							initial = start->result;
+						}
+						auto merge = std::make_shared<phi>();
+						merge->result = product;
+						merge->arguments.emplace_back(loop.preheader, initial);
+						merge->arguments.emplace_back(loop.latches[0], next);
+						phis.push_back(merge);
+						auto step = std::make_shared<threeAddress>();
+						step->op = induction->step->op;
+						step->A = product;
+						util::evaluate(multiply->op, induction->increment, factor, step->B);
+						step->result = next;
+						steps.emplace_back(induction->step, step);
+						found = derived.emplace(key, product).first;
+					}
+					instruction = util::makeCopy(found->second, multiply->result);
+					changed = true;
+				}
+			}
+
+			auto& header = blocks[loop.header].code;
+			header.insert(header.begin() + (header.size() && header[0]->type() == Asm::Label ? 1 : 0), phis.begin(), phis.end());
+			for (const auto& step : steps)
+			{
+				for (size_t b : loop.blocks)
+				{
+					auto& code = blocks[b].code;
+					auto at = std::find_if(code.begin(), code.end(), [&](const std::shared_ptr<assembly>& instruction) { return instruction.get() == step.first; });
+					if (at != code.end()) code.insert(at + 1, step.second);
+				}
+			}
+		}
+		return changed;
+	}
+}
\ No newline at end of file
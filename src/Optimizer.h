@@ -0,0 +1,51 @@
+#pragma once
+
+#include "ControlFlowAnalysis.h"
+
+//prints the blocks in SSA form before the first pass and after every pass, then the code leaving SSA
+//#define PRINT_IR
+//assembles the pseudocode exactly as the front end wrote it
+//#define DISABLE_OPTIMIZER
+
+//loops with a literal trip count up to this many are unrolled in full...
+#define UNROLL_MAX_TRIPS 16
+//...as long as the copies of their header and body stay under this many instructions
+#define UNROLL_MAX_INSTRUCTIONS 64
+
+namespace ash
+{
+	//passes over the program in SSA form, between the front end and register allocation;
+	//each returns whether it changed anything
+	class Optimizer
+	{
+		ControlFlowAnalysis cfa;
+		bool loops;
+
+		//replaces versions holding a literal by it, evaluates what reads only literals, and resolves branches on them
+		bool propagateConstants(FlowGraph& graph);
+		//replaces copies, and phis whose arguments are all one value, by their source
+		bool propagateCopies(FlowGraph& graph);
+		//global value numbering: a pure computation dominated by an identical one reuses its result
+		bool numberValues(FlowGraph& graph);
+		//removes definitions nothing needs, marking back from stores, jumps, output and the program's variables
+		bool eliminateDeadCode(FlowGraph& graph);
+		//replaces two block loops whose induction variable runs a small literal number of times by copies of their code
+		bool unrollLoops(FlowGraph& graph);
+		//range analysis: array accesses proven in bounds, by a literal index or an induction variable the loop test keeps
+		//below the array's length, skip their checks. a loop it cannot prove, left only by its header's test, gets a check of each
+		//array in its preheader when it has no other effect, and otherwise runs unchecked behind one, with a checked copy for the rest
+		bool removeBoundsChecks(FlowGraph& graph);
+		//moves computations whose operands are all defined outside a loop into its preheader
+		bool hoistInvariants(FlowGraph& graph);
+		//turns multiplications of an induction variable by a literal into a second induction variable stepped by addition
+		bool reduceStrength(FlowGraph& graph);
+
+		void run(const char* name, bool (Optimizer::*pass)(FlowGraph&), FlowGraph& graph);
+	public:
+		//loops: whether to run the loop passes as well
+		Optimizer(bool loops = true)
+			:loops(loops) {}
+
+		pseudochunk optimize(pseudochunk& chunk);
+	};
+}
@@ -130,6 +130,7 @@ namespace ash
 			TokenType::FOR,
 			TokenType::DEF,
 			TokenType::IF,
+			TokenType::RETURN,
 			TokenType::TYPE,
 			TokenType::IDENTIFIER,
 			TokenType::ELSE,
@@ -609,8 +610,9 @@ namespace ash
 	std::shared_ptr<ExpressionNode> Parser::expression()
 	{
 		inExpression++;
-		return ParsePrecedence(Precedence::ASSIGNMENT);
+		auto node = ParsePrecedence(Precedence::ASSIGNMENT);
 		inExpression--;
+		return node;
 	}
 
 	std::shared_ptr<ExpressionNode> Parser::ParsePrecedence(Precedence precedence)
@@ -681,6 +683,7 @@ namespace ash
 
 			if (panicMode) synchronize();
 		}
+		node->hadError = hadError;
 
 		return node;
 	}
@@ -0,0 +1,144 @@
+#include "PoolAllocator.h"
+
+#include <iostream>
+#include <iomanip>
+#include <stdlib.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace ash
+{
+	namespace util
+	{
+		//four classes per doubling past 64 bytes, so no block wastes more than a quarter of itself
+		static const uint16_t sizeClasses[POOL_SIZE_CLASSES] = {
+			8, 16, 24, 32, 40, 48, 56, 64,
+			80, 96, 112, 128,
+			160, 192, 224, 256,
+			320, 384, 448, 512,
+			640, 768, 896, 1024,
+			1280, 1536, 1792, 2048
+		};
+	}
+
+	PoolAllocator::PoolAllocator()
+	{
+		uint8_t sizeClass = 0;
+		for (size_t i = 0; i < classOf.size(); i++)
+		{
+			while (util::sizeClasses[sizeClass] < i * 8) sizeClass++;
+			classOf[i] = sizeClass;
+		}
+	}
+
+	PoolAllocator::~PoolAllocator()
+	{
+		for (void* page : pages) free(page);
+		for (void* page : retiredPages) free(page);
+	}
+
+	size_t PoolAllocator::classSize(uint8_t sizeClass)
+	{
+		return util::sizeClasses[sizeClass];
+	}
+
+	void PoolAllocator::refill(uint8_t sizeClass)
+	{
+		char* page = (char*)malloc(POOL_PAGE_SIZE);
+		if (page == nullptr) exit(1);
+		pages.push_back(page);
+		stats.pageBytes += POOL_PAGE_SIZE;
+
+		//threaded back to front so blocks are handed out in address order
+		size_t blockSize = util::sizeClasses[sizeClass];
+		size_t blocks = POOL_PAGE_SIZE / blockSize;
+		FreeBlock* list = freeLists[sizeClass];
+		for (size_t i = blocks; i > 0; i--)
+		{
+			FreeBlock* block = (FreeBlock*)(page + (i - 1) * blockSize);
+			block->next = list;
+			list = block;
+		}
+		freeLists[sizeClass] = list;
+	}
+
+	void* PoolAllocator::allocate(size_t size)
+	{
+		if (size == 0) size = 1;
+		stats.allocations++;
+		stats.bytesRequested += size;
+		if (size > POOL_LARGEST_CLASS)
+		{
+			void* block = malloc(size);
+			if (block == nullptr) exit(1);
+			stats.largeAllocations++;
+			stats.largeBytesInUse += size;
+			stats.bytesInUse += size;
+			if (stats.bytesInUse > stats.peakBytesInUse) stats.peakBytesInUse = stats.bytesInUse;
+			return block;
+		}
+
+		uint8_t sizeClass = classOf[(size + 7) / 8];
+		if (freeLists[sizeClass] == nullptr) refill(sizeClass);
+		FreeBlock* block = freeLists[sizeClass];
+		freeLists[sizeClass] = block->next;
+		stats.blocksInUse[sizeClass]++;
+		stats.bytesInUse += util::sizeClasses[sizeClass];
+		if (stats.bytesInUse > stats.peakBytesInUse) stats.peakBytesInUse = stats.bytesInUse;
+		return block;
+	}
+
+	void PoolAllocator::release(void* block, size_t size)
+	{
+		if (block == nullptr) return;
+		if (size == 0) size = 1;
+		stats.releases++;
+		if (size > POOL_LARGEST_CLASS)
+		{
+			stats.largeBytesInUse -= size;
+			stats.bytesInUse -= size;
+			free(block);
+			return;
+		}
+
+		uint8_t sizeClass = classOf[(size + 7) / 8];
+		FreeBlock* freed = (FreeBlock*)block;
+		freed->next = freeLists[sizeClass];
+		freeLists[sizeClass] = freed;
+		stats.blocksInUse[sizeClass]--;
+		stats.bytesInUse -= util::sizeClasses[sizeClass];
+	}
+
+	void PoolAllocator::beginCompaction()
+	{
+		retiredPages.swap(pages);
+		freeLists.fill(nullptr);
+		for (uint8_t i = 0; i < POOL_SIZE_CLASSES; i++) stats.blocksInUse[i] = 0;
+		stats.bytesInUse = stats.largeBytesInUse;
+		stats.pageBytes = 0;
+	}
+
+	void PoolAllocator::endCompaction()
+	{
+		for (void* page : retiredPages) free(page);
+		retiredPages.clear();
+#if defined(__GLIBC__)
+		//pages are below the mmap threshold, so glibc keeps them in its heap unless asked
+		malloc_trim(0);
+#endif
+	}
+
+	void PoolAllocator::printStatistics()
+	{
+		std::cout << "==heap statistics==\n";
+		std::cout << "allocations: " << stats.allocations << " (" << stats.largeAllocations << " large), releases: " << stats.releases << "\n";
+		std::cout << "bytes requested: " << stats.bytesRequested << ", in use: " << stats.bytesInUse
+			<< ", peak: " << stats.peakBytesInUse << ", pages: " << stats.pageBytes << "\n";
+		for (uint8_t i = 0; i < POOL_SIZE_CLASSES; i++)
+		{
+			if (stats.blocksInUse[i] == 0) continue;
+			std::cout << std::setfill(' ') << std::setw(6) << util::sizeClasses[i] << " bytes: " << stats.blocksInUse[i] << " blocks in use\n";
+		}
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+#define POOL_PAGE_SIZE 65536
+#define POOL_SIZE_CLASSES 28
+#define POOL_LARGEST_CLASS 2048
+
+namespace ash
+{
+	struct PoolStatistics
+	{
+		uint64_t allocations = 0;
+		uint64_t releases = 0;
+		uint64_t bytesRequested = 0; //cumulative, before rounding up to a size class
+		uint64_t bytesInUse = 0; //rounded to size classes; large blocks at their requested size
+		uint64_t peakBytesInUse = 0;
+		uint64_t pageBytes = 0; //reserved from the system for size classes
+		uint64_t largeAllocations = 0; //blocks above POOL_LARGEST_CLASS, served by malloc
+		uint64_t largeBytesInUse = 0;
+		std::array<uint64_t, POOL_SIZE_CLASSES> blocksInUse{};
+	};
+
+	//serves the VM heap: blocks up to POOL_LARGEST_CLASS bytes come from pages that each hold a
+	//single size class and are recycled through per-class free lists; anything bigger goes to malloc.
+	//pages are only returned to the system when the allocator is destroyed
+	class PoolAllocator
+	{
+	private:
+		struct FreeBlock
+		{
+			FreeBlock* next;
+		};
+
+		std::array<FreeBlock*, POOL_SIZE_CLASSES> freeLists{};
+		std::array<uint8_t, POOL_LARGEST_CLASS / 8 + 1> classOf; //size class index by (size + 7) / 8
+		std::vector<void*> pages;
+		std::vector<void*> retiredPages; //still holding the blocks being compacted out of them
+		PoolStatistics stats;
+
+		void refill(uint8_t sizeClass);
+	public:
+		PoolAllocator();
+		~PoolAllocator();
+		PoolAllocator(const PoolAllocator&) = delete;
+		PoolAllocator& operator=(const PoolAllocator&) = delete;
+
+		//blocks are 8 byte aligned and uninitialized; size must be passed back unchanged to release
+		void* allocate(size_t size);
+		void release(void* block, size_t size);
+
+		//compaction: every pooled block is forgotten and later allocations come from fresh pages; the
+		//caller copies what it wants to keep before ending it, which returns the old pages to the system
+		void beginCompaction();
+		void endCompaction();
+
+		static bool pooled(size_t size) { return size <= POOL_LARGEST_CLASS; }
+		static size_t classSize(uint8_t sizeClass);
+		const PoolStatistics& statistics() { return stats; }
+		void printStatistics();
+	};
+}
@@ -193,8 +193,29 @@ namespace ash
 			{
 				VariableDeclarationNode* varNode = (VariableDeclarationNode*)node;
 				std::string varName = varNode->identifier.string;
-				Symbol s = { varName, category::Variable, varNode->type };
 				bool hadError = false;
+				//an array is declared by its length, and allocated with every element zero
+				if (varNode->arraySize && !util::isArray(varNode->type))
+				{
+					Token lengthType = expressionTypeInfo(varNode->arraySize.get(), currentScope);
+					if (lengthType.type != TokenType::ERROR && !util::isInteger(lengthType))
+					{
+						pushError("array length must be an integer.", varNode->arraySize->line());
+						hadError = true;
+					}
+					if (!util::isBasic(varNode->type))
+					{
+						pushError("arrays can only hold basic types.", varNode->identifier.line);
+						hadError = true;
+					}
+					if (varNode->value)
+					{
+						pushError("an array is declared by its length alone.", varNode->value->line());
+						hadError = true;
+					}
+					varNode->type = { TokenType::TYPE, varNode->type.string + "[]", varNode->type.line };
+				}
+				Symbol s = { varName, category::Variable, varNode->type };
 				if (currentScope->symbols.find(varName) == currentScope->symbols.end())
 				{
 					currentScope->symbols.emplace(varName, s);
@@ -207,7 +228,7 @@ namespace ash
 					hadError = true;
 				}
 
-				if(varNode->value)
+				if(varNode->value && !varNode->arraySize)
 				{
 					auto valueType = expressionTypeInfo((ExpressionNode*)varNode->value.get(), currentScope, varNode->type);
 
@@ -386,6 +407,7 @@ namespace ash
 					return false;
 				}
 			}
+			default: return false;
 		}
 	}
 
@@ -643,6 +665,24 @@ namespace ash
 			case ExpressionNode::ExpressionType::Assignment:
 			{
 			AssignmentNode* assignmentNode = (AssignmentNode*)node;
+			if (assignmentNode->identifier->expressionType() == ExpressionNode::ExpressionType::ArrayIndex)
+			{
+				Token elementType = expressionTypeInfo(assignmentNode->identifier.get(), currentScope);
+				if (elementType.type == TokenType::ERROR) return elementType;
+				Token valueType = expressionTypeInfo(assignmentNode->value.get(), currentScope, elementType);
+				if (valueType.type == TokenType::ERROR) return valueType;
+				if (valueType.string != elementType.string)
+				{
+					std::string msg = { "expected type " };
+					msg.append(elementType.string);
+					msg.append(", actual type ");
+					msg.append(valueType.string);
+					msg.append(".");
+					return pushError(msg, assignmentNode->value->line());
+				}
+				assignmentNode->assignmentType = elementType;
+				return elementType;
+			}
 			Symbol* s = nullptr;
 			bool found = false;
 			auto scope = currentScope;
@@ -748,6 +788,12 @@ namespace ash
 			FieldCallNode* fieldCallNode = (FieldCallNode*)node;
 
 			Token parentType = expressionTypeInfo((ExpressionNode*)fieldCallNode->left.get(), currentScope);
+			if (util::isArray(parentType))
+			{
+				if (fieldCallNode->field.string != "length") return pushError("an array has no field but its length.", fieldCallNode->field.line);
+				fieldCallNode->fieldType = { TokenType::TYPE, "int", fieldCallNode->field.line };
+				return fieldCallNode->fieldType;
+			}
 
 			auto scope = currentScope;
 			std::string typeID = parentType.string;
@@ -778,6 +824,32 @@ namespace ash
 			{
 			FunctionCallNode* functionCallNode = (FunctionCallNode*)node;
 
+			//the one method of an array appends an element to it
+			if (functionCallNode->left->expressionType() == ExpressionNode::ExpressionType::FieldCall)
+			{
+				FieldCallNode* method = (FieldCallNode*)functionCallNode->left.get();
+				Token arrayType = expressionTypeInfo(method->left.get(), currentScope);
+				if (util::isArray(arrayType))
+				{
+					if (method->field.string != "push") return pushError("an array has no method but push.", method->field.line);
+					if (functionCallNode->arguments.size() != 1) return pushError("push takes the one element it appends.", method->field.line);
+					Token elementType = util::elementType(arrayType);
+					Token argumentType = expressionTypeInfo(functionCallNode->arguments[0].get(), currentScope, elementType);
+					if (argumentType.type == TokenType::ERROR) return argumentType;
+					if (argumentType.string != elementType.string)
+					{
+						std::string msg = { "expected type " };
+						msg.append(elementType.string);
+						msg.append(", actual type ");
+						msg.append(argumentType.string);
+						msg.append(".");
+						return pushError(msg, functionCallNode->line());
+					}
+					functionCallNode->functionType = { TokenType::TYPE, "void", method->field.line };
+					return functionCallNode->functionType;
+				}
+			}
+
 			std::string funcName = functionCallNode->resolveName();
 			std::string name;
 			//TODO: support calling functions from modules
@@ -847,6 +919,29 @@ namespace ash
 				return pushError(msg, functionCallNode->line());
 			}
 		}
+			case ExpressionNode::ExpressionType::ArrayIndex:
+			{
+				ArrayIndexNode* indexNode = (ArrayIndexNode*)node;
+				Token arrayType = expressionTypeInfo(indexNode->left.get(), currentScope);
+				if (arrayType.type == TokenType::ERROR) return arrayType;
+				if (!util::isArray(arrayType)) return pushError("only an array can be indexed.", indexNode->line());
+				if (!indexNode->index) return pushError("expected an index between '[' and ']'.", indexNode->line());
+				Token indexType = expressionTypeInfo(indexNode->index.get(), currentScope);
+				if (indexType.type == TokenType::ERROR) return indexType;
+				if (!util::isInteger(indexType)) return pushError("array index must be an integer.", indexNode->line());
+				Token elementType = util::elementType(arrayType);
+				if (expected.type != TokenType::ERROR && expected.string != elementType.string)
+				{
+					std::string msg = { "expected type " };
+					msg.append(expected.string);
+					msg.append(", actual type ");
+					msg.append(elementType.string);
+					msg.append(".");
+					return pushError(msg, indexNode->line());
+				}
+				indexNode->arrayType = elementType;
+				return elementType;
+			}
 			case ExpressionNode::ExpressionType::Constructor:
 			{
 				auto constructorNode = (ConstructorNode*)node;
@@ -924,6 +1019,8 @@ namespace ash
 				result->identifier = varNode->identifier;
 				result->type = varNode->type;
 				result->usign = varNode->usign;
+				if (varNode->arraySize)
+					result->arraySize = pruneBinaryExpressions(varNode->arraySize.get(), currentBlock, currentScope);
 				if(varNode->value)
 					result->value = pruneBinaryExpressions(varNode->value.get(), currentBlock, currentScope);
 				return result;
@@ -952,21 +1049,12 @@ namespace ash
 				auto whileNode = (WhileStatementNode*)node;
 				auto result = std::make_shared<WhileStatementNode>();
 
-				result->condition = pruneBinaryExpressions(whileNode->condition.get(), currentBlock, currentScope);
-				std::shared_ptr<BlockNode> stmtBlock = std::make_shared<BlockNode>();
-				std::vector<std::shared_ptr<DeclarationNode>> blockDeclarations;
-				stmtBlock->declarations = blockDeclarations;
-				if (whileNode->doStatement->nodeType() != NodeType::Block)
-				{
-					stmtBlock->scope = std::make_shared<ScopeNode>();
-					blockDeclarations.push_back(linearizeAST((ParseNode*)whileNode->doStatement.get(), blockDeclarations, stmtBlock->scope));
-				}
-				else
-				{
-					auto doStmtBlock = (BlockNode*)whileNode->doStatement.get();
-					stmtBlock = std::dynamic_pointer_cast<BlockNode>(linearizeAST((ParseNode*)doStmtBlock, blockDeclarations, doStmtBlock->scope));
-				}
-				
+				//temporaries of the condition are computed before the loop and again at the end of every pass
+				std::vector<std::shared_ptr<DeclarationNode>> conditionBlock;
+				result->condition = pruneBinaryExpressions(whileNode->condition.get(), conditionBlock, currentScope);
+				auto stmtBlock = linearizeBody(whileNode->doStatement.get(), currentScope);
+				currentBlock.insert(currentBlock.end(), conditionBlock.begin(), conditionBlock.end());
+				stmtBlock->declarations.insert(stmtBlock->declarations.end(), conditionBlock.begin(), conditionBlock.end());
 				result->doStatement = stmtBlock;
 				return result;
 			}
@@ -974,21 +1062,28 @@ namespace ash
 			{
 				auto forNode = (ForStatementNode*)node;
 				auto result = std::make_shared<ForStatementNode>();
-				result->declaration = std::dynamic_pointer_cast<ParseNode>(linearizeAST(forNode->declaration.get(), currentBlock, currentScope));
-				result->conditional = pruneBinaryExpressions(forNode->conditional.get(), currentBlock, currentScope);
-				result->increment = pruneBinaryExpressions(forNode->increment.get(), currentBlock, currentScope);
-				std::shared_ptr<BlockNode> stmtBlock = std::make_shared<BlockNode>();
-				std::vector<std::shared_ptr<DeclarationNode>> stmtDeclarations;
-				if(forNode->statement->nodeType() != NodeType::Block)
-				{
-					stmtBlock->scope = std::make_shared<ScopeNode>();
-					stmtDeclarations.push_back(linearizeAST((ParseNode*)forNode->statement.get(), stmtDeclarations, stmtBlock->scope));
-				}
-				else
+				//the loop variable belongs to the body's scope
+				auto forScope = currentScope;
+				if (forNode->statement->nodeType() == NodeType::Block) forScope = ((BlockNode*)forNode->statement.get())->scope;
+				//the declaration runs once, in a block of that scope ahead of the loop, followed by the condition's temporaries
+				auto head = std::make_shared<BlockNode>();
+				head->scope = forScope;
+				if (forNode->declaration)
+					head->declarations.push_back(linearizeAST(forNode->declaration.get(), head->declarations, forScope));
+				std::vector<std::shared_ptr<DeclarationNode>> conditionBlock;
+				if (forNode->conditional)
+					result->conditional = pruneBinaryExpressions(forNode->conditional.get(), conditionBlock, forScope);
+				auto stmtBlock = linearizeBody(forNode->statement.get(), currentScope);
+				//the increment moves to the end of the body, so its temporaries and the condition's are recomputed every pass
+				if (forNode->increment)
 				{
-					auto forStmtBlock = (BlockNode*)forNode->statement.get();
-					stmtBlock = std::dynamic_pointer_cast<BlockNode>(linearizeAST((ParseNode*)forStmtBlock, stmtDeclarations, forStmtBlock->scope));
+					auto increment = std::make_shared<ExpressionStatement>();
+					increment->expression = pruneBinaryExpressions(forNode->increment.get(), stmtBlock->declarations, forScope);
+					stmtBlock->declarations.push_back(increment);
 				}
+				head->declarations.insert(head->declarations.end(), conditionBlock.begin(), conditionBlock.end());
+				currentBlock.push_back(head);
+				stmtBlock->declarations.insert(stmtBlock->declarations.end(), conditionBlock.begin(), conditionBlock.end());
 				result->statement = stmtBlock;
 				return result;
 			}
@@ -998,35 +1093,9 @@ namespace ash
 				auto result = std::make_shared<IfStatementNode>();
 
 				result->condition = pruneBinaryExpressions(ifNode->condition.get(), currentBlock, currentScope);
-				std::shared_ptr<BlockNode> thenBlock = std::make_shared<BlockNode>();
-				std::vector<std::shared_ptr<DeclarationNode>> thenDeclarations;
-				thenBlock->declarations = thenDeclarations;
-				if(ifNode->thenStatement->nodeType() != NodeType::Block)
-				{
-					thenBlock->scope = std::make_shared<ScopeNode>();
-					thenDeclarations.push_back(linearizeAST((ParseNode*)ifNode->thenStatement.get(), thenDeclarations, thenBlock->scope));
-				}
-				else
-				{
-					auto thenStmtBlock = (BlockNode*)ifNode->thenStatement.get();
-					thenBlock = std::dynamic_pointer_cast<BlockNode>(linearizeAST((ParseNode*)thenStmtBlock, thenDeclarations, thenStmtBlock->scope));
-				}
-		
-				result->thenStatement = thenBlock;
-				std::shared_ptr<BlockNode> elseBlock = std::make_shared<BlockNode>();
-				std::vector<std::shared_ptr<DeclarationNode>> elseDeclarations;
-				elseBlock->declarations = elseDeclarations;
-				if(ifNode->elseStatement->nodeType() != NodeType::Block)
-				{
-					elseBlock->scope = std::make_shared<ScopeNode>();
-					elseDeclarations.push_back(linearizeAST((ParseNode*)ifNode->elseStatement.get(), elseDeclarations, elseBlock->scope));
-				}
-				else
-				{
-					auto elseStmtBlock = (BlockNode*)ifNode->elseStatement.get();
-					elseBlock = std::dynamic_pointer_cast<BlockNode>(linearizeAST((ParseNode*)elseStmtBlock, elseDeclarations, elseStmtBlock->scope));
-				}
-				result->elseStatement = elseBlock;
+				result->thenStatement = linearizeBody(ifNode->thenStatement.get(), currentScope);
+				if (ifNode->elseStatement)
+					result->elseStatement = linearizeBody(ifNode->elseStatement.get(), currentScope);
 				return result;
 			}
 			case NodeType::ExpressionStatement:
@@ -1042,7 +1111,8 @@ namespace ash
 				auto returnNode = (ReturnStatementNode*)node;
 				auto result = std::make_shared<ReturnStatementNode>();
 
-				result->returnValue = pruneBinaryExpressions(returnNode->returnValue.get(), currentBlock, currentScope);
+				if (returnNode->returnValue)
+					result->returnValue = pruneBinaryExpressions(returnNode->returnValue.get(), currentBlock, currentScope);
 				return result;
 			}
 			case NodeType::Expression:
@@ -1052,6 +1122,20 @@ namespace ash
 		}
 	}
 
+	std::shared_ptr<BlockNode> Semantics::linearizeBody(ParseNode* node, std::shared_ptr<ScopeNode> currentScope)
+	{
+		std::vector<std::shared_ptr<DeclarationNode>> unused;
+		if (node->nodeType() == NodeType::Block)
+		{
+			return std::dynamic_pointer_cast<BlockNode>(linearizeAST(node, unused, currentScope));
+		}
+		//a lone statement shares the enclosing scope, and its temporaries go in front of it
+		auto result = std::make_shared<BlockNode>();
+		result->scope = currentScope;
+		result->declarations.push_back(linearizeAST(node, result->declarations, currentScope));
+		return result;
+	}
+
 	std::shared_ptr<ExpressionNode> Semantics::pruneBinaryExpressions(ExpressionNode* node, std::vector<std::shared_ptr<DeclarationNode>>& currentBlock, std::shared_ptr<ScopeNode> currentScope)
 	{
 		switch(node->expressionType())
@@ -1083,6 +1167,15 @@ namespace ash
 				result->fieldType = fieldNode->fieldType;
 				return result;
 			}
+			case ExpressionNode::ExpressionType::ArrayIndex:
+			{
+				auto indexNode = (ArrayIndexNode*)node;
+				auto result = std::make_shared<ArrayIndexNode>();
+				result->left = pruneBinaryExpressions(indexNode->left.get(), currentBlock, currentScope);
+				result->index = pruneBinaryExpressions(indexNode->index.get(), currentBlock, currentScope);
+				result->arrayType = indexNode->arrayType;
+				return result;
+			}
 			case ExpressionNode::ExpressionType::Primary:
 			{
 				auto primaryNode = (CallNode*)node;
@@ -1153,7 +1246,7 @@ namespace ash
 				{
 					auto temp = std::make_shared<VariableDeclarationNode>();
 					temp->value = pruneBinaryExpressions(binaryNode->right.get(), currentBlock, currentScope);
-					temp->type = binaryNode->leftType;
+					temp->type = binaryNode->rightType;
 					std::string tempName = std::string("#").append(std::to_string(temporaries++));
 					temp->identifier = Token{ TokenType::IDENTIFIER, tempName, binaryNode->right->line() };
 
@@ -33,6 +33,26 @@ namespace ash
 			return false;
 		}
 
+		static bool isInteger(Token type)
+		{
+			for (const char* integer : { "byte", "ubyte", "short", "ushort", "int", "uint", "long", "ulong" })
+			{
+				if (type.string == integer) return true;
+			}
+			return false;
+		}
+
+		//an array's type is its elements' followed by "[]"
+		static bool isArray(const Token& type)
+		{
+			return type.string.size() > 2 && type.string.compare(type.string.size() - 2, 2, "[]") == 0;
+		}
+
+		static Token elementType(const Token& array)
+		{
+			return { TokenType::TYPE, array.string.substr(0, array.string.size() - 2), array.line };
+		}
+
 		static Token resolveBasicTypes(Token lhs, Token rhs)
 		{
 			std::string left = lhs.string;
@@ -115,6 +135,8 @@ namespace ash
 		Token pushError(std::string msg, int line);
 
 		std::shared_ptr<DeclarationNode> linearizeAST(ParseNode* node, std::vector<std::shared_ptr<DeclarationNode>>& currentBlock, std::shared_ptr<ScopeNode> currentScope);
+		//the body of a loop or branch as a block of its own
+		std::shared_ptr<BlockNode> linearizeBody(ParseNode* node, std::shared_ptr<ScopeNode> currentScope);
 		std::shared_ptr<ExpressionNode> pruneBinaryExpressions(ExpressionNode* node, std::vector<std::shared_ptr<DeclarationNode>>& currentBlock, std::shared_ptr<ScopeNode> currentScope);
 
 		std::shared_ptr<ScopeNode> getScope(ParseNode* node, std::shared_ptr<ScopeNode> scope)
@@ -1,99 +1,250 @@
 #include "VM.h"
 #include "Compiler.h"
+#include "MarkDeque.h"
 
 #include <iostream>
 #include <queue>
 #include <bitset>
 #include <typeinfo>
 #include <typeindex>
+#include <unordered_set>
+#include <algorithm>
+#include <chrono>
+#include <string.h>
 
-#define STRESSTEST_GC
+//#define STRESSTEST_GC
 //#def LOG_GC
-#define ARRAY_TYPE_OFFSET 8
-#define STRUCT_SPACING_OFFSET 8
-#define REFCOUNT_OFFSET 9
-#define OBJECT_BEGIN_OFFSET 12
+
+//bytes of bump-allocated nursery, and the largest object allocated there rather than directly in the old space
+#define NURSERY_SIZE (512 * 1024)
+#define NURSERY_LARGEST_OBJECT (NURSERY_SIZE / 16)
+
+//backward jumps to the same loop header before the interpreter switches to native code
+#define TIER_UP_THRESHOLD 1000
+
+#ifdef THREADED_DISPATCH
+#define OPCODE(op) op##_HANDLER:
+#define DISPATCH() do { instruction = ip++; goto *instruction->handler; } while (false)
+#else
+#define OPCODE(op) case op:
+#define DISPATCH() continue
+#endif
+
+//body of the compare-and-branch handlers: taken branches behave like OP_RELATIVE_JUMP, the fall-through skips the offset word
+#define BRANCH_IF(condition) \
+	do \
+	{ \
+		if (condition) \
+		{ \
+			ip = program.code() + instruction->immediate; \
+			if (ip <= instruction && isHotLoop(instruction->immediate)) \
+				ip = program.code() + native.enter(R, &comparisonRegister, instruction->immediate); \
+		} \
+		else ip++; \
+	} while (false)
+
+//native code leaves calls, returns, allocation, the stack, output, struct fields and the heap's barriers to the
+//interpreter; once the chunk is translated, the handlers for those instructions pick it up again where they land
+#define RESUME_NATIVE() \
+	do \
+	{ \
+		if (engine != ExecutionEngine::ENGINE_INTERPRETER && native.compiled()) \
+			ip = program.code() + native.enter(R, &comparisonRegister, ip - program.code()); \
+	} while (false)
 
 namespace ash
 {
 	namespace util
 	{
-		inline static uint32_t fetch_instruction(uint32_t*& ip)
+		template<typename T>
+		inline static T r_cast(void* value)
 		{
-			return *ip++;
+			return *reinterpret_cast<T*>(value);
 		}
 
-		inline static uint8_t RegisterA(uint32_t instruction)
+		template<typename T>
+		inline static T r_cast(uint64_t value)
 		{
-			uint8_t A = instruction >> 16;
-			return A;
+			return *reinterpret_cast<T*>(value);
 		}
 
-		inline static uint8_t RegisterB(uint32_t instruction)
+		//bit pattern of a float or double as it is stored in a register; floats leave the high half zero
+		template<typename T>
+		inline static uint64_t raw(T value)
 		{
-			uint8_t B = instruction >> 8;
-			return B;
+			uint64_t result = 0;
+			memcpy(&result, &value, sizeof(T));
+			return result;
 		}
 
-		inline static uint8_t RegisterC(uint32_t instruction)
+		//bytes of a struct object, header included
+		static size_t structSize(TypeMetadata* typeInfo)
 		{
-			uint8_t C = instruction;
-			return C;
+			size_t dataSize = typeInfo->fields.back().offset + util::fieldSize(typeInfo->fields.back().type);
+			size_t size = OBJECT_BEGIN_OFFSET + dataSize;
+			return (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
 		}
 
-		inline static uint16_t Value(uint32_t instruction)
+		//bytes of storage for count elements
+		static size_t elementsSize(size_t count, uint8_t fieldType)
 		{
-			uint16_t value = instruction;
-			return value;
+			size_t size = count * (fieldType & 0x7F);
+			return (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
 		}
 
-		inline static uint32_t JumpOffset(uint32_t instruction)
+		//bytes of an array object with room for count elements in its block, header included
+		static size_t arraySize(size_t count, uint8_t fieldType)
 		{
-			uint32_t offset = instruction & 0x00FFFFFF;
-			offset += (!!(offset & (1 << (24 - 1))) * 0xFF000000);
-			return offset;
+			return ARRAY_BEGIN_OFFSET + elementsSize(count, fieldType);
 		}
 
-		template<typename T>
-		inline static T r_cast(void* value)
+		//the error for a register that does not hold an array with elements [index, index + count), or nullptr
+		static const char* checkRange(uint64_t reference, uint64_t index, uint64_t count)
 		{
-			return *reinterpret_cast<T*>(value);
+			if (reference == 0) return "null reference!";
+			auto object = reinterpret_cast<ObjectHeader*>(reference);
+			if (object->kind != ObjectKind::Array) return "pointer held in register is not an array!";
+			if (index > object->count || count > object->count - index) return "array index out of bounds!";
+			return nullptr;
 		}
 
-		template<typename T>
-		inline static T r_cast(uint64_t value)
+		//element index of an array known to hold it
+		static uint64_t loadElement(ObjectHeader* array, uint64_t index)
 		{
-			return *reinterpret_cast<T*>(value);
+			char* address = array->element(index);
+			switch (array->tag & 0x7F)
+			{
+				case 1: return *reinterpret_cast<uint8_t*>(address);
+				case 2: return *reinterpret_cast<uint16_t*>(address);
+				case 4: return *reinterpret_cast<uint32_t*>(address);
+				default: return *reinterpret_cast<uint64_t*>(address);
+			}
+		}
+
+		//refIncrement for collector threads sharing the heap: a compare and swap that, like it, sticks at the top
+		static void atomicRefIncrement(ObjectHeader* object)
+		{
+			auto count = reinterpret_cast<std::atomic<uint32_t>*>(&object->refCount());
+			uint32_t seen = count->load(std::memory_order_relaxed);
+			while (seen != UINT32_MAX && !count->compare_exchange_weak(seen, seen + 1, std::memory_order_relaxed));
+		}
+
+		//a concurrent marker reads pointer fields, and array counts and storage, while the mutator changes them,
+		//so those go through atomics; a store releases what it publishes, so the marker finds an object
+		//promoted during its cycle fully copied
+		static void storePointer(ObjectHeader** slot, ObjectHeader* ref)
+		{
+			reinterpret_cast<std::atomic<ObjectHeader*>*>(slot)->store(ref, std::memory_order_release);
+		}
+
+		static ObjectHeader* loadPointer(ObjectHeader** slot)
+		{
+			return reinterpret_cast<std::atomic<ObjectHeader*>*>(slot)->load(std::memory_order_acquire);
+		}
+
+		//new storage is published before the count that needs it
+		static void publishElements(ObjectHeader* array, char* storage)
+		{
+			reinterpret_cast<std::atomic<char*>*>(&array->elements())->store(storage, std::memory_order_release);
+		}
+
+		static void publishCount(ObjectHeader* array, uint64_t count)
+		{
+			reinterpret_cast<std::atomic<uint64_t>*>(&array->count)->store(count, std::memory_order_release);
+		}
+
+		//puts object at the front of the list that link heads
+		static void linkObject(ObjectHeader** link, ObjectHeader* object)
+		{
+			object->next() = *link;
+			object->previous() = link;
+			if (*link != nullptr) (*link)->previous() = &object->next();
+			*link = object;
+		}
+
+		static void unlinkObject(ObjectHeader* object)
+		{
+			*object->previous() = object->next();
+			if (object->next() != nullptr) object->next()->previous() = object->previous();
+		}
+
+		static size_t objectSize(ObjectHeader* object)
+		{
+			if (object->kind == ObjectKind::Array) return arraySize(object->blockCapacity(), object->tag);
+			return structSize(object->type);
+		}
+
+		//storage an array has outgrown its block into, or zero
+		static size_t outlineSize(ObjectHeader* object)
+		{
+			if (object->kind != ObjectKind::Array || object->inlineElements()) return 0;
+			return elementsSize(object->capacity(), object->tag);
+		}
+
+		//a block just copied from original points at its own elements, if they are the ones in the block
+		static void copiedFrom(ObjectHeader* copy, ObjectHeader* original)
+		{
+			copy->refCount() = original->refCount();
+			copy->capacity() = original->capacity();
+			if (original->kind == ObjectKind::Array && original->inlineElements())
+				copy->elements() = reinterpret_cast<char*>(copy) + ARRAY_BEGIN_OFFSET;
+		}
+
+		//calls visit with the address of every pointer field of object
+		template<typename F>
+		static void forEachPointer(ObjectHeader* object, F visit)
+		{
+			switch (object->kind)
+			{
+				case ObjectKind::Array:
+				{
+					if ((object->tag & 0x80) == 0) return;
+					//the count first: an array growing under a concurrent marker has its new storage in place before its new count
+					size_t count = reinterpret_cast<std::atomic<uint64_t>*>(&object->count)->load(std::memory_order_acquire);
+					auto elements = reinterpret_cast<ObjectHeader**>(reinterpret_cast<std::atomic<char*>*>(&object->elements())->load(std::memory_order_acquire));
+					for (size_t i = 0; i < count; i++) visit(&elements[i]);
+					break;
+				}
+				case ObjectKind::Type:
+				{
+					TypeMetadata* metadata = object->type;
+					if (metadata == nullptr)
+					{
+						throw std::runtime_error("Invalid type object!");
+					}
+					//field offsets are from the start of the object, as OP_STORE_OFFSET uses them
+					for (const auto& field : metadata->fields)
+					{
+						if (field.type == FieldType::Struct || field.type == FieldType::Array)
+							visit(reinterpret_cast<ObjectHeader**>(reinterpret_cast<char*>(object) + field.offset));
+					}
+					break;
+				}
+			}
 		}
 	}
 
 	VM::VM()
 	{
-		R.fill(0);
-		rFlags.fill(0);
+		registers.assign(FRAME_STACK_REGISTERS, 0);
+		R = registers.data();
+		nursery = static_cast<char*>(malloc(NURSERY_SIZE));
+		if (nursery == nullptr) exit(1);
+		nurseryTop = nursery;
+		nurseryEnd = nursery + NURSERY_SIZE;
 	}
 
 	VM::~VM()
 	{
+		if (marker.joinable()) marker.join();
 		freeAllocations();
+		free(nursery);
 	}
 
 	bool VM::isTruthy(uint8_t _register)
 	{
-		bool result = false;
-		if (rFlags[_register] & REGISTER_HOLDS_FLOAT)
-		{
-			result = (*reinterpret_cast<float*>(&R[_register]) == 0.0f || *reinterpret_cast<float*>(&R[_register]) == -0.0f);
-		}
-		else if (rFlags[_register] & REGISTER_HOLDS_DOUBLE)
-		{
-			result = (*reinterpret_cast<double*>(&R[_register]) == 0.0 || *reinterpret_cast<double*>(&R[_register]) == -0.0);
-		}
-		else
-		{
-			result = R[_register];
-		}
-		return result;
+		//only comparison results and integers reach the logical operators
+		return R[_register] != 0;
 	}
 
 	InterpretResult VM::error(const char* msg)
@@ -105,161 +256,358 @@ namespace ash
 	InterpretResult VM::interpret(std::string source)
 	{
 		Compiler compiler;
+		Chunk chunk;
 
-		bool compileSuccess = compiler.compile(source.c_str());
+		bool compileSuccess = compiler.compile(source.c_str(), &chunk);
 
 		if (!compileSuccess) return InterpretResult::INTERPRET_COMPILE_ERROR;
-		//InterpretResult result = run();
 
-		//return result;
+		InterpretResult result = interpret(&chunk);
+		this->chunk = nullptr;
 
-		return InterpretResult::INTERPRET_OK;
+		return result;
 	}
 
 	InterpretResult VM::interpret(Chunk* chunk)
 	{
 		this->chunk = chunk;
-		ip = chunk->code();
-		//this->types = chunk->types;
+		const char* decodeError = program.decode(chunk);
+		if (decodeError) return error(decodeError);
+		ip = program.code();
+		loopCounters.assign(program.size(), 0);
+		this->types = chunk->types;
+		//spill slots are numbered from the bottom of the stack
+		stack.clear();
+		stackPointers.clear();
+		stackBase = 0;
+		frames.clear();
+		R = registers.data();
+		native.clear();
+#ifdef JIT_SUPPORTED
+		if (engine == ExecutionEngine::ENGINE_JIT && native.compile(program) == nullptr)
+		{
+			//native code runs up to the first instruction it leaves to the interpreter, which enters it again afterwards
+			ip = program.code() + native.enter(R, &comparisonRegister, 0);
+		}
+#endif
 		return run();
 	}
 
+	bool VM::isHotLoop(size_t header)
+	{
+#ifdef JIT_SUPPORTED
+		if (engine != ExecutionEngine::ENGINE_TIERED) return false;
+		if (loopCounters[header] < TIER_UP_THRESHOLD)
+		{
+			loopCounters[header]++;
+			return false;
+		}
+		//the whole chunk is translated the first time any of its loops gets hot
+		if (!native.compiled() && native.compile(program) != nullptr)
+		{
+			engine = ExecutionEngine::ENGINE_INTERPRETER;
+			return false;
+		}
+		return true;
+#else
+		return false;
+#endif
+	}
+
 	InterpretResult VM::run()
 	{
 		using namespace util;
 
+		DecodedInstruction* instruction;
+#ifdef THREADED_DISPATCH
+		//one entry per opcode, in the same order as the OpCodes enum
+		static void* dispatchTable[256] = {
+			&&OP_HALT_HANDLER,
+			&&OP_PUSH_HANDLER,
+			&&OP_POP_HANDLER,
+			&&OP_RETURN_HANDLER,
+			&&OP_OUT_HANDLER,
+			&&OP_STORE_IP_OFFSET_HANDLER,
+			&&OP_MOVE_HANDLER,
+			&&OP_ALLOC_HANDLER,
+			&&OP_CONST_LOW_HANDLER,
+			&&OP_CONST_LOW_NEGATIVE_HANDLER,
+			&&OP_CONST_MID_LOW_HANDLER,
+			&&OP_CONST_MID_HIGH_HANDLER,
+			&&OP_CONST_HIGH_HANDLER,
+			&&OP_STORE_OFFSET_HANDLER,
+			&&OP_LOAD_OFFSET_HANDLER,
+			&&OP_ALLOC_ARRAY_HANDLER,
+			&&OP_ARRAY_STORE_HANDLER,
+			&&OP_ARRAY_LOAD_HANDLER,
+			&&OP_INT_ADD_HANDLER,
+			&&OP_INT_SUB_HANDLER,
+			&&OP_INT_NEGATE_HANDLER,
+			&&OP_UNSIGN_MUL_HANDLER,
+			&&OP_UNSIGN_DIV_HANDLER,
+			&&OP_BIT_SHIFT_RIGHT_HANDLER,
+			&&OP_BIT_SHIFT_LEFT_HANDLER,
+			&&OP_SIGN_MUL_HANDLER,
+			&&OP_SIGN_DIV_HANDLER,
+			&&OP_FLOAT_ADD_HANDLER,
+			&&OP_FLOAT_SUB_HANDLER,
+			&&OP_FLOAT_MUL_HANDLER,
+			&&OP_FLOAT_DIV_HANDLER,
+			&&OP_FLOAT_NEGATE_HANDLER,
+			&&OP_DOUBLE_ADD_HANDLER,
+			&&OP_DOUBLE_SUB_HANDLER,
+			&&OP_DOUBLE_MUL_HANDLER,
+			&&OP_DOUBLE_DIV_HANDLER,
+			&&OP_DOUBLE_NEGATE_HANDLER,
+			&&OP_UNSIGN_LESS_HANDLER,
+			&&OP_UNSIGN_GREATER_HANDLER,
+			&&OP_SIGN_LESS_HANDLER,
+			&&OP_SIGN_GREATER_HANDLER,
+			&&OP_INT_EQUAL_HANDLER,
+			&&OP_FLOAT_LESS_HANDLER,
+			&&OP_FLOAT_GREATER_HANDLER,
+			&&OP_FLOAT_EQUAL_HANDLER,
+			&&OP_DOUBLE_LESS_HANDLER,
+			&&OP_DOUBLE_GREATER_HANDLER,
+			&&OP_DOUBLE_EQUAL_HANDLER,
+			&&OP_INT_TO_FLOAT_HANDLER,
+			&&OP_FLOAT_TO_INT_HANDLER,
+			&&OP_FLOAT_TO_DOUBLE_HANDLER,
+			&&OP_DOUBLE_TO_FLOAT_HANDLER,
+			&&OP_INT_TO_DOUBLE_HANDLER,
+			&&OP_DOUBLE_TO_INT_HANDLER,
+			&&OP_BITWISE_AND_HANDLER,
+			&&OP_BITWISE_OR_HANDLER,
+			&&OP_LOGICAL_AND_HANDLER,
+			&&OP_LOGICAL_OR_HANDLER,
+			&&OP_LOGICAL_NOT_HANDLER,
+			&&OP_RELATIVE_JUMP_HANDLER,
+			&&OP_RELATIVE_JUMP_IF_TRUE_HANDLER,
+			&&OP_REGISTER_JUMP_HANDLER,
+			&&OP_REGISTER_JUMP_IF_TRUE_HANDLER,
+			&&OP_PUSH_POINTER_HANDLER,
+			&&OP_OUT_SIGNED_HANDLER,
+			&&OP_OUT_FLOAT_HANDLER,
+			&&OP_OUT_DOUBLE_HANDLER,
+			&&OP_LOAD_CONST_HANDLER,
+			&&OP_LOAD_CONST_WIDE_HANDLER,
+			&&OP_JUMP_IF_SIGN_LESS_HANDLER,
+			&&OP_JUMP_IF_SIGN_GREATER_HANDLER,
+			&&OP_JUMP_IF_UNSIGN_LESS_HANDLER,
+			&&OP_JUMP_IF_UNSIGN_GREATER_HANDLER,
+			&&OP_JUMP_IF_INT_EQUAL_HANDLER,
+			&&OP_JUMP_IF_FLOAT_LESS_HANDLER,
+			&&OP_JUMP_IF_FLOAT_GREATER_HANDLER,
+			&&OP_JUMP_IF_FLOAT_EQUAL_HANDLER,
+			&&OP_JUMP_IF_DOUBLE_LESS_HANDLER,
+			&&OP_JUMP_IF_DOUBLE_GREATER_HANDLER,
+			&&OP_JUMP_IF_DOUBLE_EQUAL_HANDLER,
+			&&OP_ARRAY_PUSH_HANDLER,
+			&&OP_ARRAY_RESERVE_HANDLER,
+			&&OP_ARRAY_LENGTH_HANDLER,
+			&&OP_ARRAY_COPY_HANDLER,
+			&&OP_ARRAY_FILL_HANDLER,
+			&&OP_ARRAY_COMPARE_HANDLER,
+			&&OP_ARRAY_SLICE_HANDLER,
+			&&OP_ARRAY_STORE_UNCHECKED_HANDLER,
+			&&OP_ARRAY_LOAD_UNCHECKED_HANDLER,
+			&&OP_ARRAY_CHECK_HANDLER,
+			&&OP_VECTOR_INT_ADD_HANDLER,
+			&&OP_VECTOR_FLOAT_ADD_HANDLER,
+			&&OP_VECTOR_DOUBLE_ADD_HANDLER,
+			&&OP_VECTOR_INT_SUB_HANDLER,
+			&&OP_VECTOR_FLOAT_SUB_HANDLER,
+			&&OP_VECTOR_DOUBLE_SUB_HANDLER,
+			&&OP_VECTOR_INT_MUL_HANDLER,
+			&&OP_VECTOR_FLOAT_MUL_HANDLER,
+			&&OP_VECTOR_DOUBLE_MUL_HANDLER,
+			&&OP_VECTOR_INT_FMA_HANDLER,
+			&&OP_VECTOR_FLOAT_FMA_HANDLER,
+			&&OP_VECTOR_DOUBLE_FMA_HANDLER,
+			&&OP_VECTOR_INT_MIN_HANDLER,
+			&&OP_VECTOR_FLOAT_MIN_HANDLER,
+			&&OP_VECTOR_DOUBLE_MIN_HANDLER,
+			&&OP_VECTOR_INT_MAX_HANDLER,
+			&&OP_VECTOR_FLOAT_MAX_HANDLER,
+			&&OP_VECTOR_DOUBLE_MAX_HANDLER,
+			&&OP_VECTOR_INT_SCALE_HANDLER,
+			&&OP_VECTOR_FLOAT_SCALE_HANDLER,
+			&&OP_VECTOR_DOUBLE_SCALE_HANDLER,
+			&&OP_VECTOR_INT_DOT_HANDLER,
+			&&OP_VECTOR_FLOAT_DOT_HANDLER,
+			&&OP_VECTOR_DOUBLE_DOT_HANDLER,
+			&&OP_VECTOR_INT_SUM_HANDLER,
+			&&OP_VECTOR_FLOAT_SUM_HANDLER,
+			&&OP_VECTOR_DOUBLE_SUM_HANDLER,
+			&&OP_STACK_LOAD_HANDLER,
+			&&OP_STACK_STORE_HANDLER,
+			&&OP_CALL_HANDLER,
+			&&OP_RET_HANDLER,
+		};
+		//unused opcode values must still land somewhere valid
+		if (dispatchTable[255] == nullptr)
+		{
+			for (auto& handler : dispatchTable)
+			{
+				if (handler == nullptr) handler = &&UNKNOWN_OPCODE_HANDLER;
+			}
+		}
+		program.bindHandlers(dispatchTable);
+
+		DISPATCH();
+#else
 		while(true)
 		{
-			uint32_t instruction = fetch_instruction(ip);
-			uint8_t opcode = instruction >> 24;
+			instruction = ip++;
 
-			switch (opcode)
+			switch (instruction->op)
 			{
-				case OP_MOVE:
+#endif
+				OPCODE(OP_HALT)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					if (rFlags[B] & REGISTER_HOLDS_POINTER) refDecrement(reinterpret_cast<Allocation*>(R[B]));
-					setRegister(B, R[A]);
-					break;
+					return InterpretResult::INTERPRET_OK;
 				}
-				case OP_ALLOC:
+				OPCODE(OP_MOVE)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					R[B] = R[A];
+					DISPATCH();
+				}
+				OPCODE(OP_ALLOC)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
 					uint64_t typeID = R[A];
-					Allocation* alloc = allocate(typeID);
-					setRegister(B, alloc);
-					break;
+					ObjectHeader* object = allocate(typeID);
+					if (object == nullptr) return error("out of memory!");
+					R[B] = reinterpret_cast<uint64_t>(object);
+					RESUME_NATIVE();
+					DISPATCH();
 				}
-				case OP_ALLOC_ARRAY:
+				OPCODE(OP_ALLOC_ARRAY)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
 					size_t count = R[A];
 					uint8_t span = static_cast<uint8_t>(R[B]);
-					Allocation* alloc = allocateArray(nullptr, 0, count, span);
-					setRegister(C, alloc);
-					break;
+					ObjectHeader* object = allocateArray(count, span);
+					if (object == nullptr) return error("out of memory!");
+					R[C] = reinterpret_cast<uint64_t>(object);
+					RESUME_NATIVE();
+					DISPATCH();
 				}
-				case OP_CONST_LOW:
+				OPCODE(OP_CONST_LOW)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint64_t value = Value(instruction);
-					setRegister(A, value);
-					break;
+					uint8_t A = instruction->A;
+					R[A] = static_cast<uint16_t>(instruction->immediate);
+					DISPATCH();
 				}
-				case OP_CONST_LOW_NEGATIVE:
+				OPCODE(OP_CONST_LOW_NEGATIVE)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint64_t value = Value(instruction) | 0xFFFFFFFFFFFF0000;
-					setRegister(A, value);
+					uint8_t A = instruction->A;
+					R[A] = static_cast<int64_t>(instruction->immediate);
+					DISPATCH();
 				}
-				case OP_CONST_MID_LOW:
+				OPCODE(OP_CONST_MID_LOW)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint16_t value = Value(instruction);
-					setRegister(A, (R[A] & 0xFFFFFFFF0000FFFF) + (((uint64_t)value) <<16));
-					break;
+					uint8_t A = instruction->A;
+					uint16_t value = static_cast<uint16_t>(instruction->immediate);
+					R[A] = (R[A] & 0xFFFFFFFF0000FFFF) + (((uint64_t)value) << 16);
+					DISPATCH();
 				}
-				case OP_CONST_MID_HIGH:
+				OPCODE(OP_CONST_MID_HIGH)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint16_t value = Value(instruction);
-					setRegister(A, (R[A] & 0xFFFF0000FFFFFFFF) + (((uint64_t)value) << 32));
-					break;
+					uint8_t A = instruction->A;
+					uint16_t value = static_cast<uint16_t>(instruction->immediate);
+					R[A] = (R[A] & 0xFFFF0000FFFFFFFF) + (((uint64_t)value) << 32);
+					DISPATCH();
 				}
-				case OP_CONST_HIGH:
+				OPCODE(OP_CONST_HIGH)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint16_t value = Value(instruction);
-					setRegister(A,(R[A] & 0x0000FFFFFFFFFFFF) + (((uint64_t)value) << 48));
-					break;
+					uint8_t A = instruction->A;
+					uint16_t value = static_cast<uint16_t>(instruction->immediate);
+					R[A] = (R[A] & 0x0000FFFFFFFFFFFF) + (((uint64_t)value) << 48);
+					DISPATCH();
+				}
+				OPCODE(OP_LOAD_CONST)
+				{
+					uint8_t A = instruction->A;
+					R[A] = program.constant(instruction->immediate);
+					DISPATCH();
+				}
+				OPCODE(OP_LOAD_CONST_WIDE)
+				{
+					uint8_t A = instruction->A;
+					R[A] = program.constant(instruction->immediate);
+					ip++; //index word
+					DISPATCH();
 				}
-				case OP_STORE_OFFSET:
+				OPCODE(OP_STORE_OFFSET)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					if ((rFlags[B] & REGISTER_HOLDS_POINTER) == 0) return error("register not a memory address!");
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					if (R[B] == 0) return error("null reference!");
 
-					auto alloc = reinterpret_cast<Allocation*>(R[B]);
-					auto spacing = *(alloc->memory + STRUCT_SPACING_OFFSET);
-					TypeMetadata* metadata = (TypeMetadata*)alloc->memory;
+					auto object = reinterpret_cast<ObjectHeader*>(R[B]);
+					if (object->kind != ObjectKind::Type) return error("pointer held in register is not a struct!");
+					char* memory = reinterpret_cast<char*>(object);
+					TypeMetadata* metadata = object->type;
 					if (R[C] >= metadata->fields.size()) return error("field out of bounds!");
 					size_t offset = metadata->fields[R[C]].offset;
 					FieldType type = metadata->fields[R[C]].type;
+					//the field's declared type says whether R[A] is a pointer, so heap counts stay exact
 					if (type == FieldType::Array || type == FieldType::Struct)
 					{
-						Allocation* ref = *reinterpret_cast<Allocation**>(alloc->memory + offset);
-						if(ref)
-							refDecrement(ref);
-					}
-					if (rFlags[A] & REGISTER_HOLDS_POINTER)
-					{
-						Allocation* ref = *reinterpret_cast<Allocation**>(&R[A]);
-						refIncrement(ref);
+						ObjectHeader* previous = *reinterpret_cast<ObjectHeader**>(memory + offset);
+						ObjectHeader* ref = reinterpret_cast<ObjectHeader*>(R[A]);
+						countStore(previous, ref);
+						writeBarrier(object, previous, ref);
 					}
 					switch (fieldSize(type))
 					{
 					case 1:
 					{
-						auto addr = reinterpret_cast<uint8_t*>(alloc->memory + offset);
+						auto addr = reinterpret_cast<uint8_t*>(memory + offset);
 						*addr = static_cast<uint8_t>(R[A]);
 						break;
 					}
 					case 2:
 					{
-						auto addr = reinterpret_cast<uint16_t*>(alloc->memory + offset);
+						auto addr = reinterpret_cast<uint16_t*>(memory + offset);
 						*addr = static_cast<uint16_t>(R[A]);
 						break;
 					}
 					case 4:
 					{
-						auto addr = reinterpret_cast<uint32_t*>(alloc->memory + offset);
+						auto addr = reinterpret_cast<uint32_t*>(memory + offset);
 						*addr = static_cast<uint32_t>(R[A]);
 						break;
 					}
 					case 8:
 					{
-						auto addr = reinterpret_cast<uint64_t*>(alloc->memory + offset);
-						*addr = static_cast<uint64_t>(R[A]);
+						auto addr = reinterpret_cast<uint64_t*>(memory + offset);
+						if (type == FieldType::Array || type == FieldType::Struct) util::storePointer(reinterpret_cast<ObjectHeader**>(addr), reinterpret_cast<ObjectHeader*>(R[A]));
+						else *addr = static_cast<uint64_t>(R[A]);
 						break;
 					}
 					}
-					break;
+					RESUME_NATIVE();
+					DISPATCH();
 				}
-				case OP_LOAD_OFFSET:
+				OPCODE(OP_LOAD_OFFSET)
 				{
-					uint8_t A = fetch_instruction(ip);
-					uint8_t B = fetch_instruction(ip);
-					uint8_t C = fetch_instruction(ip);
-					if ((rFlags[B] & REGISTER_HOLDS_POINTER) == 0) return error("register not a memory address!");
-					
-					auto alloc = reinterpret_cast<Allocation*>(R[B]);
-					auto spacing = *(alloc->memory + STRUCT_SPACING_OFFSET);
-					TypeMetadata* metadata = (TypeMetadata*)alloc->memory;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					if (R[B] == 0) return error("null reference!");
+
+					auto object = reinterpret_cast<ObjectHeader*>(R[B]);
+					if (object->kind != ObjectKind::Type) return error("pointer held in register is not a struct!");
+					char* memory = reinterpret_cast<char*>(object);
+					TypeMetadata* metadata = object->type;
 					if (R[C] >= metadata->fields.size()) return error("field out of bounds!");
 					size_t offset = metadata->fields[R[C]].offset;
 					FieldType type = metadata->fields[R[C]].type;
@@ -268,932 +616,1760 @@ namespace ash
 						case FieldType::Bool:
 						case FieldType::UByte:
 						{
-							auto addr = reinterpret_cast<uint8_t*>(alloc->memory + offset);
-							setRegister(A, (uint64_t)*addr);
+							R[A] = *reinterpret_cast<uint8_t*>(memory + offset);
 							break;
 						}
 						case FieldType::UShort:
 						{
-							auto addr = reinterpret_cast<uint16_t*>(alloc->memory + offset);
-							setRegister(A, (uint64_t)*addr);
+							R[A] = *reinterpret_cast<uint16_t*>(memory + offset);
 							break;
 						}
-
 						case FieldType::UInt:
+						case FieldType::Char:
+						case FieldType::Float:
 						{
-							auto addr = reinterpret_cast<uint32_t*>(alloc->memory + offset);
-							setRegister(A, (uint64_t)*addr);
-							break;
-						}
-						case FieldType::ULong:
-						{
-							auto addr = reinterpret_cast<uint64_t*>(alloc->memory + offset);
-							setRegister(A, *addr);
+							R[A] = *reinterpret_cast<uint32_t*>(memory + offset);
 							break;
 						}
 						case FieldType::Byte:
 						{
-							auto addr = reinterpret_cast<int8_t*>(alloc->memory + offset);
-							setRegister(A, (int64_t)*addr);
+							R[A] = static_cast<int64_t>(*reinterpret_cast<int8_t*>(memory + offset));
 							break;
 						}
 						case FieldType::Short:
 						{
-							auto addr = reinterpret_cast<int16_t*>(alloc->memory + offset);
-							setRegister(A, (int64_t)*addr);
+							R[A] = static_cast<int64_t>(*reinterpret_cast<int16_t*>(memory + offset));
 							break;
 						}
 						case FieldType::Int:
 						{
-							auto addr = reinterpret_cast<int32_t*>(alloc->memory + offset);
-							setRegister(A, (int64_t)*addr);
+							R[A] = static_cast<int64_t>(*reinterpret_cast<int32_t*>(memory + offset));
 							break;
 						}
 						case FieldType::Long:
-						{
-							auto addr = reinterpret_cast<int64_t*>(alloc->memory + offset);
-							setRegister(A, *addr);
-							break;
-						}
-						case FieldType::Float:
-						{
-							auto addr = reinterpret_cast<float*>(alloc->memory + offset);
-							setRegister(A, *addr);
-							break;
-						}
+						case FieldType::ULong:
 						case FieldType::Double:
-						{
-							auto addr = reinterpret_cast<double*>(alloc->memory + offset);
-							setRegister(A, *addr);
-							break;
-						}
 						case FieldType::Struct:
 						case FieldType::Array:
 						{
-							auto addr = reinterpret_cast<Allocation**>(alloc->memory + offset);
-							setRegister(A, *addr);
+							R[A] = *reinterpret_cast<uint64_t*>(memory + offset);
 							break;
 						}
 					}
-					break;
+					RESUME_NATIVE();
+					DISPATCH();
 				}
-				case OP_ARRAY_STORE:
+				OPCODE(OP_ARRAY_STORE)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					if ((rFlags[B] & REGISTER_HOLDS_POINTER) == 0) return error("register not a memory address!");
-					if ((rFlags[B] & REGISTER_HOLDS_ARRAY) == 0) return error("pointer held in register is not an array!");
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					if (R[B] == 0) return error("null reference!");
 
-					auto alloc = reinterpret_cast<Allocation*>(R[B]);
-					uint8_t span = (*((char*)alloc->memory + ARRAY_TYPE_OFFSET)) & 0x7F;
-					uint8_t spacing = (span - 2) * ((span - 2) > 0);
-					uint64_t arrayCount = *reinterpret_cast<uint64_t*>(alloc->memory);
-					if (R[C] >= arrayCount) return error("array index out of bounds!");
-					uint64_t offset = span * R[C];
-					switch (span)
-					{
-					case 1:
-					{
-						auto addr = reinterpret_cast<uint8_t*>(alloc->memory + OBJECT_BEGIN_OFFSET + spacing + offset);
-						*addr = static_cast<uint8_t>(R[A]);
-						break;
-					}
-					case 2:
-					{
-						auto addr = reinterpret_cast<uint16_t*>(alloc->memory + OBJECT_BEGIN_OFFSET + spacing + offset);
-						*addr = static_cast<uint16_t>(R[A]);
-						break;
-					}
-					case 4:
-					{
-						auto addr = reinterpret_cast<uint32_t*>(alloc->memory + OBJECT_BEGIN_OFFSET + spacing + offset);
-						*addr = static_cast<uint32_t>(R[A]);
-						break;
-					}
-					case 8:
-					{
-						auto addr = reinterpret_cast<uint64_t*>(alloc->memory + OBJECT_BEGIN_OFFSET + spacing + offset);
-						*addr = R[A];
-						break;
-					}
-					}
-					break;
-				}
-				case OP_ARRAY_LOAD:
-				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					if ((rFlags[B] & REGISTER_HOLDS_POINTER) == 0) return error("register not a memory address!");
-					if ((rFlags[B] & REGISTER_HOLDS_ARRAY) == 0) return error("pointer held in register is not an array!");
-					if (rFlags[A] & REGISTER_HOLDS_POINTER) refDecrement(reinterpret_cast<Allocation*>(R[A]));
-					auto alloc = reinterpret_cast<Allocation*>(R[B]);
-					uint8_t span = (*((char*)alloc->memory + ARRAY_TYPE_OFFSET)) & 0x7F;
-					uint8_t spacing = (span - 2) * ((span - 2) > 0);
-					bool isPtr = (*((char*)alloc->memory + ARRAY_TYPE_OFFSET)) & 0x80;
-					uint64_t arrayCount = *reinterpret_cast<uint64_t*>(alloc->memory);
+					auto object = reinterpret_cast<ObjectHeader*>(R[B]);
+					if (object->kind != ObjectKind::Array) return error("pointer held in register is not an array!");
+					if (R[C] >= object->count) return error("array index out of bounds!");
+					storeElement(object, R[C], R[A]);
+					RESUME_NATIVE();
+					DISPATCH();
+				}
+				OPCODE(OP_ARRAY_LOAD)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					if (R[B] == 0) return error("null reference!");
+
+					auto object = reinterpret_cast<ObjectHeader*>(R[B]);
+					if (object->kind != ObjectKind::Array) return error("pointer held in register is not an array!");
+					char* memory = object->elements();
+					uint8_t span = object->tag & 0x7F;
+					uint64_t arrayCount = object->count;
 					if (R[C] >= arrayCount) return error("array index out of bounds!");
 					uint64_t offset = span * R[C];
 					switch (span)
 					{
 					case 1:
 					{
-						auto addr = reinterpret_cast<uint8_t*>(alloc->memory + OBJECT_BEGIN_OFFSET + spacing + offset);
+						auto addr = reinterpret_cast<uint8_t*>(memory + offset);
 						R[A] = *addr;
 						break;
 					}
 					case 2:
 					{
-						auto addr = reinterpret_cast<uint16_t*>(alloc->memory + OBJECT_BEGIN_OFFSET + spacing + offset);
+						auto addr = reinterpret_cast<uint16_t*>(memory + offset);
 						R[A] = *addr;
 						break;
 					}
 					case 4:
 					{
-						auto addr = reinterpret_cast<uint32_t*>(alloc->memory + OBJECT_BEGIN_OFFSET + spacing + offset);
+						auto addr = reinterpret_cast<uint32_t*>(memory + offset);
 						R[A] = *addr;
 						break;
 					}
 					case 8:
 					{
-						auto addr = reinterpret_cast<uint64_t*>(alloc->memory + OBJECT_BEGIN_OFFSET + spacing + offset);
+						auto addr = reinterpret_cast<uint64_t*>(memory + offset);
 						R[A] = *addr;
 						break;
 					}
 					}
-					if (isPtr)
-					{
-						auto objectAddress = reinterpret_cast<Allocation*>(R[A]);
-						rFlags[A] &= REGISTER_HIGH_BITS;
-						switch (objectAddress->type())
-						{
-						case AllocationType::Array:
-							rFlags[A] |= REGISTER_HOLDS_ARRAY;
-						case AllocationType::Type:
-							rFlags[A] |= REGISTER_HOLDS_POINTER;
-						}
-						refIncrement(objectAddress);
-					}
-					break;
+					DISPATCH();
 				}
-				case OP_PUSH:
+				OPCODE(OP_PUSH)
 				{
-					uint8_t A = RegisterA(instruction);
+					uint8_t A = instruction->A;
 					stack.push_back(R[A]);
-					stackFlags.push_back(rFlags[A]);
-					if ((rFlags[A] & REGISTER_HOLDS_POINTER) != 0)
-					{
-						stackPointers.push_back(stack.size() - 1);
-						refIncrement(*reinterpret_cast<Allocation**>(&R[A]));
-					}
-					rFlags[A] = 0;
-					break;
+					RESUME_NATIVE();
+					DISPATCH();
+				}
+				OPCODE(OP_PUSH_POINTER)
+				{
+					uint8_t A = instruction->A;
+					stack.push_back(R[A]);
+					stackPointers.push_back(stack.size() - 1);
+					RESUME_NATIVE();
+					DISPATCH();
 				}
-				case OP_POP:
+				OPCODE(OP_POP)
 				{
-					uint8_t A = RegisterA(instruction);
-					R[A] =  stack.back();
-					rFlags[A] = stackFlags.back();
-					if (stackPointers.back() == stack.size() - 1)
+					uint8_t A = instruction->A;
+					if (stack.size() == 0) return error("stack underflow!");
+					R[A] = stack.back();
+					if (stackPointers.size() != 0 && stackPointers.back() == stack.size() - 1)
 					{
 						stackPointers.pop_back();
-						//no need to decrement: register holds value, no net change in refcount
 					}
 					stack.pop_back();
-					stackFlags.pop_back();
-					break;
+					RESUME_NATIVE();
+					DISPATCH();
 				}
-				case OP_INT_ADD:
+				OPCODE(OP_STACK_LOAD)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C,static_cast<int64_t>(R[A] + R[B]));
-					break;
+					uint8_t A = instruction->A;
+					size_t slot = stackBase + static_cast<uint16_t>(instruction->immediate);
+					if (slot >= stack.size()) return error("stack slot out of bounds!");
+					R[A] = stack[slot];
+					RESUME_NATIVE();
+					DISPATCH();
 				}
-				case OP_INT_SUB:
+				OPCODE(OP_STACK_STORE)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, static_cast<int64_t>(R[A] - R[B]));
-					break;
+					uint8_t A = instruction->A;
+					size_t slot = stackBase + static_cast<uint16_t>(instruction->immediate);
+					if (slot >= stack.size()) return error("stack slot out of bounds!");
+					stack[slot] = R[A];
+					RESUME_NATIVE();
+					DISPATCH();
 				}
-				case OP_INT_NEGATE:
+				OPCODE(OP_INT_ADD)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-
-					setRegister(B, -static_cast<int64_t>(R[A]));
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = R[A] + R[B];
+					DISPATCH();
 				}
-				case OP_UNSIGN_MUL:
+				OPCODE(OP_INT_SUB)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, R[A] * R[B]);
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = R[A] - R[B];
+					DISPATCH();
 				}
-				case OP_UNSIGN_DIV:
+				OPCODE(OP_INT_NEGATE)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, R[A] / R[B]);
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					R[B] = -static_cast<int64_t>(R[A]);
+					DISPATCH();
 				}
-				case OP_UNSIGN_LESS:
+				OPCODE(OP_UNSIGN_MUL)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, comparisonRegister = R[A] < R[B]);
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = R[A] * R[B];
+					DISPATCH();
 				}
-				case OP_INT_EQUAL:
+				OPCODE(OP_UNSIGN_DIV)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, comparisonRegister = R[A] == R[B]);
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					if (R[B] == 0) return error("division by zero!");
+					R[C] = R[A] / R[B];
+					DISPATCH();
 				}
-				case OP_UNSIGN_GREATER:
+				OPCODE(OP_BIT_SHIFT_RIGHT)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, comparisonRegister = R[A] > R[B]);
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = R[A] >> R[B];
+					DISPATCH();
 				}
-				case OP_SIGN_MUL:
+				OPCODE(OP_BIT_SHIFT_LEFT)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, (static_cast<int64_t>(R[A]) * static_cast<int64_t>(R[B])));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = R[A] << R[B];
+					DISPATCH();
 				}
-				case OP_SIGN_DIV:
+				OPCODE(OP_UNSIGN_LESS)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, (static_cast<int64_t>(R[A]) / static_cast<int64_t>(R[B])));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = comparisonRegister = R[A] < R[B];
+					DISPATCH();
 				}
-				case OP_SIGN_LESS:
+				OPCODE(OP_INT_EQUAL)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					
-					setRegister(C, comparisonRegister = (static_cast<int64_t>(R[A]) < static_cast<int64_t>(R[B])));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = comparisonRegister = R[A] == R[B];
+					DISPATCH();
 				}
-				case OP_SIGN_GREATER:
+				OPCODE(OP_UNSIGN_GREATER)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, comparisonRegister = (static_cast<int64_t>(R[A]) > static_cast<int64_t>(R[B])));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = comparisonRegister = R[A] > R[B];
+					DISPATCH();
 				}
-				case OP_FLOAT_ADD:
+				OPCODE(OP_SIGN_MUL)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, (*reinterpret_cast<float*>(&R[A]) + *reinterpret_cast<float*>(&R[B])));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = static_cast<int64_t>(R[A]) * static_cast<int64_t>(R[B]);
+					DISPATCH();
 				}
-				case OP_FLOAT_SUB:
+				OPCODE(OP_SIGN_DIV)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, (*reinterpret_cast<float*>(&R[A]) - *reinterpret_cast<float*>(&R[B])));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					if (R[B] == 0) return error("division by zero!");
+					R[C] = static_cast<int64_t>(R[A]) / static_cast<int64_t>(R[B]);
+					DISPATCH();
 				}
-				case OP_FLOAT_MUL:
+				OPCODE(OP_SIGN_LESS)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, (*reinterpret_cast<float*>(&R[A]) * *reinterpret_cast<float*>(&R[B])));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = comparisonRegister = (static_cast<int64_t>(R[A]) < static_cast<int64_t>(R[B]));
+					DISPATCH();
 				}
-				case OP_FLOAT_DIV:
+				OPCODE(OP_SIGN_GREATER)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, (*reinterpret_cast<float*>(&R[A]) / *reinterpret_cast<float*>(&R[B])));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = comparisonRegister = (static_cast<int64_t>(R[A]) > static_cast<int64_t>(R[B]));
+					DISPATCH();
 				}
-				case OP_FLOAT_NEGATE:
+				OPCODE(OP_FLOAT_ADD)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-
-					setRegister(B, -*reinterpret_cast<float*>(&R[A]));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = raw(r_cast<float>(&R[A]) + r_cast<float>(&R[B]));
+					DISPATCH();
 				}
-				case OP_FLOAT_LESS:
+				OPCODE(OP_FLOAT_SUB)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, comparisonRegister = (*reinterpret_cast<float*>(&R[A]) < *reinterpret_cast<float*>(&R[B])));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = raw(r_cast<float>(&R[A]) - r_cast<float>(&R[B]));
+					DISPATCH();
 				}
-				case OP_FLOAT_GREATER:
+				OPCODE(OP_FLOAT_MUL)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, comparisonRegister = (*reinterpret_cast<float*>(&R[A]) > *reinterpret_cast<float*>(&R[B])));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = raw(r_cast<float>(&R[A]) * r_cast<float>(&R[B]));
+					DISPATCH();
 				}
-				case OP_FLOAT_EQUAL:
+				OPCODE(OP_FLOAT_DIV)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, comparisonRegister = (*reinterpret_cast<float*>(&R[A]) == *reinterpret_cast<float*>(&R[B])));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = raw(r_cast<float>(&R[A]) / r_cast<float>(&R[B]));
+					DISPATCH();
 				}
-				case OP_DOUBLE_ADD:
+				OPCODE(OP_FLOAT_NEGATE)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, (*reinterpret_cast<double*>(&R[A]) + *reinterpret_cast<double*>(&R[B])));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					R[B] = raw(-r_cast<float>(&R[A]));
+					DISPATCH();
 				}
-				case OP_DOUBLE_SUB:
+				OPCODE(OP_FLOAT_LESS)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, (*reinterpret_cast<double*>(&R[A]) - *reinterpret_cast<double*>(&R[B])));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = comparisonRegister = (r_cast<float>(&R[A]) < r_cast<float>(&R[B]));
+					DISPATCH();
 				}
-				case OP_DOUBLE_MUL:
+				OPCODE(OP_FLOAT_GREATER)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, (*reinterpret_cast<double*>(&R[A]) * *reinterpret_cast<double*>(&R[B])));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = comparisonRegister = (r_cast<float>(&R[A]) > r_cast<float>(&R[B]));
+					DISPATCH();
 				}
-				case OP_DOUBLE_DIV:
+				OPCODE(OP_FLOAT_EQUAL)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, (*reinterpret_cast<double*>(&R[A]) / *reinterpret_cast<double*>(&R[B])));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = comparisonRegister = (r_cast<float>(&R[A]) == r_cast<float>(&R[B]));
+					DISPATCH();
 				}
-				case OP_DOUBLE_NEGATE:
+				OPCODE(OP_DOUBLE_ADD)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-
-					setRegister(B, *reinterpret_cast<double*>(&R[A]));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = raw(r_cast<double>(&R[A]) + r_cast<double>(&R[B]));
+					DISPATCH();
 				}
-				case OP_DOUBLE_LESS:
+				OPCODE(OP_DOUBLE_SUB)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, comparisonRegister = (r_cast<double>(&R[A]) < r_cast<double>(&R[B])));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = raw(r_cast<double>(&R[A]) - r_cast<double>(&R[B]));
+					DISPATCH();
 				}
-				case OP_DOUBLE_GREATER:
+				OPCODE(OP_DOUBLE_MUL)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, comparisonRegister = (r_cast<double>(&R[A]) > r_cast<double>(&R[B])));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = raw(r_cast<double>(&R[A]) * r_cast<double>(&R[B]));
+					DISPATCH();
 				}
-				case OP_DOUBLE_EQUAL:
+				OPCODE(OP_DOUBLE_DIV)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					setRegister(C, comparisonRegister = (r_cast<double>(&R[A]) == r_cast<double>(&R[B])));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = raw(r_cast<double>(&R[A]) / r_cast<double>(&R[B]));
+					DISPATCH();
 				}
-				case OP_INT_TO_FLOAT:
+				OPCODE(OP_DOUBLE_NEGATE)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					setRegister(B, (static_cast<float>(static_cast<int64_t>(R[A]))));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					R[B] = raw(-r_cast<double>(&R[A]));
+					DISPATCH();
 				}
-				case OP_FLOAT_TO_INT:
+				OPCODE(OP_DOUBLE_LESS)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					setRegister(B, static_cast<uint64_t>(static_cast<int64_t>(static_cast<float>(R[A]))));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = comparisonRegister = (r_cast<double>(&R[A]) < r_cast<double>(&R[B]));
+					DISPATCH();
 				}
-				case OP_FLOAT_TO_DOUBLE:
+				OPCODE(OP_DOUBLE_GREATER)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					setRegister(B, static_cast<double>(*reinterpret_cast<float*>(&R[A])));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = comparisonRegister = (r_cast<double>(&R[A]) > r_cast<double>(&R[B]));
+					DISPATCH();
 				}
-				case OP_DOUBLE_TO_FLOAT:
+				OPCODE(OP_DOUBLE_EQUAL)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					setRegister(B, static_cast<float>(*reinterpret_cast<double*>(&R[A])));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = comparisonRegister = (r_cast<double>(&R[A]) == r_cast<double>(&R[B]));
+					DISPATCH();
 				}
-				case OP_INT_TO_DOUBLE:
+				OPCODE(OP_INT_TO_FLOAT)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					setRegister(B, static_cast<double>(static_cast<int64_t>(R[A])));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					R[B] = raw(static_cast<float>(static_cast<int64_t>(R[A])));
+					DISPATCH();
 				}
-				case OP_DOUBLE_TO_INT:
+				OPCODE(OP_FLOAT_TO_INT)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					setRegister(B, static_cast<uint64_t>(static_cast<int64_t>(static_cast<double>(R[A]))));
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					R[B] = static_cast<int64_t>(r_cast<float>(&R[A]));
+					DISPATCH();
 				}
-				case OP_BITWISE_AND:
+				OPCODE(OP_FLOAT_TO_DOUBLE)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					uint8_t flags = rFlags[C];
-					setRegister(C, R[A] & R[B]);
-					rFlags[C] = flags;
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					R[B] = raw(static_cast<double>(r_cast<float>(&R[A])));
+					DISPATCH();
 				}
-				case OP_BITWISE_OR:
+				OPCODE(OP_DOUBLE_TO_FLOAT)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					uint8_t flags = rFlags[C];
-					setRegister(C, R[A] | R[B]);
-					rFlags[C] = flags;
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					R[B] = raw(static_cast<float>(r_cast<double>(&R[A])));
+					DISPATCH();
 				}
-				case OP_LOGICAL_AND:
+				OPCODE(OP_INT_TO_DOUBLE)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					bool isATruthy = isTruthy(A);
-					bool isBTruthy = isTruthy(B);
-
-					setRegister(C, comparisonRegister = isATruthy && isBTruthy);
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					R[B] = raw(static_cast<double>(static_cast<int64_t>(R[A])));
+					DISPATCH();
 				}
-				case OP_LOGICAL_OR:
+				OPCODE(OP_DOUBLE_TO_INT)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					uint8_t C = RegisterC(instruction);
-					bool isATruthy = isTruthy(A);
-					bool isBTruthy = isTruthy(B);
-
-					setRegister(C, comparisonRegister = isATruthy || isBTruthy);
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					R[B] = static_cast<int64_t>(r_cast<double>(&R[A]));
+					DISPATCH();
 				}
-				case OP_LOGICAL_NOT:
+				OPCODE(OP_BITWISE_AND)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint8_t B = RegisterB(instruction);
-					bool isATruthy = isTruthy(A);
-
-					setRegister(B, comparisonRegister = !isATruthy);
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = R[A] & R[B];
+					DISPATCH();
 				}
-				case OP_STORE_IP_OFFSET:
+				OPCODE(OP_BITWISE_OR)
 				{
-					uint8_t A = RegisterA(instruction);
-					uint64_t temp = ip - chunk->code();
-					setRegister(A, temp);
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = R[A] | R[B];
+					DISPATCH();
 				}
-				case OP_RELATIVE_JUMP:
+				OPCODE(OP_LOGICAL_AND)
 				{
-					int32_t jump = (int32_t)JumpOffset(instruction);
-					if((ip - chunk->code()) + jump - 1 > static_cast<int64_t>(chunk->size()) || (ip - chunk->code()) + jump - 1 < 0) return error("attempted jump beyond code bounds!");
-					ip += jump - 1;
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = comparisonRegister = isTruthy(A) && isTruthy(B);
+					DISPATCH();
+				}
+				OPCODE(OP_LOGICAL_OR)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[C] = comparisonRegister = isTruthy(A) || isTruthy(B);
+					DISPATCH();
+				}
+				OPCODE(OP_LOGICAL_NOT)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					R[B] = comparisonRegister = !isTruthy(A);
+					DISPATCH();
+				}
+				OPCODE(OP_STORE_IP_OFFSET)
+				{
+					uint8_t A = instruction->A;
+					R[A] = static_cast<uint64_t>(instruction->immediate);
+					DISPATCH();
+				}
+				OPCODE(OP_RELATIVE_JUMP)
+				{
+					//jump targets were bounds-checked when the chunk was decoded
+					ip = program.code() + instruction->immediate;
+					if (ip <= instruction && isHotLoop(instruction->immediate))
+					{
+						//on-stack replacement: R and the comparison register are shared, so native code picks up mid-loop
+						ip = program.code() + native.enter(R, &comparisonRegister, instruction->immediate);
+					}
+					DISPATCH();
 				}
-				case OP_RELATIVE_JUMP_IF_TRUE:
+				OPCODE(OP_RELATIVE_JUMP_IF_TRUE)
 				{
 					if (comparisonRegister)
 					{
 						comparisonRegister = false;
-						int32_t jump = (int32_t)JumpOffset(instruction);
-						if (((ip - chunk->code()) + jump - 1) > static_cast<int64_t>(chunk->size()) || ((ip - chunk->code()) + jump - 1) < 0) return error("attempted jump beyond code bounds!");
-						ip += jump - 1;
+						ip = program.code() + instruction->immediate;
+						if (ip <= instruction && isHotLoop(instruction->immediate))
+						{
+							ip = program.code() + native.enter(R, &comparisonRegister, instruction->immediate);
+						}
 					}
-					break;
+					DISPATCH();
 				}
-				case OP_REGISTER_JUMP:
+				OPCODE(OP_REGISTER_JUMP)
 				{
-					uint8_t A = RegisterA(instruction);
-					if (R[A] > chunk->size()) return error("attempted jump beyond code bounds!");
-					ip = chunk->code() + R[A];
-					break;
+					uint8_t A = instruction->A;
+					if (R[A] >= program.size()) return error("attempted jump beyond code bounds!");
+					ip = program.code() + R[A];
+					RESUME_NATIVE();
+					DISPATCH();
 				}
-				case OP_REGISTER_JUMP_IF_TRUE:
+				OPCODE(OP_REGISTER_JUMP_IF_TRUE)
 				{
 					if (comparisonRegister)
 					{
 						comparisonRegister = false;
-						uint8_t A = RegisterA(instruction);
-						if (R[A] > chunk->size()) return error("attempted jump beyond code bounds!");
-						ip = chunk->code() + R[A];
+						uint8_t A = instruction->A;
+						if (R[A] >= program.size()) return error("attempted jump beyond code bounds!");
+						ip = program.code() + R[A];
 					}
-					break;
+					RESUME_NATIVE();
+					DISPATCH();
 				}
-				case OP_OUT:
+				OPCODE(OP_JUMP_IF_SIGN_LESS)
 				{
-					uint8_t A = RegisterA(instruction);
-
-					if ((rFlags[A] & REGISTER_HOLDS_SIGNED) != 0) std::cout << static_cast<int64_t>(R[A]) << std::endl;
-					else if ((rFlags[A] & REGISTER_HOLDS_FLOAT) != 0) std::cout << r_cast<float>(&R[A]) << std::endl;
-					else if ((rFlags[A] & REGISTER_HOLDS_FLOAT) != 0) std::cout << r_cast<double>(&R[A]) << std::endl;
-					else std::cout << R[A] << std::endl;
-
-					break;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					BRANCH_IF(static_cast<int64_t>(R[A]) < static_cast<int64_t>(R[B]));
+					DISPATCH();
 				}
-				case OP_RETURN: 
+				OPCODE(OP_JUMP_IF_SIGN_GREATER)
 				{
-					return InterpretResult::INTERPRET_OK;
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					BRANCH_IF(static_cast<int64_t>(R[A]) > static_cast<int64_t>(R[B]));
+					DISPATCH();
 				}
-			}
-		}
-	}
-
-	Allocation* VM::allocate(uint64_t typeID)
-	{
-#ifdef STRESSTEST_GC
-			collectGarbage();
-#else
-			//TODO: find a heuristic for calling the garbage collector
-#endif
-		TypeMetadata* typeInfo = types[typeID].get();
-		
-		size_t dataSize = typeInfo->fields.back().offset + util::fieldSize(typeInfo->fields.back().type);
-		size_t size = 0;
-		size = 12 + dataSize; //8 bytes TypeMetadata*, 1 byte for spacing offset, 3 bytes for refcount
-		if (size % sizeof(void*))
-		{
-			size /= sizeof(void*);
-			size += 1;
-			size *= sizeof(void*);
-		}
-		void* result = malloc(size);
-		if (result == nullptr) exit(1);
-		memset(result, 0, size);
-		auto typePtr = (TypeMetadata**)result;
-		*typePtr = typeInfo;
-		auto refCount = (uint8_t*)result + 9;
-		*refCount = 1;
-		Allocation* allocation = new TypeAllocation();
-		allocation->memory = static_cast<char*>(result);
-		allocation->next = allocationList;
-		if(allocationList) allocationList->previous = allocation;
-		allocation->size = size;
-		allocationList = allocation;
-		return allocation;
-	}
-
-	Allocation* VM::allocateArray(ArrayAllocation* pointer, size_t oldCount, size_t newCount, uint8_t fieldType)
-	{
-		if (newCount > oldCount)
-#ifdef STRESSTEST_GC
-			collectGarbage();
-#else
-			//TODO: find a heuristic for calling the garbage collector
+				OPCODE(OP_JUMP_IF_UNSIGN_LESS)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					BRANCH_IF(R[A] < R[B]);
+					DISPATCH();
+				}
+				OPCODE(OP_JUMP_IF_UNSIGN_GREATER)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					BRANCH_IF(R[A] > R[B]);
+					DISPATCH();
+				}
+				OPCODE(OP_JUMP_IF_INT_EQUAL)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					BRANCH_IF(R[A] == R[B]);
+					DISPATCH();
+				}
+				OPCODE(OP_JUMP_IF_FLOAT_LESS)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					BRANCH_IF(r_cast<float>(&R[A]) < r_cast<float>(&R[B]));
+					DISPATCH();
+				}
+				OPCODE(OP_JUMP_IF_FLOAT_GREATER)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					BRANCH_IF(r_cast<float>(&R[A]) > r_cast<float>(&R[B]));
+					DISPATCH();
+				}
+				OPCODE(OP_JUMP_IF_FLOAT_EQUAL)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					BRANCH_IF(r_cast<float>(&R[A]) == r_cast<float>(&R[B]));
+					DISPATCH();
+				}
+				OPCODE(OP_JUMP_IF_DOUBLE_LESS)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					BRANCH_IF(r_cast<double>(&R[A]) < r_cast<double>(&R[B]));
+					DISPATCH();
+				}
+				OPCODE(OP_JUMP_IF_DOUBLE_GREATER)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					BRANCH_IF(r_cast<double>(&R[A]) > r_cast<double>(&R[B]));
+					DISPATCH();
+				}
+				OPCODE(OP_JUMP_IF_DOUBLE_EQUAL)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					BRANCH_IF(r_cast<double>(&R[A]) == r_cast<double>(&R[B]));
+					DISPATCH();
+				}
+				OPCODE(OP_ARRAY_PUSH)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					if (R[B] == 0) return error("null reference!");
+
+					auto object = reinterpret_cast<ObjectHeader*>(R[B]);
+					if (object->kind != ObjectKind::Array) return error("pointer held in register is not an array!");
+					uint64_t index = object->count;
+					//R[A] is read afterwards: growing may collect, and move what it points to
+					object = resizeArray(object, index + 1);
+					if (object == nullptr) return error("out of memory!");
+					R[B] = reinterpret_cast<uint64_t>(object);
+					storeElement(object, index, R[A]);
+					RESUME_NATIVE();
+					DISPATCH();
+				}
+				OPCODE(OP_ARRAY_RESERVE)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					if (R[B] == 0) return error("null reference!");
+
+					auto object = reinterpret_cast<ObjectHeader*>(R[B]);
+					if (object->kind != ObjectKind::Array) return error("pointer held in register is not an array!");
+					object = reserveArray(object, R[A]);
+					if (object == nullptr) return error("out of memory!");
+					R[B] = reinterpret_cast<uint64_t>(object);
+					RESUME_NATIVE();
+					DISPATCH();
+				}
+				OPCODE(OP_ARRAY_LENGTH)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					if (R[A] == 0) return error("null reference!");
+
+					auto object = reinterpret_cast<ObjectHeader*>(R[A]);
+					if (object->kind != ObjectKind::Array) return error("pointer held in register is not an array!");
+					R[B] = object->count;
+					DISPATCH();
+				}
+				OPCODE(OP_ARRAY_COPY)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					uint8_t sourceIndex = A + 1;
+					uint8_t destinationIndex = B + 1;
+					if (const char* message = util::checkRange(R[A], R[sourceIndex], R[C])) return error(message);
+					if (const char* message = util::checkRange(R[B], R[destinationIndex], R[C])) return error(message);
+
+					auto source = reinterpret_cast<ObjectHeader*>(R[A]);
+					auto destination = reinterpret_cast<ObjectHeader*>(R[B]);
+					if (source->tag != destination->tag) return error("array element types differ!");
+					copyElements(destination, R[destinationIndex], source, R[sourceIndex], R[C]);
+					RESUME_NATIVE();
+					DISPATCH();
+				}
+				OPCODE(OP_ARRAY_FILL)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					uint8_t index = B + 1;
+					if (const char* message = util::checkRange(R[B], R[index], R[C])) return error(message);
+					fillElements(reinterpret_cast<ObjectHeader*>(R[B]), R[index], R[C], R[A]);
+					RESUME_NATIVE();
+					DISPATCH();
+				}
+				OPCODE(OP_ARRAY_COMPARE)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					uint8_t leftIndex = A + 1;
+					uint8_t rightIndex = B + 1;
+					if (const char* message = util::checkRange(R[A], R[leftIndex], R[C])) return error(message);
+					if (const char* message = util::checkRange(R[B], R[rightIndex], R[C])) return error(message);
+
+					auto left = reinterpret_cast<ObjectHeader*>(R[A]);
+					auto right = reinterpret_cast<ObjectHeader*>(R[B]);
+					if (left->tag != right->tag) return error("array element types differ!");
+					R[C] = memcmp(left->element(R[leftIndex]), right->element(R[rightIndex]), R[C] * (left->tag & 0x7F)) == 0;
+					DISPATCH();
+				}
+				OPCODE(OP_ARRAY_SLICE)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					uint8_t index = A + 1;
+					if (const char* message = util::checkRange(R[A], R[index], R[B])) return error(message);
+
+					ObjectHeader* slice = allocateArray(R[B], reinterpret_cast<ObjectHeader*>(R[A])->tag);
+					if (slice == nullptr) return error("out of memory!");
+					//allocating may have collected, and moved the source array
+					copyElements(slice, 0, reinterpret_cast<ObjectHeader*>(R[A]), R[index], R[B]);
+					R[C] = reinterpret_cast<uint64_t>(slice);
+					RESUME_NATIVE();
+					DISPATCH();
+				}
+				OPCODE(OP_ARRAY_STORE_UNCHECKED)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					storeElement(reinterpret_cast<ObjectHeader*>(R[B]), R[C], R[A]);
+					RESUME_NATIVE();
+					DISPATCH();
+				}
+				OPCODE(OP_ARRAY_LOAD_UNCHECKED)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					R[A] = util::loadElement(reinterpret_cast<ObjectHeader*>(R[B]), R[C]);
+					DISPATCH();
+				}
+				OPCODE(OP_ARRAY_CHECK)
+				{
+					uint8_t A = instruction->A;
+					uint8_t B = instruction->B;
+					uint8_t C = instruction->C;
+					if ((int64_t)R[B] < (int64_t)R[C])
+					{
+						if (const char* message = util::checkRange(R[A], R[B], R[C] - R[B])) return error(message);
+					}
+					DISPATCH();
+				}
+				OPCODE(OP_VECTOR_INT_ADD)
+				OPCODE(OP_VECTOR_FLOAT_ADD)
+				OPCODE(OP_VECTOR_DOUBLE_ADD)
+				OPCODE(OP_VECTOR_INT_SUB)
+				OPCODE(OP_VECTOR_FLOAT_SUB)
+				OPCODE(OP_VECTOR_DOUBLE_SUB)
+				OPCODE(OP_VECTOR_INT_MUL)
+				OPCODE(OP_VECTOR_FLOAT_MUL)
+				OPCODE(OP_VECTOR_DOUBLE_MUL)
+				OPCODE(OP_VECTOR_INT_FMA)
+				OPCODE(OP_VECTOR_FLOAT_FMA)
+				OPCODE(OP_VECTOR_DOUBLE_FMA)
+				OPCODE(OP_VECTOR_INT_MIN)
+				OPCODE(OP_VECTOR_FLOAT_MIN)
+				OPCODE(OP_VECTOR_DOUBLE_MIN)
+				OPCODE(OP_VECTOR_INT_MAX)
+				OPCODE(OP_VECTOR_FLOAT_MAX)
+				OPCODE(OP_VECTOR_DOUBLE_MAX)
+				OPCODE(OP_VECTOR_INT_SCALE)
+				OPCODE(OP_VECTOR_FLOAT_SCALE)
+				OPCODE(OP_VECTOR_DOUBLE_SCALE)
+				OPCODE(OP_VECTOR_INT_DOT)
+				OPCODE(OP_VECTOR_FLOAT_DOT)
+				OPCODE(OP_VECTOR_DOUBLE_DOT)
+				OPCODE(OP_VECTOR_INT_SUM)
+				OPCODE(OP_VECTOR_FLOAT_SUM)
+				OPCODE(OP_VECTOR_DOUBLE_SUM)
+				{
+					//one handler for all of them: the opcode picks the kernel and how the operands are read
+					if (const char* message = vectorInstruction(R, instruction->op, instruction->A, instruction->B, instruction->C))
+						return error(message);
+					DISPATCH();
+				}
+				OPCODE(OP_OUT)
+				{
+					uint8_t A = instruction->A;
+
+					std::cout << R[A] << std::endl;
+					RESUME_NATIVE();
+					DISPATCH();
+				}
+				OPCODE(OP_OUT_SIGNED)
+				{
+					uint8_t A = instruction->A;
+					std::cout << static_cast<int64_t>(R[A]) << std::endl;
+					RESUME_NATIVE();
+					DISPATCH();
+				}
+				OPCODE(OP_OUT_FLOAT)
+				{
+					uint8_t A = instruction->A;
+					std::cout << r_cast<float>(&R[A]) << std::endl;
+					RESUME_NATIVE();
+					DISPATCH();
+				}
+				OPCODE(OP_OUT_DOUBLE)
+				{
+					uint8_t A = instruction->A;
+					std::cout << r_cast<double>(&R[A]) << std::endl;
+					RESUME_NATIVE();
+					DISPATCH();
+				}
+				OPCODE(OP_RETURN)
+				{
+					return InterpretResult::INTERPRET_OK;
+				}
+				OPCODE(OP_CALL)
+				{
+					uint8_t A = instruction->A;
+					size_t base = (R - registers.data()) + A;
+					//the callee may use any register of its window
+					if (base + 256 > registers.size()) return error("call stack overflow!");
+					frames.push_back({ ip + 1, (size_t)(R - registers.data()), stackBase });
+					R += A;
+					stackBase = stack.size();
+					ip = program.code() + instruction->immediate;
+					RESUME_NATIVE();
+					DISPATCH();
+				}
+				OPCODE(OP_RET)
+				{
+					uint8_t A = instruction->A;
+					if (frames.empty()) return error("return outside of a function!");
+					R[0] = R[A];
+					Frame frame = frames.back();
+					frames.pop_back();
+					//the callee's spill slots go with it
+					while (stackPointers.size() && stackPointers.back() >= stackBase) stackPointers.pop_back();
+					stack.resize(stackBase);
+					stackBase = frame.stackBase;
+					R = registers.data() + frame.base;
+					ip = frame.returnTo;
+					RESUME_NATIVE();
+					DISPATCH();
+				}
+#ifdef THREADED_DISPATCH
+				UNKNOWN_OPCODE_HANDLER:
+				{
+					return error("unknown opcode!");
+				}
+#else
+				default:
+				{
+					return error("unknown opcode!");
+				}
+			}
+		}
 #endif
-		int64_t padding = (int64_t)(fieldType & 0x7F) - 2;
-		if (fieldType & 0x80) padding = alignof(void*) - 2;
-		if (padding < 0) padding = 0;
-		size_t oldSize = 0;
-		if (pointer)
+	}
+
+	bool VM::reserveHeap(size_t bytes)
+	{
+		pace(bytes);
+		if (gcPolicy.maxHeap == 0 || heap.statistics().bytesInUse + bytes <= gcPolicy.maxHeap) return true;
+		//an incremental cycle may still be holding garbage
+		if (gcPhase != GCPhase::Idle) collectGarbage();
+		return heap.statistics().bytesInUse + bytes <= gcPolicy.maxHeap;
+	}
+
+	void VM::pace(size_t bytes)
+	{
+		if (heap.statistics().bytesInUse + bytes <= nextCollection) return;
+		if (!gcPolicy.incremental && !gcPolicy.concurrent)
+		{
+			collectGarbage();
+		}
+		else if (gcPhase == GCPhase::Idle && gcPolicy.concurrent)
+		{
+			auto start = std::chrono::steady_clock::now();
+			startConcurrentMarking();
+			recordPause(start);
+			gcStats.slices++;
+		}
+		else if (gcPhase == GCPhase::Idle)
 		{
-		
-			uint8_t* oldArray = (uint8_t*)pointer;
-			fieldType = *oldArray;
-			oldSize = OBJECT_BEGIN_OFFSET + padding + (oldCount * (fieldType & 0x7F)); //8 bytes for capacity, 1 byte for span, 1 byte for refcount
+			auto start = std::chrono::steady_clock::now();
+			startMarking();
+			recordPause(start);
+			gcStats.slices++;
 		}
-		size_t newSize = OBJECT_BEGIN_OFFSET + padding + (newCount * (fieldType & 0x7F)); // 8 bytes for capacity, 1 byte for span, 1 byte for refcount
-		
-		if (newSize % sizeof(void*))
+	}
+
+	ObjectHeader* VM::allocateObject(size_t size)
+	{
+		size_t total = OBJECT_LINK_SIZE + size;
+#ifdef STRESSTEST_GC
+		collectGarbage();
+#else
+		allocatedSinceSlice += total;
+		if (gcPhase != GCPhase::Idle && allocatedSinceSlice >= gcPolicy.sliceBytes)
+		{
+			allocatedSinceSlice = 0;
+			auto start = std::chrono::steady_clock::now();
+			gcSlice(gcPolicy.sliceWork);
+			recordPause(start);
+			gcStats.slices++;
+		}
+#endif
+		char* block = nullptr;
+		//a conservative root cannot be redirected, so nothing it may name is allowed to move
+		if (total <= NURSERY_LARGEST_OBJECT && !program.conservativeRoots())
 		{
-			newSize /= sizeof(void*);
-			newSize += 1;
-			newSize *= sizeof(void*);
+			if (total > (size_t)(nurseryEnd - nurseryTop)) minorCollection();
+			block = nurseryTop;
+			nurseryTop += total;
+			memset(block, 0, total);
+			return reinterpret_cast<ObjectHeader*>(block + OBJECT_LINK_SIZE);
 		}
 
-		void* result = realloc(pointer, newSize);
-		if (result == nullptr) exit(1);
-		memset((void*)(((char*)result) + oldSize), 0, newSize - oldSize);
-		uint64_t* count = reinterpret_cast<uint64_t*>(result);
-		*count = newCount;
-		uint8_t* arraySpan = ((uint8_t*)result) + 8;
-		*arraySpan = fieldType;
-		uint8_t* refCount = ((uint8_t*)result + 9);
-		*refCount = 1;
-		Allocation* allocation = new ArrayAllocation();
-		allocation->memory = (char*)result;
-		allocation->next = allocationList;
-		if(allocationList) allocationList->previous = allocation;
-		allocation->size = newSize;
-		allocationList = allocation;
-		return allocation;
+		if (!reserveHeap(total)) return nullptr;
+		block = static_cast<char*>(heap.allocate(total));
+		memset(block, 0, total);
+		auto object = reinterpret_cast<ObjectHeader*>(block + OBJECT_LINK_SIZE);
+		util::linkObject(&objects, object);
+		//allocated black while marking: it holds no pointers yet, and the barrier shades whatever is stored into it
+		if (gcPhase == GCPhase::Mark) object->flags |= OBJECT_MARKED;
+		addZeroCount(object);
+		return object;
+	}
+
+	ObjectHeader* VM::allocate(uint64_t typeID)
+	{
+		TypeMetadata* typeInfo = types[typeID].get();
+		ObjectHeader* object = allocateObject(util::structSize(typeInfo));
+		if (object == nullptr) return nullptr;
+		object->type = typeInfo;
+		object->kind = ObjectKind::Type;
+		return object;
+	}
+
+	ObjectHeader* VM::allocateArray(size_t count, uint8_t fieldType)
+	{
+		if (count > UINT32_MAX) return nullptr;
+		ObjectHeader* object = allocateObject(util::arraySize(count, fieldType));
+		if (object == nullptr) return nullptr;
+		object->count = count;
+		object->capacity() = (uint32_t)count;
+		object->blockCapacity() = (uint32_t)count;
+		object->elements() = reinterpret_cast<char*>(object) + ARRAY_BEGIN_OFFSET;
+		object->tag = fieldType;
+		object->kind = ObjectKind::Array;
+		return object;
+	}
+
+	ObjectHeader* VM::resizeArray(ObjectHeader* array, size_t count)
+	{
+		if (count > array->capacity())
+		{
+			//doubling keeps a run of pushes amortized constant time
+			size_t capacity = 2 * (size_t)array->capacity();
+			if (capacity < 4) capacity = 4;
+			if (capacity > UINT32_MAX) capacity = UINT32_MAX;
+			array = reserveArray(array, capacity < count ? count : capacity);
+			if (array == nullptr) return nullptr;
+		}
+		//elements dropped from the end are cleared, so the space past count stays zeroed
+		for (size_t i = count; i < array->count; i++) storeElement(array, i, 0);
+		util::publishCount(array, count);
+		return array;
 	}
 
+	ObjectHeader* VM::reserveArray(ObjectHeader* array, size_t capacity)
+	{
+		if (capacity <= array->capacity()) return array;
+		if (capacity > UINT32_MAX) return nullptr;
+		size_t size = util::elementsSize(capacity, array->tag);
+
+		//a collection may move the array, so it is kept on the stack as a root meanwhile
+		stack.push_back(reinterpret_cast<uint64_t>(array));
+		stackPointers.push_back(stack.size() - 1);
+		bool reserved = reserveHeap(size);
+		array = reinterpret_cast<ObjectHeader*>(stack.back());
+		stack.pop_back();
+		stackPointers.pop_back();
+		if (!reserved) return nullptr;
+
+		//only the elements move: every reference to the array still finds it, and the heap counts
+		//and barriers have nothing to do, as the same pointers are held by the same object
+		char* storage = static_cast<char*>(heap.allocate(size));
+		size_t used = util::elementsSize(array->count, array->tag);
+		memcpy(storage, array->elements(), used);
+		memset(storage + used, 0, size - used);
+		if (!array->inlineElements())
+		{
+			//a concurrent marker may be scanning the old storage
+			std::pair<char*, size_t> old(array->elements(), util::outlineSize(array));
+			if (concurrentCycle) retiredElements.push_back(old);
+			else heap.release(old.first, old.second);
+		}
+		else if (isYoung(array)) grownYoung.push_back(array);
+		util::publishElements(array, storage);
+		array->capacity() = (uint32_t)capacity;
+		return array;
+	}
 
-	void VM::freeAllocation(Allocation* alloc)
+	void VM::storeElement(ObjectHeader* array, uint64_t index, uint64_t value)
 	{
-		switch (alloc->type())
+		char* address = array->element(index);
+		switch (array->tag & 0x7F)
 		{
-			case AllocationType::Type:
+			case 1: *reinterpret_cast<uint8_t*>(address) = static_cast<uint8_t>(value); break;
+			case 2: *reinterpret_cast<uint16_t*>(address) = static_cast<uint16_t>(value); break;
+			case 4: *reinterpret_cast<uint32_t*>(address) = static_cast<uint32_t>(value); break;
+			case 8:
 			{
-				TypeAllocation* typeAlloc = (TypeAllocation*)alloc;
-				char* mem = typeAlloc->memory;
-				TypeMetadata* metadata = (TypeMetadata*)typeAlloc->memory;
-				size_t currentOffset = OBJECT_BEGIN_OFFSET;
-				for (const auto field : metadata->fields)
-				{
-					if (field.type == FieldType::Struct || field.type == FieldType::Array)
-					{
-						Allocation* fieldObject = (Allocation*)(mem + currentOffset);
-						if (fieldObject != nullptr)
-							refDecrement(fieldObject);
-					}
-					currentOffset += (util::fieldSize(field.type));
+				auto slot = reinterpret_cast<uint64_t*>(address);
+				if (array->tag & 0x80)
+				{
+					ObjectHeader* previous = reinterpret_cast<ObjectHeader*>(*slot);
+					ObjectHeader* ref = reinterpret_cast<ObjectHeader*>(value);
+					countStore(previous, ref);
+					writeBarrier(array, previous, ref);
+					util::storePointer(reinterpret_cast<ObjectHeader**>(slot), ref);
+					break;
 				}
+				*slot = value;
 				break;
 			}
-			case AllocationType::Array:
+		}
+	}
+
+	void VM::copyElements(ObjectHeader* destination, uint64_t to, ObjectHeader* source, uint64_t from, uint64_t count)
+	{
+		if (count == 0) return;
+		if (destination->tag & 0x80)
+		{
+			auto refs = reinterpret_cast<ObjectHeader**>(source->element(from));
+			auto previous = reinterpret_cast<ObjectHeader**>(destination->element(to));
+			//every increment before any decrement, so an element copied onto itself never reaches zero
+			for (uint64_t i = 0; i < count; i++) countStore(nullptr, refs[i]);
+			for (uint64_t i = 0; i < count; i++)
+			{
+				countStore(previous[i], nullptr);
+				writeBarrier(destination, previous[i], refs[i]);
+			}
+			//one pointer at a time, in whichever direction an overlapping copy needs
+			if (previous < refs) for (uint64_t i = 0; i < count; i++) util::storePointer(&previous[i], refs[i]);
+			else for (uint64_t i = count; i-- > 0;) util::storePointer(&previous[i], refs[i]);
+			return;
+		}
+		memmove(destination->element(to), source->element(from), count * (source->tag & 0x7F));
+	}
+
+	void VM::fillElements(ObjectHeader* array, uint64_t index, uint64_t count, uint64_t value)
+	{
+		char* address = array->element(index);
+		if (array->tag & 0x80)
+		{
+			auto previous = reinterpret_cast<ObjectHeader**>(address);
+			ObjectHeader* ref = reinterpret_cast<ObjectHeader*>(value);
+			for (uint64_t i = 0; i < count; i++)
 			{
-				ArrayAllocation* arrayAlloc = (ArrayAllocation*)alloc;
-				uint8_t span = (*(arrayAlloc->memory + ARRAY_TYPE_OFFSET) & 0x7F);
-				uint8_t spacing = (span - 2) * (span - 2 > 0);
-				char* indexZero = arrayAlloc->memory + OBJECT_BEGIN_OFFSET;
-				bool nonbasic = (*(arrayAlloc->memory + ARRAY_TYPE_OFFSET) & 0x80);
-				if (nonbasic)
-				{
-					for (size_t i = 0; i < *(size_t*)arrayAlloc->memory; i++)
-					{
-						Allocation* ref = *(Allocation**)(indexZero + (span * i));
-						if (ref != nullptr)
-							refDecrement(ref);
-					}
-				}
+				countStore(previous[i], ref);
+				writeBarrier(array, previous[i], ref);
+				util::storePointer(&previous[i], ref);
 			}
+			return;
+		}
+		uint8_t span = array->tag & 0x7F;
+		if (span == 1 || value == 0)
+		{
+			memset(address, static_cast<uint8_t>(value), count * span);
+			return;
+		}
+		switch (span)
+		{
+			case 2: std::fill_n(reinterpret_cast<uint16_t*>(address), count, static_cast<uint16_t>(value)); break;
+			case 4: std::fill_n(reinterpret_cast<uint32_t*>(address), count, static_cast<uint32_t>(value)); break;
+			case 8: std::fill_n(reinterpret_cast<uint64_t*>(address), count, value); break;
 		}
-		delete alloc->memory;
-		delete alloc;
 	}
 
-	void VM::freeAllocations()
+	void VM::unlink(ObjectHeader* object)
 	{
-		Allocation* allocation = allocationList;
+		if (sweepCursor == &object->next()) sweepCursor = object->previous();
+		util::unlinkObject(object);
+	}
 
-		while (allocation != nullptr)
+	void VM::remember(ObjectHeader* object)
+	{
+		if (object->atomicFlags().load(std::memory_order_relaxed) & OBJECT_REMEMBERED) return;
+		//atomic, because a concurrent marker may be setting OBJECT_MARKED in the same byte
+		object->atomicFlags().fetch_or(OBJECT_REMEMBERED, std::memory_order_relaxed);
+		rememberedSet.push_back(object);
+	}
+
+	void VM::freeAllocation(ObjectHeader* object)
+	{
+		//referenced objects are not counted down here: heap counts are rebuilt by every
+		//collection, and whatever object pointed to is either still reachable or swept with it
+		if (size_t outline = util::outlineSize(object)) heap.release(object->elements(), outline);
+		heap.release(reinterpret_cast<char*>(object) - OBJECT_LINK_SIZE, OBJECT_LINK_SIZE + util::objectSize(object));
+	}
+
+	void VM::releaseGrownYoung()
+	{
+		//the ones promoted took their storage with them
+		for (ObjectHeader* array : grownYoung)
 		{
-			Allocation* next = allocation->next;
-			freeAllocation(allocation);
-			allocation = next;
+			if (array->next() == nullptr) heap.release(array->elements(), util::outlineSize(array));
 		}
+		grownYoung.clear();
 	}
 
-	void VM::collectGarbage()
+	void VM::freeAllocations()
+	{
+		for (ObjectHeader* list : { objects, sweepList })
+		{
+			ObjectHeader* object = list;
+			while (object != nullptr)
+			{
+				ObjectHeader* next = object->next();
+				freeAllocation(object);
+				object = next;
+			}
+		}
+		for (const auto& storage : retiredElements) heap.release(storage.first, storage.second);
+		retiredElements.clear();
+		releaseGrownYoung();
+		objects = nullptr;
+		sweepList = nullptr;
+		sweepCursor = nullptr;
+		gcPhase = GCPhase::Idle;
+		conservativeCandidates.clear();
+		greyset.clear();
+		nurseryTop = nursery;
+		rememberedSet.clear();
+		increments.clear();
+		decrements.clear();
+		zeroCounts.clear();
+	}
+
+	void VM::setGCPolicy(const GCPolicy& policy)
+	{
+		gcPolicy = policy;
+		scheduleCollection();
+	}
+
+	void VM::scheduleCollection()
+	{
+		//the next collection runs once the heap has grown by growthFactor over what survived this one
+		double target = heap.statistics().bytesInUse * gcPolicy.growthFactor;
+		nextCollection = target < gcPolicy.minHeap ? gcPolicy.minHeap : (uint64_t)target;
+		if (gcPolicy.maxHeap != 0 && nextCollection > gcPolicy.maxHeap) nextCollection = gcPolicy.maxHeap;
+	}
+
+	void VM::printGCStatistics()
+	{
+		std::cout << "==gc statistics==\n";
+		std::cout << "minor collections: " << gcStats.minorCollections << ", bytes promoted: " << gcStats.bytesPromoted << "\n";
+		std::cout << "collections: " << gcStats.collections << ", bytes freed: " << gcStats.bytesFreed
+			<< ", live after last: " << gcStats.liveBytes << ", next at: " << nextCollection << "\n";
+		std::cout << "compactions: " << gcStats.compactions << ", bytes moved: " << gcStats.bytesCompacted
+			<< ", page bytes released: " << gcStats.pageBytesReleased << "\n";
+		std::cout << "deferred counting: " << gcStats.objectsReclaimed << " objects, " << gcStats.bytesReclaimed << " bytes reclaimed\n";
+		std::cout << "incremental slices: " << gcStats.slices << ", concurrent marking: " << gcStats.concurrentMarkTime / 1000 << "us\n";
+		std::cout << "pause total: " << gcStats.totalPause / 1000 << "us, max: " << gcStats.maxPause / 1000
+			<< "us, last: " << gcStats.lastPause / 1000 << "us\n";
+	}
+
+	void VM::recordPause(std::chrono::steady_clock::time_point start)
+	{
+		uint64_t pause = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		gcStats.lastPause = pause;
+		gcStats.totalPause += pause;
+		if (pause > gcStats.maxPause) gcStats.maxPause = pause;
+	}
+
+	void VM::minorCollection()
+	{
+		auto start = std::chrono::steady_clock::now();
+		evacuateNursery();
+		reclaimZeroCounts();
+		recordPause(start);
+		gcStats.minorCollections++;
+
+		//promotion is what grows the old space
+		pace(0);
+	}
+
+	void VM::evacuateNursery()
 	{
 #ifdef LOG_GC
-		std::cout << "> begin gc" << std::endl;
+		std::cout << "> begin minor gc" << std::endl;
 #endif
-		Allocation* ptr = allocationList;
-		while (ptr)
+		//young counts are brought up to date before they are copied
+		applyCounts();
+		uint64_t bytesBefore = heap.statistics().bytesInUse;
+		std::vector<ObjectHeader*> promoted;
+		auto update = [&](ObjectHeader** slot) { util::storePointer(slot, evacuate(*slot, promoted)); };
+
+		std::vector<ObjectHeader**> roots;
+		gatherRoots(roots);
+		for (ObjectHeader** root : roots) update(root);
+		for (ObjectHeader* object : rememberedSet)
 		{
-			uint8_t* refCount = (uint8_t*)(ptr->memory + REFCOUNT_OFFSET);
-			*refCount = 0;
-			ptr = ptr->next;
+			object->atomicFlags().fetch_and(~OBJECT_REMEMBERED, std::memory_order_relaxed);
+			util::forEachPointer(object, update);
 		}
+		rememberedSet.clear();
+
+		//promoted objects are scanned in the order they were copied, so everything they reach follows them out
+		for (size_t i = 0; i < promoted.size(); i++) util::forEachPointer(promoted[i], update);
 
+		releaseGrownYoung();
+		nurseryTop = nursery;
+		gcStats.bytesPromoted += heap.statistics().bytesInUse - bytesBefore;
 #ifdef LOG_GC
-		std::cout << "> marking registers" << std::endl;
+		std::cout << "> end minor gc, promoted " << promoted.size() << " objects" << std::endl;
 #endif
-		std::queue<Allocation*> greyset;
-		for (int i = 0; i < R.size(); i++)
+	}
+
+	ObjectHeader* VM::evacuate(ObjectHeader* object, std::vector<ObjectHeader*>& promoted)
+	{
+		if (object == nullptr || !isYoung(object)) return object;
+		if (object->next() != nullptr) return object->next(); //already promoted
+		size_t size = util::objectSize(object);
+		char* block = static_cast<char*>(heap.allocate(OBJECT_LINK_SIZE + size));
+		auto copy = reinterpret_cast<ObjectHeader*>(block + OBJECT_LINK_SIZE);
+		memcpy(copy, object, size);
+		copy->flags = 0;
+		util::copiedFrom(copy, object);
+		util::linkObject(&objects, copy);
+		object->next() = copy;
+		promoted.push_back(copy);
+		addZeroCount(copy);
+		//its fields may point at old objects this cycle has not marked yet; a concurrent cycle works from
+		//a snapshot instead, so objects created after it started are simply black
+		if (gcPhase == GCPhase::Mark && concurrentCycle) copy->flags |= OBJECT_MARKED;
+		else if (gcPhase == GCPhase::Mark) shade(copy);
+		return copy;
+	}
+
+	void VM::collectGarbage()
+	{
+#ifdef LOG_GC
+		std::cout << "> begin gc" << std::endl;
+#endif
+		auto start = std::chrono::steady_clock::now();
+		unsigned threads = collectorThreads();
+		if (gcPhase == GCPhase::Idle)
 		{
-			if ((rFlags[i] & REGISTER_HOLDS_POINTER) != 0)
+			//promoting the nursery first leaves nothing for a remark to do, and the promoted objects
+			//are counted from scratch with the rest instead of keeping the counts they were copied with
+			evacuateNursery();
+			//nothing runs until the cycle ends, so the heap counts can be rebuilt while marking,
+			//and count updates still buffered are already part of the heap they are rebuilt from
+			increments.clear();
+			decrements.clear();
+			for (ObjectHeader* object = objects; object != nullptr; object = object->next())
+				object->refCount() = 0;
+			recount = true;
+			startMarking();
+			if (threads > 1)
 			{
-				auto alloc = reinterpret_cast<Allocation*>(R[i]);
-				refIncrement(alloc);
-				greyset.push(alloc);
+				parallelMark(threads);
+				beginSweep();
+				parallelSweep(threads);
 			}
 		}
+		//otherwise an incremental cycle is finished in one go
+		while (gcPhase != GCPhase::Idle) gcSlice(SIZE_MAX);
+		recount = false;
+		const PoolStatistics& pool = heap.statistics();
+		if (gcPolicy.compact && !program.conservativeRoots() && pool.bytesInUse - pool.largeBytesInUse < pool.pageBytes * gcPolicy.compactOccupancy)
+			compact();
+		recordPause(start);
 #ifdef LOG_GC
-		std::cout << "> marking stack" << std::endl;
+		std::cout << "> end gc" << std::endl;
 #endif
-		for (int i = 0; i < stackPointers.size(); i++)
+	}
+
+	bool VM::tryMark(ObjectHeader* object)
+	{
+		//nursery objects are not marked: they are promoted before the old space is swept
+		if (object == nullptr || isYoung(object)) return false;
+		std::atomic<uint8_t>& flags = object->atomicFlags();
+		if (flags.load(std::memory_order_relaxed) & OBJECT_MARKED) return false;
+		return (flags.fetch_or(OBJECT_MARKED, std::memory_order_relaxed) & OBJECT_MARKED) == 0;
+	}
+
+	void VM::shade(ObjectHeader* object)
+	{
+		if (!tryMark(object)) return;
+		if (concurrentCycle)
+		{
+			//the marker thread owns the greyset until it finishes
+			std::lock_guard<std::mutex> lock(satbMutex);
+			satbQueue.push_back(object);
+			return;
+		}
+		greyset.push_back(object);
+	}
+
+	void VM::startConcurrentMarking()
+	{
+		//the snapshot: with the nursery promoted, everything live is reachable from the roots through the old space
+		evacuateNursery();
+		startMarking();
+		concurrentCycle = true;
+		markerDone = false;
+		marker = std::thread(&VM::concurrentMark, this);
+	}
+
+	void VM::concurrentMark()
+	{
+		auto start = std::chrono::steady_clock::now();
+		auto scan = [&](ObjectHeader** slot)
+		{
+			ObjectHeader* ref = util::loadPointer(slot);
+			if (tryMark(ref)) greyset.push_back(ref);
+		};
+		while (true)
 		{
-			auto alloc = reinterpret_cast<Allocation*>(stack[stackPointers[i]]);
-			refIncrement(alloc);
-			greyset.push(alloc);
+			while (greyset.size())
+			{
+				ObjectHeader* object = greyset.back();
+				greyset.pop_back();
+				util::forEachPointer(object, scan);
+			}
+			std::lock_guard<std::mutex> lock(satbMutex);
+			if (satbQueue.empty()) break;
+			greyset.swap(satbQueue);
 		}
+		//the mutator owns the statistics; it adds this once it has joined the thread
+		markerTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		markerDone.store(true, std::memory_order_release);
+	}
+
+	void VM::startMarking()
+	{
 #ifdef LOG_GC
-		std::cout << "> marking from roots" << std::endl;
+		std::cout << "> marking roots" << std::endl;
 #endif
-		while(greyset.size())
+		gcPhase = GCPhase::Mark;
+		bytesBeforeCycle = heap.statistics().bytesInUse;
+		std::vector<ObjectHeader**> roots;
+		gatherRoots(roots);
+		for (ObjectHeader** root : roots) shade(*root);
+	}
+
+	void VM::gcSlice(size_t work)
+	{
+		if (gcPhase == GCPhase::Mark) markSlice(work);
+		else if (gcPhase == GCPhase::Sweep) sweepSlice(work);
+	}
+
+	void VM::markSlice(size_t work)
+	{
+		auto scan = [&](ObjectHeader** slot)
+		{
+			if (*slot == nullptr) return;
+			if (recount) refIncrement(*slot);
+			shade(*slot);
+		};
+		if (concurrentCycle)
 		{
-			auto current = greyset.front();
-			switch (current->type())
+			//a slice only checks on the marker, unless the cycle has to finish now
+			if (work != SIZE_MAX && !markerDone.load(std::memory_order_acquire)) return;
+			marker.join();
+			concurrentCycle = false;
+			gcStats.concurrentMarkTime += markerTime;
+			for (const auto& storage : retiredElements) heap.release(storage.first, storage.second);
+			retiredElements.clear();
+			//what the barrier logged after the marker last looked; with a snapshot there is no remark
+			greyset.swap(satbQueue);
+			satbQueue.clear();
+			while (greyset.size())
 			{
-				case AllocationType::Array:
-				{
-					uint8_t span = *(uint8_t*)(current->memory + ARRAY_TYPE_OFFSET);
-					if (span & 0x80)
-					{
-						size_t size = *(uint64_t*)current->memory;
-						uint8_t spacing = sizeof(Allocation*) - 2;
-						auto mem = current->memory + OBJECT_BEGIN_OFFSET + spacing;
-						for (int i = 0; i < size; i++)
-						{
-							Allocation* ptr = *(Allocation**)(mem + sizeof(Allocation*) * i);
-							if (ptr)
-							{
-								refIncrement(ptr);
-								greyset.push(ptr);
-							}
-						}
-					}
-					break;
-				}
-				case AllocationType::Type:
-				{
-					TypeMetadata* metadata = (TypeMetadata*)current->memory;
-					if (metadata == nullptr)
-					{
-						throw std::runtime_error("Invalid type object!");
-					}
-					size_t offset = 0;
-					uint8_t spacing = *(uint8_t*)(current->memory + STRUCT_SPACING_OFFSET);
-					auto mem = current->memory + OBJECT_BEGIN_OFFSET + spacing;
-					for (const auto& field : metadata->fields)
-					{
-						if (field.type == FieldType::Struct || field.type == FieldType::Array)
-						{
-							Allocation* ptr = *(Allocation**)(mem + offset);
-							if (ptr)
-							{
-								refIncrement(ptr);
-								greyset.push(ptr);
-							}
-						}
-						offset += util::fieldSize(field.type);
-					}
-					break;
-				}
+				ObjectHeader* object = greyset.back();
+				greyset.pop_back();
+				util::forEachPointer(object, scan);
 			}
-			greyset.pop();
+			beginSweep();
+			return;
+		}
+		for (; work > 0 && greyset.size(); work--)
+		{
+			ObjectHeader* object = greyset.back();
+			greyset.pop_back();
+			util::forEachPointer(object, scan);
+		}
+		if (greyset.size()) return;
+
+#ifdef LOG_GC
+		std::cout << "> remark" << std::endl;
+#endif
+		//registers, the stack and the nursery are not behind the barrier, so they are scanned again with
+		//the mutator stopped: promoting the nursery shades its survivors, then the roots are shaded
+		evacuateNursery();
+		std::vector<ObjectHeader**> roots;
+		gatherRoots(roots);
+		for (ObjectHeader** root : roots) shade(*root);
+		while (greyset.size())
+		{
+			ObjectHeader* object = greyset.back();
+			greyset.pop_back();
+			util::forEachPointer(object, scan);
 		}
+		beginSweep();
+	}
 
+	void VM::beginSweep()
+	{
 #ifdef LOG_GC
 		std::cout << "> begin sweep" << std::endl;
 #endif
-		Allocation* alloc = allocationList;
-		while (alloc != nullptr)
+		//buffered updates may name objects about to be freed. what the mutator logs from here on was
+		//reachable when it was stored or overwritten, so it survives the sweep
+		applyCounts();
+		auto dead = std::remove_if(zeroCounts.begin(), zeroCounts.end(), [](ObjectHeader* object) { return (object->flags & OBJECT_MARKED) == 0; });
+		zeroCounts.erase(dead, zeroCounts.end());
+		//objects allocated from here on go on a fresh list the sweep never visits
+		gcPhase = GCPhase::Sweep;
+		sweepList = objects;
+		objects = nullptr;
+		if (sweepList != nullptr) sweepList->previous() = &sweepList;
+		sweepCursor = &sweepList;
+	}
+
+	void VM::sweepSlice(size_t work)
+	{
+		for (; work > 0 && *sweepCursor != nullptr; work--)
 		{
-			if(refCount(alloc) == 0)
+			ObjectHeader* object = *sweepCursor;
+			if (object->flags & OBJECT_MARKED)
 			{
-				auto white = alloc;
-				alloc = alloc->next;
-				if (alloc) alloc->previous = white->previous;
-				freeAllocation(white);
-				if (white->previous == nullptr)
-				{
-					allocationList = alloc;
-				}
-				else
-				{
-					white->previous->next = alloc;
-				}
+				object->flags &= ~OBJECT_MARKED;
+				sweepCursor = &object->next();
+				continue;
 			}
-			alloc = alloc->next;
+			util::unlinkObject(object);
+			freeAllocation(object);
 		}
+		if (*sweepCursor != nullptr) return;
+		finishSweep();
+	}
 
+	void VM::finishSweep()
+	{
 #ifdef LOG_GC
 		std::cout << "> end sweep" << std::endl;
 #endif
+		//survivors go back in front of everything allocated during the sweep
+		*sweepCursor = objects;
+		if (objects != nullptr) objects->previous() = sweepCursor;
+		objects = sweepList;
+		if (objects != nullptr) objects->previous() = &objects;
+		sweepList = nullptr;
+		sweepCursor = nullptr;
+		gcPhase = GCPhase::Idle;
+		conservativeCandidates.clear();
+
+		uint64_t live = heap.statistics().bytesInUse;
+		gcStats.collections++;
+		gcStats.liveBytes = live;
+		if (bytesBeforeCycle > live) gcStats.bytesFreed += bytesBeforeCycle - live;
+		scheduleCollection();
+	}
 
+	void VM::compact()
+	{
 #ifdef LOG_GC
-		std::cout << "> end gc" << std::endl;
+		std::cout << "> begin compaction" << std::endl;
+#endif
+		//promoting the nursery leaves every reference in an old object or a root, and applies the buffered
+		//count updates, so neither young fields nor the remembered set nor the buffers can name a moved object.
+		//a collection that finished an incremental or concurrent cycle may have left it holding survivors
+		evacuateNursery();
+		std::vector<ObjectHeader**> roots;
+		gatherRoots(roots);
+		uint64_t pageBytes = heap.statistics().pageBytes;
+		heap.beginCompaction();
+
+		ObjectHeader* moved = nullptr;
+		ObjectHeader** tail = &moved;
+		ObjectHeader* object = objects;
+		while (object != nullptr)
+		{
+			ObjectHeader* next = object->next();
+			size_t size = util::objectSize(object);
+			ObjectHeader* target = object;
+			//large objects have their own malloc blocks and stay where they are
+			if (PoolAllocator::pooled(OBJECT_LINK_SIZE + size))
+			{
+				char* block = static_cast<char*>(heap.allocate(OBJECT_LINK_SIZE + size));
+				target = reinterpret_cast<ObjectHeader*>(block + OBJECT_LINK_SIZE);
+				memcpy(target, object, size);
+				util::copiedFrom(target, object);
+				object->flags |= OBJECT_FORWARDED;
+				object->next() = target;
+				gcStats.bytesCompacted += size;
+			}
+			//so does the storage an array has grown into
+			size_t outline = util::outlineSize(target);
+			if (outline != 0 && PoolAllocator::pooled(outline))
+			{
+				char* storage = static_cast<char*>(heap.allocate(outline));
+				memcpy(storage, target->elements(), outline);
+				target->elements() = storage;
+				gcStats.bytesCompacted += outline;
+			}
+			*tail = target;
+			target->previous() = tail;
+			tail = &target->next();
+			object = next;
+		}
+		*tail = nullptr;
+		objects = moved;
+		if (objects != nullptr) objects->previous() = &objects;
+
+		auto forward = [](ObjectHeader** slot)
+		{
+			ObjectHeader* ref = *slot;
+			if (ref != nullptr && (ref->flags & OBJECT_FORWARDED)) util::storePointer(slot, ref->next());
+		};
+		for (ObjectHeader** root : roots) forward(root);
+		for (ObjectHeader*& object : zeroCounts) forward(&object);
+		for (ObjectHeader* object = objects; object != nullptr; object = object->next())
+			util::forEachPointer(object, forward);
+
+		heap.endCompaction();
+		gcStats.compactions++;
+		gcStats.pageBytesReleased += pageBytes - heap.statistics().pageBytes;
+		scheduleCollection();
+#ifdef LOG_GC
+		std::cout << "> end compaction" << std::endl;
 #endif
 	}
 
-	void VM::setRegister(uint8_t _register, bool value)
+	unsigned VM::collectorThreads()
 	{
-		setRegister(_register, static_cast<uint64_t>(value));
+		if (gcPolicy.threads != 0) return gcPolicy.threads;
+		unsigned cores = std::thread::hardware_concurrency();
+		return cores ? cores : 1;
 	}
 
-	void VM::setRegister(uint8_t _register, uint64_t value)
+	void VM::parallelMark(unsigned threads)
 	{
-		if (rFlags[_register] & (REGISTER_HOLDS_POINTER))
-		{
-			refDecrement(reinterpret_cast<Allocation*>(R[_register]));
-		}
+		std::vector<MarkDeque> deques(threads);
+		//objects shaded but not yet scanned, anywhere; marking is over once it drops to zero
+		std::atomic<size_t> pending{ greyset.size() };
+		for (size_t i = 0; i < greyset.size(); i++) deques[i % threads].push(greyset[i]);
+		greyset.clear();
 
-		rFlags[_register] &= REGISTER_HIGH_BITS;
-		R[_register] = value;
+		auto worker = [&](unsigned id)
+		{
+			auto scan = [&](ObjectHeader** slot)
+			{
+				ObjectHeader* ref = *slot;
+				if (ref == nullptr) return;
+				if (recount) util::atomicRefIncrement(ref);
+				if (!tryMark(ref)) return;
+				pending.fetch_add(1, std::memory_order_relaxed);
+				deques[id].push(ref);
+			};
+			ObjectHeader* object = nullptr;
+			while (true)
+			{
+				bool found = deques[id].pop(object);
+				for (unsigned i = 1; !found && i < threads; i++) found = deques[(id + i) % threads].steal(object);
+				if (found)
+				{
+					util::forEachPointer(object, scan);
+					pending.fetch_sub(1, std::memory_order_acq_rel);
+					continue;
+				}
+				if (pending.load(std::memory_order_acquire) == 0) return;
+				std::this_thread::yield();
+			}
+		};
+		std::vector<std::thread> helpers;
+		for (unsigned i = 1; i < threads; i++) helpers.emplace_back(worker, i);
+		worker(0);
+		for (std::thread& helper : helpers) helper.join();
 	}
 
-	void VM::setRegister(uint8_t _register, int64_t value)
+	void VM::parallelSweep(unsigned threads)
 	{
-		if (rFlags[_register] & (REGISTER_HOLDS_POINTER))
+		size_t count = 0;
+		for (ObjectHeader* object = sweepList; object != nullptr; object = object->next()) count++;
+
+		//cut the list into one run per thread; each run is swept into its own survivor list,
+		//and the dead blocks are handed back to the pool afterwards, which is not thread safe
+		struct Run
 		{
-			refDecrement(reinterpret_cast<Allocation*>(R[_register]));
+			ObjectHeader* head = nullptr;
+			size_t length = 0;
+			ObjectHeader** tail = nullptr;
+			std::vector<std::pair<char*, size_t>> dead;
+		};
+		std::vector<Run> runs(threads);
+		ObjectHeader* object = sweepList;
+		for (unsigned i = 0; i < threads; i++)
+		{
+			runs[i].head = object;
+			runs[i].length = count / threads + (i < count % threads);
+			for (size_t j = 0; j < runs[i].length; j++) object = object->next();
 		}
 
-		rFlags[_register] &= REGISTER_HIGH_BITS;
-		rFlags[_register] |= ((REGISTER_HOLDS_SIGNED) * (value < 0));
-		R[_register] = value;
+		auto worker = [&](unsigned id)
+		{
+			Run& run = runs[id];
+			ObjectHeader* object = run.head;
+			run.head = nullptr;
+			run.tail = &run.head;
+			for (size_t j = 0; j < run.length; j++)
+			{
+				ObjectHeader* next = object->next();
+				if (object->flags & OBJECT_MARKED)
+				{
+					object->flags &= ~OBJECT_MARKED;
+					*run.tail = object;
+					object->previous() = run.tail;
+					run.tail = &object->next();
+				}
+				else
+				{
+					run.dead.emplace_back(reinterpret_cast<char*>(object) - OBJECT_LINK_SIZE, OBJECT_LINK_SIZE + util::objectSize(object));
+					if (size_t outline = util::outlineSize(object)) run.dead.emplace_back(object->elements(), outline);
+				}
+				object = next;
+			}
+			*run.tail = nullptr;
+		};
+		std::vector<std::thread> helpers;
+		for (unsigned i = 1; i < threads; i++) helpers.emplace_back(worker, i);
+		worker(0);
+		for (std::thread& helper : helpers) helper.join();
+
+		sweepList = nullptr;
+		sweepCursor = &sweepList;
+		for (Run& run : runs)
+		{
+			for (auto& block : run.dead) heap.release(block.first, block.second);
+			if (run.head == nullptr) continue;
+			*sweepCursor = run.head;
+			run.head->previous() = sweepCursor;
+			sweepCursor = run.tail;
+		}
+		finishSweep();
 	}
 
-	void VM::setRegister(uint8_t _register, float value)
+	void VM::gatherRoots(std::vector<ObjectHeader**>& roots)
 	{
-		if (rFlags[_register] & (REGISTER_HOLDS_POINTER))
+		//the running call's window, then each caller's as it stood at the OP_CALL it is waiting on
+		std::vector<std::pair<uint64_t*, const std::bitset<256>*>> windows;
+		if (chunk != nullptr && ip != nullptr)
 		{
-			refDecrement(reinterpret_cast<Allocation*>(R[_register]));
+			//ip has already moved past the instruction that triggered the collection
+			windows.emplace_back(R, chunk->GetRegisterMap(ip - 1 - program.code()));
+			//and a caller resumes past its call's offset word
+			for (size_t f = frames.size(); f-- > 0;)
+				windows.emplace_back(registers.data() + frames[f].base, chunk->GetRegisterMap(frames[f].returnTo - 2 - program.code()));
 		}
+		else windows.emplace_back(R, nullptr);
 
-		rFlags[_register] &= REGISTER_HIGH_BITS;
-		rFlags[_register] |= REGISTER_HOLDS_FLOAT;
-		R[_register] = *reinterpret_cast<uint64_t*>(&value);
-	}
-			
-	void VM::setRegister(uint8_t _register, double value)
-	{
-		if (rFlags[_register] & (REGISTER_HOLDS_POINTER))
+		if (program.conservativeRoots() && conservativeCandidates.empty())
 		{
-			refDecrement(reinterpret_cast<Allocation*>(R[_register]));
+			//the chunk leaves a collection without a map (hand-written chunks): any register holding the
+			//address of an object is a root. such a chunk allocates nothing young and is never compacted,
+			//so these roots are only ever read, never rewritten. the set outlasts the cycle's slices: what is
+			//allocated meanwhile is allocated marked, and nothing is freed before the sweep clears it
+			for (ObjectHeader* list : { objects, sweepList })
+			{
+				for (ObjectHeader* object = list; object != nullptr; object = object->next())
+					conservativeCandidates.insert(object);
+			}
 		}
 
-		rFlags[_register] &= REGISTER_HIGH_BITS;
-		rFlags[_register] |= REGISTER_HOLDS_DOUBLE;
-		R[_register] = *reinterpret_cast<uint64_t*>(&value);
-	}
+		for (const auto& window : windows)
+		{
+			//otherwise only a program that has stopped, or one not yet started, waits without a map; its registers are dead
+			if (!program.conservativeRoots() && window.second == nullptr) continue;
+			for (size_t i = 0; i < 256; i++)
+			{
+				auto object = reinterpret_cast<ObjectHeader*>(window.first[i]);
+				if (object == nullptr) continue;
+				if (program.conservativeRoots() ? conservativeCandidates.count(object) == 0 : !window.second->test(i)) continue;
+				roots.push_back(reinterpret_cast<ObjectHeader**>(&window.first[i]));
+			}
+		}
 
-	void VM::setRegister(uint8_t _register, Allocation* value)
-	{
-		if (rFlags[_register] & (REGISTER_HOLDS_POINTER))
+		for (size_t slot : stackPointers)
 		{
-			refDecrement(reinterpret_cast<Allocation*>(R[_register]));
+			if (stack[slot] != 0) roots.push_back(reinterpret_cast<ObjectHeader**>(&stack[slot]));
 		}
+	}
 
-		rFlags[_register] &= REGISTER_HIGH_BITS;
-		rFlags[_register] |= REGISTER_HOLDS_POINTER;
-		if (((Allocation*)value)->type() == AllocationType::Array)
+	void VM::applyCounts()
+	{
+		for (ObjectHeader* ref : increments) refIncrement(ref);
+		increments.clear();
+		for (ObjectHeader* ref : decrements)
 		{
-			rFlags[_register] |= REGISTER_HOLDS_ARRAY;
+			if (refDecrement(ref)) addZeroCount(ref);
 		}
-		R[_register] = *reinterpret_cast<uint64_t*>(&value);
+		decrements.clear();
 	}
 
-	void VM::refIncrement(Allocation* ref)
+	void VM::addZeroCount(ObjectHeader* object)
 	{
-		uint8_t* refCount = (uint8_t*)(ref->memory + REFCOUNT_OFFSET);
-		if (*refCount == 255) return;
-		(*refCount)++;
+		//the nursery is reclaimed by copying, so only old objects are tracked
+		if (!gcPolicy.deferredCounting || object->refCount() != 0 || isYoung(object)) return;
+		//atomic, because a concurrent marker may be setting OBJECT_MARKED in the same byte
+		if (object->atomicFlags().fetch_or(OBJECT_ZERO_COUNT, std::memory_order_relaxed) & OBJECT_ZERO_COUNT) return;
+		zeroCounts.push_back(object);
 	}
 
-	void VM::refDecrement(Allocation* ref)
+	void VM::reclaimZeroCounts()
 	{
-		uint8_t* refCount = (uint8_t*)(ref->memory + REFCOUNT_OFFSET);
-		if (*refCount == 255) return;
-		if (*refCount == 0 || *refCount == 1)
+		//freeing in the middle of a cycle would pull objects out from under the greyset and the sweep
+		if (gcPhase != GCPhase::Idle || zeroCounts.empty()) return;
+		applyCounts();
+		std::vector<ObjectHeader**> roots;
+		gatherRoots(roots);
+		std::unordered_set<ObjectHeader*> rooted;
+		for (ObjectHeader** root : roots) rooted.insert(*root);
+
+		std::vector<ObjectHeader*> candidates;
+		candidates.swap(zeroCounts);
+		auto release = [&](ObjectHeader** slot)
 		{
-			freeAllocation(ref);
-			return;
+			ObjectHeader* ref = *slot;
+			if (ref != nullptr && !isYoung(ref) && refDecrement(ref) && (ref->flags & OBJECT_ZERO_COUNT) == 0)
+			{
+				ref->flags |= OBJECT_ZERO_COUNT;
+				candidates.push_back(ref);
+			}
+		};
+		while (candidates.size())
+		{
+			ObjectHeader* object = candidates.back();
+			candidates.pop_back();
+			if (object->refCount() != 0)
+			{
+				object->flags &= ~OBJECT_ZERO_COUNT;
+				continue;
+			}
+			//only held by registers or the stack: checked again at the next minor collection
+			if (rooted.count(object))
+			{
+				zeroCounts.push_back(object);
+				continue;
+			}
+			util::forEachPointer(object, release);
+			if (object->flags & OBJECT_REMEMBERED)
+				rememberedSet.erase(std::find(rememberedSet.begin(), rememberedSet.end(), object));
+			size_t size = util::objectSize(object);
+			gcStats.objectsReclaimed++;
+			gcStats.bytesReclaimed += size;
+			unlink(object);
+			freeAllocation(object);
 		}
-		(*refCount)--;
 	}
 
-	uint8_t VM::refCount(Allocation* ref)
+	void VM::refIncrement(ObjectHeader* ref)
+	{
+		//a count that would overflow saturates instead, and stays there until the next collection recounts it
+		if (ref->refCount() != UINT32_MAX) ref->refCount()++;
+	}
+
+	bool VM::refDecrement(ObjectHeader* ref)
+	{
+		//counts rebuilt by a collection leave out dead referrers, so a stale update may find zero
+		if (ref->refCount() == 0 || ref->refCount() == UINT32_MAX) return false;
+		return --ref->refCount() == 0;
+	}
+
+	uint32_t VM::refCount(ObjectHeader* ref)
 	{
-		return *(uint8_t*)(ref->memory + REFCOUNT_OFFSET);
+		return ref->refCount();
 	}
 }
\ No newline at end of file
@@ -1,11 +1,34 @@
 #pragma once
 #include "Memory.h"
 #include "Chunk.h"
+#include "DecodedChunk.h"
+#include "NativeChunk.h"
+#include "PoolAllocator.h"
+#include "Vector.h"
 
 #include <array>
 #include <list>
+#include <queue>
 #include <unordered_map>
+#include <unordered_set>
 #include <memory>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+//#define SWITCH_DISPATCH
+
+//computed-goto dispatch is a GCC/Clang extension; every other compiler falls back to the switch in VM::run
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(SWITCH_DISPATCH)
+#define THREADED_DISPATCH
+#endif
+
+//buffered count updates, in deferred reference counting, that are applied in one go
+#define COUNT_BUFFER_SIZE 4096
+
+//registers in the frame stack all active calls share; a call fails once its window would run past the end
+#define FRAME_STACK_REGISTERS (256 * 1024)
 
 namespace ash
 {
@@ -16,31 +39,129 @@ namespace ash
 		INTERPRET_RUNTIME_ERROR
 	};
 
-	enum registerFlags : uint8_t
+	enum class ExecutionEngine
 	{
-		REGISTER_HOLDS_POINTER = 0x01,
-		REGISTER_HOLDS_SIGNED = 0x02,
-		REGISTER_HOLDS_FLOAT = 0x04,
-		REGISTER_HOLDS_DOUBLE = 0x08,
-		REGISTER_HOLDS_ARRAY = 0x10,
-		REGISTER_HIGH_BITS = 0xE0
+		ENGINE_INTERPRETER,
+		ENGINE_JIT, //translate the whole chunk before running it
+		ENGINE_TIERED //interpret, and move to native code once a loop gets hot
+	};
+
+	//when the collector runs: once the heap grows past growthFactor times the bytes that survived the
+	//previous collection, but never below minHeap; maxHeap (0 for none) makes allocation fail instead.
+	//an incremental collector spreads each cycle over slices of at most sliceWork objects, one for
+	//every sliceBytes allocated
+	struct GCPolicy
+	{
+		double growthFactor = 2.0;
+		uint64_t minHeap = 1 << 20;
+		uint64_t maxHeap = 0;
+		bool incremental = false;
+		bool concurrent = false; //mark on a helper thread, then sweep in slices
+		uint64_t sliceBytes = 64 * 1024;
+		size_t sliceWork = 1024;
+		unsigned threads = 1; //stop-the-world collections mark and sweep on this many threads; 0 for one per core
+		//after a stop-the-world collection, move the old space into fresh pages once live objects fill
+		//less than compactOccupancy of the pages the pool holds
+		bool compact = false;
+		double compactOccupancy = 0.5;
+		//buffer heap count updates and apply them at minor collections, where old objects left with no heap
+		//references and no root are freed right away instead of waiting for a tracing collection
+		bool deferredCounting = false;
+	};
+
+	//a call in progress, as its OP_RET finds it: where the caller resumes, and the caller's window and spill slots
+	struct Frame
+	{
+		DecodedInstruction* returnTo;
+		size_t base;
+		size_t stackBase;
+	};
+
+	enum class GCPhase
+	{
+		Idle, Mark, Sweep
+	};
+
+	struct GCStatistics
+	{
+		uint64_t collections = 0; //completed collections of the old space
+		uint64_t slices = 0; //incremental steps, each a separate pause
+		uint64_t concurrentMarkTime = 0; //nanoseconds spent marking on the helper thread
+		uint64_t compactions = 0;
+		uint64_t bytesCompacted = 0; //object bytes moved
+		uint64_t pageBytesReleased = 0;
+		uint64_t objectsReclaimed = 0; //freed by deferred counting, without tracing
+		uint64_t bytesReclaimed = 0;
+		uint64_t minorCollections = 0;
+		uint64_t bytesPromoted = 0; //nursery survivors copied to the old space
+		uint64_t bytesFreed = 0;
+		uint64_t liveBytes = 0; //heap in use right after the last collection
+		uint64_t totalPause = 0; //nanoseconds, minor and full collections alike
+		uint64_t maxPause = 0;
+		uint64_t lastPause = 0;
 	};
 
 	class VM
 	{
 	private:
 		bool comparisonRegister = false;
-		std::array<uint64_t, 256> R;
-		std::array<uint8_t, 256> rFlags;
+		//registers are untyped 64-bit slots; which of them hold heap pointers is described
+		//by the chunk's register maps and, for the stack, by the slots OP_PUSH_POINTER records
+		std::vector<uint64_t> registers; //the frame stack, FRAME_STACK_REGISTERS long
+		uint64_t* R = nullptr; //window of the running call onto the frame stack
+		std::vector<Frame> frames; //the callers of the running call, innermost last
 		std::vector<uint64_t> stack;
-		std::vector<uint8_t> stackFlags;
 		std::vector<size_t> stackPointers;
+		size_t stackBase = 0; //where the running call's spill slots begin
 		std::vector<std::shared_ptr<TypeMetadata>> types;
-		Allocation* allocationList = nullptr;
+		ObjectHeader* objects = nullptr; //every old object, linked through the word in front of its header
+		PoolAllocator heap; //the old space
+		//new objects are bump allocated here, and survivors are promoted to the old space by the next minor collection
+		char* nursery = nullptr;
+		char* nurseryTop = nullptr;
+		char* nurseryEnd = nullptr;
+		std::vector<ObjectHeader*> rememberedSet; //old objects that may point into the nursery
+		std::vector<ObjectHeader*> grownYoung; //nursery arrays whose elements have outgrown them into the old space
+		std::vector<std::pair<char*, size_t>> retiredElements; //storage arrays grew out of while a marker may still read it
+		//tri-color state of an old space collection: marked objects are grey while on the greyset and
+		//black once scanned; the sweep takes the whole list so objects allocated meanwhile are not visited
+		GCPhase gcPhase = GCPhase::Idle;
+		std::vector<ObjectHeader*> greyset;
+		ObjectHeader* sweepList = nullptr;
+		ObjectHeader** sweepCursor = nullptr;
+		//what a conservatively scanned register may name: every old object as the cycle began, built once per cycle
+		std::unordered_set<ObjectHeader*> conservativeCandidates;
+		uint64_t allocatedSinceSlice = 0;
+		uint64_t bytesBeforeCycle = 0;
+		bool recount = false; //rebuild heap counts while marking, for stop-the-world collections
+		//concurrent marking: the marker thread owns the greyset until markerDone, and the mutator's
+		//snapshot barrier logs overwritten pointers to satbQueue
+		bool concurrentCycle = false;
+		std::thread marker;
+		std::mutex satbMutex;
+		std::vector<ObjectHeader*> satbQueue;
+		std::atomic<bool> markerDone{ false };
+		uint64_t markerTime = 0; //nanoseconds the marker thread ran, read once it is joined
+		//deferred counting: stores log the pointers they add and drop, and old objects whose count has
+		//reached zero wait in the zero count table until the roots can be checked
+		std::vector<ObjectHeader*> increments;
+		std::vector<ObjectHeader*> decrements;
+		std::vector<ObjectHeader*> zeroCounts;
+		GCPolicy gcPolicy;
+		GCStatistics gcStats;
+		uint64_t nextCollection = GCPolicy().minHeap; //heap bytes in use that trigger the next collection
 		friend class Memory;
 
-		Chunk* chunk;
-		uint32_t* ip;
+		Chunk* chunk = nullptr;
+		DecodedChunk program;
+		DecodedInstruction* ip = nullptr;
+		NativeChunk native;
+		std::vector<uint32_t> loopCounters; //backward jumps taken, indexed by the loop header they target
+#ifdef JIT_SUPPORTED
+		ExecutionEngine engine = ExecutionEngine::ENGINE_TIERED;
+#else
+		ExecutionEngine engine = ExecutionEngine::ENGINE_INTERPRETER;
+#endif
 	public:
 		VM();
 		~VM();
@@ -51,32 +172,155 @@ namespace ash
 
 		InterpretResult run();
 
+		//ENGINE_JIT and ENGINE_TIERED only interpret where native code is not supported
+		void setEngine(ExecutionEngine engine) { this->engine = engine; }
+
+		uint64_t getRegister(uint8_t _register) { return R[_register]; }
+
+		const PoolStatistics& heapStatistics() { return heap.statistics(); }
+		void printHeapStatistics() { heap.printStatistics(); }
+
+		void setGCPolicy(const GCPolicy& policy);
+		const GCStatistics& gcStatistics() { return gcStats; }
+		void printGCStatistics();
+
 		InterpretResult error(const char* msg);
 
-		Allocation* allocate(uint64_t typeID);
+		//collects if the policy asks for it; false when bytes more would exceed the heap cap
+		bool reserveHeap(size_t bytes);
+
+		void scheduleCollection();
+
+		//starts a collection, or an incremental cycle, when the old space would outgrow the policy
+		void pace(size_t bytes);
+
+		void recordPause(std::chrono::steady_clock::time_point start);
+
+		//zeroed storage for an object of size bytes: in the nursery unless it is large; nullptr at the heap cap
+		ObjectHeader* allocateObject(size_t size);
+
+		//nullptr when the heap cap is reached
+		ObjectHeader* allocate(uint64_t typeID);
+
+		//an array of count zeroed elements, with no room to spare; nullptr at the heap cap
+		ObjectHeader* allocateArray(size_t count, uint8_t span);
+
+		//sets the element count, growing the array geometrically once it is full. returns the array, which
+		//a collection meanwhile may have moved like any object (nullptr, leaving it untouched, at the heap cap)
+		ObjectHeader* resizeArray(ObjectHeader* array, size_t count);
+
+		//moves the elements to storage with room for capacity of them, unless they already have that much
+		ObjectHeader* reserveArray(ObjectHeader* array, size_t capacity);
+
+		//index must be within the array; pointer elements go through the heap counts and the write barrier
+		void storeElement(ObjectHeader* array, uint64_t index, uint64_t value);
 
-		Allocation* allocateArray(ArrayAllocation* pointer, size_t oldCount, size_t newCount, uint8_t span);
+		//bulk versions of storeElement over ranges already checked against both arrays, which share an element type
+		void copyElements(ObjectHeader* destination, uint64_t to, ObjectHeader* source, uint64_t from, uint64_t count);
 
-		void freeAllocation(Allocation* alloc);
+		void fillElements(ObjectHeader* array, uint64_t index, uint64_t count, uint64_t value);
+
+		void unlink(ObjectHeader* object);
+
+		void remember(ObjectHeader* object);
+
+		void freeAllocation(ObjectHeader* object);
 
 		void freeAllocations();
 
+		//frees the storage of grown nursery arrays that were not promoted
+		void releaseGrownYoung();
+
+		//stop-the-world: runs a whole cycle, or finishes the incremental one in progress
 		void collectGarbage();
 
-		void refIncrement(Allocation* ref);
+		//sets OBJECT_MARKED; false if object needs no scanning (null, young, or already marked)
+		bool tryMark(ObjectHeader* object);
+
+		void shade(ObjectHeader* object);
+
+		void startMarking();
+
+		void startConcurrentMarking();
+
+		//body of the marker thread
+		void concurrentMark();
+
+		void beginSweep();
+
+		void finishSweep();
+
+		unsigned collectorThreads();
+
+		//drains the greyset with one work-stealing deque per thread
+		void parallelMark(unsigned threads);
+
+		//sweeps the whole sweep list in one run per thread
+		void parallelSweep(unsigned threads);
+
+		//copies every pooled old object into fresh pages and rewrites the references to it
+		void compact();
 
-		void refDecrement(Allocation* ref);
+		void gcSlice(size_t work);
 
-		uint8_t refCount(Allocation* ref);
+		void markSlice(size_t work);
 
-		void setRegister(uint8_t _register, bool value);
-		void setRegister(uint8_t _register, uint64_t value);
-		void setRegister(uint8_t _register, int64_t value);
-		void setRegister(uint8_t _register, float value);
-		void setRegister(uint8_t _register, double value);
-		void setRegister(uint8_t _register, Allocation* value);
+		void sweepSlice(size_t work);
+
+		void minorCollection();
+
+		//promotes every nursery object reachable from the roots or the remembered set, then empties the nursery
+		void evacuateNursery();
+
+		ObjectHeader* evacuate(ObjectHeader* object, std::vector<ObjectHeader*>& promoted);
+
+		//addresses of the registers and stack slots that hold heap pointers
+		void gatherRoots(std::vector<ObjectHeader**>& roots);
+
+		bool isYoung(ObjectHeader* object) { return (char*)object >= nursery && (char*)object < nurseryEnd; }
+
+		//called on every pointer store into object: old objects that start pointing at young ones are
+		//remembered. while marking incrementally the stored object is shaded, so no black object points at
+		//a white one; while marking concurrently the overwritten one is, so nothing in the snapshot is lost
+		void writeBarrier(ObjectHeader* object, ObjectHeader* previous, ObjectHeader* ref)
+		{
+			if (gcPhase == GCPhase::Mark) shade(concurrentCycle ? previous : ref);
+			if (ref != nullptr && isYoung(ref) && !isYoung(object)) remember(object);
+		}
+
+		//heap count updates for a pointer store that replaces previous with ref
+		void countStore(ObjectHeader* previous, ObjectHeader* ref)
+		{
+			if (previous == ref) return;
+			if (!gcPolicy.deferredCounting)
+			{
+				if (previous) refDecrement(previous);
+				if (ref) refIncrement(ref);
+				return;
+			}
+			if (previous) decrements.push_back(previous);
+			if (ref) increments.push_back(ref);
+			if (decrements.size() + increments.size() >= COUNT_BUFFER_SIZE) applyCounts();
+		}
+
+		//applies the buffered updates, increments first so no count passes through zero on the way
+		void applyCounts();
+
+		void addZeroCount(ObjectHeader* object);
+
+		//frees the objects of the zero count table that nothing references, and whatever that leaves unreferenced
+		void reclaimZeroCounts();
+
+		void refIncrement(ObjectHeader* ref);
+
+		//true when the count reaches zero
+		bool refDecrement(ObjectHeader* ref);
+
+		uint32_t refCount(ObjectHeader* ref);
 
 
 		bool isTruthy(uint8_t _register);
+
+		bool isHotLoop(size_t header);
 	};
 }
\ No newline at end of file
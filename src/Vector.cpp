@@ -0,0 +1,160 @@
+#include "VectorKernels.h"
+#include "Memory.h"
+
+#include <vector>
+
+#ifdef SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace ash
+{
+	namespace
+	{
+#ifdef SIMD_SSE2
+		struct Sse2Floats
+		{
+			typedef float Element;
+			typedef __m128 Vector;
+			typedef ScalarLanes<float> Tail;
+			static const size_t width = 4;
+			static Vector load(const float* address) { return _mm_loadu_ps(address); }
+			static void store(float* address, Vector value) { _mm_storeu_ps(address, value); }
+			static Vector set(float value) { return _mm_set1_ps(value); }
+			static Vector add(Vector a, Vector b) { return _mm_add_ps(a, b); }
+			static Vector sub(Vector a, Vector b) { return _mm_sub_ps(a, b); }
+			static Vector mul(Vector a, Vector b) { return _mm_mul_ps(a, b); }
+			static Vector fma(Vector a, Vector b, Vector c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+			static Vector min(Vector a, Vector b) { return _mm_min_ps(a, b); }
+			static Vector max(Vector a, Vector b) { return _mm_max_ps(a, b); }
+			static float sum(Vector value)
+			{
+				Vector pairs = _mm_add_ps(value, _mm_movehl_ps(value, value));
+				return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+			}
+		};
+
+		struct Sse2Doubles
+		{
+			typedef double Element;
+			typedef __m128d Vector;
+			typedef ScalarLanes<double> Tail;
+			static const size_t width = 2;
+			static Vector load(const double* address) { return _mm_loadu_pd(address); }
+			static void store(double* address, Vector value) { _mm_storeu_pd(address, value); }
+			static Vector set(double value) { return _mm_set1_pd(value); }
+			static Vector add(Vector a, Vector b) { return _mm_add_pd(a, b); }
+			static Vector sub(Vector a, Vector b) { return _mm_sub_pd(a, b); }
+			static Vector mul(Vector a, Vector b) { return _mm_mul_pd(a, b); }
+			static Vector fma(Vector a, Vector b, Vector c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+			static Vector min(Vector a, Vector b) { return _mm_min_pd(a, b); }
+			static Vector max(Vector a, Vector b) { return _mm_max_pd(a, b); }
+			static double sum(Vector value) { return _mm_cvtsd_f64(_mm_add_sd(value, _mm_unpackhi_pd(value, value))); }
+		};
+#endif
+	}
+
+	const VectorKernels scalarKernels = VECTOR_KERNELS("scalar", IntLanes, ScalarLanes<float>, ScalarLanes<double>);
+#ifdef SIMD_SSE2
+	const VectorKernels sse2Kernels = VECTOR_KERNELS("sse2", IntLanes, Sse2Floats, Sse2Doubles);
+#endif
+
+	namespace util
+	{
+		static const VectorKernels* selectKernels()
+		{
+#ifdef SIMD_AVX2
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return &avx2Kernels;
+#endif
+#ifdef SIMD_SSE2
+			return &sse2Kernels;
+#else
+			return &scalarKernels;
+#endif
+		}
+
+		//the elements from index R[reference + 1] of the array in R[reference], once it is known to hold count of them
+		static const char* operand(uint64_t* R, uint8_t reference, uint8_t span, uint64_t count, char** elements)
+		{
+			if (R[reference] == 0) return "null reference!";
+			auto object = reinterpret_cast<ObjectHeader*>(R[reference]);
+			if (object->kind != ObjectKind::Array) return "pointer held in register is not an array!";
+			if (object->tag != span) return "array element type does not match the vector instruction!";
+			uint64_t index = R[(uint8_t)(reference + 1)];
+			if (index > object->count || count > object->count - index) return "array index out of bounds!";
+			*elements = object->element(index);
+			return nullptr;
+		}
+
+		//a source the destination starts part way into is read from a copy taken first, so that every kernel,
+		//whatever order it writes in, sees the elements as they were before the instruction
+		static const char* unaliased(const char* destination, const char* source, size_t bytes, std::vector<char>& copy)
+		{
+			if (source == destination || destination >= source + bytes || source >= destination + bytes) return source;
+			copy.assign(source, source + bytes);
+			return copy.data();
+		}
+	}
+
+	const VectorKernels& vectorKernels()
+	{
+		static const VectorKernels* kernels = util::selectKernels();
+		return *kernels;
+	}
+
+	const char* vectorInstruction(uint64_t* R, uint8_t op, uint8_t A, uint8_t B, uint8_t C)
+	{
+		unsigned index = op - OP_VECTOR_INT_ADD;
+		uint8_t span = index % 3 == 1 ? 4 : 8; //int, float, double
+		VectorKernel kernel = vectorKernels().kernels[index];
+		char* left = nullptr;
+		char* right = nullptr;
+		char* destination = nullptr;
+		const char* message = nullptr;
+		switch (op)
+		{
+			case OP_VECTOR_INT_DOT:
+			case OP_VECTOR_FLOAT_DOT:
+			case OP_VECTOR_DOUBLE_DOT:
+			{
+				uint64_t count = R[C];
+				if ((message = util::operand(R, A, span, count, &left))) return message;
+				if ((message = util::operand(R, B, span, count, &right))) return message;
+				R[C] = kernel(nullptr, left, right, 0, count);
+				return nullptr;
+			}
+			case OP_VECTOR_INT_SUM:
+			case OP_VECTOR_FLOAT_SUM:
+			case OP_VECTOR_DOUBLE_SUM:
+			{
+				uint64_t count = R[B];
+				if ((message = util::operand(R, A, span, count, &left))) return message;
+				R[B] = kernel(nullptr, left, nullptr, 0, count);
+				return nullptr;
+			}
+			case OP_VECTOR_INT_SCALE:
+			case OP_VECTOR_FLOAT_SCALE:
+			case OP_VECTOR_DOUBLE_SCALE:
+			{
+				uint64_t count = R[(uint8_t)(C + 2)];
+				if ((message = util::operand(R, A, span, count, &left))) return message;
+				if ((message = util::operand(R, C, span, count, &destination))) return message;
+				std::vector<char> leftCopy;
+				kernel(destination, util::unaliased(destination, left, count * span, leftCopy), nullptr, R[B], count);
+				return nullptr;
+			}
+			default:
+			{
+				uint64_t count = R[(uint8_t)(C + 2)];
+				if ((message = util::operand(R, A, span, count, &left))) return message;
+				if ((message = util::operand(R, B, span, count, &right))) return message;
+				if ((message = util::operand(R, C, span, count, &destination))) return message;
+				std::vector<char> leftCopy, rightCopy;
+				kernel(destination, util::unaliased(destination, left, count * span, leftCopy),
+					util::unaliased(destination, right, count * span, rightCopy), 0, count);
+				return nullptr;
+			}
+		}
+	}
+}
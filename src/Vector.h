@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Chunk.h"
+
+//#define DISABLE_SIMD
+
+//x86-64 always has SSE2; AVX2 kernels are built alongside and picked at runtime when the CPU has them.
+//everywhere else, and with DISABLE_SIMD, the vector instructions run plain loops
+#if (defined(__x86_64__) || defined(_M_X64)) && !defined(DISABLE_SIMD)
+#define SIMD_SSE2
+#if defined(__GNUC__) || defined(__clang__)
+#define SIMD_AVX2
+#endif
+#endif
+
+#define VECTOR_OPCODES (OP_VECTOR_DOUBLE_SUM - OP_VECTOR_INT_ADD + 1)
+
+namespace ash
+{
+	//one kernel per vector opcode. elementwise kernels write count elements to destination, which may be
+	//either operand but not overlap one in part; scale multiplies left by scalar, and dot and sum return
+	//their result as register bits
+	typedef uint64_t (*VectorKernel)(void* destination, const void* left, const void* right, uint64_t scalar, size_t count);
+
+	struct VectorKernels
+	{
+		const char* name;
+		VectorKernel kernels[VECTOR_OPCODES];
+	};
+
+	//the widest kernels the CPU runs, chosen on first use
+	const VectorKernels& vectorKernels();
+
+	//runs vector instruction op on the register file R; returns nullptr, or the error when an operand
+	//is not an array of the instruction's element type or a range is out of bounds. as with memmove, a
+	//destination overlapping an operand in part gets what the operand held before the instruction
+	const char* vectorInstruction(uint64_t* R, uint8_t op, uint8_t A, uint8_t B, uint8_t C);
+}
@@ -0,0 +1,88 @@
+#include "Vector.h"
+
+#include <string.h>
+
+#ifdef SIMD_AVX2
+#include <immintrin.h>
+
+//everything below is compiled for AVX2 and FMA, and only reached once the CPU is known to have them.
+//headers with inline code of their own are included above, so none of it is built for AVX2 here
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2,fma"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+
+#include "VectorKernels.h"
+
+namespace ash
+{
+	namespace
+	{
+		//the vector part is fused, so the tail is too
+		template<typename T>
+		struct FusedLanes : public ScalarLanes<T>
+		{
+			typedef FusedLanes<T> Tail;
+			static float fma(float a, float b, float c) { return __builtin_fmaf(a, b, c); }
+			static double fma(double a, double b, double c) { return __builtin_fma(a, b, c); }
+		};
+
+		struct Avx2Floats
+		{
+			typedef float Element;
+			typedef __m256 Vector;
+			typedef FusedLanes<float> Tail;
+			static const size_t width = 8;
+			static Vector load(const float* address) { return _mm256_loadu_ps(address); }
+			static void store(float* address, Vector value) { _mm256_storeu_ps(address, value); }
+			static Vector set(float value) { return _mm256_set1_ps(value); }
+			static Vector add(Vector a, Vector b) { return _mm256_add_ps(a, b); }
+			static Vector sub(Vector a, Vector b) { return _mm256_sub_ps(a, b); }
+			static Vector mul(Vector a, Vector b) { return _mm256_mul_ps(a, b); }
+			static Vector fma(Vector a, Vector b, Vector c) { return _mm256_fmadd_ps(a, b, c); }
+			static Vector min(Vector a, Vector b) { return _mm256_min_ps(a, b); }
+			static Vector max(Vector a, Vector b) { return _mm256_max_ps(a, b); }
+			static float sum(Vector value)
+			{
+				__m128 half = _mm_add_ps(_mm256_castps256_ps128(value), _mm256_extractf128_ps(value, 1));
+				__m128 pairs = _mm_add_ps(half, _mm_movehl_ps(half, half));
+				return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+			}
+		};
+
+		struct Avx2Doubles
+		{
+			typedef double Element;
+			typedef __m256d Vector;
+			typedef FusedLanes<double> Tail;
+			static const size_t width = 4;
+			static Vector load(const double* address) { return _mm256_loadu_pd(address); }
+			static void store(double* address, Vector value) { _mm256_storeu_pd(address, value); }
+			static Vector set(double value) { return _mm256_set1_pd(value); }
+			static Vector add(Vector a, Vector b) { return _mm256_add_pd(a, b); }
+			static Vector sub(Vector a, Vector b) { return _mm256_sub_pd(a, b); }
+			static Vector mul(Vector a, Vector b) { return _mm256_mul_pd(a, b); }
+			static Vector fma(Vector a, Vector b, Vector c) { return _mm256_fmadd_pd(a, b, c); }
+			static Vector min(Vector a, Vector b) { return _mm256_min_pd(a, b); }
+			static Vector max(Vector a, Vector b) { return _mm256_max_pd(a, b); }
+			static double sum(Vector value)
+			{
+				__m128d half = _mm_add_pd(_mm256_castpd256_pd128(value), _mm256_extractf128_pd(value, 1));
+				return _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+			}
+		};
+	}
+
+	//constant initialized: no startup code runs from this file
+	const VectorKernels avx2Kernels = VECTOR_KERNELS("avx2", IntLanes, Avx2Floats, Avx2Doubles);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#endif
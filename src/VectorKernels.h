@@ -0,0 +1,159 @@
+#pragma once
+
+#include "Vector.h"
+
+#include <string.h>
+
+//kernels are written once over a lane type L: L::Element is the element type and L::Vector holds L::width
+//of them, with unaligned load/store, set, add, sub, mul, fma, min, max and a sum across the vector.
+//L::Tail is the one-element lane type that finishes what is left over.
+//every file that includes this compiles the kernels for its own instruction set, so they are kept
+//out of other files' sight: a shared instantiation could end up running AVX2 code on any CPU
+namespace ash
+{
+	extern const VectorKernels scalarKernels;
+#ifdef SIMD_SSE2
+	extern const VectorKernels sse2Kernels;
+#endif
+#ifdef SIMD_AVX2
+	extern const VectorKernels avx2Kernels;
+#endif
+
+	namespace
+	{
+		template<typename T>
+		T fromRegister(uint64_t bits)
+		{
+			T value;
+			memcpy(&value, &bits, sizeof(T));
+			return value;
+		}
+
+		//floats take the low 32 bits, like the interpreter stores them
+		template<typename T>
+		uint64_t toRegister(T value)
+		{
+			uint64_t bits = 0;
+			memcpy(&bits, &value, sizeof(T));
+			return bits;
+		}
+
+		template<typename T>
+		struct ScalarLanes
+		{
+			typedef T Element;
+			typedef T Vector;
+			typedef ScalarLanes<T> Tail;
+			static const size_t width = 1;
+			static Vector load(const T* address) { return *address; }
+			static void store(T* address, Vector value) { *address = value; }
+			static Vector set(T value) { return value; }
+			static Vector add(Vector a, Vector b) { return a + b; }
+			static Vector sub(Vector a, Vector b) { return a - b; }
+			static Vector mul(Vector a, Vector b) { return a * b; }
+			static Vector fma(Vector a, Vector b, Vector c) { return a * b + c; }
+			//the operand order of minps/maxps: b when either is NaN
+			static Vector min(Vector a, Vector b) { return a < b ? a : b; }
+			static Vector max(Vector a, Vector b) { return a > b ? a : b; }
+			static T sum(Vector value) { return value; }
+		};
+
+		//ints wrap like the interpreter's arithmetic, so they are computed unsigned
+		struct IntLanes : public ScalarLanes<int64_t>
+		{
+			typedef IntLanes Tail;
+			static Vector add(Vector a, Vector b) { return (int64_t)((uint64_t)a + (uint64_t)b); }
+			static Vector sub(Vector a, Vector b) { return (int64_t)((uint64_t)a - (uint64_t)b); }
+			static Vector mul(Vector a, Vector b) { return (int64_t)((uint64_t)a * (uint64_t)b); }
+			static Vector fma(Vector a, Vector b, Vector c) { return add(mul(a, b), c); }
+		};
+
+		struct Add { template<typename L> static typename L::Vector apply(typename L::Vector a, typename L::Vector b, typename L::Vector) { return L::add(a, b); } };
+		struct Sub { template<typename L> static typename L::Vector apply(typename L::Vector a, typename L::Vector b, typename L::Vector) { return L::sub(a, b); } };
+		struct Mul { template<typename L> static typename L::Vector apply(typename L::Vector a, typename L::Vector b, typename L::Vector) { return L::mul(a, b); } };
+		struct Fma { template<typename L> static typename L::Vector apply(typename L::Vector a, typename L::Vector b, typename L::Vector c) { return L::fma(a, b, c); } };
+		struct Min { template<typename L> static typename L::Vector apply(typename L::Vector a, typename L::Vector b, typename L::Vector) { return L::min(a, b); } };
+		struct Max { template<typename L> static typename L::Vector apply(typename L::Vector a, typename L::Vector b, typename L::Vector) { return L::max(a, b); } };
+
+		//returns how many elements it did: every whole vector's worth
+		template<typename L, typename Op>
+		size_t elementwiseRun(typename L::Element* out, const typename L::Element* a, const typename L::Element* b, size_t count)
+		{
+			size_t i = 0;
+			for (; i + L::width <= count; i += L::width)
+				L::store(out + i, Op::template apply<L>(L::load(a + i), L::load(b + i), L::load(out + i)));
+			return i;
+		}
+
+		template<typename L, typename Op>
+		uint64_t elementwise(void* destination, const void* left, const void* right, uint64_t, size_t count)
+		{
+			typedef typename L::Element T;
+			auto out = static_cast<T*>(destination);
+			auto a = static_cast<const T*>(left);
+			auto b = static_cast<const T*>(right);
+			size_t done = elementwiseRun<L, Op>(out, a, b, count);
+			elementwiseRun<typename L::Tail, Op>(out + done, a + done, b + done, count - done);
+			return 0;
+		}
+
+		template<typename L>
+		size_t scaleRun(typename L::Element* out, const typename L::Element* a, typename L::Element scalar, size_t count)
+		{
+			typename L::Vector factor = L::set(scalar);
+			size_t i = 0;
+			for (; i + L::width <= count; i += L::width) L::store(out + i, L::mul(L::load(a + i), factor));
+			return i;
+		}
+
+		template<typename L>
+		uint64_t scale(void* destination, const void* left, const void*, uint64_t scalar, size_t count)
+		{
+			typedef typename L::Element T;
+			auto out = static_cast<T*>(destination);
+			auto a = static_cast<const T*>(left);
+			T factor = fromRegister<T>(scalar);
+			size_t done = scaleRun<L>(out, a, factor, count);
+			scaleRun<typename L::Tail>(out + done, a + done, factor, count - done);
+			return 0;
+		}
+
+		//four independent accumulators hide the add latency; this sums in a different order than a loop
+		//of scalar instructions would, so floating point results can differ from one in the last bits
+		template<typename L, bool product>
+		uint64_t reduce(void*, const void* left, const void* right, uint64_t, size_t count)
+		{
+			typedef typename L::Element T;
+			typedef typename L::Tail S;
+			auto a = static_cast<const T*>(left);
+			auto b = static_cast<const T*>(right);
+			typename L::Vector sums[4] = { L::set(0), L::set(0), L::set(0), L::set(0) };
+			size_t i = 0;
+			for (; i + 4 * L::width <= count; i += 4 * L::width)
+			{
+				for (size_t j = 0; j < 4; j++)
+				{
+					typename L::Vector value = L::load(a + i + j * L::width);
+					sums[j] = product ? L::fma(value, L::load(b + i + j * L::width), sums[j]) : L::add(sums[j], value);
+				}
+			}
+			for (; i + L::width <= count; i += L::width)
+				sums[0] = product ? L::fma(L::load(a + i), L::load(b + i), sums[0]) : L::add(sums[0], L::load(a + i));
+			T total = L::sum(L::add(L::add(sums[0], sums[1]), L::add(sums[2], sums[3])));
+			for (; i < count; i++) total = product ? S::fma(a[i], b[i], total) : S::add(total, a[i]);
+			return toRegister(total);
+		}
+	}
+}
+
+//the kernel table of one instruction set, in opcode order
+#define VECTOR_KERNELS(name, Int, Float, Double) { name, { \
+	elementwise<Int, Add>, elementwise<Float, Add>, elementwise<Double, Add>, \
+	elementwise<Int, Sub>, elementwise<Float, Sub>, elementwise<Double, Sub>, \
+	elementwise<Int, Mul>, elementwise<Float, Mul>, elementwise<Double, Mul>, \
+	elementwise<Int, Fma>, elementwise<Float, Fma>, elementwise<Double, Fma>, \
+	elementwise<Int, Min>, elementwise<Float, Min>, elementwise<Double, Min>, \
+	elementwise<Int, Max>, elementwise<Float, Max>, elementwise<Double, Max>, \
+	scale<Int>, scale<Float>, scale<Double>, \
+	reduce<Int, true>, reduce<Float, true>, reduce<Double, true>, \
+	reduce<Int, false>, reduce<Float, false>, reduce<Double, false> } }